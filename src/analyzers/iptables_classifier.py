@@ -0,0 +1,812 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Compiled iptables FORWARD classifier
+
+Compiles the rules parsed by IptablesForwardAnalyzer into an integer based
+match program so that packets can be classified without re-interpreting rule
+text, constructing ipaddress objects or walking ipset member lists per rule.
+
+Key Features:
+- Source/destination criteria compiled to integer interval lists
+- Port criteria compiled to integer interval lists
+- Ipsets compiled to per-prefix-length hash tables
+- Routing table compiled once for in/out interface checks
+- Decision semantics identical to IptablesForwardAnalyzer.analyze_packet
+- Returns the IDs of all rules that matched along the evaluation
+- Incremental rule insert, delete and replace for what-if analysis
+- Optional pruning of rules that can never match (see iptables_shadow_analyzer)
+- Optional per-rule profiling (evaluations, matches, cost) with a report of
+  never-hit rules and frequently hit rules placed deep in their chain
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import argparse
+import ipaddress
+import json
+import sys
+import time
+from dataclasses import dataclass, field
+from functools import lru_cache
+from typing import Dict, List, Optional, Tuple, Any
+
+
+# Rule kinds, derived in the same order as the analyzer's target handling
+KIND_SKIP = 0       # Unknown target, never evaluated
+KIND_ACCEPT = 1
+KIND_DENY = 2       # DROP / REJECT
+KIND_RETURN = 3
+KIND_CONTINUE = 4   # LOG, MARK, ... - non-terminating
+KIND_NAT = 5        # DNAT, SNAT, MASQUERADE, REDIRECT - accepted after NAT
+KIND_JUMP = 6       # Custom chain
+
+LOG_TARGETS = ('LOG', 'ULOG', 'NFLOG')
+MANGLE_TARGETS = ('CONNMARK', 'MARK', 'TOS', 'DSCP', 'TCPMSS', 'TTL', 'HL')
+NAT_TARGETS = ('DNAT', 'SNAT', 'MASQUERADE', 'REDIRECT')
+
+# Compiled interval list that matches any value
+ANY = None
+
+
+@lru_cache(maxsize=65536)
+def ip_to_int(ip: str) -> Optional[int]:
+    """Convert dotted IPv4 string to integer, None if not a valid IPv4 address."""
+    try:
+        return int(ipaddress.IPv4Address(ip))
+    except (ipaddress.AddressValueError, ValueError):
+        return None
+
+
+@dataclass(frozen=True)
+class Flow:
+    """A single packet flow as seen by the FORWARD chain."""
+    src_ip: str
+    dest_ip: str
+    protocol: str = 'tcp'
+    src_port: Optional[int] = None
+    dest_port: Optional[int] = None
+    state: str = 'NEW'
+
+
+@dataclass
+class ClassifierVerdict:
+    """Result of classifying one flow on one router."""
+    allowed: bool
+    action: str                  # ACCEPT, DROP, REJECT, NAT, RETURN or POLICY
+    rule_ids: List[str] = field(default_factory=list)
+    reason: str = ""
+
+    @property
+    def terminal_rule(self) -> Optional[str]:
+        """ID of the rule that decided the packet fate (None for default policy)."""
+        if self.action == 'POLICY' or not self.rule_ids:
+            return None
+        return self.rule_ids[-1]
+
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        return {
+            'allowed': self.allowed,
+            'action': self.action,
+            'rule_ids': list(self.rule_ids),
+            'reason': self.reason
+        }
+
+
+def compile_ip_criteria(criteria: Optional[str]):
+    """Compile an analyzer IP criteria string to a tuple of (lo, hi) intervals.
+
+    Mirrors IptablesRule._ip_matches: comma separated lists, CIDR networks,
+    dash ranges and exact addresses. Items that the analyzer could never match
+    (invalid or non-IPv4) are dropped.
+    """
+    if criteria is None:
+        return ANY
+    intervals = []
+    for item in criteria.split(',') if ',' in criteria else [criteria]:
+        item = item.strip()
+        try:
+            if '/' in item:
+                network = ipaddress.ip_network(item, strict=False)
+                if network.version != 4:
+                    continue
+                intervals.append((int(network.network_address), int(network.broadcast_address)))
+            elif '-' in item and item.count('.') >= 3:
+                start_ip, end_ip = item.split('-', 1)
+                start = int(ipaddress.IPv4Address(start_ip.strip()))
+                end = int(ipaddress.IPv4Address(end_ip.strip()))
+                if start <= end:
+                    intervals.append((start, end))
+            else:
+                value = int(ipaddress.IPv4Address(item))
+                intervals.append((value, value))
+        except (ipaddress.AddressValueError, ValueError):
+            continue
+    return tuple(sorted(intervals))
+
+
+def compile_port_criteria(criteria: Optional[str]):
+    """Compile an analyzer port criteria string to a tuple of (lo, hi) intervals.
+
+    Mirrors IptablesRule._port_matches: lists, 'a:b' and 'a-b' ranges and
+    single ports. Unparseable items never match.
+    """
+    if criteria is None:
+        return ANY
+    intervals = []
+    for item in criteria.split(',') if ',' in criteria else [criteria]:
+        item = item.strip()
+        try:
+            if ':' in item:
+                start, end = item.split(':', 1)
+                intervals.append((int(start), int(end)))
+            elif '-' in item:
+                start, end = item.split('-', 1)
+                intervals.append((int(start), int(end)))
+            else:
+                intervals.append((int(item), int(item)))
+        except ValueError:
+            continue
+    return tuple(sorted(intervals))
+
+
+def intervals_overlap(a, b) -> bool:
+    """Check whether two compiled interval lists (None = any) share a value."""
+    if a is None or b is None:
+        return True
+    for lo_a, hi_a in a:
+        for lo_b, hi_b in b:
+            if lo_a <= hi_b and lo_b <= hi_a:
+                return True
+    return False
+
+
+def in_intervals(value: int, intervals) -> bool:
+    """Check whether value lies in any of the (lo, hi) intervals."""
+    for lo, hi in intervals:
+        if lo <= value <= hi:
+            return True
+    return False
+
+
+class CompiledIpset:
+    """Ipset members compiled to hash tables keyed by masked network integer.
+
+    Membership semantics match IpsetParser.check_membership: an entry matches
+    when the address is covered and the member port/protocol is '*' or equal
+    to the tested port/protocol string.
+    """
+
+    __slots__ = ('name', 'set_type', 'compound', 'by_prefix')
+
+    def __init__(self, name: str, set_type: str, lookup_set):
+        self.name = name
+        self.set_type = set_type
+        self.compound = set_type.startswith('hash:ip,port') or set_type.startswith('hash:net,port')
+        # prefixlen -> {network_int: [(port, protocol), ...]}
+        by_prefix: Dict[int, Dict[int, List[Tuple[str, str]]]] = {}
+        for member_ip, member_port, member_protocol in lookup_set:
+            try:
+                if '/' in member_ip:
+                    network = ipaddress.ip_network(member_ip, strict=False)
+                    if network.version != 4:
+                        continue
+                    plen = network.prefixlen
+                    key = int(network.network_address)
+                else:
+                    plen = 32
+                    key = int(ipaddress.IPv4Address(member_ip))
+            except (ipaddress.AddressValueError, ValueError):
+                continue
+            by_prefix.setdefault(plen, {}).setdefault(key, []).append((member_port, member_protocol))
+        self.by_prefix = sorted(
+            ((plen, (0xFFFFFFFF << (32 - plen)) & 0xFFFFFFFF, table) for plen, table in by_prefix.items()),
+            reverse=True
+        )
+
+    def contains(self, ip: int, port: Optional[int], protocol: str) -> bool:
+        """Check membership of an integer address with optional port/protocol."""
+        port_str = str(port) if port is not None else '*'
+        protocol_str = protocol.lower() if protocol else '*'
+        for _, mask, table in self.by_prefix:
+            entries = table.get(ip & mask)
+            if entries is None:
+                continue
+            for member_port, member_protocol in entries:
+                if ((member_port == '*' or member_port == port_str) and
+                        (member_protocol == '*' or member_protocol == protocol_str)):
+                    return True
+        return False
+
+
+# Field selectors for match-set checks: (use_dest_ip, use_dest_port)
+_DIRECTION_SELECTORS = {
+    ('src',): (False, False),
+    ('dst',): (True, True),
+    ('src', 'src'): (False, False),
+    ('dst', 'dst'): (True, True),
+    ('src', 'dst'): (False, True),
+    ('dst', 'src'): (True, False),
+}
+
+
+class CompiledRule:
+    """A single rule compiled to integer match criteria."""
+
+    __slots__ = ('rule_id', 'chain', 'position', 'line_number', 'target', 'kind', 'rule_text',
+                 'src', 'dst', 'protocol', 'sport', 'dport', 'states',
+                 'in_interface', 'out_interface', 'match_sets',
+                 'evaluations', 'hits', 'cost_ns')
+
+    def __init__(self, chain: str, position: int, rule, kind: int, ipsets: Dict[str, CompiledIpset]):
+        criteria = rule.parsed_criteria
+        self.rule_id = f"{chain}:{rule.line_number}"
+        self.chain = chain
+        self.position = position
+        self.line_number = rule.line_number
+        self.target = rule.target
+        self.kind = kind
+        self.rule_text = rule.rule_text
+        self.src = compile_ip_criteria(criteria.get('source'))
+        self.dst = compile_ip_criteria(criteria.get('destination'))
+        self.protocol = criteria.get('protocol')
+        self.sport = compile_port_criteria(criteria.get('source_port'))
+        self.dport = compile_port_criteria(criteria.get('dest_port'))
+        state = criteria.get('conntrack_state')
+        self.states = frozenset(s.strip().upper() for s in state.split(',')) if state is not None else None
+        self.in_interface = criteria.get('in_interface')
+        self.out_interface = criteria.get('out_interface')
+        self.match_sets = self._compile_match_sets(criteria.get('match_sets', []), ipsets)
+        # Profiling counters, only updated while the classifier is profiling
+        self.evaluations = 0
+        self.hits = 0
+        self.cost_ns = 0
+
+    @staticmethod
+    def _compile_match_sets(match_sets: List[Dict[str, str]], ipsets: Dict[str, CompiledIpset]):
+        """Compile match-set conditions to (ipset or None, use_dest_ip, use_dest_port).
+
+        Directions the analyzer skips (unknown or unsupported arity) are dropped;
+        a missing set or a compound match on a non port-typed set compiles to
+        None and never matches.
+        """
+        compiled = []
+        for match_set in match_sets:
+            directions = tuple(match_set['direction'].split(','))
+            selector = _DIRECTION_SELECTORS.get(directions)
+            if selector is None:
+                continue
+            ipset = ipsets.get(match_set['set_name'])
+            if ipset is not None and len(directions) == 2 and not ipset.compound:
+                ipset = None
+            compiled.append((ipset, selector[0], selector[1]))
+        return tuple(compiled)
+
+    def matches(self, src: int, sport: Optional[int], dst: int, dport: Optional[int],
+                protocol: str, state: str, classifier: 'IptablesClassifier') -> bool:
+        """Check if this rule matches the packet (integer addresses)."""
+        for ipset, use_dst_ip, use_dst_port in self.match_sets:
+            if ipset is None:
+                return False
+            if not ipset.contains(dst if use_dst_ip else src, dport if use_dst_port else sport, protocol):
+                return False
+        if self.src is not None and not in_intervals(src, self.src):
+            return False
+        if self.dst is not None and not in_intervals(dst, self.dst):
+            return False
+        if self.in_interface is not None:
+            expected = classifier.route_interface(src)
+            if expected is not None and expected != self.in_interface:
+                return False
+        if self.out_interface is not None:
+            expected = classifier.route_interface(dst)
+            if expected is not None and expected != self.out_interface:
+                return False
+        if self.protocol is not None and protocol != 'all' and self.protocol != protocol:
+            return False
+        if self.sport is not None and sport is not None and not in_intervals(sport, self.sport):
+            return False
+        if self.dport is not None and dport is not None and not in_intervals(dport, self.dport):
+            return False
+        if self.states is not None and state.upper() not in self.states:
+            return False
+        return True
+
+    def may_overlap(self, other: 'CompiledRule') -> bool:
+        """Conservatively check whether some packet could match both rules.
+
+        Follows the loose matching of matches(): a protocol 'all' packet
+        matches any protocol, a packet without ports skips port checks and
+        an address without a route skips interface checks, so protocol,
+        ports and interfaces never prove rules disjoint. Only addresses and
+        states do; match-sets are assumed to overlap.
+        """
+        if self.states is not None and other.states is not None and not (self.states & other.states):
+            return False
+        return intervals_overlap(self.src, other.src) and intervals_overlap(self.dst, other.dst)
+
+
+class IptablesClassifier:
+    """
+    Compiled FORWARD chain classifier for a single router.
+
+    Built from an IptablesForwardAnalyzer; evaluation follows the analyzer's
+    first-match semantics including custom chain jumps, RETURN handling,
+    non-terminating targets and the default policy.
+    """
+
+    def __init__(self, router_name: str, forward_rules: List[CompiledRule],
+                 custom_chains: Dict[str, List[CompiledRule]], default_policy: str,
+                 ipsets: Dict[str, CompiledIpset], routes: List[Tuple[int, int, int, str]]):
+        self.router_name = router_name
+        self.forward_rules = forward_rules
+        self.custom_chains = custom_chains
+        self.default_policy = default_policy
+        self.ipsets = ipsets
+        self.routes = routes
+        self._interface_cache: Dict[int, Optional[str]] = {}
+        # Target names the analyzer evaluates, needed to compile edited rules
+        self.known_targets: frozenset = frozenset()
+
+        # Rule profiling (see enable_profiling)
+        self.profiling = False
+        self.flows_classified = 0
+
+    @classmethod
+    def from_analyzer(cls, analyzer, prune: bool = False) -> 'IptablesClassifier':
+        """Compile the rules, ipsets and routes loaded by an IptablesForwardAnalyzer.
+
+        With prune=True, shadowed, redundant and dead rules are removed after
+        compilation; verdicts and reported rule IDs are unchanged.
+        """
+        ipsets = {}
+        for set_name, lookup_set in analyzer.ipset_parser.ipset_lookup_sets.items():
+            set_info = analyzer.ipset_parser.get_set_info(set_name)
+            if set_info is None:
+                continue
+            ipsets[set_name] = CompiledIpset(set_name, set_info.get('type', 'unknown'), lookup_set)
+
+        known_targets = analyzer.KNOWN_TARGETS
+        chain_names = set(analyzer.custom_chains)
+
+        def compile_chain(chain: str, rules) -> List[CompiledRule]:
+            return [CompiledRule(chain, position, rule,
+                                 cls._rule_kind(rule.target, known_targets, chain_names), ipsets)
+                    for position, rule in enumerate(rules, 1)]
+
+        forward_rules = compile_chain('FORWARD', analyzer.forward_rules)
+        custom_chains = {name: compile_chain(name, rules) for name, rules in analyzer.custom_chains.items()}
+        routes = cls._compile_routes(analyzer.routing_table)
+        classifier = cls(analyzer.router_name, forward_rules, custom_chains,
+                         analyzer.default_policy, ipsets, routes)
+        classifier.known_targets = frozenset(known_targets)
+        if prune:
+            classifier.prune()
+        return classifier
+
+    @classmethod
+    def from_facts(cls, facts_dir: str, router_name: str, verbosity: int = 0,
+                   prune: bool = False) -> 'IptablesClassifier':
+        """Load router facts and compile them."""
+        from tsim.analyzers.iptables_forward_analyzer import IptablesForwardAnalyzer
+        return cls.from_analyzer(IptablesForwardAnalyzer(facts_dir, router_name, verbosity), prune)
+
+    def prune(self):
+        """
+        Remove rules that can never match from all chains.
+
+        Returns:
+            ShadowReport describing the removed rules
+        """
+        from tsim.analyzers.iptables_shadow_analyzer import RuleShadowAnalyzer
+        report = RuleShadowAnalyzer(self).analyze()
+        removable = set(report.removable_ids)
+        if removable:
+            self.forward_rules = [rule for rule in self.forward_rules if rule.rule_id not in removable]
+            self.custom_chains = {
+                name: [rule for rule in rules if rule.rule_id not in removable]
+                for name, rules in self.custom_chains.items()
+            }
+            for rules in [self.forward_rules, *self.custom_chains.values()]:
+                self._renumber(rules, 0)
+        return report
+
+    @staticmethod
+    def _rule_kind(target: str, known_targets, chain_names) -> int:
+        """Map a rule target to its evaluation kind (same precedence as the analyzer)."""
+        target_upper = target.upper()
+        if target_upper not in known_targets and target not in chain_names:
+            return KIND_SKIP
+        if target_upper == 'ACCEPT':
+            return KIND_ACCEPT
+        if target_upper in ('DROP', 'REJECT'):
+            return KIND_DENY
+        if target_upper == 'RETURN':
+            return KIND_RETURN
+        if target_upper in LOG_TARGETS or target_upper in MANGLE_TARGETS:
+            return KIND_CONTINUE
+        if target_upper in NAT_TARGETS:
+            return KIND_NAT
+        if target in chain_names:
+            return KIND_JUMP
+        return KIND_CONTINUE
+
+    @staticmethod
+    def _compile_routes(routing_table: List[Dict[str, Any]]) -> List[Tuple[int, int, int, str]]:
+        """Compile routes to (prefixlen, network, mask, dev) sorted for first longest match.
+
+        The analyzer keeps the first route of the longest matching prefix, so a
+        stable sort by descending prefix length preserves its choice.
+        """
+        routes = []
+        for route in routing_table or []:
+            if 'dst' not in route or 'dev' not in route:
+                continue
+            dst = route['dst']
+            try:
+                if dst == 'default':
+                    plen, network = 0, 0
+                elif '/' in dst:
+                    net = ipaddress.ip_network(dst, strict=False)
+                    if net.version != 4:
+                        continue
+                    plen, network = net.prefixlen, int(net.network_address)
+                else:
+                    plen, network = 32, int(ipaddress.IPv4Address(dst))
+            except (ipaddress.AddressValueError, ValueError):
+                continue
+            mask = (0xFFFFFFFF << (32 - plen)) & 0xFFFFFFFF
+            routes.append((plen, network, mask, route['dev']))
+        routes.sort(key=lambda r: -r[0])
+        return routes
+
+    def route_interface(self, ip: int) -> Optional[str]:
+        """Outgoing interface for an integer address (longest prefix match, cached)."""
+        try:
+            return self._interface_cache[ip]
+        except KeyError:
+            pass
+        dev = None
+        for _, network, mask, route_dev in self.routes:
+            if ip & mask == network:
+                dev = route_dev
+                break
+        self._interface_cache[ip] = dev
+        return dev
+
+    @property
+    def rule_count(self) -> int:
+        """Total number of compiled rules across FORWARD and custom chains."""
+        return len(self.forward_rules) + sum(len(rules) for rules in self.custom_chains.values())
+
+    def classify_flow(self, flow: Flow) -> ClassifierVerdict:
+        """Classify a Flow."""
+        return self.classify(flow.src_ip, flow.src_port, flow.dest_ip, flow.dest_port,
+                             flow.protocol, flow.state)
+
+    def classify(self, src_ip: str, src_port: Optional[int], dest_ip: str, dest_port: Optional[int],
+                 protocol: str = 'tcp', connection_state: str = 'NEW') -> ClassifierVerdict:
+        """
+        Classify a packet through the FORWARD chain.
+
+        Args:
+            src_ip, src_port, dest_ip, dest_port: Packet addresses (IPv4)
+            protocol: Protocol name or 'all'
+            connection_state: Conntrack state (default NEW)
+
+        Returns:
+            ClassifierVerdict with decision and matched rule IDs
+
+        Raises:
+            ValueError: If an address is not a valid IPv4 address
+        """
+        src = ip_to_int(src_ip)
+        dst = ip_to_int(dest_ip)
+        if src is None or dst is None:
+            raise ValueError(f"Invalid IPv4 flow {src_ip} -> {dest_ip}")
+        return self.classify_packet(src, src_port, dst, dest_port, protocol, connection_state)
+
+    def classify_packet(self, src: int, src_port: Optional[int], dst: int, dest_port: Optional[int],
+                        protocol: str = 'tcp', connection_state: str = 'NEW') -> ClassifierVerdict:
+        """Classify a packet given integer addresses (as stored in columnar logs)."""
+        if self.profiling:
+            self.flows_classified += 1
+        matched: List[str] = []
+        packet = (src, src_port, dst, dest_port, protocol, connection_state)
+        result = self._walk(self.forward_rules, packet, matched, ('FORWARD',))
+        if result is not None:
+            return result
+        allowed = self.default_policy == 'ACCEPT'
+        return ClassifierVerdict(allowed, 'POLICY', matched, f"Default policy {self.default_policy}")
+
+    def _policy_verdict(self, matched: List[str], rule: CompiledRule) -> ClassifierVerdict:
+        """RETURN in FORWARD applies the default policy."""
+        matched.append(rule.rule_id)
+        allowed = self.default_policy == 'ACCEPT'
+        return ClassifierVerdict(allowed, 'RETURN', matched,
+                                 f"RETURN in {rule.rule_id}, default policy {self.default_policy}")
+
+    def _walk(self, rules: List[CompiledRule], packet, matched: List[str],
+              stack: Tuple[str, ...]) -> Optional[ClassifierVerdict]:
+        """Evaluate a chain; None means fall through (or RETURN from a custom chain)."""
+        src, sport, dst, dport, protocol, state = packet
+        in_forward = len(stack) == 1
+        profiling = self.profiling
+        for rule in rules:
+            kind = rule.kind
+            if kind == KIND_SKIP:
+                continue
+            if profiling:
+                started = time.perf_counter_ns()
+                hit = rule.matches(src, sport, dst, dport, protocol, state, self)
+                rule.cost_ns += time.perf_counter_ns() - started
+                rule.evaluations += 1
+                if not hit:
+                    continue
+                rule.hits += 1
+            elif not rule.matches(src, sport, dst, dport, protocol, state, self):
+                continue
+            if kind == KIND_CONTINUE:
+                matched.append(rule.rule_id)
+                continue
+            if kind == KIND_ACCEPT or kind == KIND_NAT:
+                matched.append(rule.rule_id)
+                action = 'ACCEPT' if kind == KIND_ACCEPT else 'NAT'
+                return ClassifierVerdict(True, action, matched, f"{action} by {rule.rule_id}")
+            if kind == KIND_DENY:
+                matched.append(rule.rule_id)
+                action = rule.target.upper()
+                return ClassifierVerdict(False, action, matched, f"{action} by {rule.rule_id}")
+            if kind == KIND_RETURN:
+                if in_forward:
+                    return self._policy_verdict(matched, rule)
+                matched.append(rule.rule_id)
+                return None
+            # KIND_JUMP - a chain already on the stack would recurse forever, treat as no-op
+            matched.append(rule.rule_id)
+            if rule.target in stack:
+                continue
+            result = self._walk(self.custom_chains[rule.target], packet, matched, stack + (rule.target,))
+            if result is not None:
+                return result
+        return None
+
+    # Rule editing
+
+    def chain_rules(self, chain: str) -> List[CompiledRule]:
+        """Compiled rules of a chain.
+
+        Raises:
+            ValueError: If the chain does not exist
+        """
+        if chain == 'FORWARD':
+            return self.forward_rules
+        if chain not in self.custom_chains:
+            raise ValueError(f"Unknown chain {chain} on {self.router_name}")
+        return self.custom_chains[chain]
+
+    def find_rule(self, rule_id: str) -> Tuple[List[CompiledRule], int]:
+        """Locate a rule by ID, returning its chain list and index.
+
+        Raises:
+            ValueError: If no rule has this ID
+        """
+        chain = rule_id.rsplit(':', 1)[0]
+        rules = self.chain_rules(chain)
+        for index, rule in enumerate(rules):
+            if rule.rule_id == rule_id:
+                return rules, index
+        raise ValueError(f"Unknown rule {rule_id} on {self.router_name}")
+
+    def compile_rule_spec(self, chain: str, spec: str, line_number: Optional[int] = None) -> CompiledRule:
+        """
+        Compile an iptables-save style rule specification.
+
+        Args:
+            chain: Chain the rule belongs to
+            spec: Rule text such as '-s 10.1.0.0/16 -p tcp --dport 22 -j ACCEPT'
+            line_number: Line number for the rule ID (default: next free in chain)
+
+        Raises:
+            ValueError: If the chain is unknown or the spec has no -j target
+        """
+        from tsim.analyzers.iptables_forward_analyzer import IptablesRule
+        rules = self.chain_rules(chain)
+        tokens = spec.split()
+        if '-j' not in tokens or tokens.index('-j') + 1 >= len(tokens):
+            raise ValueError(f"Rule spec has no -j target: {spec}")
+        target = tokens[tokens.index('-j') + 1]
+        if line_number is None:
+            line_number = max((rule.line_number for rule in rules), default=0) + 1
+        kind = self._rule_kind(target, self.known_targets, set(self.custom_chains))
+        return CompiledRule(chain, 0, IptablesRule(line_number, spec, target), kind, self.ipsets)
+
+    def insert_compiled(self, rule: CompiledRule, index: int):
+        """Insert an already compiled rule at a 0-based index of its chain."""
+        rules = self.chain_rules(rule.chain)
+        rules.insert(index, rule)
+        self._renumber(rules, index)
+
+    def remove_compiled(self, rule_id: str) -> Tuple[CompiledRule, int]:
+        """Remove a rule by ID, returning it with its former 0-based index."""
+        rules, index = self.find_rule(rule_id)
+        rule = rules.pop(index)
+        self._renumber(rules, index)
+        return rule, index
+
+    @staticmethod
+    def _renumber(rules: List[CompiledRule], start: int):
+        for position in range(start, len(rules)):
+            rules[position].position = position + 1
+
+    # Profiling
+
+    def all_rules(self) -> List[CompiledRule]:
+        """All compiled rules, FORWARD first, then custom chains."""
+        rules = list(self.forward_rules)
+        for chain_rules in self.custom_chains.values():
+            rules.extend(chain_rules)
+        return rules
+
+    def enable_profiling(self, enabled: bool = True, reset: bool = True):
+        """Start or stop collecting per-rule evaluation counts, matches and cost."""
+        if reset:
+            self.reset_profile()
+        self.profiling = enabled
+
+    def reset_profile(self):
+        """Clear all profiling counters."""
+        self.flows_classified = 0
+        for rule in self.all_rules():
+            rule.evaluations = 0
+            rule.hits = 0
+            rule.cost_ns = 0
+
+    def profile_snapshot(self) -> Dict[str, Any]:
+        """Export per-rule profiling counters for this router."""
+        return {
+            'router': self.router_name,
+            'flows_classified': self.flows_classified,
+            'rules': [
+                {
+                    'rule_id': rule.rule_id,
+                    'chain': rule.chain,
+                    'position': rule.position,
+                    'target': rule.target,
+                    'evaluations': rule.evaluations,
+                    'matches': rule.hits,
+                    'cost_ns': rule.cost_ns,
+                    'avg_cost_ns': rule.cost_ns / rule.evaluations if rule.evaluations else 0.0
+                }
+                for rule in self.all_rules()
+            ]
+        }
+
+    def earliest_safe_position(self, rule: CompiledRule) -> int:
+        """
+        Highest position a rule could be moved to without changing any verdict.
+
+        Moving up is safe past rules that cannot match the same packets, and
+        past terminal rules with the same target. Anything else (jumps, logs,
+        RETURN, different verdicts that may overlap) stops the move.
+        """
+        chain = self.forward_rules if rule.chain == 'FORWARD' else self.custom_chains[rule.chain]
+        terminal = rule.kind in (KIND_ACCEPT, KIND_DENY)
+        position = rule.position
+        for earlier in reversed(chain[:chain.index(rule)]):
+            if earlier.kind == KIND_SKIP or not earlier.may_overlap(rule):
+                position = earlier.position
+                continue
+            if terminal and earlier.kind == rule.kind and earlier.target.upper() == rule.target.upper():
+                position = earlier.position
+                continue
+            break
+        return position
+
+    def profile_report(self, hot_fraction: float = 0.05, min_depth: int = 10,
+                       limit: int = 20) -> Dict[str, Any]:
+        """
+        Summarize profiling counters into reordering hints.
+
+        Args:
+            hot_fraction: Minimum share of classified flows a rule must match to be hot
+            min_depth: Minimum chain position for a hot rule to be reported as deep
+            limit: Maximum number of hot rules to report
+
+        Returns:
+            Dictionary with never_hit rules and hot_deep rules; each hot rule
+            carries the position it can safely move to and the estimated rule
+            evaluations saved per profiling window.
+        """
+        flows = self.flows_classified
+        never_hit = []
+        hot_deep = []
+        for rule in self.all_rules():
+            if rule.kind == KIND_SKIP:
+                continue
+            if rule.hits == 0:
+                never_hit.append({
+                    'rule_id': rule.rule_id,
+                    'position': rule.position,
+                    'target': rule.target,
+                    'evaluations': rule.evaluations,
+                    'rule': rule.rule_text
+                })
+                continue
+            if flows == 0 or rule.hits / flows < hot_fraction or rule.position < min_depth:
+                continue
+            safe_position = self.earliest_safe_position(rule)
+            hot_deep.append({
+                'rule_id': rule.rule_id,
+                'position': rule.position,
+                'target': rule.target,
+                'matches': rule.hits,
+                'match_fraction': rule.hits / flows,
+                'safe_position': safe_position,
+                'estimated_evaluations_saved': rule.hits * (rule.position - safe_position),
+                'rule': rule.rule_text
+            })
+        hot_deep.sort(key=lambda entry: (-entry['estimated_evaluations_saved'], -entry['matches']))
+        return {
+            'router': self.router_name,
+            'flows_classified': flows,
+            'never_hit': never_hit,
+            'hot_deep': hot_deep[:limit]
+        }
+
+
+def main():
+    """Classify flows for a router and optionally print the rule profile report."""
+    parser = argparse.ArgumentParser(
+        description="Classify packets with the compiled FORWARD classifier",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+    # Classify a single flow
+    python3 iptables_classifier.py --router hq-gw -s 10.1.1.1 -d 10.2.1.1 -p tcp -dp 443
+
+    # Profile a flow list (JSON list of {src_ip, dest_ip, protocol, src_port, dest_port})
+    python3 iptables_classifier.py --router hq-gw --flows flows.json --profile
+        """
+    )
+    parser.add_argument('--router', required=True, help='Router name to analyze')
+    parser.add_argument('--tsim-facts', help='Facts directory (default: TRACEROUTE_SIMULATOR_FACTS)')
+    parser.add_argument('-s', '--source', help='Source IP address')
+    parser.add_argument('-d', '--dest', help='Destination IP address')
+    parser.add_argument('-p', '--protocol', default='tcp', choices=['all', 'tcp', 'udp', 'icmp'])
+    parser.add_argument('-sp', '--source-port', type=int, help='Source port')
+    parser.add_argument('-dp', '--dest-port', type=int, help='Destination port')
+    parser.add_argument('--flows', help='JSON file with a list of flows to classify')
+    parser.add_argument('--profile', action='store_true', help='Print rule profile report as JSON')
+    args = parser.parse_args()
+
+    try:
+        classifier = IptablesClassifier.from_facts(args.tsim_facts, args.router)
+        flows: List[Flow] = []
+        if args.flows:
+            with open(args.flows) as f:
+                flows = [Flow(**entry) for entry in json.load(f)]
+        if args.source and args.dest:
+            flows.append(Flow(args.source, args.dest, args.protocol, args.source_port, args.dest_port))
+        if not flows:
+            parser.error("either -s/-d or --flows is required")
+
+        classifier.enable_profiling(args.profile)
+        allowed = True
+        for flow in flows:
+            verdict = classifier.classify_flow(flow)
+            allowed = allowed and verdict.allowed
+            if not args.profile:
+                print(f"{flow.src_ip} -> {flow.dest_ip} {flow.protocol}/{flow.dest_port}: "
+                      f"{verdict.action} ({', '.join(verdict.rule_ids) or 'no rule'})")
+        if args.profile:
+            print(json.dumps(classifier.profile_report(), indent=2))
+        sys.exit(0 if allowed else 1)
+    except (FileNotFoundError, ValueError, TypeError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(2)
+
+
+if __name__ == "__main__":
+    main()
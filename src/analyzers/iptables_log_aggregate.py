@@ -0,0 +1,519 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Hash aggregation over columnar iptables logs
+
+Group-by, count-distinct, top-k and de-duplication over ColumnarLogBatch
+columns, plus correlation of every row with the iptables rule that logged
+it and the rule that decided it, using the compiled FORWARD classifier.
+
+Group keys are tuples of integer column values (dictionary ids, addresses,
+masked prefixes, ports, time buckets) built by C-level map/zip over the
+column arrays and counted by collections.Counter, so no per-row Python
+code runs for plain counts and nothing is converted to strings until the
+result is decoded. Large batches are aggregated in chunks, optionally in
+forked worker processes, and the partial aggregates are merged.
+
+Key specification: column names of ColumnarLogBatch (or LogEntry aliases
+such as source_ip/dest_port), optionally with a suffix:
+    src/24, dst/16        Address masked to a prefix length
+    timestamp/3600        Time bucket in seconds
+    rule, decision        Correlated log rule / deciding rule (needs rules)
+
+Aggregates: 'distinct:<column>', 'sum:<column>', 'min:<column>',
+'max:<column>'; every group also has a row count.
+
+Key Features:
+- Integer tuple keys over dictionary-encoded columns
+- Count, count-distinct, sum, min and max per group
+- Top-k groups, global count-distinct and first-row-per-key de-duplication
+- Optional row mask from LogFilter.compile_criteria
+- Chunked, optionally parallel (fork) partial aggregation with merge
+- Rule correlation cached per distinct packet header
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import argparse
+import heapq
+import json
+import operator
+import shlex
+import socket
+import sys
+import weakref
+from array import array
+from collections import Counter
+from dataclasses import dataclass, field
+from datetime import timedelta
+from itertools import compress, repeat
+from typing import Any, Callable, Dict, Iterable, List, Optional, Sequence, Tuple
+
+from tsim.analyzers.iptables_classifier import LOG_TARGETS
+from tsim.analyzers.iptables_log_columnar import ACTIONS, MISSING, NAIVE_EPOCH, ColumnarLogBatch, map_chunks
+
+
+# LogEntry / LogFilter field names accepted for column names
+COLUMN_ALIASES = {
+    'source_ip': 'src', 'dest_ip': 'dst', 'source_port': 'sport', 'dest_port': 'dport',
+    'packet_length': 'length'
+}
+
+_DICTIONARY_COLUMNS = {
+    'router': 'routers', 'prefix': 'prefixes', 'protocol': 'protocols',
+    'interface_in': 'interfaces', 'interface_out': 'interfaces'
+}
+_INTEGER_COLUMNS = ('sport', 'dport', 'length', 'ttl')
+_RULE_COLUMNS = ('rule', 'decision')
+
+
+def _int_to_ip(value: int) -> str:
+    return socket.inet_ntoa(value.to_bytes(4, 'big'))
+
+
+@dataclass
+class RuleAssignment:
+    """Per-row rule ids from RuleCorrelator (index into names; 0 = none)."""
+    names: List[Optional[str]]
+    rule: array                      # LOG rule that produced the line
+    decision: array                  # Rule that decided the packet (policy: 0)
+
+
+class RuleCorrelator:
+    """
+    Maps log rows to iptables rules with compiled classifiers.
+
+    The log rule is the matched LOG rule whose --log-prefix equals the
+    row's prefix (else the last LOG rule matched). Logs carry no conntrack
+    state, so packets are classified as NEW.
+    """
+
+    def __init__(self, classifiers: Dict[str, Any], state: str = 'NEW'):
+        """
+        Args:
+            classifiers: IptablesClassifier per router name
+            state: Conntrack state assumed for logged packets
+        """
+        self.classifiers = classifiers
+        self.state = state
+        self.names: List[Optional[str]] = [None]
+        self._name_ids: Dict[Optional[str], int] = {None: 0}
+        self._log_prefixes: Dict[str, Dict[str, str]] = {
+            router: self._compile_log_prefixes(classifier) for router, classifier in classifiers.items()
+        }
+        # batch -> {header: (log rule id, decision id)}, dropped with the batch
+        self._cache: 'weakref.WeakKeyDictionary[ColumnarLogBatch, Dict[Tuple, Tuple[int, int]]]' = \
+            weakref.WeakKeyDictionary()
+
+    @staticmethod
+    def _compile_log_prefixes(classifier) -> Dict[str, str]:
+        """Rule ID -> log prefix (without trailing colon) for LOG rules.
+
+        Accepts iptables-save options (--log-prefix "X: ") and iptables -L
+        match text (LOG flags 0 level 4 prefix "X: ").
+        """
+        prefixes = {}
+        for rule in classifier.all_rules():
+            if rule.target.upper() not in LOG_TARGETS:
+                continue
+            try:
+                tokens = shlex.split(rule.rule_text)
+            except ValueError:
+                tokens = rule.rule_text.split()
+            prefixes[rule.rule_id] = ''
+            for index, token in enumerate(tokens[:-1]):
+                if token in ('--log-prefix', '--nflog-prefix', '--ulog-prefix', 'prefix'):
+                    prefixes[rule.rule_id] = tokens[index + 1].strip().rstrip(':').strip()
+        return prefixes
+
+    def _name_id(self, name: Optional[str]) -> int:
+        ident = self._name_ids.get(name)
+        if ident is None:
+            ident = self._name_ids[name] = len(self.names)
+            self.names.append(name)
+        return ident
+
+    def correlate_packet(self, router: str, src: int, sport: Optional[int], dst: int,
+                         dport: Optional[int], protocol: str, prefix: Optional[str]):
+        """
+        Classify one logged packet.
+
+        Returns:
+            (log rule ID or None, ClassifierVerdict), or None without a classifier
+        """
+        classifier = self.classifiers.get(router)
+        if classifier is None:
+            return None
+        verdict = classifier.classify_packet(src, sport, dst, dport, protocol, self.state)
+        log_prefixes = self._log_prefixes[router]
+        log_rule = None
+        for rule_id in verdict.rule_ids:
+            rule_prefix = log_prefixes.get(rule_id)
+            if rule_prefix is None:
+                continue
+            log_rule = rule_id
+            if rule_prefix == prefix:
+                break
+        return log_rule, verdict
+
+    def correlate(self, batch: ColumnarLogBatch) -> RuleAssignment:
+        """Rule ids for every row of a batch (one classification per distinct header)."""
+        d = batch.dictionary
+        routers, protocols, prefixes = d.routers.values, d.protocols.values, d.prefixes.values
+        cache = self._cache.setdefault(batch, {})
+        headers = zip(batch.router, batch.src, batch.sport, batch.dst,
+                      batch.dport, batch.protocol, batch.prefix)
+        for header in set(headers) - cache.keys():
+            router, src, sport, dst, dport, protocol, prefix = header
+            result = self.correlate_packet(
+                routers[router], src, sport if sport != MISSING else None, dst,
+                dport if dport != MISSING else None, protocols[protocol], prefixes[prefix])
+            if result is None:
+                cache[header] = (0, 0)
+            else:
+                log_rule, verdict = result
+                cache[header] = (self._name_id(log_rule), self._name_id(verdict.terminal_rule))
+        assigned = list(map(cache.__getitem__, zip(
+            batch.router, batch.src, batch.sport, batch.dst,
+            batch.dport, batch.protocol, batch.prefix)))
+        return RuleAssignment(self.names, array('I', map(operator.itemgetter(0), assigned)),
+                              array('I', map(operator.itemgetter(1), assigned)))
+
+
+@dataclass
+class _Partial:
+    """Partial aggregate of one chunk."""
+    counts: Counter
+    distinct: Dict[int, set] = field(default_factory=dict)      # aggregate index -> {(key, value)}
+    values: Dict[int, Dict] = field(default_factory=dict)       # aggregate index -> {key: value}
+
+
+@dataclass
+class AggregateResult:
+    """Groups with their row count and requested aggregates."""
+    keys: List[str]
+    aggregates: List[str]
+    groups: Dict[Any, List[int]]     # raw key -> [count, aggregate values...]
+    decoder: Callable[[Any], Tuple] = field(repr=False, default=tuple)
+    # Per aggregate decoder for min/max values (None keeps the number)
+    value_decoders: List[Optional[Callable[[int], Any]]] = field(repr=False, default_factory=list)
+
+    def __len__(self) -> int:
+        return len(self.groups)
+
+    def _row(self, key, values) -> Dict[str, Any]:
+        row = dict(zip(self.keys, self.decoder(key)))
+        row['count'] = values[0]
+        for name, decode, value in zip(self.aggregates, self.value_decoders, values[1:]):
+            row[name] = decode(value) if decode is not None else value
+        return row
+
+    def rows(self) -> List[Dict[str, Any]]:
+        """Decoded groups, largest count first."""
+        ordered = sorted(self.groups.items(), key=lambda item: -item[1][0])
+        return [self._row(key, values) for key, values in ordered]
+
+    def top(self, k: int, by: str = 'count') -> List[Dict[str, Any]]:
+        """The k groups with the largest count (or aggregate named by)."""
+        index = 0 if by == 'count' else 1 + self.aggregates.index(by)
+        best = heapq.nlargest(k, self.groups.items(), key=lambda item: item[1][index])
+        return [self._row(key, values) for key, values in best]
+
+    def to_dict(self, limit: Optional[int] = None) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        rows = self.top(limit) if limit is not None else self.rows()
+        for row in rows:
+            for name, value in row.items():
+                if hasattr(value, 'isoformat'):
+                    row[name] = value.isoformat()
+        return {'keys': self.keys, 'aggregates': self.aggregates, 'groups': len(self.groups), 'rows': rows}
+
+
+class LogAggregator:
+    """
+    Hash aggregation over one ColumnarLogBatch.
+
+    Raises ValueError for unknown columns or aggregate specifications.
+    """
+
+    def __init__(self, batch: ColumnarLogBatch, rules: Optional[RuleAssignment] = None,
+                 chunk_rows: int = 1_000_000, workers: int = 1):
+        """
+        Args:
+            batch: Rows to aggregate
+            rules: Output of RuleCorrelator.correlate, enables 'rule'/'decision' keys
+            chunk_rows: Rows per partial aggregate
+            workers: Processes aggregating chunks in parallel (fork based)
+        """
+        self.batch = batch
+        self.rules = rules
+        self.chunk_rows = chunk_rows
+        self.workers = workers
+
+    # Key compilation
+
+    def _parse(self, spec: str) -> Tuple[str, Optional[int]]:
+        """Column name and numeric suffix of a key spec."""
+        name, _, suffix = spec.partition('/')
+        name = COLUMN_ALIASES.get(name, name)
+        if name not in self.batch.columns() and name not in _RULE_COLUMNS:
+            raise ValueError(f"Unknown column: {spec}")
+        if name in _RULE_COLUMNS and self.rules is None:
+            raise ValueError(f"Key {name} needs rule correlation")
+        if not suffix:
+            return name, None
+        try:
+            parameter = int(suffix)
+        except ValueError:
+            raise ValueError(f"Invalid key suffix: {spec}")
+        if name in ('src', 'dst'):
+            if not 0 <= parameter <= 32:
+                raise ValueError(f"Invalid prefix length: {spec}")
+        elif name != 'timestamp' or parameter <= 0:
+            raise ValueError(f"Suffix only valid for src, dst and timestamp: {spec}")
+        return name, parameter
+
+    def _column(self, name: str):
+        if name in _RULE_COLUMNS:
+            return getattr(self.rules, name)
+        return getattr(self.batch, name)
+
+    def _extractor(self, spec: str) -> Callable[[int, int], Iterable[int]]:
+        """Function returning the key values of rows [start, end)."""
+        name, parameter = self._parse(spec)
+        column = self._column(name)
+        if parameter is None or (name in ('src', 'dst') and parameter == 32):
+            return lambda start, end: column[start:end]
+        if name in ('src', 'dst'):
+            if parameter == 0:
+                return lambda start, end: repeat(0, end - start)
+            shift = 32 - parameter
+            return lambda start, end: map(operator.rshift, column[start:end], repeat(shift))
+        return lambda start, end: map(operator.floordiv, column[start:end], repeat(parameter))
+
+    def _value_decoder(self, spec: str) -> Callable[[int], Any]:
+        """Function turning one key value back into a readable value."""
+        name, parameter = self._parse(spec)
+        if name in _DICTIONARY_COLUMNS:
+            return getattr(self.batch.dictionary, _DICTIONARY_COLUMNS[name]).values.__getitem__
+        if name in _RULE_COLUMNS:
+            return self.rules.names.__getitem__
+        if name == 'action':
+            return ACTIONS.__getitem__
+        if name in _INTEGER_COLUMNS:
+            return lambda value: None if value == MISSING else value
+        if name in ('src', 'dst'):
+            if parameter is None or parameter == 32:
+                return _int_to_ip
+            shift = 32 - parameter
+            return lambda value: f"{_int_to_ip((value << shift) & 0xFFFFFFFF)}/{parameter}"
+        if name == 'timestamp':
+            bucket = parameter or 1
+            return lambda value: NAIVE_EPOCH + timedelta(seconds=value * bucket)
+        return lambda value: value
+
+    def _keys(self, extractors, start: int, end: int, mask: Optional[bytes]) -> Iterable:
+        if len(extractors) == 1:
+            keys = extractors[0](start, end)
+        else:
+            keys = zip(*(extract(start, end) for extract in extractors))
+        if mask is not None:
+            keys = compress(keys, mask[start:end])
+        return keys
+
+    def _decoder(self, specs: Sequence[str]) -> Callable[[Any], Tuple]:
+        decoders = [self._value_decoder(spec) for spec in specs]
+        if len(decoders) == 1:
+            decode = decoders[0]
+            return lambda key: (decode(key),)
+        return lambda key: tuple(decode(value) for decode, value in zip(decoders, key))
+
+    @staticmethod
+    def _parse_aggregate(spec: str) -> Tuple[str, str]:
+        function, _, column = spec.partition(':')
+        if function not in ('distinct', 'sum', 'min', 'max') or not column:
+            raise ValueError(f"Invalid aggregate: {spec} (expected distinct|sum|min|max:<column>)")
+        return function, column
+
+    # Chunked evaluation
+
+    def _run(self, chunk_function, merge, *args):
+        """Apply chunk_function to every chunk (forked workers if enabled) and merge."""
+        total = len(self.batch)
+        bounds = [(start, min(start + self.chunk_rows, total))
+                  for start in range(0, total, self.chunk_rows)] or [(0, 0)]
+        return merge(map_chunks(lambda start, end: chunk_function(start, end, *args), bounds, self.workers))
+
+    def _aggregate_chunk(self, start: int, end: int, extractors, aggregates, mask) -> _Partial:
+        keys = self._keys(extractors, start, end, mask)
+        if aggregates:
+            keys = list(keys)
+        partial = _Partial(Counter(keys))
+        for index, (function, extract) in enumerate(aggregates):
+            values = extract(start, end)
+            if mask is not None:
+                values = compress(values, mask[start:end])
+            if function == 'distinct':
+                partial.distinct[index] = set(zip(keys, values))
+                continue
+            result: Dict = {}
+            get = result.get
+            # Rows without the column (MISSING, e.g. ports of ICMP) do not contribute
+            if function == 'sum':
+                for key, value in zip(keys, values):
+                    if value != MISSING:
+                        result[key] = get(key, 0) + value
+            else:
+                better = operator.lt if function == 'min' else operator.gt
+                for key, value in zip(keys, values):
+                    if value == MISSING:
+                        continue
+                    current = get(key)
+                    if current is None or better(value, current):
+                        result[key] = value
+            partial.values[index] = result
+        return partial
+
+    @staticmethod
+    def _merge(functions: List[str]) -> Callable[[List[_Partial]], Dict[Any, List[int]]]:
+        def merge(parts: List[_Partial]) -> Dict[Any, List[int]]:
+            counts = parts[0].counts
+            for part in parts[1:]:
+                counts.update(part.counts)
+            # min/max of a group whose rows all lack the column stay MISSING (None)
+            initial = [MISSING if function in ('min', 'max') else 0 for function in functions]
+            groups = {key: [count] + initial for key, count in counts.items()}
+            for index, function in enumerate(functions):
+                column = index + 1
+                if function == 'distinct':
+                    pairs = set().union(*(part.distinct[index] for part in parts))
+                    for key, distinct in Counter(map(operator.itemgetter(0), pairs)).items():
+                        groups[key][column] = distinct
+                    continue
+                combine = {'sum': operator.add, 'min': min, 'max': max}[function]
+                seen = set()
+                for part in parts:
+                    for key, value in part.values[index].items():
+                        if key in seen:
+                            groups[key][column] = combine(groups[key][column], value)
+                        else:
+                            seen.add(key)
+                            groups[key][column] = value
+            return groups
+        return merge
+
+    # Public API
+
+    def group_by(self, keys: Sequence[str], aggregates: Sequence[str] = (),
+                 mask: Optional[bytes] = None) -> AggregateResult:
+        """
+        Group rows by key columns.
+
+        Args:
+            keys: Key specs, e.g. ['src/24', 'dst', 'dport', 'action']
+            aggregates: e.g. ['distinct:src', 'sum:length', 'max:timestamp']
+            mask: Optional 0/1 row selection (LogFilter.filter_columnar)
+        """
+        if isinstance(keys, str):
+            keys = [keys]
+        extractors = [self._extractor(spec) for spec in keys]
+        compiled = []
+        value_decoders = []
+        for spec in aggregates:
+            function, column = self._parse_aggregate(spec)
+            compiled.append((function, self._extractor(column)))
+            value_decoders.append(self._value_decoder(column) if function in ('min', 'max') else None)
+        groups = self._run(self._aggregate_chunk, self._merge([f for f, _ in compiled]),
+                           extractors, compiled, mask)
+        return AggregateResult(list(keys), list(aggregates), groups, self._decoder(keys), value_decoders)
+
+    def top_k(self, keys: Sequence[str], k: int = 10, aggregates: Sequence[str] = (),
+              by: str = 'count', mask: Optional[bytes] = None) -> List[Dict[str, Any]]:
+        """The k largest groups by count or by one of the aggregates."""
+        return self.group_by(keys, aggregates, mask).top(k, by)
+
+    def _distinct_chunk(self, start: int, end: int, extractors, mask) -> set:
+        return set(self._keys(extractors, start, end, mask))
+
+    def count_distinct(self, keys: Sequence[str], mask: Optional[bytes] = None) -> int:
+        """Number of distinct key values over all (selected) rows."""
+        if isinstance(keys, str):
+            keys = [keys]
+        extractors = [self._extractor(spec) for spec in keys]
+        return self._run(self._distinct_chunk, lambda parts: len(set().union(*parts)), extractors, mask)
+
+    def _first_rows_chunk(self, start: int, end: int, extractors, mask) -> Dict:
+        rows = range(start, end)
+        if mask is not None:
+            rows = compress(rows, mask[start:end])
+        rows = list(rows)
+        keys = list(self._keys(extractors, start, end, mask))
+        # Reversed insertion leaves the first row of every key in the dict
+        return dict(zip(reversed(keys), reversed(rows)))
+
+    @staticmethod
+    def _merge_first_rows(parts: List[Dict]) -> List[int]:
+        first: Dict = {}
+        for part in reversed(parts):
+            first.update(part)
+        return sorted(first.values())
+
+    def distinct_rows(self, keys: Sequence[str], mask: Optional[bytes] = None) -> List[int]:
+        """Row indices of the first row of every distinct key (de-duplication)."""
+        if isinstance(keys, str):
+            keys = [keys]
+        extractors = [self._extractor(spec) for spec in keys]
+        return self._run(self._first_rows_chunk, self._merge_first_rows, extractors, mask)
+
+
+def main():
+    """Aggregate an iptables log file."""
+    parser = argparse.ArgumentParser(
+        description='Group-by / top-k aggregation over iptables logs',
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+    # Firewall review: top 20 (src /24, dst, dport, action) with distinct sources
+    python3 iptables_log_aggregate.py /var/log/kern.log --group-by src/24,dst,dport,action \\
+        --aggregate distinct:src --top 20
+
+    # Hits per logging rule, correlated with the router facts
+    python3 iptables_log_aggregate.py /var/log/kern.log --group-by router,rule,decision --correlate
+        """
+    )
+    parser.add_argument('log_file', help='Kernel log or syslog file')
+    parser.add_argument('--group-by', required=True, help='Comma separated key specs')
+    parser.add_argument('--aggregate', default='', help='Comma separated aggregates (e.g. distinct:src,sum:length)')
+    parser.add_argument('--top', type=int, default=20, help='Number of groups to print')
+    parser.add_argument('--correlate', action='store_true',
+                        help='Correlate rows with rules (enables rule/decision keys)')
+    parser.add_argument('--tsim-facts', help='Facts directory (default: TRACEROUTE_SIMULATOR_FACTS)')
+    parser.add_argument('--year', type=int, help='Year for syslog timestamps (default: current year)')
+    parser.add_argument('--workers', type=int, default=1, help='Parallel worker processes')
+    args = parser.parse_args()
+
+    from tsim.analyzers.iptables_log_columnar import ColumnarLogParser
+    try:
+        batch = ColumnarLogParser(args.year).parse_file(args.log_file)
+        rules = None
+        if args.correlate:
+            from tsim.analyzers.iptables_classifier import IptablesClassifier
+            classifiers = {}
+            for router in batch.dictionary.routers.values[1:]:
+                try:
+                    classifiers[router] = IptablesClassifier.from_facts(args.tsim_facts, router)
+                except (FileNotFoundError, ValueError) as e:
+                    print(f"Warning: no rules for {router}: {e}", file=sys.stderr)
+            rules = RuleCorrelator(classifiers).correlate(batch)
+        aggregator = LogAggregator(batch, rules, workers=args.workers)
+        aggregates = [spec for spec in args.aggregate.split(',') if spec]
+        result = aggregator.group_by(args.group_by.split(','), aggregates)
+    except (FileNotFoundError, PermissionError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    print(json.dumps(result.to_dict(args.top), indent=2))
+
+
+if __name__ == '__main__':
+    main()
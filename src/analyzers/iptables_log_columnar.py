@@ -0,0 +1,508 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Columnar iptables log parser
+
+Parses kernel/syslog iptables LOG lines straight out of a memory-mapped file
+into typed column arrays instead of one LogEntry object per line. The whole
+file is scanned by a single compiled bytes regex running over the mmap, so
+lines are never copied into Python strings; raw lines are referenced by
+byte offset and only decoded on demand.
+
+Accepts exactly the lines IptablesLogProcessor.parse_log_line accepts (for
+IPv4 packets) and produces the same field values, except that timestamps
+with a space-padded day ('Jul  1') are parsed instead of falling back to
+the current time.
+
+Key Features:
+- mmap based, zero-copy scan of multi-GB log files
+- Timestamps as int64 seconds since a naive epoch (no datetime per line)
+- Source/destination addresses as uint32
+- Interned routers, prefixes, interfaces and protocols (small integer ids)
+- Raw-line byte offsets and lengths instead of line copies
+- Batched iteration with a bounded number of rows per batch
+- Materialization of LogEntry objects for individual rows when needed
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import calendar
+import mmap
+import multiprocessing
+import re
+import socket
+import sys
+import time
+from array import array
+from datetime import datetime, timedelta
+from pathlib import Path
+from typing import Callable, Dict, Iterator, List, Optional, Tuple, Union, Any
+
+from tsim.analyzers.iptables_log_processor import LogEntry
+
+
+# Same fields and optional groups as IptablesLogProcessor.log_patterns, as one
+# line-anchored pattern. Separators are restricted to blanks so that a match
+# never runs across a newline.
+_LINE_PATTERN = re.compile(
+    rb'^[ \t]*'
+    rb'(\w+[ \t]+\d+[ \t]+\d+:\d+:\d+)[ \t]+'    # timestamp
+    rb'(\S+)[ \t]+'                              # hostname
+    rb'kernel:[ \t]*'                            # kernel prefix
+    rb'(\S+):[ \t]*'                             # log prefix
+    rb'IN=(\S*)[ \t]+'                           # input interface
+    rb'OUT=(\S*)[ \t]+'                          # output interface
+    rb'(?:MAC=\S+[ \t]+)?'                       # optional MAC
+    rb'SRC=(\S+)[ \t]+'                          # source IP
+    rb'DST=(\S+)[ \t]+'                          # destination IP
+    rb'(?:LEN=(\d+)[ \t]+)?'                     # optional length
+    rb'(?:TOS=\S+[ \t]+)?'                       # optional TOS
+    rb'(?:PREC=\S+[ \t]+)?'                      # optional precedence
+    rb'(?:TTL=(\d+)[ \t]+)?'                     # optional TTL
+    rb'(?:ID=\S+[ \t]+)?'                        # optional ID
+    rb'(?:CE[ \t]+)?'                            # optional CE
+    rb'(?:DF[ \t]+)?'                            # optional DF
+    rb'(?:MF[ \t]+)?'                            # optional MF
+    rb'PROTO=(\S+)'                              # protocol
+    rb'(?:[ \t]+SPT=(\d+))?'                     # optional source port
+    rb'(?:[ \t]+DPT=(\d+))?'                     # optional dest port
+    rb'[^\n]*',                                  # optional additional fields
+    re.MULTILINE
+)
+
+_MONTHS = {name.encode(): number for number, name in enumerate(calendar.month_abbr) if name}
+
+# Action ids, derived from the log prefix exactly like parse_log_line
+ACTIONS = ('LOG', 'ACCEPT', 'DROP', 'REJECT')
+
+# Column value for missing optional integers (ports, length, TTL)
+MISSING = -1
+
+NAIVE_EPOCH = datetime(1970, 1, 1)
+
+
+def prefix_action(prefix: str) -> int:
+    """Action id for a log prefix."""
+    prefix_upper = prefix.upper()
+    if "ACCEPT" in prefix_upper or "ALLOW" in prefix_upper:
+        return 1
+    if "DROP" in prefix_upper:
+        return 2
+    if "REJECT" in prefix_upper or "DENY" in prefix_upper:
+        return 3
+    return 0
+
+
+class InternTable:
+    """Bidirectional string <-> small integer id table (id 0 is None)."""
+
+    def __init__(self):
+        self.values: List[Optional[str]] = [None]
+        self.ids: Dict[Optional[str], int] = {None: 0}
+
+    def intern(self, value: Optional[str]) -> int:
+        """Return the id for value, adding it if new."""
+        ident = self.ids.get(value)
+        if ident is None:
+            ident = len(self.values)
+            self.values.append(value)
+            self.ids[value] = ident
+        return ident
+
+    def lookup(self, value: Optional[str]) -> Optional[int]:
+        """Id of an existing value, None if it was never interned."""
+        return self.ids.get(value)
+
+    def __getitem__(self, ident: int) -> Optional[str]:
+        return self.values[ident]
+
+    def __len__(self) -> int:
+        return len(self.values)
+
+
+class LogDictionary:
+    """Intern tables shared by all batches parsed by one ColumnarLogParser."""
+
+    def __init__(self):
+        self.routers = InternTable()
+        self.prefixes = InternTable()
+        self.interfaces = InternTable()
+        self.protocols = InternTable()
+        # Action id per prefix id (index aligned with prefixes)
+        self.prefix_actions = array('B', [0])
+
+    def intern_prefix(self, prefix: str) -> int:
+        """Intern a prefix and record its action."""
+        ident = self.prefixes.intern(prefix)
+        if ident == len(self.prefix_actions):
+            self.prefix_actions.append(prefix_action(prefix))
+        return ident
+
+
+class ColumnarLogBatch:
+    """
+    Parsed log rows stored column-wise.
+
+    All columns have one element per row; optional integers use MISSING.
+    Raw lines stay in the source buffer and are addressed by offset/length.
+    """
+
+    def __init__(self, dictionary: LogDictionary, buffer=None, source: Optional[str] = None):
+        self.dictionary = dictionary
+        self.source = source
+        self._buffer = buffer
+        self.timestamp = array('q')   # Seconds since naive epoch
+        self.router = array('I')      # Intern ids: as many as there are distinct values
+        self.prefix = array('I')
+        self.action = array('B')      # Index into ACTIONS
+        self.protocol = array('I')
+        self.src = array('I')
+        self.dst = array('I')
+        self.sport = array('i')
+        self.dport = array('i')
+        self.interface_in = array('I')
+        self.interface_out = array('I')
+        self.length = array('i')
+        self.ttl = array('i')
+        self.offset = array('Q')
+        self.line_length = array('I')
+        self.skipped = 0              # Matching lines that could not be stored (non-IPv4)
+
+    def __len__(self) -> int:
+        return len(self.timestamp)
+
+    @property
+    def nbytes(self) -> int:
+        """Memory used by the column arrays."""
+        return sum(column.itemsize * len(column) for column in self.columns().values())
+
+    def columns(self) -> Dict[str, array]:
+        """All column arrays by name."""
+        return {
+            'timestamp': self.timestamp, 'router': self.router, 'prefix': self.prefix,
+            'action': self.action, 'protocol': self.protocol, 'src': self.src, 'dst': self.dst,
+            'sport': self.sport, 'dport': self.dport, 'interface_in': self.interface_in,
+            'interface_out': self.interface_out, 'length': self.length, 'ttl': self.ttl,
+            'offset': self.offset, 'line_length': self.line_length
+        }
+
+    def raw_line_bytes(self, row: int) -> bytes:
+        """Original bytes of a row's line from the source buffer."""
+        start = self.offset[row]
+        if self._buffer is not None:
+            return bytes(self._buffer[start:start + self.line_length[row]])
+        with open(self.source, 'rb') as f:
+            f.seek(start)
+            return f.read(self.line_length[row])
+
+    def raw_line(self, row: int) -> str:
+        """Decode the original line of a row from the source buffer."""
+        return self.raw_line_bytes(row).decode('utf-8', 'replace').strip()
+
+    def timestamp_datetime(self, row: int) -> datetime:
+        """Naive datetime of a row, as parse_log_line would produce it."""
+        return NAIVE_EPOCH + timedelta(seconds=self.timestamp[row])
+
+    def entry(self, row: int, with_raw_line: bool = True) -> LogEntry:
+        """Materialize one row as a LogEntry."""
+        d = self.dictionary
+        sport, dport = self.sport[row], self.dport[row]
+        length, ttl = self.length[row], self.ttl[row]
+        return LogEntry(
+            timestamp=self.timestamp_datetime(row),
+            router=d.routers[self.router[row]],
+            prefix=d.prefixes[self.prefix[row]],
+            protocol=d.protocols[self.protocol[row]],
+            source_ip=socket.inet_ntoa(self.src[row].to_bytes(4, 'big')),
+            dest_ip=socket.inet_ntoa(self.dst[row].to_bytes(4, 'big')),
+            source_port=sport if sport != MISSING else None,
+            dest_port=dport if dport != MISSING else None,
+            interface_in=d.interfaces[self.interface_in[row]],
+            interface_out=d.interfaces[self.interface_out[row]],
+            packet_length=length if length != MISSING else None,
+            ttl=ttl if ttl != MISSING else None,
+            action=ACTIONS[self.action[row]],
+            raw_line=self.raw_line(row) if with_raw_line else ""
+        )
+
+    def entries(self, rows: Optional[Iterator[int]] = None, with_raw_line: bool = True) -> List[LogEntry]:
+        """Materialize rows (default: all) as LogEntry objects."""
+        if rows is None:
+            rows = range(len(self))
+        return [self.entry(row, with_raw_line) for row in rows]
+
+    def close(self):
+        """Release the source buffer; raw lines are then re-read from the file."""
+        if isinstance(self._buffer, mmap.mmap):
+            self._buffer.close()
+        self._buffer = None
+
+
+def map_chunks(chunk_function: Callable[[int, int], Any], bounds: List[Tuple[int, int]],
+               workers: int = 1) -> List[Any]:
+    """
+    chunk_function(start, end) for every row range, in forked workers if enabled.
+
+    chunk_function (typically closing over a ColumnarLogBatch) is handed to
+    the workers as Pool initializer argument, which fork passes on without
+    pickling; only row ranges and results cross the pipes. Nothing is kept
+    in the calling process, so concurrent calls from several threads are safe.
+
+    Args:
+        chunk_function: Callable taking (start, end) row bounds
+        bounds: Row ranges to evaluate
+        workers: Processes evaluating ranges in parallel (1 evaluates in
+                 the calling process, as does a platform without fork)
+
+    Returns:
+        Results in bounds order
+    """
+    if workers > 1 and len(bounds) > 1 and 'fork' in multiprocessing.get_all_start_methods():
+        with multiprocessing.get_context('fork').Pool(min(workers, len(bounds)), initializer=_set_worker_chunk_function,
+                                                      initargs=(chunk_function,)) as pool:
+            return pool.map(_run_worker_chunk, bounds)
+    return [chunk_function(start, end) for start, end in bounds]
+
+
+# Chunk function of a map_chunks worker process (set by its Pool initializer)
+_worker_chunk_function = None
+
+
+def _set_worker_chunk_function(chunk_function: Callable[[int, int], Any]):
+    global _worker_chunk_function
+    _worker_chunk_function = chunk_function
+
+
+def _run_worker_chunk(bounds: Tuple[int, int]) -> Any:
+    return _worker_chunk_function(*bounds)
+
+
+class ColumnarLogParser:
+    """
+    mmap based iptables log parser producing ColumnarLogBatch objects.
+
+    One parser keeps one LogDictionary, so ids are comparable across all
+    batches and files it parses.
+    """
+
+    # Timestamps and addresses are not interned; their conversion caches are
+    # dropped when they reach this many entries so a long-lived parser stays bounded
+    CONVERSION_CACHE_LIMIT = 1 << 16
+
+    def __init__(self, year: Optional[int] = None, verbose: bool = False):
+        """
+        Args:
+            year: Year for syslog timestamps without one (default: current year,
+                  matching IptablesLogProcessor.parse_log_line)
+            verbose: Print parse statistics to stderr
+        """
+        self.year = year if year is not None else datetime.now().year
+        self.verbose = verbose
+        self.dictionary = LogDictionary()
+        self._timestamp_cache: Dict[bytes, int] = {}
+        self._day_cache: Dict[Tuple[bytes, bytes], int] = {}
+        self._ip_cache: Dict[bytes, Optional[int]] = {}
+        self._router_cache: Dict[bytes, int] = {}
+        self._prefix_cache: Dict[bytes, int] = {}
+        self._interface_cache: Dict[bytes, int] = {b'': 0}
+        self._protocol_cache: Dict[bytes, int] = {}
+
+    def parse_file(self, log_file: Union[str, Path], router_name: Optional[str] = None) -> ColumnarLogBatch:
+        """
+        Parse a whole log file into a single batch.
+
+        Args:
+            log_file: Kernel log or syslog file
+            router_name: Router for all rows (default: the syslog hostname)
+
+        Raises:
+            FileNotFoundError: If the file does not exist
+        """
+        batches = list(self.iter_file_batches(log_file, router_name, batch_rows=None))
+        return batches[0]
+
+    def iter_file_batches(self, log_file: Union[str, Path], router_name: Optional[str] = None,
+                          batch_rows: Optional[int] = 1_000_000) -> Iterator[ColumnarLogBatch]:
+        """
+        Parse a log file into batches of at most batch_rows rows.
+
+        Batches keep the mmap alive for raw_line(); it is released when the
+        last batch referencing it is garbage collected or closed.
+        """
+        path = str(log_file)
+        started = time.perf_counter()
+        with open(path, 'rb') as f:
+            size = f.seek(0, 2)
+            if size == 0:
+                yield ColumnarLogBatch(self.dictionary, None, path)
+                return
+            buffer = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        rows = 0
+        for batch in self.iter_buffer_batches(buffer, router_name, batch_rows, path):
+            rows += len(batch)
+            yield batch
+        if self.verbose:
+            elapsed = time.perf_counter() - started
+            print(f"Parsed {rows} rows from {path} ({size / 1e6:.1f} MB) in {elapsed:.2f}s", file=sys.stderr)
+
+    def parse_bytes(self, data: bytes, router_name: Optional[str] = None) -> ColumnarLogBatch:
+        """Parse an in-memory log buffer (e.g. dmesg or journalctl output)."""
+        batches = list(self.iter_buffer_batches(data, router_name, None))
+        return batches[0]
+
+    def iter_buffer_batches(self, buffer, router_name: Optional[str] = None,
+                            batch_rows: Optional[int] = None,
+                            source: Optional[str] = None) -> Iterator[ColumnarLogBatch]:
+        """Scan a bytes-like buffer, yielding batches of at most batch_rows rows.
+
+        Field values repeat heavily in logs, so every conversion (timestamp,
+        address, interning) goes through a bytes-keyed cache and each distinct
+        value is decoded once per parser (timestamps and addresses at least
+        once per CONVERSION_CACHE_LIMIT distinct values).
+        """
+        d = self.dictionary
+        cache_limit = self.CONVERSION_CACHE_LIMIT
+        fixed_router = d.routers.intern(router_name) if router_name else None
+        timestamp_cache = self._timestamp_cache
+        ip_cache = self._ip_cache
+        router_cache = self._router_cache
+        prefix_cache = self._prefix_cache
+        interface_cache = self._interface_cache
+        protocol_cache = self._protocol_cache
+        prefix_actions = d.prefix_actions
+
+        batch = ColumnarLogBatch(d, buffer, source)
+        for match in _LINE_PATTERN.finditer(buffer):
+            (ts, host, prefix, in_if, out_if, src, dst, length, ttl,
+             protocol, sport, dport) = match.groups()
+
+            src_int = ip_cache.get(src, False)
+            if src_int is False:
+                if len(ip_cache) >= cache_limit:
+                    ip_cache.clear()
+                src_int = ip_cache[src] = self._ip_to_int(src)
+            dst_int = ip_cache.get(dst, False)
+            if dst_int is False:
+                if len(ip_cache) >= cache_limit:
+                    ip_cache.clear()
+                dst_int = ip_cache[dst] = self._ip_to_int(dst)
+            if src_int is None or dst_int is None:
+                batch.skipped += 1
+                continue
+
+            epoch = timestamp_cache.get(ts)
+            if epoch is None:
+                if len(timestamp_cache) >= cache_limit:
+                    timestamp_cache.clear()
+                epoch = timestamp_cache[ts] = self._epoch(ts)
+            if fixed_router is not None:
+                router_id = fixed_router
+            else:
+                router_id = router_cache.get(host)
+                if router_id is None:
+                    router_id = router_cache[host] = d.routers.intern(host.decode('utf-8', 'replace'))
+            prefix_id = prefix_cache.get(prefix)
+            if prefix_id is None:
+                prefix_id = prefix_cache[prefix] = d.intern_prefix(prefix.decode('utf-8', 'replace'))
+            in_id = interface_cache.get(in_if)
+            if in_id is None:
+                in_id = interface_cache[in_if] = d.interfaces.intern(in_if.decode('utf-8', 'replace'))
+            out_id = interface_cache.get(out_if)
+            if out_id is None:
+                out_id = interface_cache[out_if] = d.interfaces.intern(out_if.decode('utf-8', 'replace'))
+            protocol_id = protocol_cache.get(protocol)
+            if protocol_id is None:
+                protocol_id = protocol_cache[protocol] = d.protocols.intern(
+                    protocol.decode('utf-8', 'replace').lower())
+
+            batch.timestamp.append(epoch)
+            batch.router.append(router_id)
+            batch.prefix.append(prefix_id)
+            batch.action.append(prefix_actions[prefix_id])
+            batch.protocol.append(protocol_id)
+            batch.src.append(src_int)
+            batch.dst.append(dst_int)
+            batch.sport.append(int(sport) if sport is not None else MISSING)
+            batch.dport.append(int(dport) if dport is not None else MISSING)
+            batch.interface_in.append(in_id)
+            batch.interface_out.append(out_id)
+            batch.length.append(int(length) if length is not None else MISSING)
+            batch.ttl.append(int(ttl) if ttl is not None else MISSING)
+            start = match.start()
+            batch.offset.append(start)
+            batch.line_length.append(match.end() - start)
+
+            if batch_rows is not None and len(batch.timestamp) >= batch_rows:
+                yield batch
+                batch = ColumnarLogBatch(d, buffer, source)
+        yield batch
+
+    @staticmethod
+    def _ip_to_int(ip: bytes) -> Optional[int]:
+        """uint32 of a dotted IPv4 address, None for anything else."""
+        try:
+            text = ip.decode('ascii')
+            if text.count('.') != 3:
+                return None
+            return int.from_bytes(socket.inet_aton(text), 'big')
+        except (UnicodeDecodeError, OSError):
+            return None
+
+    def _epoch(self, timestamp: bytes) -> int:
+        """Seconds since the naive epoch for 'Mon DD HH:MM:SS' (current time if invalid)."""
+        try:
+            month, day, clock = timestamp.split()
+            hour, minute, second = map(int, clock.split(b':'))
+            if hour > 23 or minute > 59 or second > 59:
+                raise ValueError(timestamp)
+            key = (month, day)
+            day_start = self._day_cache.get(key)
+            if day_start is None:
+                month_number = _MONTHS.get(month[:1].upper() + month[1:].lower())
+                if month_number is None:
+                    raise ValueError(timestamp)
+                # Validates the day like strptime would (e.g. Feb 30 is rejected)
+                day_start = self._day_cache[key] = (
+                    datetime(self.year, month_number, int(day)) - NAIVE_EPOCH).days * 86400
+            return day_start + hour * 3600 + minute * 60 + second
+        except ValueError:
+            return int((datetime.now().replace(microsecond=0) - NAIVE_EPOCH).total_seconds())
+
+
+def main():
+    """Parse a log file and print column statistics."""
+    import argparse
+    import json
+
+    parser = argparse.ArgumentParser(description='Columnar iptables log parser')
+    parser.add_argument('log_file', help='Kernel log or syslog file')
+    parser.add_argument('--router', help='Router name for all rows (default: syslog hostname)')
+    parser.add_argument('--year', type=int, help='Year for syslog timestamps (default: current year)')
+    parser.add_argument('--show', type=int, default=0, help='Print the first N rows as JSON')
+    parser.add_argument('-v', '--verbose', action='store_true', help='Print timing to stderr')
+    args = parser.parse_args()
+
+    try:
+        log_parser = ColumnarLogParser(args.year, args.verbose)
+        batch = log_parser.parse_file(args.log_file, args.router)
+    except (FileNotFoundError, PermissionError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    d = log_parser.dictionary
+    print(json.dumps({
+        'rows': len(batch),
+        'skipped': batch.skipped,
+        'column_bytes': batch.nbytes,
+        'routers': len(d.routers) - 1,
+        'prefixes': len(d.prefixes) - 1,
+        'interfaces': len(d.interfaces) - 1,
+        'protocols': [p for p in d.protocols.values if p]
+    }, indent=2))
+    for row in range(min(args.show, len(batch))):
+        entry = batch.entry(row)
+        print(json.dumps({**entry.__dict__, 'timestamp': entry.timestamp.isoformat()}))
+
+
+if __name__ == '__main__':
+    main()
@@ -80,20 +80,26 @@ class IptablesLogProcessor:
         verbose_level (int): Verbosity level (1=basic, 2=detailed debugging)
         rule_database (Dict): Database of iptables rules for correlation
         routers (Set): Set of known router names
+        log_store: Optional LogStore answering get_recent_logs without reparsing
+        classifiers (Dict): Compiled iptables classifiers used for rule correlation
     """
     
-    def __init__(self, verbose: bool = False, verbose_level: int = 1):
+    def __init__(self, verbose: bool = False, verbose_level: int = 1, log_store=None):
         """
         Initialize iptables log processor.
         
         Args:
             verbose: Enable verbose output for debugging operations
             verbose_level: Verbosity level (1=basic, 2=detailed debugging)
+            log_store: LogStore (see iptables_log_store) fed by a LogTailer
         """
         self.verbose = verbose
         self.verbose_level = verbose_level
         self.rule_database: Dict[str, Dict] = {}
         self.routers: Set[str] = set()
+        self.log_store = log_store
+        self.classifiers: Dict[str, Any] = {}
+        self._correlator = None
         
         # Common iptables log patterns
         self.log_patterns = {
@@ -129,6 +135,11 @@ class IptablesLogProcessor:
         """Add a router to the known routers set."""
         self.routers.add(router_name)
     
+    def attach_classifier(self, classifier):
+        """Use a compiled IptablesClassifier to correlate the router's log entries with rules."""
+        self.classifiers[classifier.router_name] = classifier
+        self._correlator = None
+    
     def load_rule_database(self, rules_data: Dict[str, Any]):
         """Load iptables rules database for correlation."""
         self.rule_database = rules_data
@@ -237,6 +248,21 @@ class IptablesLogProcessor:
         
         return entries
     
+    def parse_logs_columnar(self, log_file: Path, router_name: str = None, year: int = None):
+        """
+        Parse a large log file into columnar arrays instead of LogEntry objects.
+        
+        Args:
+            log_file: Kernel log or syslog file (memory-mapped, not read into memory)
+            router_name: Router for all rows (default: syslog hostname)
+            year: Year for syslog timestamps (default: current year)
+            
+        Returns:
+            ColumnarLogBatch with one element per parsed line in every column
+        """
+        from tsim.analyzers.iptables_log_columnar import ColumnarLogParser
+        return ColumnarLogParser(year, self.verbose).parse_file(log_file, router_name)
+    
     def parse_logs_from_namespace(self, namespace: str, lines: int = 1000) -> List[LogEntry]:
         """Parse iptables logs from a network namespace using dmesg."""
         entries = []
@@ -369,8 +395,10 @@ class IptablesLogProcessor:
                 'raw_line': entry.raw_line
             }
             
-            # Try to correlate with rule database
-            if entry.router in self.rule_database:
+            # Correlate with the compiled classifier, else the rule database
+            if entry.router in self.classifiers:
+                entry_dict.update(self._classify_entry(entry))
+            elif entry.router in self.rule_database:
                 router_rules = self.rule_database[entry.router]
                 # Add rule correlation logic here
                 # This would match log entries to specific iptables rules
@@ -383,6 +411,24 @@ class IptablesLogProcessor:
         
         return correlated
     
+    def _classify_entry(self, entry: LogEntry) -> Dict[str, Any]:
+        """Rule correlation fields for one entry of a router with a classifier."""
+        from tsim.analyzers.iptables_classifier import ip_to_int
+        from tsim.analyzers.iptables_log_aggregate import RuleCorrelator
+        if self._correlator is None:
+            self._correlator = RuleCorrelator(self.classifiers)
+        src, dst = ip_to_int(entry.source_ip), ip_to_int(entry.dest_ip)
+        if src is None or dst is None:
+            return {'matched_rules': []}
+        log_rule, verdict = self._correlator.correlate_packet(
+            entry.router, src, entry.source_port, dst, entry.dest_port, entry.protocol, entry.prefix)
+        return {
+            'matched_rules': list(verdict.rule_ids),
+            'rule_id': log_rule or verdict.terminal_rule,
+            'decision': verdict.action,
+            'decision_rule': verdict.terminal_rule
+        }
+    
     def generate_report(self, entries: List[LogEntry], format: str = "text") -> str:
         """Generate a formatted report from log entries."""
         if format == "json":
@@ -445,9 +491,23 @@ class IptablesLogProcessor:
         
         return "\n".join(report)
     
-    def get_recent_logs(self, router_name: str = None, minutes: int = 60) -> List[LogEntry]:
-        """Get recent iptables logs from the last N minutes."""
+    def get_recent_logs(self, router_name: str = None, minutes: int = 60,
+                        address: str = None) -> List[LogEntry]:
+        """
+        Get recent iptables logs from the last N minutes.
+        
+        With a log store attached this is a segment lookup; otherwise all
+        log sources are re-read and parsed.
+        
+        Args:
+            router_name: Only logs of this router
+            minutes: Age limit
+            address: Only packets with this source or destination IP
+        """
         since = datetime.now() - timedelta(minutes=minutes)
+        if self.log_store is not None:
+            return self.log_store.query(since, router=router_name, address=address)
+        
         log_filter = LogFilter(
             router=router_name,
             time_start=since
@@ -485,6 +545,8 @@ class IptablesLogProcessor:
         unique_entries = []
         for entry in filtered_entries:
             key = (entry.timestamp, entry.raw_line)
+            if address and address not in (entry.source_ip, entry.dest_ip):
+                continue
             if key not in seen:
                 seen.add(key)
                 unique_entries.append(entry)
@@ -503,13 +565,19 @@ def main():
     parser.add_argument('--router', help='Router filter')
     parser.add_argument('--port', type=int, help='Destination port filter')
     parser.add_argument('--minutes', type=int, default=60, help='Minutes of recent logs')
+    parser.add_argument('--store', help='Read recent logs from a log store directory (iptables_log_store)')
     parser.add_argument('--format', choices=['text', 'json'], default='text', help='Output format')
     parser.add_argument('-v', '--verbose', action='count', default=0, help='Increase verbosity')
     
     args = parser.parse_args()
     
     # Create processor
-    processor = IptablesLogProcessor(verbose=args.verbose >= 1, verbose_level=args.verbose)
+    log_store = None
+    if args.store:
+        from tsim.analyzers.iptables_log_store import LogStore
+        log_store = LogStore(args.store, readonly=True)
+    processor = IptablesLogProcessor(verbose=args.verbose >= 1, verbose_level=args.verbose,
+                                     log_store=log_store)
     
     # Create filter
     log_filter = LogFilter(
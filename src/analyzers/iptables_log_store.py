@@ -0,0 +1,888 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Time-indexed on-disk iptables log store
+
+Append-only store of parsed iptables log records, so "last N minutes for
+router X involving 10.1.2.3" is answered by skipping whole segments and
+scanning a short record range instead of re-reading and re-parsing kernel
+logs for every query.
+
+Records are fixed-size binary rows written to numbered segments. Each
+segment keeps its minimum/maximum timestamp, the set of routers it
+contains and a bloom filter over source/destination addresses; segments
+that cannot contain a match are skipped without being opened, and within
+a time-ordered segment the first candidate row is found by binary search.
+Strings (routers, prefixes, interfaces, protocols) are stored once in an
+append-only dictionary log and referenced by id.
+
+A LogTailer follows log files (inotify via ctypes, polling where inotify
+is unavailable), parses new complete lines with ColumnarLogParser and
+appends them to the store, surviving truncation and rotation.
+
+Store layout:
+    format.json                Record format version of the store
+    dictionary.log             One JSON [table, value] line per interned string
+    segment-NNNNNNNN.rows      Fixed-size records
+    segment-NNNNNNNN.lines     Raw log lines referenced by the records
+    segment-NNNNNNNN.json      Segment index, written when the segment is sealed
+    tail-state.json            Inode and offset per tailed file
+
+Key Features:
+- Append-only segments with per-segment time range, router set and address bloom filter
+- Binary search within time-ordered segments
+- Single writer (flock), any number of concurrent readers
+- Crash recovery: partial records are truncated, unsealed segments re-indexed
+- Tailing ingester with rotation/truncation handling and persisted offsets
+- Retention by dropping whole segments
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import argparse
+import base64
+import ctypes
+import ctypes.util
+import errno
+import fcntl
+import json
+import math
+import mmap
+import operator
+import os
+import select
+import socket
+import struct
+import sys
+import threading
+from bisect import bisect_left
+from dataclasses import dataclass, field
+from datetime import datetime, timedelta
+from itertools import islice
+from pathlib import Path
+from typing import Any, Dict, Iterable, List, Optional, Set, Tuple, Union
+
+from tsim.analyzers.iptables_log_columnar import (
+    ACTIONS, MISSING, NAIVE_EPOCH, ColumnarLogBatch, ColumnarLogParser, LogDictionary
+)
+from tsim.analyzers.iptables_log_processor import LogEntry
+
+
+# timestamp, src, dst, prefix, router, interface_in, interface_out, protocol,
+# action, sport, dport, length, ttl, line_offset, line_length
+_RECORD = struct.Struct('<qIIIIIIIBiiiiQI')
+
+# Bumped whenever _RECORD changes; version 1 stored router/interface ids as
+# uint16 and protocol ids as uint8
+FORMAT_VERSION = 2
+
+DEFAULT_SEGMENT_ROWS = 262144
+
+
+def _to_epoch(value: datetime) -> float:
+    """Seconds since the naive epoch used by ColumnarLogBatch timestamps."""
+    return (value - NAIVE_EPOCH).total_seconds()
+
+
+def _ip_to_int(address: str) -> int:
+    """uint32 of a dotted IPv4 address.
+
+    Raises:
+        ValueError: If address is not an IPv4 address
+    """
+    try:
+        if address.count('.') == 3:
+            return int.from_bytes(socket.inet_aton(address), 'big')
+    except OSError:
+        pass
+    raise ValueError(f"Invalid IPv4 address: {address}")
+
+
+class AddressBloom:
+    """Bloom filter over IPv4 addresses (uint32), double hashing."""
+
+    def __init__(self, bits: int = 1 << 17, hashes: int = 4, data: Optional[bytes] = None):
+        self.bits = bits
+        self.hashes = hashes
+        self.data = bytearray(bits // 8) if data is None else bytearray(data)
+
+    def _positions(self, address: int) -> List[int]:
+        h1 = (address * 0x9E3779B97F4A7C15) & 0xFFFFFFFFFFFFFFFF
+        h2 = (((address ^ (address >> 16)) * 0x85EBCA6B) & 0xFFFFFFFF) | 1
+        return [(h1 + i * h2) % self.bits for i in range(self.hashes)]
+
+    def add(self, address: int):
+        data = self.data
+        for position in self._positions(address):
+            data[position >> 3] |= 1 << (position & 7)
+
+    def update(self, addresses: Iterable[int]):
+        for address in addresses:
+            self.add(address)
+
+    def __contains__(self, address: int) -> bool:
+        data = self.data
+        return all(data[position >> 3] & (1 << (position & 7)) for position in self._positions(address))
+
+
+@dataclass
+class SegmentInfo:
+    """Index of one segment."""
+    number: int
+    rows: int = 0
+    min_timestamp: Optional[int] = None
+    max_timestamp: Optional[int] = None
+    time_ordered: bool = True
+    routers: Set[int] = field(default_factory=set)
+    bloom: AddressBloom = field(default_factory=AddressBloom)
+    line_bytes: int = 0
+    sealed: bool = False
+
+    def absorb(self, timestamps, routers: Iterable[int], addresses: Iterable[int], line_bytes: int):
+        """Account for appended records (columns of equal length)."""
+        if not len(timestamps):
+            return
+        if self.time_ordered:
+            self.time_ordered = (
+                (self.max_timestamp is None or timestamps[0] >= self.max_timestamp)
+                and all(map(operator.le, timestamps, islice(timestamps, 1, None))))
+        low, high = min(timestamps), max(timestamps)
+        self.min_timestamp = low if self.min_timestamp is None else min(self.min_timestamp, low)
+        self.max_timestamp = high if self.max_timestamp is None else max(self.max_timestamp, high)
+        self.routers.update(routers)
+        self.bloom.update(set(addresses))
+        self.rows += len(timestamps)
+        self.line_bytes += line_bytes
+
+    def overlaps(self, low: Optional[int], high: Optional[int]) -> bool:
+        """Whether the segment may hold timestamps in [low, high]."""
+        if self.rows == 0:
+            return False
+        if low is not None and self.max_timestamp < low:
+            return False
+        return high is None or self.min_timestamp <= high
+
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        return {
+            'number': self.number,
+            'rows': self.rows,
+            'min_timestamp': self.min_timestamp,
+            'max_timestamp': self.max_timestamp,
+            'time_ordered': self.time_ordered,
+            'routers': sorted(self.routers),
+            'bloom_bits': self.bloom.bits,
+            'bloom_hashes': self.bloom.hashes,
+            'bloom': base64.b64encode(bytes(self.bloom.data)).decode('ascii'),
+            'line_bytes': self.line_bytes
+        }
+
+    @classmethod
+    def from_dict(cls, data: Dict[str, Any]) -> 'SegmentInfo':
+        return cls(
+            number=data['number'], rows=data['rows'],
+            min_timestamp=data['min_timestamp'], max_timestamp=data['max_timestamp'],
+            time_ordered=data['time_ordered'], routers=set(data['routers']),
+            bloom=AddressBloom(data['bloom_bits'], data['bloom_hashes'], base64.b64decode(data['bloom'])),
+            line_bytes=data['line_bytes'], sealed=True
+        )
+
+
+class _TimestampView:
+    """Sequence view of the timestamp field of mapped records, for bisect."""
+
+    def __init__(self, buffer, rows: int):
+        self.buffer = buffer
+        self.rows = rows
+
+    def __len__(self) -> int:
+        return self.rows
+
+    def __getitem__(self, index: int) -> int:
+        return struct.unpack_from('<q', self.buffer, index * _RECORD.size)[0]
+
+
+class LogStore:
+    """
+    Segment store of parsed iptables log records.
+
+    Open with readonly=False in exactly one process (the ingester); readers
+    call query(), which picks up records appended by the writer.
+    """
+
+    def __init__(self, directory: Union[str, Path], readonly: bool = False,
+                 segment_rows: int = DEFAULT_SEGMENT_ROWS, verbose: bool = False):
+        """
+        Raises:
+            FileNotFoundError: If a read-only store does not exist
+            RuntimeError: If another process has the store open for writing,
+                          or the store was written in another record format
+        """
+        self.directory = Path(directory)
+        self.readonly = readonly
+        self.segment_rows = segment_rows
+        self.verbose = verbose
+        self.dictionary = LogDictionary()
+        self.segments: Dict[int, SegmentInfo] = {}
+        self.last_scan: Dict[str, int] = {}
+        self._dictionary_offset = 0
+        self._lock_file = None
+        self._dictionary_out = None
+        self._rows_out = None
+        self._lines_out = None
+        self._active: Optional[SegmentInfo] = None
+        self._id_maps: Dict[Tuple[int, str], Tuple[LogDictionary, List[int]]] = {}
+
+        if readonly:
+            if not self.directory.is_dir():
+                raise FileNotFoundError(f"Log store not found: {self.directory}")
+        else:
+            self.directory.mkdir(parents=True, exist_ok=True)
+            self._lock_file = open(self.directory / 'store.lock', 'a')
+            try:
+                fcntl.flock(self._lock_file.fileno(), fcntl.LOCK_EX | fcntl.LOCK_NB)
+            except BlockingIOError:
+                self._lock_file.close()
+                raise RuntimeError(f"Log store {self.directory} is open for writing by another process")
+        try:
+            self._check_format()
+        except RuntimeError:
+            if self._lock_file is not None:
+                self._lock_file.close()
+            raise
+        self.refresh()
+        if not readonly:
+            self._open_writer()
+
+    # File helpers
+
+    def _path(self, number: int, suffix: str) -> Path:
+        return self.directory / f"segment-{number:08d}.{suffix}"
+
+    def _check_format(self):
+        """Stamp a new store with FORMAT_VERSION, refuse stores written in another format.
+
+        Raises:
+            RuntimeError: If the store holds records of another format version
+        """
+        path = self.directory / 'format.json'
+        if path.exists():
+            with open(path) as f:
+                version = json.load(f)['version']
+        elif any(self.directory.glob('segment-*.rows')):
+            version = 1
+        else:
+            if not self.readonly:
+                with open(path, 'w') as f:
+                    json.dump({'version': FORMAT_VERSION}, f)
+            return
+        if version != FORMAT_VERSION:
+            raise RuntimeError(f"Log store {self.directory} has record format {version}, "
+                               f"expected {FORMAT_VERSION}; ingest into a new store")
+
+    def refresh(self):
+        """Load dictionary additions and new or grown segments from disk."""
+        path = self.directory / 'dictionary.log'
+        if path.exists():
+            with open(path, 'rb') as f:
+                f.seek(self._dictionary_offset)
+                data = f.read()
+            complete = data.rfind(b'\n') + 1
+            for line in data[:complete].splitlines():
+                table, value = json.loads(line)
+                if table == 'prefixes':
+                    self.dictionary.intern_prefix(value)
+                else:
+                    getattr(self.dictionary, table).intern(value)
+            self._dictionary_offset += complete
+
+        present = set()
+        for rows_path in sorted(self.directory.glob('segment-*.rows')):
+            number = int(rows_path.stem.split('-')[1])
+            present.add(number)
+            info = self.segments.get(number)
+            if info is not None and info.sealed:
+                continue
+            index_path = self._path(number, 'json')
+            if index_path.exists():
+                with open(index_path) as f:
+                    self.segments[number] = SegmentInfo.from_dict(json.load(f))
+                continue
+            if info is None:
+                info = self.segments[number] = SegmentInfo(number)
+            self._index_new_records(info)
+        for number in set(self.segments) - present:
+            del self.segments[number]     # Expired by the writer
+
+    def _index_new_records(self, info: SegmentInfo):
+        """Absorb records written beyond info.rows (unsealed segments)."""
+        with open(self._path(info.number, 'rows'), 'rb') as f:
+            f.seek(info.rows * _RECORD.size)
+            data = f.read()
+        data = data[:len(data) - len(data) % _RECORD.size]
+        if not data:
+            return
+        records = list(_RECORD.iter_unpack(data))
+        last = records[-1]
+        info.absorb([r[0] for r in records], {r[4] for r in records},
+                    [r[1] for r in records] + [r[2] for r in records],
+                    last[13] + last[14] + 1 - info.line_bytes)
+
+    def _open_writer(self):
+        """Seal interrupted segments, truncate partial records and open the active segment."""
+        numbers = sorted(self.segments)
+        for number in numbers[:-1]:
+            if not self.segments[number].sealed:
+                self._seal(self.segments[number])
+        if numbers and not self.segments[numbers[-1]].sealed:
+            self._active = self.segments[numbers[-1]]
+            os.truncate(self._path(self._active.number, 'rows'), self._active.rows * _RECORD.size)
+            os.truncate(self._path(self._active.number, 'lines'), self._active.line_bytes)
+        else:
+            self._start_segment((numbers[-1] + 1) if numbers else 1)
+        dictionary_path = self.directory / 'dictionary.log'
+        if dictionary_path.exists():
+            os.truncate(dictionary_path, self._dictionary_offset)
+        self._dictionary_out = open(dictionary_path, 'ab')
+        self._open_active_files()
+
+    def _start_segment(self, number: int):
+        self._active = self.segments[number] = SegmentInfo(number)
+        self._path(number, 'rows').touch()
+        self._path(number, 'lines').touch()
+
+    def _open_active_files(self):
+        self._rows_out = open(self._path(self._active.number, 'rows'), 'ab')
+        self._lines_out = open(self._path(self._active.number, 'lines'), 'ab')
+
+    def _seal(self, info: SegmentInfo):
+        """Write the segment index; the segment is immutable afterwards."""
+        index_path = self._path(info.number, 'json')
+        temp_path = index_path.with_suffix('.json.tmp')
+        with open(temp_path, 'w') as f:
+            json.dump(info.to_dict(), f)
+        os.replace(temp_path, index_path)
+        info.sealed = True
+
+    # Writing
+
+    def _intern(self, table: str, value: Optional[str]) -> int:
+        """Store id of a string, logging new values to the dictionary."""
+        ident = getattr(self.dictionary, table).lookup(value)
+        if ident is None:
+            if table == 'prefixes':
+                ident = self.dictionary.intern_prefix(value)
+            else:
+                ident = getattr(self.dictionary, table).intern(value)
+            self._dictionary_out.write(json.dumps([table, value]).encode('utf-8') + b'\n')
+        return ident
+
+    def _id_map(self, source: LogDictionary, table: str) -> List[int]:
+        """Batch id -> store id for one table, extended as the source grows."""
+        key = (id(source), table)
+        cached = self._id_maps.get(key)
+        if cached is None or cached[0] is not source:
+            cached = self._id_maps[key] = (source, [])
+        mapping = cached[1]
+        values = getattr(source, table).values
+        for value in values[len(mapping):]:
+            mapping.append(self._intern(table, value))
+        return mapping
+
+    def append_batch(self, batch: ColumnarLogBatch) -> int:
+        """
+        Append all rows of a batch, rolling over to new segments as needed.
+
+        Returns:
+            Number of rows appended
+
+        Raises:
+            PermissionError: If the store is read-only
+        """
+        if self.readonly:
+            raise PermissionError(f"Log store {self.directory} is read-only")
+        routers = self._id_map(batch.dictionary, 'routers')
+        prefixes = self._id_map(batch.dictionary, 'prefixes')
+        interfaces = self._id_map(batch.dictionary, 'interfaces')
+        protocols = self._id_map(batch.dictionary, 'protocols')
+        self._dictionary_out.flush()
+
+        pack = _RECORD.pack
+        total = len(batch)
+        start = 0
+        while start < total:
+            if self._active.rows >= self.segment_rows:
+                self._roll_over()
+            end = min(total, start + self.segment_rows - self._active.rows)
+            records = bytearray()
+            lines = bytearray()
+            line_offset = self._active.line_bytes
+            router_ids = [routers[r] for r in batch.router[start:end]]
+            for row in range(start, end):
+                line = batch.raw_line_bytes(row).strip() + b'\n'
+                records += pack(
+                    batch.timestamp[row], batch.src[row], batch.dst[row], prefixes[batch.prefix[row]],
+                    router_ids[row - start], interfaces[batch.interface_in[row]],
+                    interfaces[batch.interface_out[row]], protocols[batch.protocol[row]],
+                    batch.action[row], batch.sport[row], batch.dport[row], batch.length[row],
+                    batch.ttl[row], line_offset + len(lines), len(line) - 1)
+                lines += line
+            self._lines_out.write(lines)
+            self._rows_out.write(records)
+            self._active.absorb(batch.timestamp[start:end], router_ids,
+                                batch.src[start:end] + batch.dst[start:end], len(lines))
+            start = end
+        self.flush()
+        return total
+
+    def _roll_over(self):
+        self.flush()
+        self._rows_out.close()
+        self._lines_out.close()
+        self._seal(self._active)
+        self._start_segment(self._active.number + 1)
+        self._open_active_files()
+
+    def flush(self):
+        """Make appended records visible to readers (dictionary first)."""
+        if self._dictionary_out is not None:
+            self._dictionary_out.flush()
+            self._lines_out.flush()
+            self._rows_out.flush()
+
+    def expire(self, before: datetime) -> int:
+        """
+        Delete sealed segments whose newest record is older than before.
+
+        Returns:
+            Number of segments deleted
+        """
+        if self.readonly:
+            raise PermissionError(f"Log store {self.directory} is read-only")
+        limit = _to_epoch(before)
+        expired = [info for info in self.segments.values()
+                   if info.sealed and info.rows and info.max_timestamp < limit]
+        for info in expired:
+            for suffix in ('json', 'rows', 'lines'):
+                self._path(info.number, suffix).unlink(missing_ok=True)
+            del self.segments[info.number]
+        return len(expired)
+
+    def close(self):
+        """Flush and release the writer lock."""
+        if self._dictionary_out is not None:
+            self.flush()
+            for handle in (self._dictionary_out, self._rows_out, self._lines_out):
+                handle.close()
+            self._dictionary_out = self._rows_out = self._lines_out = None
+        if self._lock_file is not None:
+            self._lock_file.close()
+            self._lock_file = None
+
+    def __enter__(self) -> 'LogStore':
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+    # Reading
+
+    @property
+    def rows(self) -> int:
+        return sum(info.rows for info in self.segments.values())
+
+    def query(self, since: Optional[datetime] = None, until: Optional[datetime] = None,
+              router: Optional[str] = None, address: Optional[str] = None,
+              limit: Optional[int] = None) -> List[LogEntry]:
+        """
+        Records in a time range, optionally for one router and/or involving
+        one address (as source or destination).
+
+        Args:
+            since: Oldest timestamp (inclusive)
+            until: Newest timestamp (inclusive)
+            router: Router name
+            address: IPv4 address matched against source and destination
+            limit: Return only the newest limit entries
+
+        Returns:
+            LogEntry objects sorted by timestamp
+
+        Raises:
+            ValueError: If address is not an IPv4 address
+        """
+        if self.readonly:
+            self.refresh()
+        else:
+            self.flush()
+        low = math.ceil(_to_epoch(since)) if since is not None else None
+        high = math.floor(_to_epoch(until)) if until is not None else None
+        address_int = _ip_to_int(address) if address else None
+        router_id = None
+        if router:
+            router_id = self.dictionary.routers.lookup(router)
+            if router_id is None:
+                self.last_scan = {'segments': len(self.segments), 'segments_scanned': 0, 'rows_scanned': 0}
+                return []
+
+        entries: List[LogEntry] = []
+        scanned = rows_scanned = 0
+        for number in sorted(self.segments):
+            info = self.segments[number]
+            if not info.overlaps(low, high):
+                continue
+            if router_id is not None and router_id not in info.routers:
+                continue
+            if address_int is not None and address_int not in info.bloom:
+                continue
+            scanned += 1
+            rows_scanned += self._scan(info, low, high, router_id, address_int, entries)
+
+        self.last_scan = {'segments': len(self.segments), 'segments_scanned': scanned,
+                          'rows_scanned': rows_scanned}
+        if self.verbose:
+            print(f"Log store query: {scanned}/{len(self.segments)} segments, "
+                  f"{rows_scanned} rows scanned, {len(entries)} matches", file=sys.stderr)
+        entries.sort(key=lambda e: e.timestamp)
+        if limit is not None:
+            entries = entries[-limit:] if limit > 0 else []
+        return entries
+
+    def _scan(self, info: SegmentInfo, low: Optional[int], high: Optional[int],
+              router_id: Optional[int], address: Optional[int], entries: List[LogEntry]) -> int:
+        """Append matching records of one segment to entries; returns rows scanned."""
+        with open(self._path(info.number, 'rows'), 'rb') as f:
+            rows = min(info.rows, os.fstat(f.fileno()).st_size // _RECORD.size)
+            if rows == 0:
+                return 0
+            start = 0
+            if info.time_ordered and low is not None:
+                with mmap.mmap(f.fileno(), rows * _RECORD.size, access=mmap.ACCESS_READ) as buffer:
+                    start = bisect_left(_TimestampView(buffer, rows), low)
+            f.seek(start * _RECORD.size)
+            data = f.read((rows - start) * _RECORD.size)
+
+        matches = []
+        scanned = 0
+        stop_at_high = info.time_ordered and high is not None
+        for record in _RECORD.iter_unpack(data):
+            scanned += 1
+            timestamp = record[0]
+            if high is not None and timestamp > high:
+                if stop_at_high:
+                    break
+                continue
+            if low is not None and timestamp < low:
+                continue
+            if router_id is not None and record[4] != router_id:
+                continue
+            if address is not None and record[1] != address and record[2] != address:
+                continue
+            matches.append(record)
+        if matches:
+            with open(self._path(info.number, 'lines'), 'rb') as f:
+                for record in matches:
+                    f.seek(record[13])
+                    entries.append(self._entry(record, f.read(record[14])))
+        return scanned
+
+    def _entry(self, record: Tuple, line: bytes) -> LogEntry:
+        (timestamp, src, dst, prefix, router, interface_in, interface_out, protocol,
+         action, sport, dport, length, ttl, _, _) = record
+        d = self.dictionary
+        return LogEntry(
+            timestamp=NAIVE_EPOCH + timedelta(seconds=timestamp),
+            router=d.routers[router],
+            prefix=d.prefixes[prefix],
+            protocol=d.protocols[protocol],
+            source_ip=socket.inet_ntoa(src.to_bytes(4, 'big')),
+            dest_ip=socket.inet_ntoa(dst.to_bytes(4, 'big')),
+            source_port=sport if sport != MISSING else None,
+            dest_port=dport if dport != MISSING else None,
+            interface_in=d.interfaces[interface_in],
+            interface_out=d.interfaces[interface_out],
+            packet_length=length if length != MISSING else None,
+            ttl=ttl if ttl != MISSING else None,
+            action=ACTIONS[action],
+            raw_line=line.decode('utf-8', 'replace')
+        )
+
+
+class _Inotify:
+    """Minimal inotify binding (ctypes) reporting changed file names per directory."""
+
+    IN_MODIFY = 0x00000002
+    IN_CLOSE_WRITE = 0x00000008
+    IN_MOVED_FROM = 0x00000040
+    IN_MOVED_TO = 0x00000080
+    IN_CREATE = 0x00000100
+    IN_DELETE = 0x00000200
+    IN_NONBLOCK = 0o4000
+    IN_CLOEXEC = 0o2000000
+    _EVENT = struct.Struct('iIII')
+
+    def __init__(self):
+        """
+        Raises:
+            OSError: If inotify is not available
+        """
+        libc = ctypes.CDLL(ctypes.util.find_library('c'), use_errno=True)
+        if not hasattr(libc, 'inotify_init1'):
+            raise OSError(errno.ENOSYS, "inotify not supported")
+        self._libc = libc
+        self.fd = libc.inotify_init1(self.IN_NONBLOCK | self.IN_CLOEXEC)
+        if self.fd < 0:
+            code = ctypes.get_errno()
+            raise OSError(code, os.strerror(code))
+        self._directories: Dict[int, str] = {}
+
+    def watch_directory(self, directory: str):
+        mask = (self.IN_MODIFY | self.IN_CLOSE_WRITE | self.IN_MOVED_FROM | self.IN_MOVED_TO
+                | self.IN_CREATE | self.IN_DELETE)
+        wd = self._libc.inotify_add_watch(self.fd, os.fsencode(directory), mask)
+        if wd < 0:
+            code = ctypes.get_errno()
+            raise OSError(code, f"{os.strerror(code)}: {directory}")
+        self._directories[wd] = directory
+
+    def wait(self, timeout: float) -> Set[str]:
+        """Paths of files changed within timeout seconds (empty on timeout)."""
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        changed: Set[str] = set()
+        if not ready:
+            return changed
+        while True:
+            try:
+                data = os.read(self.fd, 65536)
+            except BlockingIOError:
+                break
+            offset = 0
+            while offset + self._EVENT.size <= len(data):
+                wd, _, _, length = self._EVENT.unpack_from(data, offset)
+                offset += self._EVENT.size
+                name = data[offset:offset + length].rstrip(b'\0')
+                offset += length
+                directory = self._directories.get(wd)
+                if directory is not None and name:
+                    changed.add(os.path.join(directory, os.fsdecode(name)))
+        return changed
+
+    def close(self):
+        if self.fd >= 0:
+            os.close(self.fd)
+            self.fd = -1
+
+
+@dataclass
+class _TailedFile:
+    path: str
+    handle: Optional[Any] = None
+    inode: Optional[int] = None
+    offset: int = 0
+
+
+class LogTailer:
+    """
+    Follows log files and appends new iptables records to a LogStore.
+
+    Offsets are persisted in the store directory after each append, so a
+    restarted tailer continues where it stopped (a crash between the two
+    can re-ingest the last read). A rotated file is read to its end before
+    the new file is opened; a truncated file is re-read from the start.
+    """
+
+    def __init__(self, store: LogStore, paths: Iterable[Union[str, Path]],
+                 router_name: Optional[str] = None, from_start: bool = True,
+                 poll_interval: float = 1.0, read_size: int = 64 * 1024 * 1024,
+                 verbose: bool = False):
+        """
+        Args:
+            store: Writable store
+            paths: Log files to follow (need not exist yet)
+            router_name: Router for all rows (default: the syslog hostname)
+            from_start: Ingest existing content of files seen for the first time
+            poll_interval: Seconds between polls (safety interval with inotify)
+            read_size: Maximum bytes parsed per read
+        """
+        self.store = store
+        self.router_name = router_name
+        self.from_start = from_start
+        self.poll_interval = poll_interval
+        self.read_size = read_size
+        self.verbose = verbose
+        self.files = [_TailedFile(os.path.abspath(str(path))) for path in paths]
+        self.parser = ColumnarLogParser()
+        self._state_path = store.directory / 'tail-state.json'
+        self._state: Dict[str, Dict[str, int]] = {}
+        if self._state_path.exists():
+            with open(self._state_path) as f:
+                self._state = json.load(f)
+
+    def save_state(self):
+        """Persist inode and offset of every followed file."""
+        for tailed in self.files:
+            if tailed.inode is not None:
+                self._state[tailed.path] = {'inode': tailed.inode, 'offset': tailed.offset}
+        temp_path = self._state_path.with_suffix('.json.tmp')
+        with open(temp_path, 'w') as f:
+            json.dump(self._state, f, indent=2)
+        os.replace(temp_path, self._state_path)
+
+    def poll_once(self) -> int:
+        """
+        Ingest everything appended since the last poll.
+
+        Returns:
+            Number of rows appended to the store
+        """
+        if self.parser.year != datetime.now().year:
+            self.parser = ColumnarLogParser()
+        appended = 0
+        positions = [(tailed.inode, tailed.offset) for tailed in self.files]
+        for tailed in self.files:
+            appended += self._poll_file(tailed)
+        if positions != [(tailed.inode, tailed.offset) for tailed in self.files]:
+            self.save_state()
+        if appended:
+            if self.verbose:
+                print(f"Ingested {appended} rows", file=sys.stderr)
+        return appended
+
+    def _poll_file(self, tailed: _TailedFile) -> int:
+        try:
+            stat = os.stat(tailed.path)
+        except FileNotFoundError:
+            stat = None
+
+        appended = 0
+        rotated = False
+        if tailed.handle is not None and (stat is None or stat.st_ino != tailed.inode):
+            # Rotated or removed: finish the old file first
+            appended += self._read_available(tailed)
+            tailed.handle.close()
+            tailed.handle = None
+            tailed.inode = None
+            rotated = True
+        if stat is None:
+            return appended
+
+        if tailed.handle is None:
+            tailed.handle = open(tailed.path, 'rb')
+            tailed.inode = stat.st_ino
+            saved = self._state.get(tailed.path)
+            if saved and saved['inode'] == stat.st_ino:
+                tailed.offset = saved['offset']
+            else:
+                tailed.offset = 0 if self.from_start or saved or rotated else stat.st_size
+        if stat.st_size < tailed.offset:
+            tailed.offset = 0
+        return appended + self._read_available(tailed)
+
+    def _read_available(self, tailed: _TailedFile) -> int:
+        """Parse complete lines from the current offset to the end of file."""
+        appended = 0
+        while True:
+            tailed.handle.seek(tailed.offset)
+            data = tailed.handle.read(self.read_size)
+            complete = data.rfind(b'\n') + 1
+            if complete == 0:
+                if len(data) < self.read_size:
+                    return appended
+                complete = len(data)     # Oversized line: skip it
+            batch = self.parser.parse_bytes(data[:complete], self.router_name)
+            appended += self.store.append_batch(batch)
+            tailed.offset += complete
+            if len(data) < self.read_size:
+                return appended
+
+    def _open_watcher(self) -> Optional[_Inotify]:
+        try:
+            watcher = _Inotify()
+            for directory in sorted({os.path.dirname(tailed.path) for tailed in self.files}):
+                watcher.watch_directory(directory)
+            return watcher
+        except OSError as e:
+            if self.verbose:
+                print(f"inotify unavailable ({e}), polling every {self.poll_interval}s", file=sys.stderr)
+            return None
+
+    def run(self, stop: Optional[threading.Event] = None):
+        """Follow the files until stop is set (forever if None)."""
+        stop = stop or threading.Event()
+        watcher = self._open_watcher()
+        paths = {tailed.path for tailed in self.files}
+        try:
+            self.poll_once()
+            while not stop.is_set():
+                if watcher is not None:
+                    changed = watcher.wait(self.poll_interval)
+                    if changed and not changed & paths:
+                        continue
+                else:
+                    stop.wait(self.poll_interval)
+                self.poll_once()
+        finally:
+            if watcher is not None:
+                watcher.close()
+            for tailed in self.files:
+                if tailed.handle is not None:
+                    tailed.handle.close()
+                    tailed.handle = None
+            self.save_state()
+
+
+def main():
+    """Ingest, follow or query an iptables log store."""
+    parser = argparse.ArgumentParser(
+        description='Time-indexed iptables log store',
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+    # Ingest kernel logs once
+    python3 iptables_log_store.py --store /var/lib/tsim/logs ingest /var/log/kern.log
+
+    # Follow kernel logs (inotify)
+    python3 iptables_log_store.py --store /var/lib/tsim/logs tail /var/log/kern.log
+
+    # Last 15 minutes on hq-gw involving 10.1.2.3
+    python3 iptables_log_store.py --store /var/lib/tsim/logs query --minutes 15 --router hq-gw --ip 10.1.2.3
+        """
+    )
+    parser.add_argument('--store', required=True, help='Store directory')
+    parser.add_argument('-v', '--verbose', action='store_true', help='Print statistics to stderr')
+    commands = parser.add_subparsers(dest='command', required=True)
+    for name in ('ingest', 'tail'):
+        command = commands.add_parser(name)
+        command.add_argument('files', nargs='+', help='Log files')
+        command.add_argument('--router', help='Router name for all rows (default: syslog hostname)')
+    query = commands.add_parser('query')
+    query.add_argument('--minutes', type=int, help='Only the last N minutes')
+    query.add_argument('--router', help='Router name')
+    query.add_argument('--ip', help='Source or destination address')
+    query.add_argument('--limit', type=int, help='Newest N entries')
+    args = parser.parse_args()
+
+    try:
+        if args.command == 'query':
+            store = LogStore(args.store, readonly=True, verbose=args.verbose)
+            since = datetime.now() - timedelta(minutes=args.minutes) if args.minutes else None
+            for entry in store.query(since, router=args.router, address=args.ip, limit=args.limit):
+                print(json.dumps({**entry.__dict__, 'timestamp': entry.timestamp.isoformat()}))
+            return
+        with LogStore(args.store, verbose=args.verbose) as store:
+            tailer = LogTailer(store, args.files, args.router, verbose=args.verbose)
+            if args.command == 'ingest':
+                print(f"Ingested {tailer.poll_once()} rows", file=sys.stderr)
+                tailer.save_state()
+            else:
+                try:
+                    tailer.run()
+                except KeyboardInterrupt:
+                    pass
+    except (FileNotFoundError, PermissionError, RuntimeError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,221 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Single-pass iptables-save snapshot index
+
+Walks an iptables-save snapshot (with or without counters) once and builds
+the lookup structures consumers otherwise rebuild per query: a map from
+rule comment to its counters, and per-table chain -> rule arrays in the
+same layout the namespace status collector produces.
+
+Lines are split with plain string operations; no regular expression runs
+per line, so indexing is O(lines) and every lookup afterwards is O(1).
+
+Key Features:
+- Comment -> (table, chain, packets, bytes) map, optionally limited to a prefix
+- Chain policies, chain counters and ordered rule arrays per table
+- Accepts both "[pkts:bytes] -A ..." and "-A ... -c pkts bytes" counters
+- Rule list in the (chain, rule_number, rule) shape used by packet count analysis
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import argparse
+import json
+import sys
+import time
+from typing import Dict, List, Optional, Tuple, Any
+
+
+def _comment_value(line: str) -> Optional[str]:
+    """Value of the first --comment option in a rule line, unquoted."""
+    pos = line.find('--comment ')
+    if pos < 0:
+        return None
+    start = pos + 10
+    if line.startswith('"', start):
+        end = line.find('"', start + 1)
+        while end > 0 and line[end - 1] == '\\':
+            end = line.find('"', end + 1)
+        if end < 0:
+            return line[start + 1:]
+        return line[start + 1:end].replace('\\"', '"')
+    end = line.find(' ', start)
+    return line[start:end] if end >= 0 else line[start:]
+
+
+def _option_value(line: str, option: str) -> Optional[str]:
+    """Value following the first ' <option> ' token, if present."""
+    pos = line.find(option)
+    if pos < 0:
+        return None
+    start = pos + len(option)
+    end = line.find(' ', start)
+    return line[start:end] if end >= 0 else line[start:]
+
+
+class IptablesSaveIndex:
+    """
+    Index of one iptables-save snapshot.
+
+    Attributes:
+        tables: table -> {'chains': {chain: {'policy', 'packets', 'bytes', 'rules'}},
+                          'custom_chains': [...]}
+        comments: comment -> (table, chain, packets, bytes); first rule wins
+    """
+
+    def __init__(self, snapshot: str, comment_prefix: Optional[str] = None):
+        """
+        Index a snapshot.
+
+        Args:
+            snapshot: iptables-save output
+            comment_prefix: Only index comments starting with this prefix (None: all)
+        """
+        self.tables: Dict[str, Dict[str, Any]] = {}
+        self.comments: Dict[str, Tuple[str, str, int, int]] = {}
+        self.comment_prefix = comment_prefix
+        self._parse(snapshot)
+
+    def _parse(self, snapshot: str):
+        prefix = self.comment_prefix
+        comments = self.comments
+        table_name = 'filter'
+        chains: Dict[str, Dict[str, Any]] = {}
+        custom: List[str] = []
+        self.tables[table_name] = {'chains': chains, 'custom_chains': custom}
+
+        for line in snapshot.splitlines():
+            if not line:
+                continue
+            first = line[0]
+            if first == '[' or first == '-':
+                packets = bytes_ = 0
+                rule = line
+                if first == '[':
+                    close = line.find(']')
+                    if close < 0:
+                        continue
+                    pkts, _, byts = line[1:close].partition(':')
+                    packets = int(pkts) if pkts.isdigit() else 0
+                    bytes_ = int(byts) if byts.isdigit() else 0
+                    rule = line[close + 1:].lstrip()
+                if not rule.startswith('-A '):
+                    continue
+                end = rule.find(' ', 3)
+                chain = rule[3:end] if end >= 0 else rule[3:]
+                if first == '-':
+                    counters = rule.find(' -c ')
+                    if counters >= 0:
+                        parts = rule[counters + 4:].split(' ', 2)
+                        if len(parts) >= 2 and parts[0].isdigit() and parts[1].isdigit():
+                            packets, bytes_ = int(parts[0]), int(parts[1])
+
+                comment = _comment_value(rule) if '--comment' in rule else None
+                if comment is not None and (prefix is None or comment.startswith(prefix)):
+                    if comment not in comments:
+                        comments[comment] = (table_name, chain, packets, bytes_)
+
+                chain_data = chains.get(chain)
+                if chain_data is None:
+                    chain_data = chains[chain] = {'policy': None, 'packets': 0, 'bytes': 0, 'rules': []}
+                chain_data['rules'].append({
+                    'packets': packets,
+                    'bytes': bytes_,
+                    'target': _option_value(rule, ' -j ') or _option_value(rule, ' -g '),
+                    'comment': comment,
+                    'raw': line
+                })
+            elif first == ':':
+                name, _, rest = line[1:].partition(' ')
+                policy, _, counters = rest.partition(' ')
+                packets = bytes_ = 0
+                if counters.startswith('['):
+                    pkts, _, byts = counters[1:counters.find(']')].partition(':')
+                    packets = int(pkts) if pkts.isdigit() else 0
+                    bytes_ = int(byts) if byts.isdigit() else 0
+                chains[name] = {
+                    'policy': policy if policy != '-' else None,
+                    'packets': packets,
+                    'bytes': bytes_,
+                    'rules': chains[name]['rules'] if name in chains else []
+                }
+                if policy == '-':
+                    custom.append(name)
+            elif first == '*':
+                table_name = line[1:].strip()
+                table = self.tables.setdefault(table_name, {'chains': {}, 'custom_chains': []})
+                chains = table['chains']
+                custom = table['custom_chains']
+
+        # Drop the implicit filter table when the snapshot never used it
+        if not self.tables['filter']['chains']:
+            del self.tables['filter']
+
+    def counter(self, comment: str) -> Optional[Tuple[int, int]]:
+        """(packets, bytes) of the rule carrying this comment, or None if absent."""
+        entry = self.comments.get(comment.replace('"', ''))
+        return (entry[2], entry[3]) if entry is not None else None
+
+    def chain_rules(self, table: str = 'filter') -> Dict[str, List[Dict[str, Any]]]:
+        """Chain -> ordered rule dicts for a table."""
+        chains = self.tables.get(table, {}).get('chains', {})
+        return {name: chain['rules'] for name, chain in chains.items()}
+
+    def policies(self, table: str = 'filter') -> Dict[str, str]:
+        """Chain -> policy ('-' for custom chains)."""
+        chains = self.tables.get(table, {}).get('chains', {})
+        return {name: chain['policy'] or '-' for name, chain in chains.items()}
+
+    def rule_list(self, table: str = 'filter') -> List[Dict[str, Any]]:
+        """Rules as [{'chain', 'rule_number', 'rule'}] in snapshot order."""
+        return [{'chain': name, 'rule_number': number, 'rule': rule}
+                for name, rules in self.chain_rules(table).items()
+                for number, rule in enumerate(rules, 1)]
+
+
+def main():
+    """Index an iptables-save snapshot and print comment counters or chains."""
+    parser = argparse.ArgumentParser(
+        description="Index an iptables-save snapshot in one pass",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+    # Counters of all KSMS tap rules
+    ip netns exec hq-gw iptables-save -c -t mangle | python3 iptables_save_index.py --prefix TSIM_KSMS=
+
+    # Chain -> rules of the filter table
+    python3 iptables_save_index.py --file save.txt --chains filter
+        """
+    )
+    parser.add_argument('--file', help='Snapshot file (default: stdin)')
+    parser.add_argument('--prefix', help='Only index comments with this prefix')
+    parser.add_argument('--chains', metavar='TABLE', help='Print chain -> rules of a table instead of comments')
+    parser.add_argument('-v', '--verbose', action='store_true', help='Print timing to stderr')
+    args = parser.parse_args()
+
+    try:
+        if args.file:
+            with open(args.file) as f:
+                snapshot = f.read()
+        else:
+            snapshot = sys.stdin.read()
+    except OSError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(2)
+
+    started = time.perf_counter()
+    index = IptablesSaveIndex(snapshot, args.prefix)
+    if args.verbose:
+        print(f"Indexed {snapshot.count(chr(10))} lines, {len(index.comments)} comments "
+              f"in {time.perf_counter() - started:.4f}s", file=sys.stderr)
+
+    if args.chains:
+        print(json.dumps(index.chain_rules(args.chains), indent=2))
+    else:
+        print(json.dumps({comment: {'table': table, 'chain': chain, 'packets': packets, 'bytes': bytes_}
+                          for comment, (table, chain, packets, bytes_) in index.comments.items()}, indent=2))
+
+
+if __name__ == "__main__":
+    main()
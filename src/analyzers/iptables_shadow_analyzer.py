@@ -0,0 +1,358 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Iptables rule shadowing and redundancy analyzer
+
+Finds rules that can never match because an earlier terminating rule in the
+same chain already matches every packet they would match, or because their
+own criteria are unsatisfiable. Works on the compiled rules of an
+IptablesClassifier, so the analysis uses exactly the classifier's (and thus
+IptablesForwardAnalyzer's) match semantics.
+
+Key Features:
+- Interval set arithmetic over source/destination addresses and ports
+- Protocol, conntrack state and interface containment
+- Match-set containment: identical set references, or address ranges fully
+  covered by wildcard ipset members
+- Prefix-ancestor index of earlier terminating rules, so each rule is only
+  compared with rules that could possibly cover it (10k-rule chains in seconds)
+- Classifies findings as shadowed (earlier rule with a different verdict),
+  redundant (earlier rule with the same verdict) or dead (never matches)
+- Removable rules can be pruned from the classifier without changing any
+  verdict or reported rule ID
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import argparse
+import json
+import sys
+import time
+from bisect import bisect_right
+from dataclasses import dataclass, field, asdict
+from typing import Dict, List, Optional, Tuple, Any
+
+from tsim.analyzers.iptables_classifier import (
+    IptablesClassifier, CompiledRule, CompiledIpset,
+    KIND_SKIP, KIND_ACCEPT, KIND_DENY, KIND_RETURN, KIND_NAT
+)
+
+
+# Kinds that end evaluation of the chain for every packet they match
+TERMINAL_KINDS = (KIND_ACCEPT, KIND_DENY, KIND_RETURN, KIND_NAT)
+
+IP_SPACE = (0, 0xFFFFFFFF)
+PORT_SPACE = (0, 65535)
+
+# Index keys for destination port buckets
+_PORT_ANY = 'any'
+_PORT_RANGE = 'range'
+
+
+def merge_intervals(intervals) -> Tuple[Tuple[int, int], ...]:
+    """Merge sorted (lo, hi) intervals, joining overlapping and adjacent ones."""
+    merged: List[List[int]] = []
+    for lo, hi in sorted(intervals):
+        if merged and lo <= merged[-1][1] + 1:
+            if hi > merged[-1][1]:
+                merged[-1][1] = hi
+        else:
+            merged.append([lo, hi])
+    return tuple((lo, hi) for lo, hi in merged)
+
+
+def intervals_subset(inner, outer, space: Tuple[int, int]) -> bool:
+    """Check inner ⊆ outer for compiled interval lists (None = whole space).
+
+    outer must already be merged.
+    """
+    if outer is None:
+        return True
+    if inner is None:
+        inner = (space,)
+    starts = [lo for lo, _ in outer]
+    for lo, hi in inner:
+        index = bisect_right(starts, lo) - 1
+        if index < 0 or outer[index][1] < hi:
+            return False
+    return True
+
+
+def bounding_prefix(intervals) -> Optional[Tuple[int, int]]:
+    """Smallest CIDR block (prefixlen, network) containing all intervals.
+
+    None means the interval list is empty; ANY compiles to (0, 0).
+    """
+    if intervals is None:
+        return (0, 0)
+    if not intervals:
+        return None
+    lo = intervals[0][0]
+    hi = max(h for _, h in intervals)
+    plen = 32 - (lo ^ hi).bit_length()
+    return (plen, lo & _mask(plen))
+
+
+def _mask(plen: int) -> int:
+    return (0xFFFFFFFF << (32 - plen)) & 0xFFFFFFFF
+
+
+def _port_key(intervals):
+    """Destination port bucket of a potential covering rule."""
+    if intervals is None:
+        return _PORT_ANY
+    if len(intervals) == 1 and intervals[0][0] == intervals[0][1]:
+        return intervals[0][0]
+    return _PORT_RANGE
+
+
+@dataclass
+class ShadowFinding:
+    """A rule that can be removed without changing any verdict."""
+    rule_id: str
+    chain: str
+    position: int
+    target: str
+    category: str                 # shadowed, redundant or dead
+    covered_by: Optional[str]     # Earliest covering rule ID (None for dead rules)
+    reason: str
+    rule: str = ""
+
+
+@dataclass
+class ShadowReport:
+    """Result of analyzing all chains of one router."""
+    router: str
+    rules_analyzed: int
+    findings: List[ShadowFinding] = field(default_factory=list)
+    elapsed_seconds: float = 0.0
+
+    @property
+    def removable_ids(self) -> List[str]:
+        """IDs of all rules that can be pruned."""
+        return [finding.rule_id for finding in self.findings]
+
+    def count(self, category: str) -> int:
+        """Number of findings in a category."""
+        return sum(1 for finding in self.findings if finding.category == category)
+
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        return {
+            'router': self.router,
+            'rules_analyzed': self.rules_analyzed,
+            'shadowed': self.count('shadowed'),
+            'redundant': self.count('redundant'),
+            'dead': self.count('dead'),
+            'elapsed_seconds': round(self.elapsed_seconds, 3),
+            'findings': [asdict(finding) for finding in self.findings]
+        }
+
+
+class _CoverIndex:
+    """Earlier terminating rules of one chain, bucketed by what they can cover.
+
+    Key: (src prefixlen, src network, dst prefixlen, dst network, protocol,
+    dest port bucket). A rule can only cover another if its bounding prefixes
+    are ancestors of the other rule's bounding prefixes, so lookups enumerate
+    ancestor prefixes of the prefix lengths present in the index.
+    """
+
+    def __init__(self):
+        self.buckets: Dict[tuple, List[Tuple[CompiledRule, tuple, tuple]]] = {}
+        self.src_plens: set = set()
+        self.dst_plens: set = set()
+
+    def add(self, rule: CompiledRule, src_prefix, dst_prefix):
+        key = (src_prefix[0], src_prefix[1], dst_prefix[0], dst_prefix[1],
+               rule.protocol, _port_key(rule.dport))
+        merged_src = merge_intervals(rule.src) if rule.src is not None else None
+        merged_dst = merge_intervals(rule.dst) if rule.dst is not None else None
+        self.buckets.setdefault(key, []).append((rule, merged_src, merged_dst))
+        self.src_plens.add(src_prefix[0])
+        self.dst_plens.add(dst_prefix[0])
+
+    def candidates(self, rule: CompiledRule, src_prefix, dst_prefix):
+        """Yield indexed rules that might cover rule, in no particular order."""
+        protocols = (None,) if rule.protocol is None else (None, rule.protocol)
+        port_keys = [_PORT_ANY, _PORT_RANGE]
+        if rule.dport is not None and len(rule.dport) == 1 and rule.dport[0][0] == rule.dport[0][1]:
+            port_keys.append(rule.dport[0][0])
+        src_plen, src_net = src_prefix
+        dst_plen, dst_net = dst_prefix
+        src_keys = [(plen, src_net & _mask(plen)) for plen in self.src_plens if plen <= src_plen]
+        dst_keys = [(plen, dst_net & _mask(plen)) for plen in self.dst_plens if plen <= dst_plen]
+        buckets = self.buckets
+        for s_plen, s_net in src_keys:
+            for d_plen, d_net in dst_keys:
+                for protocol in protocols:
+                    for port_key in port_keys:
+                        bucket = buckets.get((s_plen, s_net, d_plen, d_net, protocol, port_key))
+                        if bucket:
+                            yield from bucket
+
+
+class RuleShadowAnalyzer:
+    """
+    Shadowing and redundancy analysis over a compiled classifier.
+
+    A rule is removable when it can never match: either its own criteria are
+    unsatisfiable, or a single earlier terminating rule (ACCEPT, DROP,
+    REJECT, NAT or RETURN) in the same chain matches a superset of its
+    packets. Coverage is decided conservatively; a rule is only reported if
+    containment holds on every criterion.
+    """
+
+    def __init__(self, classifier: IptablesClassifier, verbose: bool = False):
+        self.classifier = classifier
+        self.verbose = verbose
+        self._wildcard_cache: Dict[str, Tuple[Tuple[int, int], ...]] = {}
+
+    def analyze(self) -> ShadowReport:
+        """Analyze FORWARD and all custom chains."""
+        started = time.perf_counter()
+        report = ShadowReport(self.classifier.router_name, self.classifier.rule_count)
+        chains = [('FORWARD', self.classifier.forward_rules)]
+        chains.extend(self.classifier.custom_chains.items())
+        for chain_name, rules in chains:
+            report.findings.extend(self.analyze_chain(rules))
+        report.elapsed_seconds = time.perf_counter() - started
+        if self.verbose:
+            print(f"Analyzed {report.rules_analyzed} rules on {report.router} in "
+                  f"{report.elapsed_seconds:.2f}s: {len(report.findings)} removable", file=sys.stderr)
+        return report
+
+    def analyze_chain(self, rules: List[CompiledRule]) -> List[ShadowFinding]:
+        """Analyze one chain in rule order."""
+        findings = []
+        index = _CoverIndex()
+        for rule in rules:
+            src_prefix = bounding_prefix(rule.src)
+            dst_prefix = bounding_prefix(rule.dst)
+            dead_reason = self._dead_reason(rule, src_prefix, dst_prefix)
+            if dead_reason:
+                findings.append(self._finding(rule, 'dead', None, dead_reason))
+                continue
+
+            cover = None
+            for candidate, merged_src, merged_dst in index.candidates(rule, src_prefix, dst_prefix):
+                if cover is not None and candidate.position > cover.position:
+                    continue
+                if self.covers(candidate, merged_src, merged_dst, rule):
+                    cover = candidate
+            if cover is not None:
+                same = cover.kind == rule.kind and cover.target.upper() == rule.target.upper()
+                category = 'redundant' if same else 'shadowed'
+                findings.append(self._finding(rule, category, cover.rule_id,
+                                              f"All packets already matched by {cover.rule_id} ({cover.target})"))
+                continue
+
+            if rule.kind in TERMINAL_KINDS:
+                index.add(rule, src_prefix, dst_prefix)
+        return findings
+
+    @staticmethod
+    def _dead_reason(rule: CompiledRule, src_prefix, dst_prefix) -> Optional[str]:
+        """Why a rule can never match on its own, or None."""
+        if rule.kind == KIND_SKIP:
+            return f"Unknown target {rule.target}, never evaluated"
+        if src_prefix is None:
+            return "Source criteria match no IPv4 address"
+        if dst_prefix is None:
+            return "Destination criteria match no IPv4 address"
+        for ipset, _, _ in rule.match_sets:
+            if ipset is None:
+                return "References a missing ipset or a compound match on a non port-typed set"
+        return None
+
+    def covers(self, earlier: CompiledRule, merged_src, merged_dst, rule: CompiledRule) -> bool:
+        """Check every packet matched by rule is also matched by earlier."""
+        if earlier.protocol is not None and earlier.protocol != rule.protocol:
+            return False
+        if earlier.states is not None and (rule.states is None or not rule.states <= earlier.states):
+            return False
+        if earlier.in_interface is not None and earlier.in_interface != rule.in_interface:
+            return False
+        if earlier.out_interface is not None and earlier.out_interface != rule.out_interface:
+            return False
+        if not intervals_subset(rule.src, merged_src, IP_SPACE):
+            return False
+        if not intervals_subset(rule.dst, merged_dst, IP_SPACE):
+            return False
+        if earlier.sport is not None and not intervals_subset(
+                rule.sport, merge_intervals(earlier.sport), PORT_SPACE):
+            return False
+        if earlier.dport is not None and not intervals_subset(
+                rule.dport, merge_intervals(earlier.dport), PORT_SPACE):
+            return False
+        for condition in earlier.match_sets:
+            if condition in rule.match_sets:
+                continue
+            ipset, use_dst_ip, _ = condition
+            addresses = rule.dst if use_dst_ip else rule.src
+            if addresses is None or not intervals_subset(addresses, self._wildcard_intervals(ipset), IP_SPACE):
+                return False
+        return True
+
+    def _wildcard_intervals(self, ipset: CompiledIpset) -> Tuple[Tuple[int, int], ...]:
+        """Address intervals of members that match regardless of port and protocol."""
+        cached = self._wildcard_cache.get(ipset.name)
+        if cached is not None:
+            return cached
+        intervals = []
+        for plen, _, table in ipset.by_prefix:
+            size = 1 << (32 - plen)
+            for network, entries in table.items():
+                if ('*', '*') in entries:
+                    intervals.append((network, network + size - 1))
+        merged = merge_intervals(intervals)
+        self._wildcard_cache[ipset.name] = merged
+        return merged
+
+    @staticmethod
+    def _finding(rule: CompiledRule, category: str, covered_by: Optional[str], reason: str) -> ShadowFinding:
+        return ShadowFinding(rule.rule_id, rule.chain, rule.position, rule.target,
+                             category, covered_by, reason, rule.rule_text)
+
+
+def main():
+    """Report shadowed, redundant and dead rules for a router."""
+    parser = argparse.ArgumentParser(
+        description="Find iptables rules that can never match",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+    # Summary and findings for one router
+    python3 iptables_shadow_analyzer.py --router hq-gw
+
+    # JSON output
+    python3 iptables_shadow_analyzer.py --router hq-gw --json
+        """
+    )
+    parser.add_argument('--router', required=True, help='Router name to analyze')
+    parser.add_argument('--tsim-facts', help='Facts directory (default: TRACEROUTE_SIMULATOR_FACTS)')
+    parser.add_argument('--json', action='store_true', help='Output report as JSON')
+    parser.add_argument('-v', '--verbose', action='store_true', help='Print timing to stderr')
+    args = parser.parse_args()
+
+    try:
+        classifier = IptablesClassifier.from_facts(args.tsim_facts, args.router)
+    except (FileNotFoundError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(2)
+
+    report = RuleShadowAnalyzer(classifier, args.verbose).analyze()
+    if args.json:
+        print(json.dumps(report.to_dict(), indent=2))
+    else:
+        print(f"Router {report.router}: {report.rules_analyzed} rules, "
+              f"{report.count('shadowed')} shadowed, {report.count('redundant')} redundant, "
+              f"{report.count('dead')} dead")
+        for finding in report.findings:
+            cover = f" by {finding.covered_by}" if finding.covered_by else ""
+            print(f"  {finding.rule_id:<24} {finding.category}{cover}: {finding.rule}")
+    sys.exit(1 if report.findings else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,446 @@
+#!/usr/bin/env -S python3 -B -u
+"""Shared-memory lock contention statistics.
+
+Every lock site in tsim (registry semaphores and shm locks, the lock
+manager service, the DSCP registry, the queue lock and the host registry
+JSON lock) reports into one mmap'd segment under /dev/shm/tsim, so the
+tsimsh `locks` command and the admin queue page can show where jobs wait
+without attaching to any process.
+
+Updates are lock-free: counters and histogram buckets are 64-bit
+atomic adds through libatomic (ctypes, no native build), maxima use a
+compare-and-swap loop, and a lock name claims its record by CAS on the
+name hash. Recording never blocks and never raises, so a missing or full
+segment only loses statistics, never a lock. Readers take a racy but
+word-consistent snapshot.
+
+Per lock name the segment keeps acquisition and contention counts,
+timeouts, total/max wait and hold times, log2 histograms of both, and
+the top waiters by total wait. Top waiters use space-saving eviction
+(the entry with the least wait is replaced), so they are approximate
+once more than WAITER_SLOTS distinct waiters have queued.
+
+Record layout (1024 bytes):
+    0     u64   name hash (0 = free record)
+    8     56s   name (NUL padded)
+    64    u64   acquisitions
+    72    u64   contended acquisitions (had to wait)
+    80    u64   timeouts
+    88    u64   releases
+    96    u64   wait total ns
+    104   u64   wait max ns
+    112   u64   hold total ns
+    120   u64   hold max ns
+    128   24 x u64  wait histogram
+    320   24 x u64  hold histogram
+    512   8 x {u64 hash, u64 count, u64 wait ns, 40s label}  top waiters
+
+Histogram bucket 0 counts durations under 1us; bucket i counts
+[2^(i-1), 2^i) us; the last bucket is everything from ~4.2s up.
+"""
+
+import ctypes
+import ctypes.util
+import fcntl
+import hashlib
+import logging
+import os
+import struct
+import sys
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional
+
+from .tsim_shm_manager import map_shared_segment
+
+
+MAGIC = b'TSIMLSTA'
+VERSION = 1
+HEADER_SIZE = 64
+RECORD_SIZE = 1024
+NAME_OFFSET = 8
+NAME_SIZE = 56
+COUNTERS_OFFSET = 64
+WAIT_HIST_OFFSET = 128
+HOLD_HIST_OFFSET = 320
+WAITERS_OFFSET = 512
+BUCKETS = 24
+WAITER_SLOTS = 8
+WAITER_SIZE = 64
+LABEL_SIZE = 40
+
+ACQUISITIONS, CONTENDED, TIMEOUTS, RELEASES, WAIT_TOTAL, WAIT_MAX, HOLD_TOTAL, HOLD_MAX = range(8)
+COUNTER_NAMES = ('acquisitions', 'contended', 'timeouts', 'releases',
+                 'wait_total_ns', 'wait_max_ns', 'hold_total_ns', 'hold_max_ns')
+
+DEFAULT_PATH = '/dev/shm/tsim/lock_stats.shm'
+DEFAULT_RECORDS = 1024
+ENV_PATH = 'TSIM_LOCK_STATS'  # Segment path, or "off" to disable recording
+
+_HEADER = struct.Struct('<8sIId')
+_COUNTERS = struct.Struct('<8Q')
+_HIST = struct.Struct(f'<{BUCKETS}Q')
+_WAITER = struct.Struct(f'<QQQ{LABEL_SIZE}s')
+_SEQ_CST = 5
+
+
+def _load_atomics():
+    """64-bit atomic add/load/CAS from libatomic, or None when unavailable."""
+    try:
+        lib = ctypes.CDLL(ctypes.util.find_library('atomic') or 'libatomic.so.1')
+        add = lib.__atomic_fetch_add_8
+        load = lib.__atomic_load_8
+        cas = lib.__atomic_compare_exchange_8
+    except (OSError, AttributeError):
+        return None
+    add.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_int]
+    add.restype = ctypes.c_uint64
+    load.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    load.restype = ctypes.c_uint64
+    cas.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint64, ctypes.c_int, ctypes.c_int]
+    cas.restype = ctypes.c_bool
+    return add, load, cas
+
+
+_ATOMICS = _load_atomics()
+
+
+def _hash(text: str) -> int:
+    """Stable, non-zero 64-bit hash (Python's hash() differs per process)."""
+    value = int.from_bytes(hashlib.blake2b(text.encode(), digest_size=8).digest(), 'little')
+    return value or 1
+
+
+def _bucket(ns: int) -> int:
+    return min(BUCKETS - 1, (ns // 1000).bit_length())
+
+
+def _bucket_upper_ms(bucket: int) -> float:
+    """Upper bound of a histogram bucket in milliseconds."""
+    return (1 << bucket) / 1000.0
+
+
+def _percentile_ms(hist: List[int], fraction: float, max_ns: int) -> Optional[float]:
+    """Bucket upper bound at the given rank, capped at the observed maximum."""
+    total = sum(hist)
+    if not total:
+        return None
+    rank = total * fraction
+    seen = 0
+    for bucket, count in enumerate(hist):
+        seen += count
+        if seen >= rank:
+            break
+    return min(_bucket_upper_ms(bucket), max_ns / 1e6)
+
+
+def _program_name() -> str:
+    argv0 = sys.argv[0] if sys.argv and sys.argv[0] else ''
+    program = os.path.basename(argv0)
+    if program == '__main__.py':  # python -m package
+        program = os.path.basename(os.path.dirname(argv0))
+    return program
+
+
+_PROGRAM = _program_name()
+
+
+def default_waiter() -> str:
+    """Who is waiting: program name plus the creator tag of the job, if any."""
+    program = _PROGRAM
+    if not program or program in ('-c', '-m'):
+        try:
+            program = Path('/proc/self/comm').read_text().strip()
+        except OSError:
+            program = 'python'
+    tag = os.environ.get('TSIM_CREATOR_TAG')
+    return f"{program} {tag}" if tag else f"{program}[{os.getpid()}]"
+
+
+class TsimLockStats:
+    """Lock-free per-lock-name contention counters in /dev/shm"""
+
+    def __init__(self, path: Path = Path(DEFAULT_PATH), records: int = DEFAULT_RECORDS,
+                 logger: Optional[logging.Logger] = None, unix_group: str = 'tsim-users'):
+        """Map (creating if needed) the statistics segment
+
+        Raises:
+            RuntimeError: If 64-bit atomics are not available
+            OSError: If the segment cannot be created or mapped
+        """
+        if _ATOMICS is None:
+            raise RuntimeError("libatomic not available")
+        self._add, self._load, self._cas = _ATOMICS
+        self.path = Path(path)
+        self.records = records
+        self.size = HEADER_SIZE + records * RECORD_SIZE
+        self.logger = logger or logging.getLogger(__name__)
+
+        # registry_manager imports this module, so its helper is imported here
+        from .registry_manager import ensure_tsim_file_permissions
+
+        # Shared by tsimsh users and the WSGI daemon: group read-write from creation
+        self._mm = map_shared_segment(
+            self.path, self.size, _HEADER.pack(MAGIC, VERSION, records, time.time()), compare=16,
+            prepare=lambda temp_path: ensure_tsim_file_permissions(temp_path, unix_group, self.logger))
+        self._buffer = (ctypes.c_char * self.size).from_buffer(self._mm)
+        self._base = ctypes.addressof(self._buffer)
+        self._index: Dict[str, Optional[int]] = {}
+
+    # --------------- records ---------------
+    def _record_offset(self, record: int) -> int:
+        return HEADER_SIZE + record * RECORD_SIZE
+
+    def _record(self, name: str) -> Optional[int]:
+        """Record index for name, claiming a free one on first use; None if full."""
+        if name in self._index:
+            return self._index[name]
+        key = _hash(name)
+        start = key % self.records
+        found = None
+        for probe in range(self.records):
+            record = (start + probe) % self.records
+            addr = self._base + self._record_offset(record)
+            stored = self._load(addr, _SEQ_CST)
+            if stored == 0:
+                expected = ctypes.c_uint64(0)
+                if self._cas(addr, ctypes.addressof(expected), key, _SEQ_CST, _SEQ_CST):
+                    offset = self._record_offset(record) + NAME_OFFSET
+                    self._mm[offset:offset + NAME_SIZE] = name.encode()[:NAME_SIZE - 1].ljust(NAME_SIZE, b'\0')
+                    found = record
+                    break
+                stored = expected.value
+            if stored == key:
+                found = record
+                break
+        if found is None:
+            self.logger.debug(f"Lock stats segment {self.path} is full, not recording {name}")
+        self._index[name] = found
+        return found
+
+    def _counters(self, record: int) -> int:
+        """Address of a record's first counter."""
+        return self._base + HEADER_SIZE + record * RECORD_SIZE + COUNTERS_OFFSET
+
+    def _max(self, addr: int, value: int):
+        current = self._load(addr, _SEQ_CST)
+        if value <= current:
+            return
+        expected = ctypes.c_uint64(current)
+        while value > expected.value:
+            if self._cas(addr, ctypes.addressof(expected), value, _SEQ_CST, _SEQ_CST):
+                return
+
+    def _observe(self, counters: int, total: int, maximum: int, hist_offset: int, ns: int):
+        self._add(counters + total * 8, ns, _SEQ_CST)
+        self._max(counters + maximum * 8, ns)
+        self._add(counters - COUNTERS_OFFSET + hist_offset + _bucket(ns) * 8, 1, _SEQ_CST)
+
+    def _note_waiter(self, record: int, waiter: str, ns: int):
+        """Charge wait time to a waiter slot (space-saving eviction)."""
+        key = _hash(waiter)
+        base = self._base + self._record_offset(record) + WAITERS_OFFSET
+        slot = None
+        for attempt in range(2):
+            keys = [self._load(base + i * WAITER_SIZE, _SEQ_CST) for i in range(WAITER_SLOTS)]
+            if key in keys:
+                slot = keys.index(key)
+                break
+            if 0 in keys:
+                victim = keys.index(0)
+            else:
+                waits = [self._load(base + i * WAITER_SIZE + 16, _SEQ_CST) for i in range(WAITER_SLOTS)]
+                victim = waits.index(min(waits))
+            expected = ctypes.c_uint64(keys[victim])
+            if self._cas(base + victim * WAITER_SIZE, ctypes.addressof(expected), key, _SEQ_CST, _SEQ_CST):
+                offset = self._record_offset(record) + WAITERS_OFFSET + victim * WAITER_SIZE
+                _WAITER.pack_into(self._mm, offset, key, 0, 0, waiter.encode()[:LABEL_SIZE])
+                slot = victim
+                break
+        if slot is None:
+            return
+        addr = base + slot * WAITER_SIZE
+        self._add(addr + 8, 1, _SEQ_CST)
+        self._add(addr + 16, ns, _SEQ_CST)
+
+    # --------------- recording ---------------
+    def acquired(self, name: str, wait: float, contended: bool, waiter: Optional[str] = None):
+        """Record a successful acquisition after waiting `wait` seconds."""
+        try:
+            record = self._record(name)
+            if record is None:
+                return
+            ns = max(0, int(wait * 1e9))
+            counters = self._counters(record)
+            self._add(counters + ACQUISITIONS * 8, 1, _SEQ_CST)
+            self._observe(counters, WAIT_TOTAL, WAIT_MAX, WAIT_HIST_OFFSET, ns)
+            if contended:
+                self._add(counters + CONTENDED * 8, 1, _SEQ_CST)
+                self._note_waiter(record, waiter or default_waiter(), ns)
+        except Exception as e:
+            self.logger.debug(f"Lock stats for {name} not recorded: {e}")
+
+    def timed_out(self, name: str, wait: float, waiter: Optional[str] = None):
+        """Record an acquisition attempt that gave up after `wait` seconds."""
+        try:
+            record = self._record(name)
+            if record is None:
+                return
+            ns = max(0, int(wait * 1e9))
+            counters = self._counters(record)
+            self._add(counters + TIMEOUTS * 8, 1, _SEQ_CST)
+            self._add(counters + CONTENDED * 8, 1, _SEQ_CST)
+            self._note_waiter(record, waiter or default_waiter(), ns)
+        except Exception as e:
+            self.logger.debug(f"Lock stats for {name} not recorded: {e}")
+
+    def released(self, name: str, hold: float):
+        """Record a release after holding the lock for `hold` seconds."""
+        try:
+            record = self._record(name)
+            if record is None:
+                return
+            counters = self._counters(record)
+            self._add(counters + RELEASES * 8, 1, _SEQ_CST)
+            self._observe(counters, HOLD_TOTAL, HOLD_MAX, HOLD_HIST_OFFSET, max(0, int(hold * 1e9)))
+        except Exception as e:
+            self.logger.debug(f"Lock stats for {name} not recorded: {e}")
+
+    # --------------- reading ---------------
+    def snapshot(self) -> Dict[str, Any]:
+        """All recorded locks, most total wait first."""
+        _, _, _, since = _HEADER.unpack_from(self._mm, 0)
+        locks = []
+        for record in range(self.records):
+            offset = self._record_offset(record)
+            if not struct.unpack_from('<Q', self._mm, offset)[0]:
+                continue
+            name = self._mm[offset + NAME_OFFSET:offset + COUNTERS_OFFSET].split(b'\0', 1)[0].decode(errors='replace')
+            if not name:
+                continue
+            counters = dict(zip(COUNTER_NAMES, _COUNTERS.unpack_from(self._mm, offset + COUNTERS_OFFSET)))
+            wait_hist = list(_HIST.unpack_from(self._mm, offset + WAIT_HIST_OFFSET))
+            hold_hist = list(_HIST.unpack_from(self._mm, offset + HOLD_HIST_OFFSET))
+            waiters = []
+            for i in range(WAITER_SLOTS):
+                key, count, wait_ns, label = _WAITER.unpack_from(self._mm, offset + WAITERS_OFFSET + i * WAITER_SIZE)
+                if key and count:
+                    waiters.append({
+                        'waiter': label.split(b'\0', 1)[0].decode(errors='replace'),
+                        'count': count,
+                        'wait_total_ms': wait_ns / 1e6
+                    })
+            waiters.sort(key=lambda w: w['wait_total_ms'], reverse=True)
+            acquisitions, releases = counters['acquisitions'], counters['releases']
+            locks.append({
+                'name': name,
+                'acquisitions': acquisitions,
+                'contended': counters['contended'],
+                'timeouts': counters['timeouts'],
+                'releases': releases,
+                'wait_total_ms': counters['wait_total_ns'] / 1e6,
+                'wait_avg_ms': counters['wait_total_ns'] / 1e6 / acquisitions if acquisitions else None,
+                'wait_p50_ms': _percentile_ms(wait_hist, 0.5, counters['wait_max_ns']),
+                'wait_p99_ms': _percentile_ms(wait_hist, 0.99, counters['wait_max_ns']),
+                'wait_max_ms': counters['wait_max_ns'] / 1e6,
+                'hold_total_ms': counters['hold_total_ns'] / 1e6,
+                'hold_avg_ms': counters['hold_total_ns'] / 1e6 / releases if releases else None,
+                'hold_p99_ms': _percentile_ms(hold_hist, 0.99, counters['hold_max_ns']),
+                'hold_max_ms': counters['hold_max_ns'] / 1e6,
+                'wait_histogram': wait_hist,
+                'hold_histogram': hold_hist,
+                'top_waiters': waiters
+            })
+        locks.sort(key=lambda l: l['wait_total_ms'], reverse=True)
+        return {
+            'since': since,
+            'buckets_ms': [_bucket_upper_ms(b) for b in range(BUCKETS)],
+            'locks': locks
+        }
+
+    def reset(self):
+        """Zero all counters (names keep their records)."""
+        for record in range(self.records):
+            offset = self._record_offset(record)
+            self._mm[offset + COUNTERS_OFFSET:offset + RECORD_SIZE] = bytes(RECORD_SIZE - COUNTERS_OFFSET)
+        struct.pack_into('<d', self._mm, 16, time.time())
+
+    def close(self):
+        del self._buffer
+        self._mm.close()
+
+
+_instance: Optional[TsimLockStats] = None
+_instance_path: Optional[str] = None
+
+
+def get_lock_stats(path: Optional[str] = None) -> Optional[TsimLockStats]:
+    """Process-wide stats segment, or None when disabled or unavailable.
+
+    The segment path is `path`, else TSIM_LOCK_STATS, else the default;
+    "off" disables recording.
+    """
+    global _instance, _instance_path
+    path = path or os.environ.get(ENV_PATH) or DEFAULT_PATH
+    if path == 'off':
+        return None
+    if _instance_path == path:
+        return _instance
+    _instance_path = path
+    _instance = None
+    if _ATOMICS is None:
+        return None
+    try:
+        Path(path).parent.mkdir(parents=True, exist_ok=True)
+        _instance = TsimLockStats(Path(path))
+    except (OSError, RuntimeError) as e:
+        logging.getLogger(__name__).debug(f"Lock stats disabled ({path}): {e}")
+    return _instance
+
+
+def flock_exclusive(fd: int, name: str, waiter: Optional[str] = None) -> float:
+    """Blocking LOCK_EX on fd, recorded under `name`; returns the monotonic acquire time."""
+    start = time.monotonic()
+    contended = False
+    try:
+        fcntl.flock(fd, fcntl.LOCK_EX | fcntl.LOCK_NB)
+    except BlockingIOError:
+        contended = True
+        fcntl.flock(fd, fcntl.LOCK_EX)
+    acquired_at = time.monotonic()
+    stats = get_lock_stats()
+    if stats is not None:
+        stats.acquired(name, acquired_at - start, contended, waiter)
+    return acquired_at
+
+
+def record_release(name: str, acquired_at: Optional[float]):
+    """Record the hold time of a lock taken at monotonic time `acquired_at`."""
+    if acquired_at is None:
+        return
+    stats = get_lock_stats()
+    if stats is not None:
+        stats.released(name, time.monotonic() - acquired_at)
+
+
+def main():
+    import argparse
+    import json
+
+    parser = argparse.ArgumentParser(description='Show lock contention statistics')
+    parser.add_argument('--path', default=None, help=f'Stats segment (default: {DEFAULT_PATH})')
+    parser.add_argument('--reset', action='store_true', help='Zero all counters')
+    args = parser.parse_args()
+
+    stats = get_lock_stats(args.path)
+    if stats is None:
+        print("Lock statistics unavailable", file=sys.stderr)
+        return 1
+    if args.reset:
+        stats.reset()
+    print(json.dumps(stats.snapshot(), indent=2))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -13,18 +13,26 @@ Key features:
 - Regex pattern matching for log prefixes
 - Interface-based filtering
 - Log aggregation and deduplication
+- Criteria compiled into a predicate program evaluated over columnar logs
+  (see iptables_log_columnar), producing a per-row selection mask
 
 Author: Network Analysis Tool
 License: MIT
 """
 
 import re
+import sys
 import ipaddress
+import operator
+from bisect import bisect_left, bisect_right
+from itertools import islice
 from datetime import datetime, timedelta
-from typing import Dict, List, Optional, Any, Set, Union, Callable
+from typing import Dict, List, Optional, Any, Set, Union, Callable, Iterator, Tuple
 from dataclasses import dataclass
 import socket
 
+from tsim.analyzers.iptables_log_columnar import ACTIONS, MISSING, NAIVE_EPOCH, map_chunks
+
 
 @dataclass
 class FilterCriteria:
@@ -71,6 +79,292 @@ class FilterCriteria:
                 setattr(self, field, [])
 
 
+def mask_and(a: bytes, b: bytes) -> bytes:
+    """Row-wise AND of two 0/1 byte masks of equal length."""
+    return (int.from_bytes(a, 'little') & int.from_bytes(b, 'little')).to_bytes(len(a), 'little')
+
+
+def mask_rows(mask: bytes) -> Iterator[int]:
+    """Indices of selected rows in a 0/1 byte mask."""
+    position = mask.find(1)
+    while position != -1:
+        yield position
+        position = mask.find(1, position + 1)
+
+
+class CompiledFilter:
+    """
+    FilterCriteria compiled into a predicate program over log columns.
+
+    Produced by LogFilter.compile_criteria. Each criterion becomes a lookup
+    table indexed by a column value: interned columns (routers, prefixes,
+    interfaces, protocols) by dictionary id, small integer columns (ports,
+    length, TTL) by value, and high-cardinality columns (addresses,
+    timestamps) through a table over the distinct values of the chunk. Rows
+    are then selected by table lookups and masks are combined with big
+    integer ANDs, so no per-row Python predicate runs. Results match
+    LogFilter.filter_entries on the equivalent entry dictionaries.
+    """
+
+    def __init__(self, log_filter: 'LogFilter', criteria: FilterCriteria):
+        self.log_filter = log_filter
+        self.criteria = criteria
+        self.source_networks = self._compile_networks(criteria.source_networks)
+        self.dest_networks = self._compile_networks(criteria.dest_networks)
+        self.protocols = {p.lower() for p in criteria.protocols}
+        self.routers = set(criteria.routers)
+        self.interfaces_in = set(criteria.interfaces_in)
+        self.interfaces_out = set(criteria.interfaces_out)
+        self.actions = {a.upper() for a in criteria.actions}
+        flags = 0 if log_filter.case_sensitive else re.IGNORECASE
+        self.prefix_patterns = []
+        for pattern in criteria.prefix_patterns:
+            try:
+                self.prefix_patterns.append(re.compile(pattern, flags))
+            except re.error:
+                if log_filter.verbose:
+                    print(f"Invalid regex pattern: {pattern}")
+        self.source_ports = self._value_table(criteria.source_ports, lambda v: v in criteria.source_ports)
+        self.dest_ports = self._value_table(criteria.dest_ports, lambda v: v in criteria.dest_ports)
+        self.length_table = None
+        if criteria.min_packet_length or criteria.max_packet_length:
+            self.length_table = self._value_table(True, lambda v: not v or (
+                not (criteria.min_packet_length and v < criteria.min_packet_length) and
+                not (criteria.max_packet_length and v > criteria.max_packet_length)))
+        self.ttl_table = None
+        if criteria.ttl_range:
+            min_ttl, max_ttl = criteria.ttl_range
+            self.ttl_table = self._value_table(True, lambda v: not v or min_ttl <= v <= max_ttl)
+        self._dictionary_tables: Dict[Tuple[int, str, int], bytes] = {}
+        self._address_classes: Dict[str, Dict[int, int]] = {}
+
+    def _compile_networks(self, networks: List[str]) -> Optional[Tuple[List[int], List[int]]]:
+        """Resolve a network list once into merged sorted (starts, ends) intervals.
+
+        Mirrors match_ip_network: CIDR, exact address, or hostname resolved
+        once here instead of per entry.
+        """
+        if not networks:
+            return None
+        intervals = []
+        for network in networks:
+            try:
+                if '/' in network:
+                    net = ipaddress.ip_network(network, strict=False)
+                    if net.version == 4:
+                        intervals.append((int(net.network_address), int(net.broadcast_address)))
+                else:
+                    addr = ipaddress.ip_address(network)
+                    if addr.version == 4:
+                        intervals.append((int(addr), int(addr)))
+            except ValueError:
+                try:
+                    value = int(ipaddress.IPv4Address(socket.gethostbyname(network)))
+                    intervals.append((value, value))
+                except (socket.gaierror, UnicodeError, ValueError):
+                    continue
+        merged: List[List[int]] = []
+        for lo, hi in sorted(intervals):
+            if merged and lo <= merged[-1][1] + 1:
+                merged[-1][1] = max(merged[-1][1], hi)
+            else:
+                merged.append([lo, hi])
+        return [lo for lo, _ in merged], [hi for _, hi in merged]
+
+    @staticmethod
+    def _value_table(enabled, predicate: Callable[[Optional[int]], bool]) -> Optional[bytes]:
+        """Table over 0..65535 plus MISSING (last slot) for an optional int column."""
+        if not enabled:
+            return None
+        table = bytearray(65537)
+        for value in range(65536):
+            table[value] = 1 if predicate(value) else 0
+        table[MISSING] = 1 if predicate(None) else 0
+        return bytes(table)
+
+    def _dictionary_table(self, dictionary, name: str, values: List[Optional[str]],
+                          predicate: Callable[[Any], bool]) -> bytes:
+        """0/1 table over an intern table, cached per dictionary size."""
+        key = (id(dictionary), name, len(values))
+        table = self._dictionary_tables.get(key)
+        if table is None:
+            table = bytes(1 if predicate(value) else 0 for value in values)
+            self._dictionary_tables[key] = table
+        return table
+
+    @staticmethod
+    def _lookup(column, table: bytes) -> bytes:
+        """Per-row table lookup of a column."""
+        if column.typecode == 'B' and len(table) >= 256:
+            return column.tobytes().translate(table)
+        if column.typecode == 'B':
+            return column.tobytes().translate(table + bytes(256 - len(table)))
+        if column.typecode in ('H', 'I') and len(table) <= 256 and sys.byteorder == 'little':
+            # Every id fits the low byte; translate and keep the low bytes
+            return column.tobytes().translate(table + bytes(256 - len(table)))[0::column.itemsize]
+        return bytes(map(table.__getitem__, column))
+
+    @staticmethod
+    def _distinct_lookup(column, predicate: Callable[[int], bool]) -> bytes:
+        """Per-row predicate evaluated once per distinct column value."""
+        table = {value: 1 if predicate(value) else 0 for value in set(column)}
+        return bytes(map(table.__getitem__, column))
+
+    @classmethod
+    def _range_mask(cls, column, low: float, high: float) -> bytes:
+        """Rows with low <= value <= high; binary search when the chunk is sorted.
+
+        Log files are written in time order, so timestamp chunks are usually
+        non-decreasing and the selection is one contiguous run.
+        """
+        if all(map(operator.le, column, islice(column, 1, None))):
+            first = bisect_left(column, low)
+            last = bisect_right(column, high)
+            if last < first:
+                last = first
+            return bytes(first) + b'\x01' * (last - first) + bytes(len(column) - last)
+        return cls._distinct_lookup(column, lambda value: low <= value <= high)
+
+    @staticmethod
+    def _in_networks(networks: Tuple[List[int], List[int]]) -> Callable[[int], bool]:
+        starts, ends = networks
+
+        def contains(value: int) -> bool:
+            index = bisect_right(starts, value) - 1
+            return index >= 0 and value <= ends[index]
+        return contains
+
+    def _time_bounds(self) -> Tuple[Optional[float], Optional[float]]:
+        """Time criteria as seconds since the naive epoch."""
+        criteria = self.criteria
+        bounds = []
+        for moment in (criteria.time_start, criteria.time_end):
+            if moment is not None and moment.tzinfo is not None:
+                moment = moment.astimezone().replace(tzinfo=None)
+            bounds.append((moment - NAIVE_EPOCH).total_seconds() if moment is not None else None)
+        start, end = bounds
+        if criteria.duration_minutes:
+            cutoff = (datetime.now() - timedelta(minutes=criteria.duration_minutes) - NAIVE_EPOCH).total_seconds()
+            start = cutoff if start is None else max(start, cutoff)
+        return start, end
+
+    def evaluate_chunk(self, batch, start: int, end: int) -> bytes:
+        """Selection mask (one 0/1 byte per row) for rows start..end-1."""
+        rows = end - start
+        mask = b'\x01' * rows
+        if rows <= 0:
+            return b''
+        criteria = self.criteria
+        d = batch.dictionary
+
+        def column(name):
+            return getattr(batch, name)[start:end]
+
+        def apply(step: bytes):
+            nonlocal mask
+            mask = mask_and(mask, step)
+
+        # Interned columns: one table per dictionary
+        if self.routers:
+            apply(self._lookup(column('router'), self._dictionary_table(
+                d, 'routers', d.routers.values, lambda v: v in self.routers)))
+        if self.protocols:
+            apply(self._lookup(column('protocol'), self._dictionary_table(
+                d, 'protocols', d.protocols.values, lambda v: (v or '') in self.protocols)))
+        if self.interfaces_in:
+            apply(self._lookup(column('interface_in'), self._dictionary_table(
+                d, 'interfaces_in', d.interfaces.values, lambda v: v in self.interfaces_in)))
+        if self.interfaces_out:
+            apply(self._lookup(column('interface_out'), self._dictionary_table(
+                d, 'interfaces_out', d.interfaces.values, lambda v: v in self.interfaces_out)))
+        if self.prefix_patterns or self.actions or criteria.include_only_errors:
+            apply(self._lookup(column('prefix'), self._dictionary_table(
+                d, 'prefixes', d.prefixes.values, self._prefix_predicate(d))))
+        if criteria.prefix_patterns and not self.prefix_patterns:
+            # Only invalid patterns: filter_entries matches nothing
+            return bytes(rows)
+
+        # Small integer columns: fixed tables
+        for name, table in (('sport', self.source_ports), ('dport', self.dest_ports),
+                            ('length', self.length_table), ('ttl', self.ttl_table)):
+            if table is not None:
+                apply(self._lookup(column(name), table))
+
+        # High cardinality columns: tables over distinct values
+        start_s, end_s = self._time_bounds()
+        if start_s is not None or end_s is not None:
+            low = start_s if start_s is not None else float('-inf')
+            high = end_s if end_s is not None else float('inf')
+            apply(self._range_mask(column('timestamp'), low, high))
+        if self.source_networks is not None:
+            apply(self._distinct_lookup(column('src'), self._in_networks(self.source_networks)))
+        if self.dest_networks is not None:
+            apply(self._distinct_lookup(column('dst'), self._in_networks(self.dest_networks)))
+        if criteria.exclude_internal or criteria.exclude_broadcast or criteria.exclude_multicast:
+            apply(self._advanced_mask(column('src'), column('dst')))
+        return mask
+
+    def _prefix_predicate(self, dictionary) -> Callable[[Optional[str]], bool]:
+        """Prefix patterns, actions and include_only_errors per distinct prefix."""
+        criteria = self.criteria
+        prefix_ids = dictionary.prefixes.ids
+        prefix_actions = dictionary.prefix_actions
+
+        def predicate(prefix: Optional[str]) -> bool:
+            text = prefix or ''
+            action = ACTIONS[prefix_actions[prefix_ids[prefix]]]
+            if self.prefix_patterns and not any(p.search(text) for p in self.prefix_patterns):
+                return False
+            if self.actions and action not in self.actions:
+                return False
+            if criteria.include_only_errors:
+                upper = text.upper()
+                if action not in ('DROP', 'REJECT') and 'ERROR' not in upper and 'DENY' not in upper:
+                    return False
+            return True
+        return predicate
+
+    def _advanced_mask(self, src, dst) -> bytes:
+        """exclude_internal / broadcast / multicast using LogFilter's own classifiers."""
+        criteria = self.criteria
+        log_filter = self.log_filter
+        rows = len(src)
+        ones = int.from_bytes(b'\x01' * rows, 'little')
+
+        def classify(check: Callable[[str], bool], column) -> int:
+            table = self._address_classes.setdefault(check.__name__, {})
+            for value in set(column).difference(table):
+                table[value] = 1 if check(str(ipaddress.IPv4Address(value))) else 0
+            return int.from_bytes(bytes(map(table.__getitem__, column)), 'little')
+
+        keep = ones
+        if criteria.exclude_internal:
+            keep &= ones ^ (classify(log_filter.is_internal_ip, src) & classify(log_filter.is_internal_ip, dst))
+        if criteria.exclude_broadcast:
+            keep &= ones ^ (classify(log_filter.is_broadcast_ip, src) | classify(log_filter.is_broadcast_ip, dst))
+        if criteria.exclude_multicast:
+            keep &= ones ^ (classify(log_filter.is_multicast_ip, src) | classify(log_filter.is_multicast_ip, dst))
+        return keep.to_bytes(rows, 'little')
+
+    def evaluate(self, batch, chunk_rows: int = 1_000_000, workers: int = 1) -> bytearray:
+        """
+        Selection mask for a whole ColumnarLogBatch.
+
+        Args:
+            batch: ColumnarLogBatch to filter
+            chunk_rows: Rows evaluated per chunk (bounds temporary memory)
+            workers: Processes evaluating chunks in parallel (fork based;
+                     1 evaluates in the calling process)
+
+        Returns:
+            bytearray with one byte per row, 1 where the row is selected
+        """
+        total = len(batch)
+        bounds = [(start, min(start + chunk_rows, total)) for start in range(0, total, chunk_rows)]
+        parts = map_chunks(lambda start, end: self.evaluate_chunk(batch, start, end), bounds, workers)
+        return bytearray(b''.join(parts))
+
+
 class LogFilter:
     """
     Advanced log filtering engine for network analysis.
@@ -439,6 +733,19 @@ class LogFilter:
         
         return filtered
     
+    def compile_criteria(self, criteria: FilterCriteria) -> CompiledFilter:
+        """Compile filter criteria once for columnar evaluation."""
+        return CompiledFilter(self, criteria)
+    
+    def filter_columnar(self, batch, criteria: FilterCriteria, workers: int = 1) -> bytearray:
+        """
+        Filter a ColumnarLogBatch.
+        
+        Returns:
+            Selection mask with one 0/1 byte per row (see mask_rows)
+        """
+        return self.compile_criteria(criteria).evaluate(batch, workers=workers)
+    
     def group_entries(self, entries: List[Dict[str, Any]], 
                      group_by: Union[str, List[str]]) -> Dict[str, List[Dict[str, Any]]]:
         """Group log entries by specified fields."""
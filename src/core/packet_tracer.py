@@ -14,6 +14,9 @@ Key Features:
 - Detailed hop-by-hop analysis
 - Policy-based routing consideration
 - Firewall decision tracking
+- Whole-path verdict evaluation with compiled per-router classifiers
+- Bounded, indexed storage of completed traces
+- Exact per-hop rule attribution from live TRACE events
 
 Author: Network Analysis Tool
 License: MIT
@@ -23,15 +26,19 @@ import time
 import ipaddress
 from datetime import datetime, timedelta
 from dataclasses import dataclass, field
-from typing import Dict, List, Optional, Tuple, Any, Union
+from typing import Dict, List, Optional, Tuple, Any, Union, Iterable
 from pathlib import Path
 import json
 
 # Import our existing components
 from tsim.core.traceroute_simulator import TracerouteSimulator
 from tsim.analyzers.iptables_forward_analyzer import IptablesForwardAnalyzer
+from tsim.analyzers.iptables_classifier import IptablesClassifier, Flow
+from tsim.analyzers.iptables_whatif import WhatIfSession
 from tsim.analyzers.iptables_log_processor import IptablesLogProcessor, LogEntry
 from tsim.core.log_filter import LogFilter, FilterCriteria
+from tsim.core.trace_store import TraceStore
+from tsim.core.rule_trace_collector import RuleTraceCollector
 
 
 @dataclass
@@ -140,6 +147,65 @@ class PacketHop:
         }
 
 
+@dataclass
+class HopVerdict:
+    """FORWARD verdict of a single router on an evaluated path."""
+    router_name: str
+    router_ip: str
+    interface_in: Optional[str]
+    interface_out: Optional[str]
+    verdict: str                     # ACCEPT, DROP, REJECT, NAT, RETURN, POLICY, LOCAL or UNKNOWN
+    allowed: bool
+    rule_ids: List[str] = field(default_factory=list)
+    
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        return {
+            'router_name': self.router_name,
+            'router_ip': self.router_ip,
+            'interface_in': self.interface_in,
+            'interface_out': self.interface_out,
+            'verdict': self.verdict,
+            'allowed': self.allowed,
+            'rule_ids': list(self.rule_ids)
+        }
+
+
+@dataclass
+class PathVerdict:
+    """Routing and FORWARD filtering result for a flow along its whole path."""
+    flow: Flow
+    hops: List[HopVerdict] = field(default_factory=list)
+    routed: bool = True
+    
+    @property
+    def allowed(self) -> bool:
+        """True if the flow was routed and every hop forwarded it."""
+        return self.routed and all(hop.allowed for hop in self.hops)
+    
+    @property
+    def blocked_at(self) -> Optional[str]:
+        """Name of the first router that denied the flow."""
+        for hop in self.hops:
+            if not hop.allowed:
+                return hop.router_name
+        return None
+    
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        return {
+            'source_ip': self.flow.src_ip,
+            'dest_ip': self.flow.dest_ip,
+            'protocol': self.flow.protocol,
+            'source_port': self.flow.src_port,
+            'dest_port': self.flow.dest_port,
+            'routed': self.routed,
+            'allowed': self.allowed,
+            'blocked_at': self.blocked_at,
+            'hops': [hop.to_dict() for hop in self.hops]
+        }
+
+
 class PacketTracerEngine:
     """
     Comprehensive packet tracing engine that combines multiple analysis methods.
@@ -148,7 +214,12 @@ class PacketTracerEngine:
     to provide complete packet path analysis through network topology.
     """
     
-    def __init__(self, facts_dir: str = None, verbose: bool = False, verbose_level: int = 1):
+    # Distinct (source, destination) pairs whose router hops are kept
+    ROUTE_CACHE_LIMIT = 1 << 16
+    
+    def __init__(self, facts_dir: str = None, verbose: bool = False, verbose_level: int = 1,
+                 trace_store_bytes: int = TraceStore.DEFAULT_MAX_BYTES,
+                 trace_max_age_hours: Optional[float] = None, prune_rules: bool = False):
         """
         Initialize packet tracer engine.
         
@@ -156,6 +227,9 @@ class PacketTracerEngine:
             facts_dir: Directory containing network facts
             verbose: Enable verbose output
             verbose_level: Verbosity level (1-3)
+            trace_store_bytes: Memory budget for completed traces (LRU eviction)
+            trace_max_age_hours: Evict completed traces older than this (None: no limit)
+            prune_rules: Drop shadowed, redundant and dead rules from compiled classifiers
         """
         self.facts_dir = facts_dir
         self.verbose = verbose
@@ -169,12 +243,24 @@ class PacketTracerEngine:
         
         # Trace management
         self.active_traces: Dict[str, PacketTrace] = {}
-        self.completed_traces: Dict[str, PacketTrace] = {}
+        self.completed_traces = TraceStore(
+            max_bytes=trace_store_bytes,
+            max_age_seconds=trace_max_age_hours * 3600 if trace_max_age_hours is not None else None
+        )
         self.trace_counter = 0
         
         # Cache for per-router analyzers
         self.router_analyzers: Dict[str, Any] = {}
         
+        # Cache for per-router compiled classifiers and router hops per (src, dst)
+        self.router_classifiers: Dict[str, Optional[IptablesClassifier]] = {}
+        self.route_cache: Dict[Tuple[str, str], Tuple[List[Dict[str, Any]], bool]] = {}
+        self.rule_profiling = False
+        self.prune_rules = prune_rules
+        
+        # Live rule trace collector used by real-time correlation (optional)
+        self.rule_trace: Optional[RuleTraceCollector] = None
+        
         if self.verbose:
             print(f"PacketTracerEngine initialized with facts_dir: {facts_dir}")
     
@@ -193,6 +279,151 @@ class PacketTracerEngine:
         
         return self.router_analyzers[router_name]
     
+    def get_classifier(self, router_name: str) -> Optional[IptablesClassifier]:
+        """Get compiled FORWARD classifier for a specific router."""
+        if router_name not in self.router_classifiers:
+            analyzer = self.get_iptables_analyzer(router_name)
+            classifier = IptablesClassifier.from_analyzer(analyzer, self.prune_rules) if analyzer else None
+            if classifier is not None and self.rule_profiling:
+                classifier.enable_profiling()
+            self.router_classifiers[router_name] = classifier
+        return self.router_classifiers[router_name]
+    
+    def attach_rule_trace(self, collector: Optional[RuleTraceCollector]):
+        """Use live TRACE events for real-time hop decisions (None detaches)."""
+        self.rule_trace = collector
+    
+    def what_if_session(self, router_name: str, flows: Iterable[Flow]) -> Optional[WhatIfSession]:
+        """Start a what-if session on a private copy of a router's classifier."""
+        analyzer = self.get_iptables_analyzer(router_name)
+        if analyzer is None:
+            return None
+        return WhatIfSession(IptablesClassifier.from_analyzer(analyzer), flows, self.verbose)
+    
+    def enable_rule_profiling(self, enabled: bool = True):
+        """Enable per-rule profiling on all current and future router classifiers."""
+        self.rule_profiling = enabled
+        for classifier in self.router_classifiers.values():
+            if classifier is not None:
+                classifier.enable_profiling(enabled, reset=enabled)
+    
+    def export_rule_profiles(self) -> Dict[str, Dict[str, Any]]:
+        """Export per-rule profiling counters for every compiled router."""
+        return {
+            router: classifier.profile_snapshot()
+            for router, classifier in self.router_classifiers.items()
+            if classifier is not None
+        }
+    
+    def rule_profile_report(self, hot_fraction: float = 0.05, min_depth: int = 10) -> Dict[str, Dict[str, Any]]:
+        """Never-hit and hot-but-deep rule report for every compiled router."""
+        return {
+            router: classifier.profile_report(hot_fraction, min_depth)
+            for router, classifier in self.router_classifiers.items()
+            if classifier is not None
+        }
+    
+    def evaluate_path(self, source_ip: str, dest_ip: str, protocol: str = "tcp",
+                      source_port: int = None, dest_port: int = None,
+                      connection_state: str = "NEW") -> PathVerdict:
+        """
+        Evaluate routing and FORWARD filtering for every hop of a flow in one call.
+        
+        Unlike trace_packet_path no trace or PacketHop objects are created; the
+        routing path is computed once per (source, destination) pair and each
+        router hop is classified with its compiled classifier.
+        
+        Args:
+            source_ip: Source IP address
+            dest_ip: Destination IP address
+            protocol: Protocol (tcp, udp, icmp, all)
+            source_port: Source port (for TCP/UDP)
+            dest_port: Destination port (for TCP/UDP)
+            connection_state: Conntrack state (default NEW)
+            
+        Returns:
+            PathVerdict with hop list, per-hop verdict and matching rule IDs
+        """
+        flow = Flow(source_ip, dest_ip, protocol, source_port, dest_port, connection_state)
+        return self._evaluate_flow(flow)
+    
+    def evaluate_paths(self, flows: Iterable[Flow]) -> List[PathVerdict]:
+        """Evaluate many flows; routing paths and classifiers are shared across flows."""
+        return [self._evaluate_flow(flow) for flow in flows]
+    
+    def _evaluate_flow(self, flow: Flow) -> PathVerdict:
+        """Walk the router hops of a flow, stopping at the first denying router."""
+        router_hops, routed = self._router_hops(flow.src_ip, flow.dest_ip)
+        result = PathVerdict(flow=flow, routed=routed)
+        
+        for hop_info in router_hops:
+            router_name = hop_info['router']
+            if hop_info['local']:
+                # Router owns source or destination: traffic uses INPUT/OUTPUT, not FORWARD
+                hop = HopVerdict(router_name, hop_info['ip'], hop_info['interface_in'],
+                                 hop_info['interface_out'], 'LOCAL', True)
+            else:
+                classifier = self.get_classifier(router_name)
+                if classifier is None:
+                    hop = HopVerdict(router_name, hop_info['ip'], hop_info['interface_in'],
+                                     hop_info['interface_out'], 'UNKNOWN', True)
+                else:
+                    verdict = classifier.classify_flow(flow)
+                    hop = HopVerdict(router_name, hop_info['ip'], hop_info['interface_in'],
+                                     hop_info['interface_out'], verdict.action, verdict.allowed,
+                                     verdict.rule_ids)
+            result.hops.append(hop)
+            if not hop.allowed:
+                break
+        
+        return result
+    
+    def _router_hops(self, source_ip: str, dest_ip: str) -> Tuple[List[Dict[str, Any]], bool]:
+        """
+        Get router hops between source and destination (cached per pair).
+        
+        Returns:
+            Tuple of (hops, routed) where hops are dicts with router, ip,
+            interface_in, interface_out, next_hop and local (router owns source
+            or destination IP), and routed is False if the simulator found no
+            route or a loop
+        """
+        key = (source_ip, dest_ip)
+        if key in self.route_cache:
+            return self.route_cache[key]
+        if len(self.route_cache) >= self.ROUTE_CACHE_LIMIT:
+            self.route_cache.clear()
+        
+        hops = []
+        routed = True
+        try:
+            path = self.simulator.simulate_traceroute(source_ip, dest_ip)
+        except Exception as e:
+            if self.verbose_level >= 2:
+                print(f"Error getting routing path: {e}")
+            path = []
+        
+        routers = self.simulator.routers
+        for i, (_, name, ip, interface_in, _, _, interface_out) in enumerate(path):
+            if name == "* * *" or "(loop detected)" in ip:
+                routed = False
+                break
+            if name not in routers:
+                continue
+            router_ips = routers[name].get_all_ip_addresses()
+            next_hop = path[i + 1][2] if i + 1 < len(path) else None
+            hops.append({
+                'router': name,
+                'ip': ip,
+                'interface_in': interface_in or None,
+                'interface_out': interface_out or None,
+                'next_hop': next_hop,
+                'local': source_ip in router_ips or dest_ip in router_ips
+            })
+        
+        self.route_cache[key] = (hops, routed and bool(hops))
+        return self.route_cache[key]
+    
     def generate_trace_id(self) -> str:
         """Generate unique trace ID."""
         self.trace_counter += 1
@@ -283,7 +514,7 @@ class PacketTracerEngine:
                 self._analyze_routing_decision(trace, hop, hop_info)
                 
                 # Iptables analysis
-                self._analyze_iptables_decision(trace, hop)
+                self._analyze_iptables_decision(trace, hop, hop_info.get('local', False))
                 
                 # Real-time log correlation if enabled
                 if real_time:
@@ -336,40 +567,20 @@ class PacketTracerEngine:
     
     def _get_routing_path(self, trace: PacketTrace) -> List[Dict[str, Any]]:
         """Get routing path using simulator."""
-        try:
-            # Use existing simulator to get path
-            result = self.simulator.simulate_traceroute(
-                source=trace.source_ip,
-                destination=trace.dest_ip,
-                protocol=trace.protocol,
-                destination_port=trace.dest_port
-            )
-            
-            if result and result.get('path'):
-                # Convert simulator output to hop info
-                hops = []
-                path = result['path']
-                
-                for i, hop in enumerate(path):
-                    if isinstance(hop, tuple) and len(hop) >= 7:
-                        hop_info = {
-                            'router': hop[1],
-                            'ip': hop[0],
-                            'interface_in': hop[2],
-                            'interface_out': hop[3],
-                            'next_hop': hop[4],
-                            'metric': hop[5],
-                            'routing_table': hop[6] if len(hop) > 6 else 'main'
-                        }
-                        hops.append(hop_info)
-                
-                return hops
-            
-        except Exception as e:
-            if self.verbose_level >= 2:
-                print(f"Error getting routing path: {e}")
-        
-        return []
+        hops = []
+        router_hops, _ = self._router_hops(trace.source_ip, trace.dest_ip)
+        for hop_info in router_hops:
+            hops.append({
+                'router': hop_info['router'],
+                'ip': hop_info['ip'],
+                'interface_in': hop_info['interface_in'],
+                'interface_out': hop_info['interface_out'],
+                'next_hop': hop_info['next_hop'],
+                'local': hop_info['local'],
+                'metric': None,
+                'routing_table': 'main'
+            })
+        return hops
     
     def _analyze_routing_decision(self, trace: PacketTrace, hop: PacketHop, hop_info: Dict[str, Any]):
         """Analyze routing decision for this hop."""
@@ -382,40 +593,79 @@ class PacketTracerEngine:
         if self.verbose_level >= 3:
             print(f"  Hop {hop.hop_number}: routing via {hop.routing_table} table to {hop.next_hop}")
     
-    def _analyze_iptables_decision(self, trace: PacketTrace, hop: PacketHop):
+    def _analyze_iptables_decision(self, trace: PacketTrace, hop: PacketHop, local: bool = False):
         """Analyze iptables decision for this hop."""
+        if local:
+            # Router owns source or destination: INPUT/OUTPUT apply, not FORWARD,
+            # and they are not analyzed (evaluate_path reports these hops as LOCAL)
+            hop.iptables_decision = "ACCEPT"
+            return
         try:
-            # Use iptables analyzer to check forwarding decision
-            result = self.iptables_analyzer.analyze_packet_forwarding(
-                router=hop.router_name,
-                source_ip=trace.source_ip,
-                dest_ip=trace.dest_ip,
-                protocol=trace.protocol,
-                source_port=trace.source_port,
-                dest_port=trace.dest_port,
-                verbose=False
+            classifier = self.get_classifier(hop.router_name)
+            if classifier is None:
+                # Default to ACCEPT if no rules are known for this router
+                hop.iptables_decision = "ACCEPT"
+                return
+            
+            verdict = classifier.classify(
+                trace.source_ip, trace.source_port,
+                trace.dest_ip, trace.dest_port,
+                trace.protocol
             )
             
-            if result:
-                hop.iptables_decision = "ACCEPT" if result.get('allowed', False) else "DROP"
-                hop.iptables_rule = result.get('matching_rule')
-                hop.iptables_chain = result.get('chain', 'FORWARD')
-                hop.iptables_table = result.get('table', 'filter')
-                
-                if self.verbose_level >= 2:
-                    print(f"  Hop {hop.hop_number}: iptables {hop.iptables_decision}")
-            else:
-                # Default to ACCEPT if no specific rules found
+            if verdict.allowed:
                 hop.iptables_decision = "ACCEPT"
+            elif verdict.action == "REJECT":
+                hop.iptables_decision = "REJECT"
+            else:
+                # DROP rule, or RETURN / default policy denying the packet
+                hop.iptables_decision = "DROP"
+            hop.iptables_rule = verdict.terminal_rule
+            hop.iptables_chain = verdict.terminal_rule.split(':', 1)[0] if verdict.terminal_rule else 'FORWARD'
+            hop.iptables_table = 'filter'
+            
+            if self.verbose_level >= 2:
+                print(f"  Hop {hop.hop_number}: iptables {hop.iptables_decision}")
         
         except Exception as e:
             if self.verbose_level >= 2:
                 print(f"Error analyzing iptables for hop {hop.hop_number}: {e}")
             hop.iptables_decision = "ACCEPT"  # Default assumption
     
+    def _apply_rule_trace(self, trace: PacketTrace, hop: PacketHop) -> bool:
+        """Set the hop decision from the traced terminal rule; False if untraced."""
+        event = self.rule_trace.terminal_event(hop.router_name, trace.source_ip, trace.dest_ip,
+                                               trace.protocol, trace.dest_port, trace.source_port)
+        if event is None:
+            return False
+        decision = event.decision
+        classifier = self.get_classifier(hop.router_name)
+        if event.rule_id is not None and classifier is not None:
+            # REJECT shows up as a drop verdict (nftrace) or not at all (nflog)
+            try:
+                rules, index = classifier.find_rule(event.rule_id)
+                if rules[index].target in ('ACCEPT', 'DROP', 'REJECT'):
+                    decision = rules[index].target
+            except ValueError:
+                pass
+        elif decision is None and classifier is not None:
+            decision = classifier.default_policy
+        if decision is not None:
+            hop.iptables_decision = decision
+        hop.iptables_rule = event.rule_id
+        hop.iptables_chain = event.chain
+        hop.iptables_table = event.table
+        if self.verbose_level >= 2:
+            print(f"  Hop {hop.hop_number}: traced {event.rule_id or event.chain + ' policy'} "
+                  f"-> {hop.iptables_decision}")
+        return True
+    
     def _correlate_real_time_logs(self, trace: PacketTrace, hop: PacketHop):
-        """Correlate with real-time log entries."""
+        """Correlate with live rule traces, else with real-time log entries."""
         try:
+            if self.rule_trace is not None and self._apply_rule_trace(trace, hop):
+                return
+            
             # Create filter criteria for this packet
             criteria = FilterCriteria(
                 source_networks=[trace.source_ip],
@@ -461,17 +711,24 @@ class PacketTracerEngine:
             return self.completed_traces[trace_id]
         return None
     
-    def list_traces(self, status: str = None) -> List[PacketTrace]:
-        """List traces, optionally filtered by status."""
-        all_traces = list(self.active_traces.values()) + list(self.completed_traces.values())
-        
-        if status:
-            return [trace for trace in all_traces if trace.status == status]
-        
-        return all_traces
+    def list_traces(self, status: str = None, source_ip: str = None,
+                    dest_ip: str = None) -> List[PacketTrace]:
+        """List traces, optionally filtered by status, source and destination."""
+        def matches(trace: PacketTrace) -> bool:
+            return ((status is None or trace.status == status) and
+                    (source_ip is None or trace.source_ip == source_ip) and
+                    (dest_ip is None or trace.dest_ip == dest_ip))
+        
+        active = [trace for trace in self.active_traces.values() if matches(trace)]
+        completed_ids = self.completed_traces.query(status, source_ip, dest_ip)
+        return active + [self.completed_traces.peek(trace_id) for trace_id in completed_ids]
     
     def export_trace(self, trace_id: str, format: str = "json") -> str:
         """Export trace in specified format."""
+        if format.lower() == "json" and trace_id in self.completed_traces:
+            # Stream from the packed record, no intermediate dicts
+            return self.completed_traces.export_json(trace_id)
+        
         trace = self.get_trace(trace_id)
         if not trace:
             raise ValueError(f"Trace {trace_id} not found")
@@ -483,6 +740,24 @@ class PacketTracerEngine:
         else:
             raise ValueError(f"Unsupported format: {format}")
     
+    def export_traces(self, fp, format: str = "json", status: str = None,
+                      source_ip: str = None, dest_ip: str = None):
+        """
+        Stream completed traces to a file object.
+        
+        Args:
+            fp: Text file object for json, binary file object for binary
+            format: json or binary
+            status, source_ip, dest_ip: Optional filters (indexed)
+        """
+        trace_ids = self.completed_traces.query(status, source_ip, dest_ip)
+        if format.lower() == "json":
+            self.completed_traces.write_json(fp, trace_ids)
+        elif format.lower() == "binary":
+            self.completed_traces.write_binary(fp, trace_ids)
+        else:
+            raise ValueError(f"Unsupported format: {format}")
+    
     def _format_trace_text(self, trace: PacketTrace) -> str:
         """Format trace as human-readable text."""
         lines = []
@@ -528,17 +803,10 @@ class PacketTracerEngine:
     def cleanup_completed_traces(self, max_age_hours: int = 24):
         """Clean up old completed traces."""
         cutoff_time = datetime.now() - timedelta(hours=max_age_hours)
+        removed = self.completed_traces.evict_older_than(cutoff_time)
         
-        to_remove = []
-        for trace_id, trace in self.completed_traces.items():
-            if trace.end_time and trace.end_time < cutoff_time:
-                to_remove.append(trace_id)
-        
-        for trace_id in to_remove:
-            del self.completed_traces[trace_id]
-        
-        if self.verbose and to_remove:
-            print(f"Cleaned up {len(to_remove)} old traces")
+        if self.verbose and removed:
+            print(f"Cleaned up {removed} old traces")
 
 
 def main():
@@ -10,8 +10,13 @@ This module provides a single point of coordination for:
 
 Thread-safe and process-safe using posix_ipc semaphores.
 All operations are atomic.
+
+With registry_manager.backend = "journal" the registries are cached in
+memory per process and updates go to an append-only write-ahead log that
+is compacted into the JSON files, which remain the format other tools read.
 """
 
+import atexit
 import json
 import os
 import time
@@ -19,11 +24,15 @@ import logging
 import posix_ipc
 import select
 import grp
+import threading
 from pathlib import Path
 from typing import Dict, List, Optional, Tuple, Any, Callable
 from contextlib import contextmanager
 from dataclasses import dataclass
 
+from .lock_stats import get_lock_stats
+from .shm_lock import TsimShmLockTable, shm_locks_available
+
 
 # ==================== EXCEPTION CLASSES ====================
 
@@ -140,25 +149,50 @@ def ensure_tsim_file_permissions(path: Path, unix_group: str = 'tsim-users', log
 # ==================== INTERNAL CLASSES ====================
 
 class _TsimLockManager:
-    """Internal lock manager using posix_ipc semaphores.
+    """Internal lock manager using posix_ipc semaphores or the shm lock table.
+
+    With backend "shm" locks are robust process-shared mutexes in
+    lock_dir/tsim-locks.shm: waiters block in the kernel and are handed the
+    lock first-come first-served, and a dead holder's lock passes to the
+    next waiter at once. Such locks must be released by the acquiring thread.
 
     This class is NOT exposed to external callers.
     """
 
-    def __init__(self, lock_dir: Path, unix_group: str, logger: logging.Logger):
+    LOCK_TABLE_FILE = "tsim-locks.shm"
+
+    def __init__(self, lock_dir: Path, unix_group: str, logger: logging.Logger,
+                 backend: str = "semaphore", table_size: int = 1024):
         """Initialize lock manager.
 
         Args:
             lock_dir: Directory for lock files (must already exist with proper permissions)
             unix_group: Group name for ownership
             logger: Logger instance
+            backend: "semaphore" (posix_ipc, polled) or "shm" (blocking FIFO mutexes)
+            table_size: Maximum distinct lock names in the shm lock table
         """
         self.lock_dir = Path(lock_dir)
         self.unix_group = unix_group
         self.logger = logger
         self.semaphores: Dict[str, posix_ipc.Semaphore] = {}
+        self.table: Optional[TsimShmLockTable] = None
+        # Acquisition time per held lock, for hold-time statistics
+        self._held_since: Dict[str, float] = {}
         # Directory is created by parent with proper permissions
 
+        if backend == "shm":
+            if not shm_locks_available():
+                self.logger.warning("Robust shared mutexes unavailable, using posix_ipc semaphores")
+            else:
+                table_path = self.lock_dir / self.LOCK_TABLE_FILE
+                self.table = TsimShmLockTable(
+                    table_path, table_size, self.logger,
+                    prepare=lambda path: ensure_tsim_file_permissions(path, unix_group, logger))
+                ensure_tsim_file_permissions(table_path, unix_group, logger)
+        elif backend != "semaphore":
+            raise ValueError(f"Unknown lock backend: {backend}")
+
     def acquire(self, lock_name: str, timeout: float) -> bool:
         """Acquire semaphore with timeout.
 
@@ -172,6 +206,19 @@ class _TsimLockManager:
         Raises:
             RegistryError: On lock system errors
         """
+        start_time = time.monotonic()
+        if self.table is not None:
+            try:
+                contended = not self.table.try_acquire(lock_name)
+                if not contended or self.table.acquire(lock_name, timeout):
+                    self._acquired(lock_name, start_time, contended)
+                    return True
+                self._timed_out(lock_name, start_time)
+                return False
+            except Exception as e:
+                self.logger.error(f"Error acquiring lock {lock_name}: {e}")
+                raise TsimRegistryError(f"Lock acquisition failed: {e}")
+
         try:
             # Get or create semaphore
             sem_name = f"/{lock_name}"
@@ -201,16 +248,21 @@ class _TsimLockManager:
             else:
                 sem = self.semaphores[lock_name]
 
-            # Try to acquire with timeout
-            start_time = time.time()
+            # Uncontended fast path, then poll with timeout
+            try:
+                sem.acquire(timeout=0)
+                self._acquired(lock_name, start_time, False)
+                return True
+            except posix_ipc.BusyError:
+                pass
             while True:
                 try:
                     sem.acquire(timeout=0.1)  # Poll every 100ms
-                    self.logger.debug(f"Acquired lock: {lock_name}")
+                    self._acquired(lock_name, start_time, True)
                     return True
                 except posix_ipc.BusyError:
-                    if time.time() - start_time >= timeout:
-                        self.logger.warning(f"Timeout acquiring lock: {lock_name}")
+                    if time.monotonic() - start_time >= timeout:
+                        self._timed_out(lock_name, start_time)
                         return False
                     continue
 
@@ -227,11 +279,20 @@ class _TsimLockManager:
         Returns:
             True if released, False if not held
         """
+        if self.table is not None:
+            held_since = self._held_since.pop(lock_name, None)
+            if self.table.release(lock_name):
+                self._released(lock_name, held_since)
+                return True
+            self.logger.warning(f"Attempted to release unheld lock: {lock_name}")
+            return False
+
         try:
             if lock_name in self.semaphores:
                 sem = self.semaphores[lock_name]
+                held_since = self._held_since.pop(lock_name, None)
                 sem.release()
-                self.logger.debug(f"Released lock: {lock_name}")
+                self._released(lock_name, held_since)
                 return True
             else:
                 self.logger.warning(f"Attempted to release unheld lock: {lock_name}")
@@ -240,6 +301,26 @@ class _TsimLockManager:
             self.logger.error(f"Error releasing lock {lock_name}: {e}")
             return False
 
+    def _acquired(self, lock_name: str, start_time: float, contended: bool):
+        now = time.monotonic()
+        self._held_since[lock_name] = now
+        self.logger.debug(f"Acquired lock: {lock_name}")
+        stats = get_lock_stats()
+        if stats is not None:
+            stats.acquired(lock_name, now - start_time, contended)
+
+    def _timed_out(self, lock_name: str, start_time: float):
+        self.logger.warning(f"Timeout acquiring lock: {lock_name}")
+        stats = get_lock_stats()
+        if stats is not None:
+            stats.timed_out(lock_name, time.monotonic() - start_time)
+
+    def _released(self, lock_name: str, held_since: Optional[float]):
+        self.logger.debug(f"Released lock: {lock_name}")
+        stats = get_lock_stats()
+        if stats is not None and held_since is not None:
+            stats.released(lock_name, time.monotonic() - held_since)
+
     def acquire_multiple_sorted(self, lock_names: List[str],
                                 timeout: float) -> Tuple[bool, List[str]]:
         """Atomically acquire multiple locks in sorted order.
@@ -295,6 +376,18 @@ class _TsimLockManager:
                 count += 1
         return count
 
+    def is_locked(self, lock_name: str) -> Optional[bool]:
+        """Whether a lock is held; None if the backend cannot tell."""
+        if self.table is not None:
+            return self.table.is_locked(lock_name)
+        return None
+
+    def wait_unlocked(self, lock_name: str, timeout: float) -> Optional[bool]:
+        """Block until a lock is free without taking it; None if unsupported."""
+        if self.table is not None:
+            return self.table.wait_unlocked(lock_name, timeout)
+        return None
+
     def cleanup(self):
         """Cleanup semaphores on shutdown."""
         for lock_name, sem in self.semaphores.items():
@@ -369,6 +462,10 @@ class _TsimRegistryIO:
 
         return {}
 
+    def read_entry(self, file_name: str, key: str) -> Optional[Any]:
+        """Read one top-level entry of a registry file (None if absent)."""
+        return self.atomic_read(file_name).get(key)
+
     def atomic_write(self, file_name: str, data: Dict[str, Any]) -> None:
         """Write registry file atomically with fsync.
 
@@ -438,6 +535,363 @@ class _TsimRegistryIO:
         return new_data
 
 
+class _TsimJournaledRegistryIO:
+    """Internal registry I/O handler backed by a write-ahead log.
+
+    Same interface as _TsimRegistryIO. Each registry keeps its JSON file as
+    the snapshot that external tools read, plus an append-only log
+    (<file>.wal) of top-level key changes since that snapshot. Every process
+    caches the registry in memory and catches up by reading only the log
+    bytes appended since its last look, so a read costs two stat() calls and
+    an update costs one small append instead of re-reading, re-serializing,
+    fsyncing and renaming the whole file.
+
+    Log format (one JSON object per line):
+        {"snapshot": [ino, size, mtime_ns] | null}   header, first line
+        {"s": {key: value, ...}, "d": [key, ...]}     one update
+
+    The header names the snapshot the log applies to. A snapshot replaced or
+    removed behind our back (cleanup tools, legacy writers) no longer
+    matches, so the stale log is ignored and reset by the next update.
+
+    Compaction rewrites the snapshot and starts a fresh log. It runs inline
+    when the log exceeds compact_bytes and from a background thread once the
+    log has had records for compact_interval seconds, so the snapshot never
+    lags far behind. With fsync enabled, updates from all threads are
+    group-committed: one fdatasync per commit window covers every append
+    made in it.
+
+    This class is NOT exposed to external callers.
+    """
+
+    WAL_SUFFIX = '.wal'
+
+    class _Table:
+        """Cached state of one registry file."""
+
+        def __init__(self):
+            self.entries: Dict[str, str] = {}   # key -> compact JSON of value
+            self.wal_ino: Optional[int] = None
+            self.offset = 0
+            self.snapshot_sig: Optional[List[int]] = None
+            self.valid = False                   # log header matches snapshot
+            self.first_record_at: Optional[float] = None
+
+    def __init__(self, registry_dir: Path, unix_group: str, logger: logging.Logger,
+                 retry_attempts: int = 3, retry_delay: float = 0.1,
+                 lock_fn: Optional[Callable[[str, float], Any]] = None,
+                 compact_interval: float = 1.0, compact_bytes: int = 262144,
+                 fsync: bool = False, group_commit_window: float = 0.002):
+        """Initialize journaled registry I/O handler.
+
+        Args:
+            registry_dir: Directory containing registry files
+            unix_group: Group name for file ownership
+            logger: Logger instance
+            retry_attempts: Number of retry attempts on I/O errors
+            retry_delay: Delay between retries in seconds
+            lock_fn: (file_name, timeout) -> context manager holding that registry's
+                lock, or raising TsimRegistryLockTimeout; used by background compaction
+            compact_interval: Max seconds log records wait before compaction
+            compact_bytes: Log size that triggers inline compaction
+            fsync: fdatasync the log before an update returns (group commit)
+            group_commit_window: Seconds the committer waits to batch appends
+        """
+        self._json = _TsimRegistryIO(registry_dir, unix_group, logger, retry_attempts, retry_delay)
+        self.registry_dir = Path(registry_dir)
+        self.unix_group = unix_group
+        self.logger = logger
+        self.lock_fn = lock_fn
+        self.compact_interval = compact_interval
+        self.compact_bytes = compact_bytes
+        self.fsync = fsync
+        self.group_commit_window = group_commit_window
+
+        self._tables: Dict[str, '_TsimJournaledRegistryIO._Table'] = {}
+        self._cond = threading.Condition()
+        self._appended = 0          # commit tickets handed out
+        self._synced = 0            # tickets covered by an fdatasync
+        self._unsynced: set = set()
+        self._thread: Optional[threading.Thread] = None
+        self._stopping = False
+
+    # ---------- catching up ----------
+
+    def _paths(self, file_name: str) -> Tuple[Path, Path]:
+        snapshot = self.registry_dir / file_name
+        return snapshot, snapshot.with_name(file_name + self.WAL_SUFFIX)
+
+    @staticmethod
+    def _signature(path: Path) -> Optional[List[int]]:
+        try:
+            st = os.stat(path)
+        except FileNotFoundError:
+            return None
+        return [st.st_ino, st.st_size, st.st_mtime_ns]
+
+    def _apply(self, table: '_TsimJournaledRegistryIO._Table', chunk: bytes, header: bool) -> int:
+        """Apply complete log lines in chunk; returns bytes consumed."""
+        end = chunk.rfind(b'\n') + 1
+        for line in chunk[:end].splitlines():
+            record = json.loads(line)
+            if header:
+                header = False
+                table.valid = record.get('snapshot') == table.snapshot_sig
+                continue
+            if not table.valid:
+                continue
+            for key in record.get('d', ()):
+                table.entries.pop(key, None)
+            for key, value in record.get('s', {}).items():
+                table.entries[key] = json.dumps(value, separators=(',', ':'))
+            if table.first_record_at is None:
+                table.first_record_at = time.time()
+        return end
+
+    def _sync(self, file_name: str) -> '_TsimJournaledRegistryIO._Table':
+        """Bring the cached registry up to date with snapshot + log."""
+        table = self._tables.get(file_name)
+        if table is None:
+            table = self._tables[file_name] = self._Table()
+        snapshot_path, wal_path = self._paths(file_name)
+
+        for attempt in range(3):
+            wal_sig = self._signature(wal_path)
+            snapshot_sig = self._signature(snapshot_path)
+            wal_ino = wal_sig[0] if wal_sig else None
+
+            if wal_ino == table.wal_ino and snapshot_sig == table.snapshot_sig:
+                if wal_sig and wal_sig[1] > table.offset:
+                    try:
+                        with open(wal_path, 'rb') as f:
+                            if os.fstat(f.fileno()).st_ino != wal_ino:
+                                continue  # Log replaced since the stat
+                            f.seek(table.offset)
+                            table.offset += self._apply(table, f.read(), header=table.offset == 0)
+                    except FileNotFoundError:
+                        continue
+                return table
+
+            # Snapshot or log replaced: reload both
+            data = self._json.atomic_read(file_name)
+            if self._signature(snapshot_path) != snapshot_sig:
+                continue  # Replaced while reading
+            table.entries = {k: json.dumps(v, separators=(',', ':')) for k, v in data.items()}
+            table.snapshot_sig = snapshot_sig
+            table.wal_ino = wal_ino
+            table.offset = 0
+            table.valid = False
+            table.first_record_at = None
+            if wal_sig:
+                try:
+                    with open(wal_path, 'rb') as f:
+                        if os.fstat(f.fileno()).st_ino == wal_ino:
+                            table.offset = self._apply(table, f.read(), header=True)
+                except FileNotFoundError:
+                    continue
+            return table
+        raise TsimRegistryError(f"Registry {file_name} kept changing while loading")
+
+    # ---------- public interface (same as _TsimRegistryIO) ----------
+
+    def atomic_read(self, file_name: str) -> Dict[str, Any]:
+        """Current registry contents (no lock needed)."""
+        table = self._sync(file_name)
+        return {k: json.loads(v) for k, v in table.entries.items()}
+
+    def read_entry(self, file_name: str, key: str) -> Optional[Any]:
+        """One entry, decoding only that entry (no lock needed)."""
+        encoded = self._sync(file_name).entries.get(key)
+        return json.loads(encoded) if encoded is not None else None
+
+    def atomic_write(self, file_name: str, data: Dict[str, Any]) -> None:
+        """Replace the whole registry: new snapshot, empty log.
+
+        IMPORTANT: This method must be called while holding appropriate lock!
+        """
+        self._json.atomic_write(file_name, data)
+        table = self._sync(file_name)
+        self._reset_log(file_name, table)
+
+    def atomic_update(self, file_name: str,
+                      update_fn: Callable[[Dict], Dict]) -> Dict[str, Any]:
+        """Read-modify-write that logs only the changed top-level keys.
+
+        IMPORTANT: This method must be called while holding appropriate lock!
+        """
+        table = self._sync(file_name)
+        data = {k: json.loads(v) for k, v in table.entries.items()}
+        new_data = update_fn(data)
+
+        changed = {}
+        for key, value in new_data.items():
+            encoded = json.dumps(value, separators=(',', ':'))
+            if table.entries.get(key) != encoded:
+                changed[key] = (value, encoded)
+        removed = [key for key in table.entries if key not in new_data]
+        if not changed and not removed:
+            return new_data
+
+        if not table.valid or table.wal_ino is None:
+            self._reset_log(file_name, table)
+        record = {}
+        if changed:
+            record['s'] = {key: value for key, (value, _) in changed.items()}
+        if removed:
+            record['d'] = removed
+        self._append(file_name, table, json.dumps(record, separators=(',', ':')).encode() + b'\n')
+
+        for key in removed:
+            del table.entries[key]
+        for key, (_, encoded) in changed.items():
+            table.entries[key] = encoded
+        if table.first_record_at is None:
+            table.first_record_at = time.time()
+
+        if table.offset >= self.compact_bytes:
+            self._compact(file_name, table)
+        else:
+            self._commit(file_name)
+        return new_data
+
+    def compact(self, file_name: str) -> None:
+        """Fold the log into the JSON snapshot.
+
+        IMPORTANT: This method must be called while holding appropriate lock!
+        """
+        self._compact(file_name, self._sync(file_name))
+
+    def close(self) -> None:
+        """Stop the background thread, compacting what it still can."""
+        with self._cond:
+            self._stopping = True
+            self._cond.notify_all()
+        if self._thread:
+            self._thread.join(timeout=5.0)
+            self._thread = None
+        self._compact_due(force=True)
+
+    # ---------- log writing ----------
+
+    def _append(self, file_name: str, table: '_TsimJournaledRegistryIO._Table', line: bytes) -> None:
+        _, wal_path = self._paths(file_name)
+        fd = os.open(str(wal_path), os.O_WRONLY | os.O_APPEND)
+        try:
+            os.write(fd, line)
+        finally:
+            os.close(fd)
+        table.offset += len(line)
+        self._start_thread()
+
+    def _reset_log(self, file_name: str, table: '_TsimJournaledRegistryIO._Table') -> None:
+        """Start an empty log for the current snapshot (atomic rename)."""
+        snapshot_path, wal_path = self._paths(file_name)
+        snapshot_sig = self._signature(snapshot_path)
+        header = json.dumps({'snapshot': snapshot_sig}).encode() + b'\n'
+        temp_path = wal_path.with_name(wal_path.name + '.tmp')
+        with open(temp_path, 'wb') as f:
+            f.write(header)
+        ensure_tsim_file_permissions(temp_path, self.unix_group, self.logger)
+        temp_path.replace(wal_path)
+        table.wal_ino = os.stat(wal_path).st_ino
+        table.snapshot_sig = snapshot_sig
+        table.offset = len(header)
+        table.valid = True
+        table.first_record_at = None
+
+    def _compact(self, file_name: str, table: '_TsimJournaledRegistryIO._Table') -> None:
+        if table.first_record_at is None and table.valid:
+            return
+        data = {k: json.loads(v) for k, v in table.entries.items()}
+        self._json.atomic_write(file_name, data)
+        self._reset_log(file_name, table)
+        self.logger.debug(f"Compacted {file_name} ({len(data)} entries)")
+
+    def _commit(self, file_name: str) -> None:
+        """Wait until a group fdatasync covers our append (fsync mode only)."""
+        if not self.fsync:
+            return
+        with self._cond:
+            self._appended += 1
+            ticket = self._appended
+            self._unsynced.add(file_name)
+            self._cond.notify_all()
+            while self._synced < ticket and self._thread is not None:
+                self._cond.wait(1.0)
+
+    # ---------- background committer / compactor ----------
+
+    def _start_thread(self) -> None:
+        if self._thread is None and not self._stopping:
+            self._thread = threading.Thread(target=self._run, name='tsim-registry-wal', daemon=True)
+            self._thread.start()
+
+    def _run(self) -> None:
+        while True:
+            with self._cond:
+                if not self._unsynced and not self._stopping:
+                    self._cond.wait(self.compact_interval)
+                if self._stopping:
+                    self._synced = self._appended
+                    self._cond.notify_all()
+                    return
+                pending = self._unsynced
+            if pending:
+                time.sleep(self.group_commit_window)  # Let more appends join this commit
+                with self._cond:
+                    target = self._appended
+                    files, self._unsynced = self._unsynced, set()
+                for file_name in files:
+                    try:
+                        fd = os.open(str(self._paths(file_name)[1]), os.O_RDONLY)
+                        try:
+                            os.fdatasync(fd)
+                        finally:
+                            os.close(fd)
+                    except OSError as e:
+                        self.logger.warning(f"fdatasync of {file_name} log failed: {e}")
+                with self._cond:
+                    self._synced = target
+                    self._cond.notify_all()
+            self._compact_due()
+
+    def _compact_due(self, force: bool = False) -> None:
+        """Compact logs whose oldest record is older than compact_interval."""
+        if self.lock_fn is None:
+            return
+        for file_name in list(self._tables):
+            try:
+                table = self._sync(file_name)
+                started = table.first_record_at
+                if started is None or (not force and time.time() - started < self.compact_interval):
+                    continue
+                with self.lock_fn(file_name, 0.5):
+                    self.compact(file_name)
+            except TsimRegistryLockTimeout:
+                continue  # Busy: the lock holder's updates keep the log going; retry later
+            except Exception as e:
+                self.logger.warning(f"Background compaction of {file_name} failed: {e}")
+
+
+def read_registry_file(path) -> Dict[str, Any]:
+    """Read a registry file the way TsimRegistryManager sees it.
+
+    For tools that read registry files directly instead of through a
+    TsimRegistryManager: with the journal backend the JSON file is only the
+    last snapshot, so apply its <file>.wal log on top (no lock needed). A
+    file without a log reads as plain JSON.
+
+    Args:
+        path: Registry file path
+
+    Returns:
+        Registry data dict (empty if the file doesn't exist)
+    """
+    path = Path(path)
+    reader = _TsimJournaledRegistryIO(path.parent, '', logging.getLogger(__name__))
+    return reader.atomic_read(path.name)
+
+
 @dataclass
 class _ActionRecord:
     """Record of an action for potential rollback."""
@@ -591,9 +1045,27 @@ class TsimRegistryManager:
         ensure_tsim_directory(self.lock_dir, self.unix_group, self.logger)
 
         # Initialize internal managers
-        self._lock_mgr = _TsimLockManager(self.lock_dir, self.unix_group, self.logger)
-        self._io = _TsimRegistryIO(self.registry_dir, self.unix_group, self.logger,
-                                    self.retry_attempts, self.retry_delay)
+        self._lock_mgr = _TsimLockManager(self.lock_dir, self.unix_group, self.logger,
+                                          registry_config.get('lock_backend', 'semaphore'),
+                                          registry_config.get('lock_table_size', 1024))
+        self.backend = registry_config.get('backend', 'json')
+        if self.backend == 'journal':
+            # In-memory tables + write-ahead log, compacted into the JSON files
+            self._io = _TsimJournaledRegistryIO(
+                self.registry_dir, self.unix_group, self.logger,
+                self.retry_attempts, self.retry_delay,
+                lock_fn=self._registry_file_lock,
+                compact_interval=registry_config.get('wal_compact_interval', 1.0),
+                compact_bytes=registry_config.get('wal_compact_bytes', 262144),
+                fsync=registry_config.get('wal_fsync', False),
+                group_commit_window=registry_config.get('wal_group_commit_window', 0.002))
+            # Processes that never call cleanup() must not leave updates only in the log
+            atexit.register(self._io.close)
+        elif self.backend == 'json':
+            self._io = _TsimRegistryIO(self.registry_dir, self.unix_group, self.logger,
+                                        self.retry_attempts, self.retry_delay)
+        else:
+            raise ValueError(f"Unknown registry_manager backend: {self.backend}")
 
         # Transaction log
         self.enable_transaction_log = registry_config.get('enable_transaction_log', False)
@@ -602,6 +1074,21 @@ class TsimRegistryManager:
         self.logger.info(f"TsimRegistryManager initialized: registry_dir={self.registry_dir}, "
                         f"lock_dir={self.lock_dir}")
 
+    @contextmanager
+    def _registry_file_lock(self, file_name: str, timeout: float):
+        """Hold the lock guarding a registry file (for background compaction)."""
+        lock_name = {
+            self.hosts_registry: self.LOCK_HOSTS,
+            self.host_leases_registry: self.LOCK_HOST_LEASES,
+            self.neighbor_leases_registry: self.LOCK_NEIGHBOR_LEASES
+        }[file_name]
+        if not self._lock_mgr.acquire(lock_name, timeout):
+            raise TsimRegistryLockTimeout(f"Timeout acquiring {lock_name}")
+        try:
+            yield
+        finally:
+            self._lock_mgr.release(lock_name)
+
     def _get_timeout(self, operation: str) -> float:
         """Get timeout for operation from config."""
         return self.lock_timeouts.get(operation, 30.0)
@@ -749,6 +1236,181 @@ class TsimRegistryManager:
         finally:
             self._lock_mgr.release(self.LOCK_HOSTS)
 
+    def check_and_register_hosts(self, hosts: List[Dict[str, Any]]) -> bool:
+        """Atomically check and register a set of hosts (all or nothing).
+
+        Same checks as check_and_register_host(), applied to every entry
+        against the existing registry and against the other entries, in a
+        single locked update. Nothing is registered if any entry collides.
+
+        Args:
+            hosts: Entries with host_name, primary_ip, connected_to,
+                   mac_address and optional additional_info
+
+        Returns:
+            True if all hosts registered, False if any collision detected
+
+        Raises:
+            RegistryError: On I/O errors or corruption
+        """
+        if not hosts:
+            return True
+
+        timeout = self._get_timeout('host_registry')
+
+        if not self._lock_mgr.acquire(self.LOCK_HOSTS, timeout):
+            raise TsimRegistryLockTimeout(f"Timeout acquiring host registry lock")
+
+        try:
+            def update_fn(existing: Dict) -> Dict:
+                # Collision index built once: (router, ip) -> host, mac -> host
+                ips = {}
+                macs = {}
+                for name, info in existing.items():
+                    ip_only = info.get('primary_ip', '').split('/')[0]
+                    ips[(info.get('connected_to', ''), ip_only)] = name
+                    if info.get('mac_address'):
+                        macs[info['mac_address']] = name
+
+                now = time.time()
+                created_at = time.strftime('%c')
+                for entry in hosts:
+                    host_name = entry['host_name']
+                    ip_only = entry['primary_ip'].split('/')[0]
+                    ip_key = (entry['connected_to'], ip_only)
+
+                    if host_name in existing:
+                        raise TsimRegistryCollision(f"Host name already exists: {host_name}")
+                    if ip_key in ips:
+                        raise TsimRegistryCollision(
+                            f"IP {ip_only} already in use by {ips[ip_key]} on router {entry['connected_to']}"
+                        )
+                    if entry['mac_address'] in macs:
+                        raise TsimRegistryCollision(
+                            f"MAC {entry['mac_address']} already in use by {macs[entry['mac_address']]}"
+                        )
+
+                    existing[host_name] = {
+                        'primary_ip': entry['primary_ip'],
+                        'connected_to': entry['connected_to'],
+                        'mac_address': entry['mac_address'],
+                        'created_at': created_at,
+                        'registered_at_timestamp': now
+                    }
+                    if entry.get('additional_info'):
+                        existing[host_name].update(entry['additional_info'])
+
+                    ips[ip_key] = host_name
+                    macs[entry['mac_address']] = host_name
+
+                return existing
+
+            try:
+                self._io.atomic_update(self.hosts_registry, update_fn)
+                self._log_transaction('register_hosts', {
+                    'hosts': [{'host_name': e['host_name'], 'ip': e['primary_ip'],
+                               'router': e['connected_to']} for e in hosts]
+                })
+                return True
+
+            except TsimRegistryCollision as e:
+                self.logger.warning(f"Bulk host registration rejected: {e}")
+                return False
+
+        finally:
+            self._lock_mgr.release(self.LOCK_HOSTS)
+
+    def unregister_hosts(self, host_names: List[str]) -> List[str]:
+        """Remove a set of hosts from physical registry in one update.
+
+        Args:
+            host_names: Hosts to remove
+
+        Returns:
+            Names that were registered and have been removed
+
+        Raises:
+            RegistryError: On I/O errors
+        """
+        timeout = self._get_timeout('host_registry')
+
+        if not self._lock_mgr.acquire(self.LOCK_HOSTS, timeout):
+            raise TsimRegistryLockTimeout(f"Timeout acquiring host registry lock")
+
+        try:
+            removed = []
+
+            def update_fn(hosts: Dict) -> Dict:
+                for host_name in host_names:
+                    if host_name in hosts:
+                        del hosts[host_name]
+                        removed.append(host_name)
+                return hosts
+
+            self._io.atomic_update(self.hosts_registry, update_fn)
+            if removed:
+                self._log_transaction('unregister_hosts', {'host_names': removed})
+
+            return removed
+
+        finally:
+            self._lock_mgr.release(self.LOCK_HOSTS)
+
+    def readdress_host(self, host_name: str, primary_ip: str) -> bool:
+        """Atomically move a registered host to a new primary IP.
+
+        Used by the warm host pool to hand an idle namespace to a job
+        without re-registering it. Same collision rule as registration:
+        the IP must not be in use by another host on the same router.
+
+        Args:
+            host_name: Registered host
+            primary_ip: New primary IP (CIDR format)
+
+        Returns:
+            True if updated, False if host unknown or IP collision
+
+        Raises:
+            RegistryError: On I/O errors
+        """
+        timeout = self._get_timeout('host_registry')
+
+        if not self._lock_mgr.acquire(self.LOCK_HOSTS, timeout):
+            raise TsimRegistryLockTimeout(f"Timeout acquiring host registry lock")
+
+        try:
+            def update_fn(hosts: Dict) -> Dict:
+                if host_name not in hosts:
+                    raise TsimRegistryCollision(f"Host not registered: {host_name}")
+
+                ip_only = primary_ip.split('/')[0]
+                router = hosts[host_name].get('connected_to', '')
+                for existing_name, existing_info in hosts.items():
+                    if existing_name == host_name:
+                        continue
+                    existing_ip_only = existing_info.get('primary_ip', '').split('/')[0]
+                    if existing_ip_only == ip_only and existing_info.get('connected_to', '') == router:
+                        raise TsimRegistryCollision(
+                            f"IP {ip_only} already in use by {existing_name} on router {router}"
+                        )
+
+                hosts[host_name]['primary_ip'] = primary_ip
+                return hosts
+
+            try:
+                self._io.atomic_update(self.hosts_registry, update_fn)
+                self._log_transaction('readdress_host', {
+                    'host_name': host_name,
+                    'ip': primary_ip
+                })
+                return True
+
+            except TsimRegistryCollision:
+                return False
+
+        finally:
+            self._lock_mgr.release(self.LOCK_HOSTS)
+
     def get_host_info(self, host_name: str) -> Optional[Dict[str, Any]]:
         """Get host information (no lock needed - read-only).
 
@@ -758,8 +1420,7 @@ class TsimRegistryManager:
         Returns:
             Host info dict or None if not found
         """
-        hosts = self._io.atomic_read(self.hosts_registry)
-        return hosts.get(host_name)
+        return self._io.read_entry(self.hosts_registry, host_name)
 
     def list_all_hosts(self) -> Dict[str, Dict[str, Any]]:
         """Get all registered hosts (no lock needed - read-only)."""
@@ -905,10 +1566,10 @@ class TsimRegistryManager:
         Returns:
             Current reference count (0 if no leases)
         """
-        leases = self._io.atomic_read(self.host_leases_registry)
-        if host_name not in leases:
+        entry = self._io.read_entry(self.host_leases_registry, host_name)
+        if not entry:
             return 0
-        return len(leases[host_name].get('leases', []))
+        return len(entry.get('leases', []))
 
     def list_host_leases(self, host_name: Optional[str] = None) -> Dict[str, Any]:
         """List all leases, optionally filtered by host name.
@@ -982,6 +1643,8 @@ class TsimRegistryManager:
 
     def _notify_router_waiters(self, router_name: str):
         """Notify waiters that router is free (touch notify file for inotify)."""
+        if self._lock_mgr.table is not None:
+            return  # Waiters sleep on the router mutex and are woken by its release
         notify_file = self.lock_dir / f"router_{router_name}_notify"
         try:
             notify_file.touch()
@@ -997,6 +1660,9 @@ class TsimRegistryManager:
         Returns:
             True if locked by any job
         """
+        locked = self._lock_mgr.is_locked(f"tsim-router-{router_name}")
+        if locked is not None:
+            return locked
         lock_file = self.lock_dir / f"tsim-router-{router_name}"
         return lock_file.exists()
 
@@ -1127,6 +1793,13 @@ class TsimRegistryManager:
         Returns:
             True if router became free, False if timeout
         """
+        # Shm locks: sleep on the router's mutex itself, woken by the release
+        free = self._lock_mgr.wait_unlocked(f"tsim-router-{router_name}", timeout)
+        if free is not None:
+            if not free:
+                self.logger.warning(f"Timeout waiting for router {router_name}")
+            return free
+
         lock_file = self.lock_dir / f"tsim-router-{router_name}"
         notify_file = self.lock_dir / f"router_{router_name}_notify"
 
@@ -1309,5 +1982,8 @@ class TsimRegistryManager:
     def cleanup(self):
         """Cleanup resources on shutdown."""
         self.logger.info("TsimRegistryManager shutting down...")
+        if isinstance(self._io, _TsimJournaledRegistryIO):
+            self._io.close()
+            atexit.unregister(self._io.close)
         self._lock_mgr.cleanup()
         self.logger.info("TsimRegistryManager shutdown complete")
@@ -0,0 +1,522 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Live per-packet rule trace collection
+
+Installs netfilter TRACE rules keyed by a job DSCP in router namespaces and
+streams the resulting trace events from the nflog_collector helper into
+Python. Each probe packet is attributed to the exact table, chain and rule
+it traversed on every router, in one pass, instead of being inferred from
+counter snapshots or syslog scraping.
+
+Two kernel sources are supported and auto-detected per router:
+- iptables-nft: TRACE sets nftrace; events come from the nf_tables trace
+  group and name the rule by handle, which is mapped to its position.
+- iptables-legacy: TRACE logs through nf_log; the namespace's IPv4 logger is
+  bound to nfnetlink_log and events carry "TRACE: table:chain:type:rulenum".
+
+Key Features:
+- Raw-table TRACE rules matching only the job's DSCP, removed on stop
+- One collector process per router with reader threads
+- Events normalised to classifier rule IDs (e.g. 'FORWARD:12')
+- Per-packet grouping by trace id (nftrace sends packet headers only with
+  the first event of each chain evaluation) and terminal rule/verdict lookup
+- Callback hook for streaming consumers
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import threading
+import time
+from dataclasses import dataclass, field
+from typing import Callable, Dict, List, Optional, Tuple, Any
+
+
+DEFAULT_COLLECTOR = '/usr/local/bin/nflog_collector'
+
+# Legacy TRACE prefix: "TRACE: <table>:<chain>:<rule|return|policy>:<rulenum> "
+TRACE_PREFIX_RE = re.compile(r'^TRACE: ([^:]+):([^:]+):(rule|return|policy):(\d+)')
+
+# Verdict names from the collector mapped to iptables decisions
+VERDICT_DECISIONS = {'accept': 'ACCEPT', 'drop': 'DROP', 'queue': 'QUEUE'}
+
+
+def _sudo_wrap(cmd: List[str]) -> List[str]:
+    return (['sudo', '-n'] + cmd) if os.geteuid() != 0 else cmd
+
+
+def _run(cmd: List[str]) -> subprocess.CompletedProcess:
+    return subprocess.run(_sudo_wrap(cmd), stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          text=True, check=False)
+
+
+@dataclass
+class RuleTraceEvent:
+    """One rule traversal of a traced packet on a router."""
+    router: str
+    source: str                      # nftrace or nflog
+    table: str
+    chain: str
+    rule_type: str                   # rule, return or policy
+    rule_number: Optional[int] = None
+    handle: Optional[int] = None
+    verdict: Optional[str] = None
+    jump: Optional[str] = None
+    trace_id: Optional[int] = None
+    timestamp: float = 0.0
+    dscp: Optional[int] = None
+    protocol: Optional[str] = None
+    src_ip: Optional[str] = None
+    dst_ip: Optional[str] = None
+    src_port: Optional[int] = None
+    dst_port: Optional[int] = None
+    interface_in: Optional[str] = None
+    interface_out: Optional[str] = None
+
+    @property
+    def rule_id(self) -> Optional[str]:
+        """Classifier-style rule ID ('CHAIN:N'), or None for policy/return events."""
+        if self.rule_type != 'rule' or self.rule_number is None:
+            return None
+        return f"{self.chain}:{self.rule_number}"
+
+    @property
+    def packet_key(self) -> Tuple:
+        """Key identifying the packet on its router (ICMP type/code ignored)."""
+        if self.protocol == 'icmp':
+            return (self.router, self.src_ip, self.dst_ip, self.protocol)
+        return (self.router, self.src_ip, self.dst_ip, self.protocol, self.src_port, self.dst_port)
+
+    @property
+    def decision(self) -> Optional[str]:
+        """ACCEPT/DROP if the event carries a final verdict."""
+        return VERDICT_DECISIONS.get(self.verdict)
+
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        return {
+            'router': self.router,
+            'source': self.source,
+            'table': self.table,
+            'chain': self.chain,
+            'rule_type': self.rule_type,
+            'rule_id': self.rule_id,
+            'rule_number': self.rule_number,
+            'handle': self.handle,
+            'verdict': self.verdict,
+            'jump': self.jump,
+            'trace_id': self.trace_id,
+            'timestamp': self.timestamp,
+            'dscp': self.dscp,
+            'protocol': self.protocol,
+            'src_ip': self.src_ip,
+            'dst_ip': self.dst_ip,
+            'src_port': self.src_port,
+            'dst_port': self.dst_port,
+            'interface_in': self.interface_in,
+            'interface_out': self.interface_out
+        }
+
+
+def parse_trace_line(router: str, line: str,
+                     resolve_handle: Optional[Callable[[str, str, int], Optional[int]]] = None
+                     ) -> Optional[RuleTraceEvent]:
+    """
+    Parse one collector output line into a RuleTraceEvent.
+
+    Args:
+        router: Router the collector runs in
+        line: JSON line printed by nflog_collector
+        resolve_handle: Maps (table, chain, handle) to a 1-based rule position (nftrace)
+
+    Returns:
+        RuleTraceEvent, or None for non-trace lines (ready, overrun, foreign NFLOG)
+    """
+    try:
+        data = json.loads(line)
+    except ValueError:
+        return None
+    if not isinstance(data, dict) or data.get('event') != 'trace':
+        return None
+
+    source = data.get('source', '')
+    if source == 'nflog':
+        match = TRACE_PREFIX_RE.match(data.get('prefix', ''))
+        if not match:
+            return None
+        table, chain, rule_type, number = match.groups()
+        rule_number = int(number) if rule_type == 'rule' else None
+        handle = None
+    else:
+        table = data.get('table')
+        chain = data.get('chain')
+        if not table or not chain:
+            return None
+        rule_type = data.get('type', 'rule')
+        handle = data.get('handle')
+        rule_number = None
+        if rule_type == 'rule' and handle is not None and resolve_handle is not None:
+            rule_number = resolve_handle(table, chain, handle)
+
+    return RuleTraceEvent(
+        router=router,
+        source=source,
+        table=table,
+        chain=chain,
+        rule_type=rule_type,
+        rule_number=rule_number,
+        handle=handle,
+        verdict=data.get('verdict'),
+        jump=data.get('jump'),
+        trace_id=data.get('id'),
+        timestamp=data.get('time', 0.0),
+        dscp=data.get('dscp'),
+        protocol=data.get('protocol'),
+        src_ip=data.get('src'),
+        dst_ip=data.get('dst'),
+        src_port=data.get('sport'),
+        dst_port=data.get('dport'),
+        interface_in=data.get('in'),
+        interface_out=data.get('out')
+    )
+
+
+def terminal_event(events: List[RuleTraceEvent], table: str = 'filter') -> Optional[RuleTraceEvent]:
+    """
+    The event that decided a packet's fate in a table.
+
+    Returns and non-terminal continues are skipped; the last remaining event
+    is the deciding rule or the chain policy.
+    """
+    for event in reversed(events):
+        if event.table != table or event.rule_type == 'return':
+            continue
+        if event.verdict in ('continue', 'return', 'jump', 'goto', 'break'):
+            continue
+        return event
+    return None
+
+
+@dataclass
+class _RouterTrace:
+    """Per-router collector process and installed state."""
+    router: str
+    backend: str
+    process: Optional[subprocess.Popen] = None
+    reader: Optional[threading.Thread] = None
+    ready: threading.Event = field(default_factory=threading.Event)
+    rule_installed: bool = False
+    restore_logger: Optional[str] = None
+    errors: List[str] = field(default_factory=list)
+
+
+class RuleTraceCollector:
+    """
+    Collect per-packet rule traces for one job DSCP on a set of routers.
+
+    Usage:
+        with RuleTraceCollector(['hq-gw', 'br-gw'], job_dscp=42) as collector:
+            send_probes()
+            collector.wait_idle()
+            event = collector.terminal_event('hq-gw', '10.1.1.1', '10.2.1.1', 'tcp', 80)
+    """
+
+    def __init__(self, routers: List[str], job_dscp: int, backend: str = 'auto',
+                 collector_path: str = DEFAULT_COLLECTOR, nflog_group: int = 0,
+                 on_event: Optional[Callable[[RuleTraceEvent], None]] = None, verbose: int = 0):
+        """
+        Args:
+            routers: Router namespaces to trace in
+            job_dscp: DSCP value (0-63) tagging this job's probes
+            backend: 'nftrace', 'nflog' or 'auto' (detect per router)
+            collector_path: Path to the nflog_collector helper
+            nflog_group: nfnetlink_log group (legacy TRACE logs to group 0)
+            on_event: Called from reader threads for every event
+            verbose: Verbosity level
+
+        Raises:
+            ValueError: If the DSCP or backend is invalid
+        """
+        if not 0 <= job_dscp <= 63:
+            raise ValueError(f"DSCP {job_dscp} out of range 0-63")
+        if backend not in ('auto', 'nftrace', 'nflog'):
+            raise ValueError(f"Unknown trace backend '{backend}'")
+        self.routers = list(routers)
+        self.job_dscp = job_dscp
+        self.backend = backend
+        self.collector_path = collector_path
+        self.nflog_group = nflog_group
+        self.on_event = on_event
+        self.verbose = verbose
+        self.comment = f"TSIM_TRACE_{job_dscp}"
+
+        self.events: List[RuleTraceEvent] = []
+        self.packets: Dict[Tuple, List[RuleTraceEvent]] = {}
+        self.overruns = 0
+        # (router, trace_id) -> first event of that packet carrying its headers
+        self._trace_headers: Dict[Tuple[str, int], RuleTraceEvent] = {}
+        self._lock = threading.Lock()
+        self._changed = threading.Condition(self._lock)
+        self._last_event = 0.0
+        self._handle_positions: Dict[Tuple[str, str, str], Dict[int, int]] = {}
+        self._traces: Dict[str, _RouterTrace] = {}
+
+    def _dbg(self, msg: str, level: int = 1):
+        if self.verbose >= level:
+            print(msg, file=sys.stderr)
+
+    def __enter__(self) -> 'RuleTraceCollector':
+        self.start()
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        self.stop()
+
+    def _trace_rule(self, op: str) -> List[str]:
+        return ['iptables', '-t', 'raw', op, 'PREROUTING'] + (['1'] if op == '-I' else []) + [
+            '-m', 'dscp', '--dscp', str(self.job_dscp),
+            '-m', 'comment', '--comment', self.comment, '-j', 'TRACE']
+
+    def detect_backend(self, router: str) -> str:
+        """'nftrace' if the router's iptables is the nf_tables variant, else 'nflog'."""
+        if self.backend != 'auto':
+            return self.backend
+        result = _run(['ip', 'netns', 'exec', router, 'iptables', '-V'])
+        return 'nftrace' if 'nf_tables' in result.stdout else 'nflog'
+
+    def start(self, timeout: float = 5.0):
+        """
+        Spawn collectors, then install the TRACE rules once each is listening.
+
+        Raises:
+            RuntimeError: If no router could be traced
+        """
+        for router in self.routers:
+            trace = _RouterTrace(router, self.detect_backend(router))
+            self._traces[router] = trace
+            if trace.backend == 'nflog':
+                # Legacy TRACE logs through the namespace's IPv4 nf_log backend
+                current = _run(['ip', 'netns', 'exec', router, 'cat', '/proc/sys/net/netfilter/nf_log/2'])
+                if current.returncode == 0 and current.stdout.strip() != 'nfnetlink_log':
+                    trace.restore_logger = current.stdout.strip()
+                    _run(['ip', 'netns', 'exec', router, 'sysctl', '-q', '-w',
+                          'net.netfilter.nf_log.2=nfnetlink_log'])
+                args = ['--nflog', str(self.nflog_group)]
+            else:
+                args = ['--nftrace']
+            try:
+                trace.process = subprocess.Popen(
+                    [self.collector_path, router] + args + ['--dscp', str(self.job_dscp)],
+                    stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, bufsize=1)
+            except OSError as e:
+                trace.errors.append(str(e))
+                continue
+            trace.reader = threading.Thread(target=self._read, args=(trace,), daemon=True)
+            trace.reader.start()
+
+        deadline = time.monotonic() + timeout
+        for trace in self._traces.values():
+            if trace.process is None:
+                continue
+            if not trace.ready.wait(max(0.0, deadline - time.monotonic())):
+                trace.errors.append('collector did not become ready')
+                continue
+            result = _run(['ip', 'netns', 'exec', trace.router] + self._trace_rule('-I'))
+            if result.returncode == 0:
+                trace.rule_installed = True
+            else:
+                trace.errors.append(result.stderr.strip())
+
+        for trace in self._traces.values():
+            for error in trace.errors:
+                self._dbg(f"[{trace.router}] rule trace: {error}", 1)
+        if not any(trace.rule_installed for trace in self._traces.values()):
+            self.stop()
+            raise RuntimeError(f"Rule tracing unavailable on {', '.join(self.routers)}")
+
+    def stop(self):
+        """Remove TRACE rules, restore loggers and terminate collectors."""
+        for trace in self._traces.values():
+            if trace.rule_installed:
+                _run(['ip', 'netns', 'exec', trace.router] + self._trace_rule('-D'))
+                trace.rule_installed = False
+            if trace.restore_logger is not None:
+                _run(['ip', 'netns', 'exec', trace.router, 'sysctl', '-q', '-w',
+                      f'net.netfilter.nf_log.2={trace.restore_logger}'])
+                trace.restore_logger = None
+            if trace.process is not None and trace.process.poll() is None:
+                trace.process.terminate()
+                try:
+                    trace.process.wait(timeout=2)
+                except subprocess.TimeoutExpired:
+                    trace.process.kill()
+                    trace.process.wait()
+        for trace in self._traces.values():
+            if trace.reader is not None:
+                trace.reader.join(timeout=2)
+
+    def traced_routers(self) -> List[str]:
+        """Routers with an installed TRACE rule."""
+        return [router for router, trace in self._traces.items() if trace.rule_installed]
+
+    def _read(self, trace: _RouterTrace):
+        """Reader thread: feed collector output into the event store."""
+        for line in trace.process.stdout:
+            if not trace.ready.is_set() and '"ready"' in line:
+                trace.ready.set()
+                continue
+            if '"overrun"' in line:
+                with self._lock:
+                    self.overruns += 1
+                continue
+            self.ingest(trace.router, line)
+        stderr = trace.process.stderr.read().strip()
+        if stderr:
+            trace.errors.append(stderr)
+        trace.ready.set()
+
+    def ingest(self, router: str, line: str) -> Optional[RuleTraceEvent]:
+        """Parse and record one collector line; returns the event if it was a trace."""
+        event = parse_trace_line(router, line, lambda table, chain, handle:
+                                 self.rule_position(router, table, chain, handle))
+        if event is None:
+            return None
+        with self._changed:
+            if event.trace_id is not None:
+                key = (router, event.trace_id)
+                first = self._trace_headers.get(key)
+                if event.protocol is not None:
+                    if first is None:
+                        self._trace_headers[key] = event
+                elif first is not None:
+                    # Later events of the packet: take the headers of its first one
+                    for name in ('dscp', 'protocol', 'src_ip', 'dst_ip', 'src_port', 'dst_port'):
+                        setattr(event, name, getattr(first, name))
+            self.events.append(event)
+            self.packets.setdefault(event.packet_key, []).append(event)
+            self._last_event = time.monotonic()
+            self._changed.notify_all()
+        if self.on_event is not None:
+            self.on_event(event)
+        return event
+
+    def rule_position(self, router: str, table: str, chain: str, handle: int) -> Optional[int]:
+        """1-based position of an nf_tables rule handle in its chain (cached per chain)."""
+        key = (router, table, chain)
+        positions = self._handle_positions.get(key)
+        if positions is None:
+            positions = {}
+            result = _run(['ip', 'netns', 'exec', router, 'nft', '-j', '-a', 'list', 'chain', 'ip', table, chain])
+            if result.returncode == 0:
+                try:
+                    items = json.loads(result.stdout).get('nftables', [])
+                except ValueError:
+                    items = []
+                rules = [item['rule'] for item in items if 'rule' in item]
+                positions = {rule['handle']: index for index, rule in enumerate(rules, 1)}
+            self._handle_positions[key] = positions
+        return positions.get(handle)
+
+    def wait_idle(self, quiet: float = 0.2, timeout: float = 5.0) -> int:
+        """
+        Wait until no event arrived for `quiet` seconds (or timeout).
+
+        Returns:
+            Number of events collected so far
+        """
+        started = time.monotonic()
+        deadline = started + timeout
+        with self._changed:
+            while True:
+                now = time.monotonic()
+                idle_at = max(self._last_event, started) + quiet
+                if now >= deadline or now >= idle_at:
+                    return len(self.events)
+                self._changed.wait(min(idle_at, deadline) - now)
+
+    def packet_events(self, router: str, src_ip: str, dst_ip: str, protocol: str,
+                      dst_port: Optional[int] = None, src_port: Optional[int] = None) -> List[RuleTraceEvent]:
+        """Events for packets matching the flow on a router, in arrival order.
+
+        nftrace events are grouped by trace id: once one event of a packet
+        matches the flow, every event with its id belongs to it.
+        """
+        def matches(event: RuleTraceEvent) -> bool:
+            return (event.src_ip == src_ip and event.dst_ip == dst_ip and event.protocol == protocol
+                    and (dst_port is None or protocol == 'icmp' or event.dst_port == dst_port)
+                    and (src_port is None or protocol == 'icmp' or event.src_port == src_port))
+
+        with self._lock:
+            events = [event for event in self.events if event.router == router]
+            trace_ids = {event.trace_id for event in events
+                         if event.trace_id is not None and matches(event)}
+            return [event for event in events
+                    if (event.trace_id in trace_ids if event.trace_id is not None else matches(event))]
+
+    def terminal_event(self, router: str, src_ip: str, dst_ip: str, protocol: str,
+                       dst_port: Optional[int] = None, src_port: Optional[int] = None,
+                       table: str = 'filter') -> Optional[RuleTraceEvent]:
+        """The rule (or policy) that decided the flow's fate on a router, if traced."""
+        return terminal_event(self.packet_events(router, src_ip, dst_ip, protocol, dst_port, src_port), table)
+
+    def to_dict(self) -> Dict[str, Any]:
+        """Convert to dictionary for JSON serialization."""
+        with self._lock:
+            events = [event.to_dict() for event in self.events]
+            overruns = self.overruns
+        return {
+            'job_dscp': self.job_dscp,
+            'routers': {router: {'backend': trace.backend, 'traced': trace.rule_installed,
+                                 'errors': list(trace.errors)}
+                        for router, trace in self._traces.items()},
+            'overruns': overruns,
+            'events': events
+        }
+
+
+def main():
+    """Trace a job DSCP on routers and print events as JSON lines."""
+    parser = argparse.ArgumentParser(
+        description="Live per-packet iptables rule tracing",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+    # Trace DSCP 42 on two routers for 30 seconds
+    python3 rule_trace_collector.py --routers hq-gw,br-gw --dscp 42 --duration 30
+
+    # Force the legacy nflog backend
+    python3 rule_trace_collector.py --routers hq-gw --dscp 42 --backend nflog
+        """
+    )
+    parser.add_argument('--routers', required=True, help='Comma-separated router namespaces')
+    parser.add_argument('--dscp', type=int, required=True, help='Job DSCP value to trace (0-63)')
+    parser.add_argument('--duration', type=float, default=10.0, help='Seconds to collect (default: 10)')
+    parser.add_argument('--backend', choices=['auto', 'nftrace', 'nflog'], default='auto')
+    parser.add_argument('--collector', default=DEFAULT_COLLECTOR, help='Path to nflog_collector')
+    parser.add_argument('-v', '--verbose', action='count', default=0, help='Increase verbosity')
+    args = parser.parse_args()
+
+    def print_event(event: RuleTraceEvent):
+        print(json.dumps(event.to_dict()), flush=True)
+
+    try:
+        collector = RuleTraceCollector([r for r in args.routers.split(',') if r], args.dscp,
+                                       args.backend, args.collector, on_event=print_event,
+                                       verbose=args.verbose)
+        with collector:
+            time.sleep(args.duration)
+    except (ValueError, RuntimeError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(2)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
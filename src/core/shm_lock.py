@@ -0,0 +1,425 @@
+#!/usr/bin/env -S python3 -B -u
+"""Shared-memory lock table with FIFO handoff and owner-death recovery.
+
+Named locks live in one mmap'd segment under /dev/shm/tsim. Each lock is a
+robust, process-shared pthread mutex (glibc via ctypes, no native build):
+
+- A holder owns the lock mutex for its whole critical section. Waiters
+  block inside the kernel (futex) instead of polling, so a release hands
+  the lock over in microseconds.
+- If a holder dies, the kernel's robust-futex list wakes the next waiter
+  with EOWNERDEAD; it marks the mutex consistent and owns the lock. No
+  stale-lock sweep is needed.
+- Fairness: waiters take a ticket in the lock's queue. Only the oldest
+  live ticket blocks on the lock mutex; the others sleep on a condition
+  variable until they reach the head. A new caller only takes the lock
+  directly when nobody is queued, so locks are granted first-come
+  first-served.
+
+A record's bookkeeping (queue, owner, tickets) is guarded by a second
+robust mutex that is only ever held briefly.
+
+Like any pthread mutex, a lock must be released by the thread that
+acquired it.
+
+Record layout (2048 bytes):
+    0     64s   name (NUL padded, empty = free record)
+    64    64B   state mutex (guards the fields below)
+    128   64B   condition variable (queue changes)
+    192   64B   lock mutex (held by the lock owner)
+    256   u64   next ticket
+    264   u32   owner pid
+    268   u32   owner tid
+    272   f64   acquired_at
+    280   8B    reserved
+    288   96 x {u64 ticket, u32 pid, u32 tid}  waiter queue (ticket 0 = empty)
+"""
+
+import ctypes
+import ctypes.util
+import errno
+import logging
+import mmap
+import os
+import struct
+import threading
+import time
+from pathlib import Path
+from typing import Any, Callable, Dict, List, Optional
+
+from .tsim_shm_manager import map_shared_segment
+
+
+MAGIC = b'TSIMLOCK'
+VERSION = 1
+HEADER_SIZE = 4096
+HEADER_MUTEX_OFFSET = 64
+RECORD_SIZE = 2048
+NAME_SIZE = 64
+STATE_OFFSET = 64
+COND_OFFSET = 128
+LOCK_OFFSET = 192
+TICKET_OFFSET = 256
+OWNER_OFFSET = 264
+QUEUE_OFFSET = 288
+QUEUE_SLOTS = 96
+_HEADER = struct.Struct('<8sII')
+_OWNER = struct.Struct('<IId')
+_SLOT = struct.Struct('<QII')
+
+_CLOCK_MONOTONIC = 1
+_PSHARED = 1
+_ROBUST = 1
+_LIVENESS_SLICE = 1.0  # How often non-head waiters re-check for dead queue entries
+
+
+class _Timespec(ctypes.Structure):
+    _fields_ = [('tv_sec', ctypes.c_long), ('tv_nsec', ctypes.c_long)]
+
+
+def _load_pthread():
+    """Robust/process-shared pthread entry points from libc, or None."""
+    try:
+        libc = ctypes.CDLL(ctypes.util.find_library('c') or 'libc.so.6')
+        funcs = {name: getattr(libc, name) for name in (
+            'pthread_mutexattr_init', 'pthread_mutexattr_setpshared', 'pthread_mutexattr_setrobust',
+            'pthread_mutex_init', 'pthread_mutex_lock', 'pthread_mutex_trylock',
+            'pthread_mutex_clocklock', 'pthread_mutex_unlock', 'pthread_mutex_consistent',
+            'pthread_condattr_init', 'pthread_condattr_setpshared', 'pthread_condattr_setclock',
+            'pthread_cond_init', 'pthread_cond_clockwait', 'pthread_cond_broadcast')}
+    except (OSError, AttributeError):
+        return None
+    for name, func in funcs.items():
+        func.restype = ctypes.c_int
+        if name in ('pthread_mutex_clocklock',):
+            func.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(_Timespec)]
+        elif name == 'pthread_cond_clockwait':
+            func.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(_Timespec)]
+        elif name in ('pthread_mutexattr_setpshared', 'pthread_mutexattr_setrobust',
+                      'pthread_condattr_setpshared', 'pthread_condattr_setclock'):
+            func.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        elif name in ('pthread_mutex_init', 'pthread_cond_init'):
+            func.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        else:
+            func.argtypes = [ctypes.c_void_p]
+    return funcs
+
+
+_PTHREAD = _load_pthread()
+
+
+def shm_locks_available() -> bool:
+    """True when robust process-shared mutexes are usable."""
+    return _PTHREAD is not None
+
+
+def _pid_alive(pid: int) -> bool:
+    if pid <= 0:
+        return False
+    try:
+        os.kill(pid, 0)
+        return True
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        return True
+
+
+def _deadline(timeout: float) -> _Timespec:
+    when = time.clock_gettime_ns(time.CLOCK_MONOTONIC) + int(max(0.0, timeout) * 1e9)
+    return _Timespec(when // 1_000_000_000, when % 1_000_000_000)
+
+
+class TsimShmLockTable:
+    """Named FIFO locks on robust process-shared mutexes in /dev/shm"""
+
+    def __init__(self, path: Path, records: int = 1024, logger: Optional[logging.Logger] = None,
+                 prepare: Optional[Callable[[Path], None]] = None):
+        """Map (creating if needed) the lock table
+
+        Args:
+            path: Segment file, normally under /dev/shm/tsim
+            records: Maximum number of distinct lock names
+            logger: Optional logger
+            prepare: Called with a newly built table file before it replaces path
+                     (e.g. to set group permissions)
+
+        Raises:
+            RuntimeError: If robust pthread mutexes are not available
+            OSError: If the table cannot be created or mapped
+        """
+        if _PTHREAD is None:
+            raise RuntimeError("robust process-shared pthread mutexes not available")
+        self._pt = _PTHREAD
+        self.path = Path(path)
+        self.records = records
+        self.size = HEADER_SIZE + records * RECORD_SIZE
+        self.logger = logger or logging.getLogger(__name__)
+
+        def initialize(mm: mmap.mmap):
+            buffer = (ctypes.c_char * self.size).from_buffer(mm)
+            self._init_mutex(ctypes.addressof(buffer) + HEADER_MUTEX_OFFSET)
+            del buffer
+
+        self._mm = map_shared_segment(self.path, self.size, _HEADER.pack(MAGIC, VERSION, records),
+                                      initialize=initialize, prepare=prepare)
+        self._buffer = (ctypes.c_char * self.size).from_buffer(self._mm)
+        self._base = ctypes.addressof(self._buffer)
+
+        self._index: Dict[str, int] = {}
+
+    # --------------- pthread primitives ---------------
+    def _init_mutex(self, addr: int):
+        attr = ctypes.create_string_buffer(64)
+        self._pt['pthread_mutexattr_init'](attr)
+        self._pt['pthread_mutexattr_setpshared'](attr, _PSHARED)
+        self._pt['pthread_mutexattr_setrobust'](attr, _ROBUST)
+        rc = self._pt['pthread_mutex_init'](addr, attr)
+        if rc:
+            raise OSError(rc, f"pthread_mutex_init: {os.strerror(rc)}")
+
+    def _init_cond(self, addr: int):
+        attr = ctypes.create_string_buffer(64)
+        self._pt['pthread_condattr_init'](attr)
+        self._pt['pthread_condattr_setpshared'](attr, _PSHARED)
+        self._pt['pthread_condattr_setclock'](attr, _CLOCK_MONOTONIC)
+        rc = self._pt['pthread_cond_init'](addr, attr)
+        if rc:
+            raise OSError(rc, f"pthread_cond_init: {os.strerror(rc)}")
+
+    def _recovered(self, rc: int, addr: int, what: str) -> int:
+        """Turn EOWNERDEAD into success after marking the mutex consistent."""
+        if rc == errno.EOWNERDEAD:
+            self._pt['pthread_mutex_consistent'](addr)
+            self.logger.warning(f"Recovered {what} from a dead owner")
+            return 0
+        return rc
+
+    def _lock_state(self, addr: int, what: str):
+        rc = self._recovered(self._pt['pthread_mutex_lock'](addr), addr, what)
+        if rc:
+            raise OSError(rc, f"Locking {what}: {os.strerror(rc)}")
+
+    # --------------- records ---------------
+    def _record_addr(self, record: int) -> int:
+        return self._base + HEADER_SIZE + record * RECORD_SIZE
+
+    def _record_offset(self, record: int) -> int:
+        return HEADER_SIZE + record * RECORD_SIZE
+
+    def _record(self, name: str) -> int:
+        """Record index for name, allocating and initializing it on first use."""
+        record = self._index.get(name)
+        if record is not None:
+            return record
+        key = name.encode()[:NAME_SIZE - 1]
+        found = self._find(key)
+        if found is None:
+            header_mutex = self._base + HEADER_MUTEX_OFFSET
+            self._lock_state(header_mutex, 'lock table header')
+            try:
+                found = self._find(key)
+                if found is None:
+                    found = self._find(b'')
+                    if found is None:
+                        raise RuntimeError(f"Lock table {self.path} is full ({self.records} names)")
+                    offset = self._record_offset(found)
+                    addr = self._record_addr(found)
+                    self._mm[offset:offset + RECORD_SIZE] = bytes(RECORD_SIZE)
+                    self._init_mutex(addr + STATE_OFFSET)
+                    self._init_cond(addr + COND_OFFSET)
+                    self._init_mutex(addr + LOCK_OFFSET)
+                    self._mm[offset:offset + NAME_SIZE] = key.ljust(NAME_SIZE, b'\0')
+            finally:
+                self._pt['pthread_mutex_unlock'](header_mutex)
+        self._index[name] = found
+        return found
+
+    def _find(self, key: bytes) -> Optional[int]:
+        for record in range(self.records):
+            offset = self._record_offset(record)
+            stored = self._mm[offset:offset + NAME_SIZE].split(b'\0', 1)[0]
+            if stored == key:
+                return record
+        return None
+
+    def _record_name(self, record: int) -> str:
+        offset = self._record_offset(record)
+        return self._mm[offset:offset + NAME_SIZE].split(b'\0', 1)[0].decode(errors='replace')
+
+    # --------------- queue (state mutex held) ---------------
+    def _slots(self, record: int) -> List[tuple]:
+        base = self._record_offset(record) + QUEUE_OFFSET
+        return [_SLOT.unpack_from(self._mm, base + i * _SLOT.size) for i in range(QUEUE_SLOTS)]
+
+    def _set_slot(self, record: int, index: int, ticket: int, pid: int, tid: int):
+        _SLOT.pack_into(self._mm, self._record_offset(record) + QUEUE_OFFSET + index * _SLOT.size,
+                        ticket, pid, tid)
+
+    def _head(self, record: int) -> Optional[int]:
+        """Oldest live ticket; dead waiters' entries are dropped on the way."""
+        head = None
+        for index, (ticket, pid, _) in enumerate(self._slots(record)):
+            if not ticket:
+                continue
+            if pid != os.getpid() and not _pid_alive(pid):
+                self._set_slot(record, index, 0, 0, 0)
+                continue
+            if head is None or ticket < head:
+                head = ticket
+        return head
+
+    def _enqueue(self, record: int) -> Optional[int]:
+        offset = self._record_offset(record)
+        for index, (ticket, _, _) in enumerate(self._slots(record)):
+            if not ticket:
+                ticket = struct.unpack_from('<Q', self._mm, offset + TICKET_OFFSET)[0] + 1
+                struct.pack_into('<Q', self._mm, offset + TICKET_OFFSET, ticket)
+                self._set_slot(record, index, ticket, os.getpid(), threading.get_native_id())
+                return ticket
+        return None
+
+    def _dequeue(self, record: int, ticket: int):
+        for index, (slot_ticket, _, _) in enumerate(self._slots(record)):
+            if slot_ticket == ticket:
+                self._set_slot(record, index, 0, 0, 0)
+                return
+
+    def _set_owner(self, record: int, pid: int, tid: int, acquired_at: float):
+        _OWNER.pack_into(self._mm, self._record_offset(record) + OWNER_OFFSET, pid, tid, acquired_at)
+
+    # --------------- public API ---------------
+    def acquire(self, name: str, timeout: float) -> bool:
+        """Block until the named lock is held (FIFO) or timeout expires
+
+        Returns:
+            True if acquired, False on timeout
+        """
+        record = self._record(name)
+        addr = self._record_addr(record)
+        state, cond, lock = addr + STATE_OFFSET, addr + COND_OFFSET, addr + LOCK_OFFSET
+        deadline = time.monotonic() + timeout
+        ticket = None
+
+        self._lock_state(state, f"lock {name} state")
+        try:
+            while True:
+                head = self._head(record)
+                if ticket is None and head is None:
+                    # Nobody queued: take it directly if free
+                    rc = self._recovered(self._pt['pthread_mutex_trylock'](lock), lock, f"lock {name}")
+                    if rc == 0:
+                        self._set_owner(record, os.getpid(), threading.get_native_id(), time.time())
+                        return True
+                if ticket is None:
+                    ticket = self._enqueue(record)
+                    head = self._head(record)
+
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    break
+
+                if ticket is not None and ticket == head:
+                    # Head of the queue: sleep in the kernel on the lock itself
+                    self._pt['pthread_mutex_unlock'](state)
+                    rc = self._pt['pthread_mutex_clocklock'](lock, _CLOCK_MONOTONIC,
+                                                             ctypes.byref(_deadline(remaining)))
+                    rc = self._recovered(rc, lock, f"lock {name}")
+                    self._lock_state(state, f"lock {name} state")
+                    if rc == 0:
+                        self._dequeue(record, ticket)
+                        ticket = None
+                        self._set_owner(record, os.getpid(), threading.get_native_id(), time.time())
+                        self._pt['pthread_cond_broadcast'](cond)
+                        return True
+                    if rc != errno.ETIMEDOUT:
+                        raise OSError(rc, f"Locking {name}: {os.strerror(rc)}")
+                    break
+
+                # Not our turn (or queue full): wait for the queue to move
+                rc = self._pt['pthread_cond_clockwait'](
+                    cond, state, _CLOCK_MONOTONIC, ctypes.byref(_deadline(min(remaining, _LIVENESS_SLICE))))
+                self._recovered(rc, state, f"lock {name} state")
+
+            if ticket is not None:
+                self._dequeue(record, ticket)
+                self._pt['pthread_cond_broadcast'](cond)
+            return False
+        finally:
+            self._pt['pthread_mutex_unlock'](state)
+
+    def try_acquire(self, name: str) -> bool:
+        """Take the named lock only if it is free and nobody is queued."""
+        record = self._record(name)
+        addr = self._record_addr(record)
+        state, lock = addr + STATE_OFFSET, addr + LOCK_OFFSET
+        self._lock_state(state, f"lock {name} state")
+        try:
+            if self._head(record) is not None:
+                return False
+            if self._recovered(self._pt['pthread_mutex_trylock'](lock), lock, f"lock {name}"):
+                return False
+            self._set_owner(record, os.getpid(), threading.get_native_id(), time.time())
+            return True
+        finally:
+            self._pt['pthread_mutex_unlock'](state)
+
+    def release(self, name: str) -> bool:
+        """Release the named lock; False if this thread does not hold it."""
+        record = self._record(name)
+        addr = self._record_addr(record)
+        offset = self._record_offset(record)
+        pid, tid, _ = _OWNER.unpack_from(self._mm, offset + OWNER_OFFSET)
+        if pid != os.getpid() or tid != threading.get_native_id():
+            return False
+        self._set_owner(record, 0, 0, 0.0)
+        rc = self._pt['pthread_mutex_unlock'](addr + LOCK_OFFSET)
+        if rc:
+            self.logger.error(f"Unlocking {name}: {os.strerror(rc)}")
+            return False
+        return True
+
+    def is_locked(self, name: str) -> bool:
+        """True if some live thread holds the named lock."""
+        record = self._record(name)
+        lock = self._record_addr(record) + LOCK_OFFSET
+        rc = self._recovered(self._pt['pthread_mutex_trylock'](lock), lock, f"lock {name}")
+        if rc == 0:
+            self._pt['pthread_mutex_unlock'](lock)
+            return False
+        return True
+
+    def wait_unlocked(self, name: str, timeout: float) -> bool:
+        """Block until the named lock is free (without taking it) or timeout."""
+        record = self._record(name)
+        lock = self._record_addr(record) + LOCK_OFFSET
+        rc = self._pt['pthread_mutex_clocklock'](lock, _CLOCK_MONOTONIC, ctypes.byref(_deadline(timeout)))
+        rc = self._recovered(rc, lock, f"lock {name}")
+        if rc == 0:
+            self._pt['pthread_mutex_unlock'](lock)
+            return True
+        return False
+
+    def holders(self) -> List[Dict[str, Any]]:
+        """Snapshot of named locks: owner, hold time and queue length."""
+        result = []
+        now = time.time()
+        for record in range(self.records):
+            name = self._record_name(record)
+            if not name:
+                continue
+            offset = self._record_offset(record)
+            pid, tid, acquired_at = _OWNER.unpack_from(self._mm, offset + OWNER_OFFSET)
+            queued = sum(1 for ticket, _, _ in self._slots(record) if ticket)
+            result.append({
+                'name': name,
+                'owner_pid': pid or None,
+                'owner_tid': tid or None,
+                'held_for': now - acquired_at if pid else None,
+                'waiters': queued
+            })
+        return result
+
+    def close(self):
+        del self._buffer
+        self._mm.close()
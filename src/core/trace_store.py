@@ -0,0 +1,421 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Trace Store
+
+Bounded in-memory store for completed packet traces. Each trace is packed
+into a compact binary record when stored, so memory use is accounted per
+byte and enforced against a fixed budget instead of growing with the number
+of PacketTrace/PacketHop objects kept alive.
+
+Key Features:
+- Fixed memory budget with least-recently-used eviction
+- Optional maximum age with eviction by trace end time
+- Secondary indexes by status, source IP and destination IP
+- Streaming JSON and binary export straight from the packed records
+- Dict-like interface compatible with the previous completed_traces dict
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import heapq
+import io
+import json
+import math
+import struct
+from collections import OrderedDict
+from collections.abc import MutableMapping
+from datetime import datetime, timedelta
+from typing import Any, BinaryIO, Dict, Iterable, Iterator, List, Optional, Set, TextIO, Tuple
+
+
+# Binary export file magic
+BINARY_MAGIC = b'TSIMTRC1'
+
+# Sentinels for nullable fixed-width fields
+_NULL_I32 = -2 ** 31
+_NULL_I64 = -2 ** 63
+_NULL_STR = 0xFFFF
+
+# start_us, end_us, source_port, dest_port, packet_size, ttl, hop_count
+_TRACE_HEADER = struct.Struct('<qqiiIIH')
+# hop_number, timestamp_us, rtt_ms, ttl_in, ttl_out, route_metric,
+# processing_time_ms, queue_delay_ms, log_entry_count
+_HOP_HEADER = struct.Struct('<iqdiiiddI')
+_STR_LEN = struct.Struct('<H')
+_REC_LEN = struct.Struct('<I')
+
+_TRACE_STRINGS = ('trace_id', 'source_ip', 'dest_ip', 'protocol', 'status')
+_HOP_STRINGS = ('router_name', 'router_ip', 'interface_in', 'interface_out',
+                'routing_table', 'next_hop', 'policy_rule', 'iptables_decision',
+                'iptables_rule', 'iptables_chain', 'iptables_table')
+
+# Estimated per-trace bookkeeping cost (OrderedDict slot, metadata, index
+# entries, and up to two age heap entries)
+_ENTRY_OVERHEAD = 256
+
+_EPOCH = datetime(1970, 1, 1)
+_MICROSECOND = timedelta(microseconds=1)
+
+
+def _dt_to_us(value: Optional[datetime]) -> int:
+    """Naive datetime to integer microseconds (lossless round trip)."""
+    if value is None:
+        return _NULL_I64
+    return (value - _EPOCH) // _MICROSECOND
+
+
+def _us_to_dt(value: int) -> Optional[datetime]:
+    if value == _NULL_I64:
+        return None
+    return _EPOCH + timedelta(microseconds=value)
+
+
+def _opt_int(value: Optional[int]) -> int:
+    return _NULL_I32 if value is None else value
+
+
+def _int_or_none(value: int) -> Optional[int]:
+    return None if value == _NULL_I32 else value
+
+
+def _opt_float(value: Optional[float]) -> float:
+    return math.nan if value is None else value
+
+
+def _float_or_none(value: float) -> Optional[float]:
+    return None if math.isnan(value) else value
+
+
+def _pack_str(parts: List[bytes], value: Optional[str]):
+    if value is None:
+        parts.append(_STR_LEN.pack(_NULL_STR))
+        return
+    data = str(value).encode('utf-8')
+    if len(data) >= _NULL_STR:
+        # Truncate on a character boundary so the record still decodes
+        data = data[:_NULL_STR - 1].decode('utf-8', 'ignore').encode('utf-8')
+    parts.append(_STR_LEN.pack(len(data)))
+    parts.append(data)
+
+
+def _unpack_str(buf: memoryview, offset: int) -> Tuple[Optional[str], int]:
+    (length,) = _STR_LEN.unpack_from(buf, offset)
+    offset += _STR_LEN.size
+    if length == _NULL_STR:
+        return None, offset
+    return str(buf[offset:offset + length], 'utf-8'), offset + length
+
+
+def encode_trace(trace) -> bytes:
+    """Pack a PacketTrace into a binary record."""
+    parts: List[bytes] = [_TRACE_HEADER.pack(
+        _dt_to_us(trace.start_time), _dt_to_us(trace.end_time),
+        _opt_int(trace.source_port), _opt_int(trace.dest_port),
+        trace.packet_size, trace.ttl, len(trace.hops)
+    )]
+    for name in _TRACE_STRINGS:
+        _pack_str(parts, getattr(trace, name))
+    for hop in trace.hops:
+        parts.append(_HOP_HEADER.pack(
+            hop.hop_number, _dt_to_us(hop.timestamp), _opt_float(hop.rtt_ms),
+            _opt_int(hop.ttl_in), _opt_int(hop.ttl_out), _opt_int(hop.route_metric),
+            _opt_float(hop.processing_time_ms), _opt_float(hop.queue_delay_ms),
+            len(hop.log_entries)
+        ))
+        for name in _HOP_STRINGS:
+            _pack_str(parts, getattr(hop, name))
+    return b''.join(parts)
+
+
+def iter_record(record: bytes) -> Tuple[Dict[str, Any], Iterator[Dict[str, Any]]]:
+    """
+    Decode a binary record lazily.
+
+    Returns:
+        Tuple of (trace fields, iterator over hop fields). Hop fields carry
+        'log_entry_count' instead of LogEntry objects.
+    """
+    buf = memoryview(record)
+    start_us, end_us, sport, dport, size, ttl, hop_count = _TRACE_HEADER.unpack_from(buf, 0)
+    offset = _TRACE_HEADER.size
+    fields: Dict[str, Any] = {
+        'start_time': _us_to_dt(start_us),
+        'end_time': _us_to_dt(end_us),
+        'source_port': _int_or_none(sport),
+        'dest_port': _int_or_none(dport),
+        'packet_size': size,
+        'ttl': ttl,
+        'hop_count': hop_count
+    }
+    for name in _TRACE_STRINGS:
+        fields[name], offset = _unpack_str(buf, offset)
+
+    def hops(offset: int = offset) -> Iterator[Dict[str, Any]]:
+        for _ in range(hop_count):
+            (number, ts_us, rtt, ttl_in, ttl_out, metric,
+             processing, queue, log_count) = _HOP_HEADER.unpack_from(buf, offset)
+            offset += _HOP_HEADER.size
+            hop = {
+                'hop_number': number,
+                'timestamp': _us_to_dt(ts_us),
+                'rtt_ms': _float_or_none(rtt),
+                'ttl_in': _int_or_none(ttl_in),
+                'ttl_out': _int_or_none(ttl_out),
+                'route_metric': _int_or_none(metric),
+                'processing_time_ms': _float_or_none(processing),
+                'queue_delay_ms': _float_or_none(queue),
+                'log_entry_count': log_count
+            }
+            for name in _HOP_STRINGS:
+                hop[name], offset = _unpack_str(buf, offset)
+            yield hop
+
+    return fields, hops()
+
+
+def decode_trace(record: bytes):
+    """Unpack a binary record into a PacketTrace (hops without LogEntry objects)."""
+    from tsim.core.packet_tracer import PacketTrace, PacketHop
+
+    fields, hops = iter_record(record)
+    fields.pop('hop_count')
+    trace = PacketTrace(**fields)
+    for hop_fields in hops:
+        hop_fields.pop('log_entry_count')
+        trace.hops.append(PacketHop(**hop_fields))
+    return trace
+
+
+def _write_json_record(fp: TextIO, record: bytes, indent: str = ''):
+    """Write one record as a JSON object with the same keys as PacketTrace.to_dict."""
+    dumps = json.dumps
+    fields, hops = iter_record(record)
+    start, end = fields['start_time'], fields['end_time']
+    duration_ms = (end - start).total_seconds() * 1000 if end else None
+    pad = indent + '  '
+    fp.write('{\n')
+    for key, value in (
+        ('trace_id', fields['trace_id']), ('source_ip', fields['source_ip']),
+        ('dest_ip', fields['dest_ip']), ('protocol', fields['protocol']),
+        ('source_port', fields['source_port']), ('dest_port', fields['dest_port']),
+        ('packet_size', fields['packet_size']), ('ttl', fields['ttl']),
+        ('start_time', start.isoformat()), ('end_time', end.isoformat() if end else None),
+        ('status', fields['status']), ('duration_ms', duration_ms),
+        ('hop_count', fields['hop_count'])
+    ):
+        fp.write(f'{pad}{dumps(key)}: {dumps(value)},\n')
+    fp.write(f'{pad}"hops": [')
+    first = True
+    for hop in hops:
+        fp.write('\n' if first else ',\n')
+        first = False
+        fp.write(f'{pad}  {{')
+        fp.write(', '.join(f'{dumps(key)}: {dumps(value)}' for key, value in (
+            ('hop_number', hop['hop_number']), ('router_name', hop['router_name']),
+            ('router_ip', hop['router_ip']), ('interface_in', hop['interface_in']),
+            ('interface_out', hop['interface_out']), ('timestamp', hop['timestamp'].isoformat()),
+            ('rtt_ms', hop['rtt_ms']), ('ttl_in', hop['ttl_in']), ('ttl_out', hop['ttl_out']),
+            ('routing_table', hop['routing_table']), ('next_hop', hop['next_hop']),
+            ('route_metric', hop['route_metric']), ('policy_rule', hop['policy_rule']),
+            ('iptables_decision', hop['iptables_decision']), ('iptables_rule', hop['iptables_rule']),
+            ('iptables_chain', hop['iptables_chain']), ('iptables_table', hop['iptables_table']),
+            ('processing_time_ms', hop['processing_time_ms']),
+            ('queue_delay_ms', hop['queue_delay_ms']), ('log_entries', hop['log_entry_count'])
+        )))
+        fp.write('}')
+    fp.write(f'\n{pad}]\n{indent}}}' if not first else f']\n{indent}}}')
+
+
+class TraceStore(MutableMapping):
+    """
+    Completed trace store with a fixed memory budget.
+
+    Behaves like a dict of trace_id -> PacketTrace; values are decoded from
+    their packed record on access, so mutating a returned trace does not
+    change the stored copy (store it again to update).
+    """
+
+    DEFAULT_MAX_BYTES = 64 * 1024 * 1024
+
+    def __init__(self, max_bytes: int = DEFAULT_MAX_BYTES, max_age_seconds: Optional[float] = None):
+        """
+        Initialize trace store.
+
+        Args:
+            max_bytes: Memory budget for packed records plus bookkeeping
+            max_age_seconds: Evict traces whose end time is older (None: no limit)
+        """
+        self.max_bytes = max_bytes
+        self.max_age_seconds = max_age_seconds
+        self.bytes_used = 0
+        self.evictions = 0
+
+        # trace_id -> packed record, in LRU order (oldest first)
+        self._records: 'OrderedDict[str, bytes]' = OrderedDict()
+        # trace_id -> (status, source_ip, dest_ip, end_us, insertion sequence)
+        self._meta: Dict[str, Tuple[str, str, str, int, int]] = {}
+        self._sequence = 0
+        self._by_status: Dict[str, Set[str]] = {}
+        self._by_source: Dict[str, Set[str]] = {}
+        self._by_dest: Dict[str, Set[str]] = {}
+        # (end_us, trace_id) min-heap for age eviction, stale entries skipped lazily
+        # and dropped by a rebuild once they outnumber the live ones
+        self._age_heap: List[Tuple[int, str]] = []
+
+    # Mapping interface
+
+    def __len__(self) -> int:
+        return len(self._records)
+
+    def __iter__(self) -> Iterator[str]:
+        return iter(list(self._records))
+
+    def __contains__(self, trace_id) -> bool:
+        return trace_id in self._records
+
+    def __getitem__(self, trace_id: str):
+        record = self._records[trace_id]
+        self._records.move_to_end(trace_id)
+        return decode_trace(record)
+
+    def __setitem__(self, trace_id: str, trace):
+        if trace_id in self._records:
+            self._remove(trace_id)
+        record = encode_trace(trace)
+        end_us = _dt_to_us(trace.end_time)
+        self._records[trace_id] = record
+        self._sequence += 1
+        self._meta[trace_id] = (trace.status, trace.source_ip, trace.dest_ip, end_us, self._sequence)
+        self._by_status.setdefault(trace.status, set()).add(trace_id)
+        self._by_source.setdefault(trace.source_ip, set()).add(trace_id)
+        self._by_dest.setdefault(trace.dest_ip, set()).add(trace_id)
+        if end_us != _NULL_I64:
+            heapq.heappush(self._age_heap, (end_us, trace_id))
+        self.bytes_used += len(record) + _ENTRY_OVERHEAD
+
+        if self.max_age_seconds is not None:
+            self.evict_older_than(datetime.now() - timedelta(seconds=self.max_age_seconds))
+        # Enforce budget, but always keep the trace just stored
+        while self.bytes_used > self.max_bytes and len(self._records) > 1:
+            oldest = next(iter(self._records))
+            if oldest == trace_id:
+                break
+            self._remove(oldest)
+            self.evictions += 1
+
+    def __delitem__(self, trace_id: str):
+        if trace_id not in self._records:
+            raise KeyError(trace_id)
+        self._remove(trace_id)
+
+    def _remove(self, trace_id: str):
+        record = self._records.pop(trace_id)
+        status, source_ip, dest_ip, _, _ = self._meta.pop(trace_id)
+        for index, key in ((self._by_status, status), (self._by_source, source_ip), (self._by_dest, dest_ip)):
+            members = index.get(key)
+            if members is not None:
+                members.discard(trace_id)
+                if not members:
+                    del index[key]
+        self.bytes_used -= len(record) + _ENTRY_OVERHEAD
+        if len(self._age_heap) > 2 * len(self._records) + 16:
+            self._age_heap = [(meta[3], tid) for tid, meta in self._meta.items() if meta[3] != _NULL_I64]
+            heapq.heapify(self._age_heap)
+
+    # Eviction
+
+    def evict_older_than(self, cutoff: datetime) -> int:
+        """Remove traces that ended before cutoff. Returns number removed."""
+        cutoff_us = _dt_to_us(cutoff)
+        removed = 0
+        heap = self._age_heap
+        while heap and heap[0][0] < cutoff_us:
+            end_us, trace_id = heapq.heappop(heap)
+            meta = self._meta.get(trace_id)
+            if meta is None or meta[3] != end_us:
+                continue  # Deleted or replaced since pushed
+            self._remove(trace_id)
+            removed += 1
+        return removed
+
+    # Indexed queries
+
+    def query(self, status: str = None, source_ip: str = None, dest_ip: str = None) -> List[str]:
+        """
+        Find trace IDs by status, source and/or destination (all given criteria must match).
+
+        Returns:
+            Matching trace IDs in insertion order
+        """
+        candidates: Optional[Set[str]] = None
+        for index, key in ((self._by_status, status), (self._by_source, source_ip), (self._by_dest, dest_ip)):
+            if key is None:
+                continue
+            members = index.get(key, set())
+            candidates = set(members) if candidates is None else candidates & members
+            if not candidates:
+                return []
+        if candidates is None:
+            return sorted(self._records, key=lambda trace_id: self._meta[trace_id][4])
+        return sorted(candidates, key=lambda trace_id: self._meta[trace_id][4])
+
+    def peek(self, trace_id: str):
+        """Decode a trace without updating its LRU position."""
+        return decode_trace(self._records[trace_id])
+
+    def stats(self) -> Dict[str, Any]:
+        """Get store statistics."""
+        return {
+            'traces': len(self._records),
+            'bytes_used': self.bytes_used,
+            'max_bytes': self.max_bytes,
+            'max_age_seconds': self.max_age_seconds,
+            'evictions': self.evictions,
+            'statuses': {status: len(ids) for status, ids in self._by_status.items()}
+        }
+
+    # Streaming export
+
+    def write_json(self, fp: TextIO, trace_ids: Iterable[str] = None):
+        """Stream traces as a JSON array without building per-hop dicts of objects."""
+        ids = self._records if trace_ids is None else trace_ids
+        fp.write('[')
+        first = True
+        for trace_id in ids:
+            record = self._records.get(trace_id)
+            if record is None:
+                continue
+            fp.write('\n  ' if first else ',\n  ')
+            first = False
+            _write_json_record(fp, record, '  ')
+        fp.write('\n]\n' if not first else ']\n')
+
+    def export_json(self, trace_id: str) -> str:
+        """Export a single stored trace as JSON text."""
+        record = self._records[trace_id]
+        out = io.StringIO()
+        _write_json_record(out, record)
+        return out.getvalue()
+
+    def write_binary(self, fp: BinaryIO, trace_ids: Iterable[str] = None):
+        """Stream packed records: magic header, then length-prefixed records."""
+        ids = self._records if trace_ids is None else trace_ids
+        fp.write(BINARY_MAGIC)
+        for trace_id in ids:
+            record = self._records.get(trace_id)
+            if record is not None:
+                fp.write(_REC_LEN.pack(len(record)))
+                fp.write(record)
+
+    @staticmethod
+    def read_binary(fp: BinaryIO) -> Iterator[Any]:
+        """Read traces written by write_binary."""
+        if fp.read(len(BINARY_MAGIC)) != BINARY_MAGIC:
+            raise ValueError("Not a trace store binary export")
+        while True:
+            header = fp.read(_REC_LEN.size)
+            if not header:
+                return
+            (length,) = _REC_LEN.unpack(header)
+            yield decode_trace(fp.read(length))
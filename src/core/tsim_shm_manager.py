@@ -2,13 +2,79 @@
 """
 Shared Memory Manager for TSIM
 
-Manages batch files in /dev/shm/tsim/ directory.
+Manages batch files in /dev/shm/tsim/ directory, and maps the fixed-layout
+shared segments there (lock table, lock statistics, job tag slots).
 """
 
+import fcntl
+import mmap
 import os
 from pathlib import Path
+from typing import Callable, Optional
 from tsim.core.config_loader import load_traceroute_config
 
+
+def map_shared_segment(path: Path, size: int, header: bytes, compare: Optional[int] = None,
+                       initialize: Optional[Callable[[mmap.mmap], None]] = None,
+                       prepare: Optional[Callable[[Path], None]] = None,
+                       mode: int = 0o660) -> mmap.mmap:
+    """Map a shared segment file, replacing it when missing or of another layout
+
+    The first `compare` bytes of `header` (default: all) identify the layout.
+    A file with another header is never truncated in place: processes that
+    still map it would fault (SIGBUS) on the lost pages. Instead a new file
+    is built beside it (initialize, then header, then prepare, e.g. to fix
+    group permissions) and renamed over the path; old mappings keep the
+    unlinked file until their owners reopen.
+
+    Raises:
+        OSError: If the segment cannot be created or mapped
+    """
+    path = Path(path)
+    compare = len(header) if compare is None else compare
+    while True:
+        fd = os.open(str(path), os.O_RDWR | os.O_CREAT, mode)
+        try:
+            # Creation and replacement are the only file-locked (cold) path
+            fcntl.flock(fd, fcntl.LOCK_EX)
+            try:
+                stat = os.fstat(fd)
+                try:
+                    current = os.stat(path).st_ino == stat.st_ino
+                except FileNotFoundError:
+                    current = False
+                if current:
+                    if stat.st_size >= size and os.pread(fd, compare, 0) == header[:compare]:
+                        return mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+                    _replace_segment(path, size, header, initialize, prepare, mode)
+                # Replaced (by us or a concurrent creator): map the new file
+            finally:
+                fcntl.flock(fd, fcntl.LOCK_UN)
+        finally:
+            os.close(fd)
+
+
+def _replace_segment(path: Path, size: int, header: bytes,
+                     initialize: Optional[Callable[[mmap.mmap], None]],
+                     prepare: Optional[Callable[[Path], None]], mode: int):
+    temp_path = path.with_name(f".{path.name}.{os.getpid()}.tmp")
+    fd = os.open(str(temp_path), os.O_RDWR | os.O_CREAT | os.O_TRUNC, mode)
+    try:
+        os.ftruncate(fd, size)
+        with mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE) as mm:
+            if initialize is not None:
+                initialize(mm)
+            mm[0:len(header)] = header
+        if prepare is not None:
+            prepare(temp_path)
+        os.rename(temp_path, path)
+    except BaseException:
+        temp_path.unlink(missing_ok=True)
+        raise
+    finally:
+        os.close(fd)
+
+
 class TsimBatchMemory:
     """
     Manages a batch file in /dev/shm/tsim/
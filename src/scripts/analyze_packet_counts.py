@@ -7,6 +7,11 @@ import sys
 import json
 import argparse
 
+try:
+    from tsim.analyzers.iptables_save_index import IptablesSaveIndex
+except ImportError:
+    IptablesSaveIndex = None
+
 
 def extract_rule_details(rule):
     """Extract key details from a rule for better analysis."""
@@ -39,10 +44,19 @@ def extract_rule_details(rule):
 
 
 def extract_iptables_rules(iptables_data):
-    """Extract all rules from iptables data structure."""
+    """Extract all rules from iptables data structure.
+    
+    Accepts the network status JSON, raw iptables-save text or an
+    IptablesSaveIndex built from it.
+    """
     rules = []
     chain_policies = {}
     
+    if isinstance(iptables_data, str) and IptablesSaveIndex is not None:
+        iptables_data = IptablesSaveIndex(iptables_data)
+    if IptablesSaveIndex is not None and isinstance(iptables_data, IptablesSaveIndex):
+        return iptables_data.rule_list('filter'), iptables_data.policies('filter')
+    
     # Handle different possible JSON structures
     if isinstance(iptables_data, dict):
         # Check if it's wrapped in a router name
@@ -541,6 +555,18 @@ def compare_packet_counts(before_data, after_data, router_name, verbose=False, m
     return result
 
 
+def load_snapshot(path):
+    """Load a network status JSON file, or index raw iptables-save output."""
+    with open(path, 'r') as f:
+        content = f.read()
+    try:
+        return json.loads(content)
+    except ValueError:
+        if IptablesSaveIndex is None:
+            raise
+        return IptablesSaveIndex(content)
+
+
 def main():
     parser = argparse.ArgumentParser(description='Analyze iptables packet counts')
     parser.add_argument('router_name', help='Name of the router')
@@ -553,18 +579,14 @@ def main():
     args = parser.parse_args()
     
     try:
-        # Read before data
-        with open(args.before_file, 'r') as f:
-            before_data = json.load(f)
-            
-        # Read after data
-        with open(args.after_file, 'r') as f:
-            after_data = json.load(f)
+        # Read before/after data: network status JSON or raw iptables-save output
+        before_data = load_snapshot(args.before_file)
+        after_data = load_snapshot(args.after_file)
             
         if args.verbose:
             print(f"Analyzing packet counts for router: {args.router_name}", file=sys.stderr)
-            print(f"Before data keys: {list(before_data.keys())}", file=sys.stderr)
-            print(f"After data keys: {list(after_data.keys())}", file=sys.stderr)
+            print(f"Before data keys: {list(before_data.keys() if isinstance(before_data, dict) else before_data.tables)}", file=sys.stderr)
+            print(f"After data keys: {list(after_data.keys() if isinstance(after_data, dict) else after_data.tables)}", file=sys.stderr)
         
         # Compare packet counts
         result = compare_packet_counts(before_data, after_data, args.router_name, args.verbose, args.mode)
@@ -22,7 +22,7 @@ class HostCommands(BaseCommandHandler):
     
     def get_subcommand_names(self) -> List[str]:
         """Get list of host subcommands."""
-        return ['add', 'list', 'remove', 'clean']
+        return ['add', 'add-bulk', 'list', 'remove', 'remove-bulk', 'clean']
     
     @choices_provider
     def router_choices(self) -> List[str]:
@@ -78,6 +78,15 @@ class HostCommands(BaseCommandHandler):
         add_parser.add_argument('-v', '--verbose', action='count', default=0,
                               help='Increase verbosity (-v for info, -vv for debug, -vvv for trace)')
         
+        # Bulk add subcommand
+        add_bulk_parser = subparsers.add_parser('add-bulk', help='Add many hosts in one batch')
+        add_bulk_parser.add_argument('--file', required=True,
+                                   help='JSON list of hosts: name, primary_ip, connect_to, secondary_ips')
+        add_bulk_parser.add_argument('--no-delay', action='store_true',
+                                   help='Skip stabilization delays for faster host creation')
+        add_bulk_parser.add_argument('-v', '--verbose', action='count', default=0,
+                                   help='Increase verbosity (-v for info, -vv for debug, -vvv for trace)')
+        
         # List subcommand
         list_parser = subparsers.add_parser('list', help='List all hosts')
         list_parser.add_argument('-j', '--json', action='store_true',
@@ -95,6 +104,15 @@ class HostCommands(BaseCommandHandler):
         remove_parser.add_argument('-v', '--verbose', action='count', default=0,
                                  help='Increase verbosity (-v for info, -vv for debug, -vvv for trace)')
         
+        # Bulk remove subcommand
+        remove_bulk_parser = subparsers.add_parser('remove-bulk', help='Remove many hosts in one batch')
+        remove_bulk_parser.add_argument('--file', required=True,
+                                      help='JSON list of host names (or host objects with name)')
+        remove_bulk_parser.add_argument('-f', '--force', action='store_true',
+                                      help='Force removal without confirmation')
+        remove_bulk_parser.add_argument('-v', '--verbose', action='count', default=0,
+                                      help='Increase verbosity (-v for info, -vv for debug, -vvv for trace)')
+        
         # Clean subcommand
         clean_parser = subparsers.add_parser('clean', help='Remove all hosts')
         clean_parser.add_argument('-f', '--force', action='store_true',
@@ -117,10 +135,14 @@ class HostCommands(BaseCommandHandler):
         
         if args.subcommand == 'add':
             return self._add_host(args)
+        elif args.subcommand == 'add-bulk':
+            return self._add_hosts_bulk(args)
         elif args.subcommand == 'list':
             return self._list_hosts(args)
         elif args.subcommand == 'remove':
             return self._remove_host(args)
+        elif args.subcommand == 'remove-bulk':
+            return self._remove_hosts_bulk(args)
         elif args.subcommand == 'clean':
             return self._clean_hosts(args)
         else:
@@ -183,6 +205,29 @@ class HostCommands(BaseCommandHandler):
         
         return returncode
     
+    def _add_hosts_bulk(self, args: argparse.Namespace) -> int:
+        """Add all hosts listed in a JSON file with one batched setup."""
+        self.info(f"Adding hosts from {args.file}")
+        
+        script_path = self.get_script_path('src/simulators/host_namespace_setup.py')
+        if not self.check_script_exists(script_path):
+            return 1
+        
+        cmd_args = ['--hosts-file', args.file]
+        if args.no_delay:
+            cmd_args.append('--no-delay')
+        for _ in range(args.verbose):
+            cmd_args.append('-v')
+        
+        returncode = self.run_script_with_output(script_path, cmd_args, use_sudo=False)
+        
+        if returncode == 0:
+            self.success(f"Hosts from {args.file} added successfully")
+        else:
+            self.error(f"Failed to add hosts from {args.file}")
+        
+        return returncode
+    
     def _list_hosts(self, args: argparse.Namespace) -> int:
         """List all hosts."""
         # Store current args for JSON output detection
@@ -252,6 +297,37 @@ class HostCommands(BaseCommandHandler):
         
         return returncode
     
+    def _remove_hosts_bulk(self, args: argparse.Namespace) -> int:
+        """Remove all hosts listed in a JSON file with one batched teardown."""
+        if not args.force:
+            try:
+                response = input(f"Are you sure you want to remove all hosts listed in {args.file}? (y/N): ")
+                if response.lower() not in ['y', 'yes']:
+                    self.info("Host removal cancelled")
+                    return 0
+            except KeyboardInterrupt:
+                self.info("\nHost removal cancelled")
+                return 0
+        
+        self.info(f"Removing hosts from {args.file}")
+        
+        script_path = self.get_script_path('src/simulators/host_namespace_setup.py')
+        if not self.check_script_exists(script_path):
+            return 1
+        
+        cmd_args = ['--hosts-file', args.file, '--remove']
+        for _ in range(args.verbose):
+            cmd_args.append('-v')
+        
+        returncode = self.run_script_with_output(script_path, cmd_args, use_sudo=False)
+        
+        if returncode == 0:
+            self.success(f"Hosts from {args.file} removed successfully")
+        else:
+            self.error(f"Failed to remove hosts from {args.file}")
+        
+        return returncode
+    
     def _clean_hosts(self, args: argparse.Namespace) -> int:
         """Remove all hosts."""
         # Confirmation if not forced
@@ -337,6 +413,14 @@ class HostCommands(BaseCommandHandler):
             available_args = ['--name', '-f', '--force', '-v', '--verbose']
             return [arg for arg in available_args if arg not in used_args and arg.startswith(text)]
         
+        elif subcommand in ['add-bulk', 'remove-bulk']:
+            used_args = set(args)
+            if subcommand == 'add-bulk':
+                available_args = ['--file', '--no-delay', '-v', '--verbose']
+            else:
+                available_args = ['--file', '-f', '--force', '-v', '--verbose']
+            return [arg for arg in available_args if arg not in used_args and arg.startswith(text)]
+        
         elif subcommand in ['list', 'clean']:
             # These subcommands have simpler arguments
             used_args = set(args)
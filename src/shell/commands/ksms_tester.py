@@ -95,6 +95,13 @@ class KsmsTesterCommand(BaseCommandHandler):
         parser.add_argument('--dscp', type=int, metavar='VALUE',
                             help='DSCP value for packet marking (32-63). Required for coordination. '
                                  'Falls back to KSMS_JOB_DSCP environment variable if not specified.')
+        parser.add_argument('--tag-mode', choices=['dscp', 'ipid'],
+                            help='Job tag: DSCP value (dscp) or IP ID under the --dscp marker (ipid)')
+        parser.add_argument('--ip-id-tag', type=int, metavar='ID',
+                            help='IP ID tag (1-65535) for --tag-mode ipid')
+        parser.add_argument('--virtual-source', action='append', default=[], metavar='ROUTER=NAMESPACE',
+                            help='Send probes for ROUTER from injector host NAMESPACE using the source '
+                                 'IP as a non-local address (repeatable)')
         parser.add_argument('-j', '--json', action='store_true',
                             help='Output in JSON format')
         parser.add_argument('-v', '--verbose', action='count', default=0,
@@ -124,6 +131,12 @@ class KsmsTesterCommand(BaseCommandHandler):
         cmd_args.append('--force')
         if hasattr(args, 'dscp') and args.dscp is not None:
             cmd_args.extend(['--dscp', str(args.dscp)])
+        if args.tag_mode:
+            cmd_args.extend(['--tag-mode', args.tag_mode])
+        if args.ip_id_tag is not None:
+            cmd_args.extend(['--ip-id-tag', str(args.ip_id_tag)])
+        for spec in args.virtual_source:
+            cmd_args.extend(['--virtual-source', spec])
         if args.json:
             cmd_args.append('--json')
         for _ in range(args.verbose):
@@ -149,7 +162,7 @@ class KsmsTesterCommand(BaseCommandHandler):
         # complete argument names
         available_args = ['-s', '--source', '-d', '--destination', '-P', '--ports',
                           '--default-proto', '--max-services', '--range-limit', '--tcp-timeout',
-                          '--force', '--dscp', '-j', '--json', '-v', '--verbose']
+                          '--force', '--dscp', '--tag-mode', '--ip-id-tag', '--virtual-source', '-j', '--json', '-v', '--verbose']
         if len(args) >= 2 and args[-2] in ['-s', '--source', '-d', '--destination']:
             return [ip for ip in self.ip_choices() if ip.startswith(text)]
         if len(args) >= 2 and args[-2] == '--default-proto':
@@ -0,0 +1,100 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Locks command handler: lock contention statistics
+
+Reads the shared lock statistics segment (see tsim.core.lock_stats) and
+shows acquisition latency, hold times, contention and top waiters per lock.
+"""
+
+import argparse
+import json
+from typing import List, Optional
+
+try:
+    from cmd2 import Cmd2ArgumentParser
+except ImportError:
+    from argparse import ArgumentParser as Cmd2ArgumentParser
+
+from .base import BaseCommandHandler
+from tsim.core.lock_stats import get_lock_stats
+
+
+class LocksCommand(BaseCommandHandler):
+    """Handler for locks command."""
+
+    def create_parser(self) -> Cmd2ArgumentParser:
+        parser = Cmd2ArgumentParser(
+            prog='locks',
+            description='Show lock contention statistics'
+        )
+        parser.add_argument('-n', '--name', help='Only locks whose name contains this text')
+        parser.add_argument('-l', '--limit', type=int, default=20,
+                            help='Maximum number of locks to show (default: 20)')
+        parser.add_argument('--histogram', action='store_true',
+                            help='Show wait and hold time histograms')
+        parser.add_argument('--reset', action='store_true',
+                            help='Zero all counters')
+        parser.add_argument('-j', '--json', action='store_true',
+                            help='Output in JSON format')
+        return parser
+
+    def _handle_command_impl(self, args: str) -> Optional[int]:
+        parser = self.create_parser()
+        parsed_args = self.parse_arguments(args, parser)
+        if parsed_args is None:
+            return None
+        return self.handle_parsed_command(parsed_args)
+
+    def handle_parsed_command(self, args: argparse.Namespace) -> Optional[int]:
+        stats = get_lock_stats()
+        if stats is None:
+            self.error("Lock statistics unavailable")
+            return 1
+        if args.reset:
+            stats.reset()
+            self.success("Lock statistics reset")
+            return 0
+
+        snapshot = stats.snapshot()
+        locks = [l for l in snapshot['locks'] if not args.name or args.name in l['name']][:args.limit]
+        if args.json:
+            self.shell.poutput(json.dumps({**snapshot, 'locks': locks}, indent=2))
+            return 0
+
+        if not locks:
+            self.shell.poutput("No lock activity recorded")
+            return 0
+
+        def ms(value) -> str:
+            return '-' if value is None else f"{value:.2f}"
+
+        self.shell.poutput(f"{'LOCK':<36} {'ACQ':>8} {'CONT':>7} {'TMO':>5} "
+                           f"{'WAIT avg/p99/max ms':>26} {'HOLD avg/p99/max ms':>26}")
+        for lock in locks:
+            wait = f"{ms(lock['wait_avg_ms'])}/{ms(lock['wait_p99_ms'])}/{ms(lock['wait_max_ms'])}"
+            hold = f"{ms(lock['hold_avg_ms'])}/{ms(lock['hold_p99_ms'])}/{ms(lock['hold_max_ms'])}"
+            self.shell.poutput(f"{lock['name'][:36]:<36} {lock['acquisitions']:>8} {lock['contended']:>7} "
+                               f"{lock['timeouts']:>5} {wait:>26} {hold:>26}")
+            for waiter in lock['top_waiters'][:3]:
+                self.shell.poutput(f"    waiter {waiter['waiter']}: {waiter['count']} waits, "
+                                   f"{waiter['wait_total_ms']:.2f} ms total")
+            if args.histogram:
+                self._print_histogram('wait', lock['wait_histogram'], snapshot['buckets_ms'])
+                self._print_histogram('hold', lock['hold_histogram'], snapshot['buckets_ms'])
+        return 0
+
+    def _print_histogram(self, label: str, hist: List[int], buckets_ms: List[float]):
+        total = sum(hist)
+        if not total:
+            return
+        peak = max(hist)
+        self.shell.poutput(f"    {label} time:")
+        for bucket, count in enumerate(hist):
+            if count:
+                bar = '#' * max(1, count * 30 // peak)
+                bound = f"< {buckets_ms[bucket]:>10.3f}" if bucket < len(hist) - 1 else f">={buckets_ms[bucket - 1]:>10.3f}"
+                self.shell.poutput(f"      {bound} ms {count:>8} {bar}")
+
+    def complete_command(self, text: str, line: str, begidx: int, endidx: int) -> List[str]:
+        options = ['-n', '--name', '-l', '--limit', '--histogram', '--reset', '-j', '--json']
+        return [o for o in options if o.startswith(text)]
@@ -1052,6 +1052,7 @@ Type 'set' to see all variables.
             from .commands.trace import TraceCommands
             from .commands.nettest import NetTestCommands
             from .commands.ksms_tester import KsmsTesterCommand
+            from .commands.locks import LocksCommand
             
             self.facts_handler = FactsCommands(self)
             self.network_handler = NetworkCommands(self)
@@ -1061,6 +1062,7 @@ Type 'set' to see all variables.
             self.trace_handler = TraceCommands(self)
             self.nettest_handler = NetTestCommands(self)
             self.ksms_tester_handler = KsmsTesterCommand(self)
+            self.locks_handler = LocksCommand(self)
 
         except Exception as e:
             import traceback
@@ -1269,6 +1271,23 @@ Type 'set' to see all variables.
             return self.ksms_tester_handler.complete_command(text, line, begidx, endidx)
         except Exception:
             return []
+
+    def do_locks(self, args):
+        """Show lock contention statistics."""
+        try:
+            ret = self.locks_handler.handle_command(args)
+            self.variable_manager.set_variable('TSIM_RETURN_VALUE', str(ret if ret is not None else 0))
+            return None
+        except Exception as e:
+            self.poutput(f"{Fore.RED}locks command not available: {e}{Style.RESET_ALL}")
+            self.variable_manager.set_variable('TSIM_RETURN_VALUE', '1')
+            return None
+
+    def complete_locks(self, text, line, begidx, endidx):
+        try:
+            return self.locks_handler.complete_command(text, line, begidx, endidx)
+        except Exception:
+            return []
     
     
     def do_completion(self, args):
@@ -1626,16 +1645,20 @@ Type 'set' to see all variables.
         
         self.poutput(f"\n{Fore.CYAN}USAGE:{Style.RESET_ALL}")
         self.poutput("  host add --name NAME --primary-ip IP/MASK --connect-to ROUTER [options]")
+        self.poutput("  host add-bulk --file HOSTS.json [options]")
         self.poutput("  host list [options]")
         self.poutput("  host remove --name NAME [options]")
+        self.poutput("  host remove-bulk --file HOSTS.json [options]")
         self.poutput("  host clean [options]")
         self.poutput("  host --help | -h")
         
         self.poutput(f"\n{Fore.CYAN}SUBCOMMANDS:{Style.RESET_ALL}")
-        self.poutput("  add     - Add a new host to the network")
-        self.poutput("  list    - List all hosts")
-        self.poutput("  remove  - Remove a host from the network")
-        self.poutput("  clean   - Remove all hosts")
+        self.poutput("  add         - Add a new host to the network")
+        self.poutput("  add-bulk    - Add many hosts in one batch")
+        self.poutput("  list        - List all hosts")
+        self.poutput("  remove      - Remove a host from the network")
+        self.poutput("  remove-bulk - Remove many hosts in one batch")
+        self.poutput("  clean       - Remove all hosts")
         
         self.poutput(f"\n{Fore.CYAN}ADD OPTIONS:{Style.RESET_ALL}")
         self.poutput(f"  {Fore.YELLOW}--name NAME{Style.RESET_ALL}          Host name (MANDATORY)")
@@ -1654,6 +1677,14 @@ Type 'set' to see all variables.
         self.poutput("  -f, --force           Force removal without confirmation")
         self.poutput("  -v, --verbose         Increase verbosity")
         
+        self.poutput(f"\n{Fore.CYAN}BULK OPTIONS:{Style.RESET_ALL}")
+        self.poutput(f"  {Fore.YELLOW}--file FILE{Style.RESET_ALL}          JSON list of hosts (MANDATORY)")
+        self.poutput("                        add-bulk: [{name, primary_ip, connect_to, secondary_ips}]")
+        self.poutput("                        remove-bulk: [name, ...]")
+        self.poutput("  --no-delay            Skip stabilization delays (add-bulk)")
+        self.poutput("  -f, --force           Force removal without confirmation (remove-bulk)")
+        self.poutput("  -v, --verbose         Increase verbosity")
+        
         self.poutput(f"\n{Fore.CYAN}CLEAN OPTIONS:{Style.RESET_ALL}")
         self.poutput("  -f, --force           Force cleanup without confirmation")
         self.poutput("  -v, --verbose         Increase verbosity")
@@ -1665,6 +1696,9 @@ Type 'set' to see all variables.
         self.poutput("\n  Add host with secondary IPs:")
         self.poutput("    host add --name db1 --primary-ip 10.3.20.100/24 --connect-to dc-srv --secondary-ips 192.168.1.1/24")
         
+        self.poutput("\n  Add many hosts at once:")
+        self.poutput("    host add-bulk --file hosts.json --no-delay")
+        
         self.poutput("\n  List all hosts:")
         self.poutput("    host list")
         
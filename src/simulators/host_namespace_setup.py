@@ -24,7 +24,10 @@ Usage:
     
     # Remove host
     sudo python3 host_namespace_setup.py --remove-host host1
-    
+
+    # Add (or with --remove, remove) many hosts in one batch
+    sudo python3 host_namespace_setup.py --hosts-file hosts.json
+
     # List all hosts
     sudo python3 host_namespace_setup.py --list-hosts
 
@@ -40,6 +43,7 @@ import subprocess
 import sys
 import ipaddress
 import re
+import tempfile
 import time
 from pathlib import Path
 from typing import Dict, List, Set, Optional, Any, Tuple
@@ -49,6 +53,7 @@ import hashlib
 # Import configuration loader
 from tsim.core.config_loader import get_registry_paths, load_traceroute_config
 from tsim.core.creator_tag import CreatorTagManager
+from tsim.core.lock_stats import get_lock_stats
 
 
 def generate_mac_address(host_name: str) -> str:
@@ -80,6 +85,13 @@ class HostNamespaceManager:
     Hosts are endpoint devices with single physical interface and simple routing.
     They can be dynamically added to and removed from the running network simulation.
     """
+
+    # host_config fields stored in the host registry besides IP, router and MAC
+    HOST_REGISTRY_FIELDS = [
+        'secondary_ips', 'created_at', 'router_interface', 'gateway_ip',
+        'router_ip_added', 'dummy_interfaces', 'connection_type',
+        'mesh_bridge', 'host_veth', 'mesh_veth', 'sim_namespace'
+    ]
     
     def __init__(self, verbose: int = 0, no_delay: bool = False):
         self.verbose = verbose
@@ -296,12 +308,25 @@ class HostNamespaceManager:
                 sem = posix_ipc.Semaphore(sem_name)
             self.semaphores[path_str] = sem
         
-        # Acquire semaphore
+        # Acquire semaphore (uncontended fast path first, for lock statistics)
+        stats = get_lock_stats()
+        lock_name = f"tsim-json-{Path(path_str).stem}"
+        wait_start = time.monotonic()
+        contended = False
         try:
-            sem.acquire(timeout)
+            sem.acquire(0)
         except posix_ipc.BusyError:
-            self.logger.error(f"Failed to acquire lock for {file_path}")
-            return False, None
+            contended = True
+            try:
+                sem.acquire(timeout)
+            except posix_ipc.BusyError:
+                if stats is not None:
+                    stats.timed_out(lock_name, time.monotonic() - wait_start)
+                self.logger.error(f"Failed to acquire lock for {file_path}")
+                return False, None
+        acquired_at = time.monotonic()
+        if stats is not None:
+            stats.acquired(lock_name, acquired_at - wait_start, contended)
         
         try:
             # Read current data
@@ -343,6 +368,8 @@ class HostNamespaceManager:
         finally:
             # Always release semaphore
             sem.release()
+            if stats is not None:
+                stats.released(lock_name, time.monotonic() - acquired_at)
         
     def load_router_facts(self):
         """Load router facts to understand network topology."""
@@ -435,6 +462,7 @@ class HostNamespaceManager:
             'brctl addif',
             'brctl delif',
             'tc qdisc',
+            'sh -e',  # iproute2 batch scripts (add_hosts/remove_hosts)
             'kill',
             'pkill'
         ]
@@ -507,6 +535,8 @@ class HostNamespaceManager:
                 cmd_type = 'route_cmd'
             elif 'network_namespace_status.py' in full_command:
                 cmd_type = 'status_script'
+            elif command.startswith('sh -e'):
+                cmd_type = 'batch_script'
             else:
                 cmd_type = 'other'
             
@@ -743,12 +773,7 @@ class HostNamespaceManager:
                 # Build additional info dict from host_config
                 # Include all fields that were saved in old implementation
                 additional_info = {}
-                optional_fields = [
-                    'secondary_ips', 'created_at', 'router_interface', 'gateway_ip',
-                    'router_ip_added', 'dummy_interfaces', 'connection_type',
-                    'mesh_bridge', 'host_veth', 'mesh_veth', 'sim_namespace'
-                ]
-                for field in optional_fields:
+                for field in self.HOST_REGISTRY_FIELDS:
                     if field in host_config:
                         additional_info[field] = host_config[field]
 
@@ -2055,12 +2080,7 @@ class HostNamespaceManager:
             self.unregister_host_from_bridge_registry(host_name)
 
             # Remove from host registry atomically
-            def remove_host_op(registry):
-                if host_name in registry:
-                    del registry[host_name]
-                return True, registry
-
-            self._atomic_json_operation(self.host_registry_file, remove_host_op)
+            self._remove_host_from_registry(host_name)
 
             if self.verbose >= 1:
                 print(f"[SUCCESS] Host {host_name} removed successfully")
@@ -2073,7 +2093,643 @@ class HostNamespaceManager:
             self.logger.error(f"CRITICAL: Namespace {host_name} deleted but registry update failed: {e}")
             self.logger.error(f"Manual cleanup may be required for {host_name} registries")
             raise RuntimeError(f"Registry update failed after namespace deletion: {e}")
-            
+
+    def readdress_host(self, host_name: str, primary_ip: str) -> bool:
+        """Move an existing host to a new primary IP in the same subnet.
+
+        The namespace, veth and bridge attachment are kept; only the eth0
+        address and default route change, in a single `ip -batch` run.
+        Registries are updated first so a collision aborts before the
+        namespace is touched. Used by the quick job warm host pool.
+
+        Returns:
+            True if the host now answers on primary_ip
+        """
+        registry = self.load_host_registry()
+        host_config = registry.get(host_name)
+        if not host_config:
+            self.logger.error(f"Host {host_name} not found in registry")
+            return False
+
+        old_ip = host_config.get('primary_ip', '')
+        if old_ip == primary_ip:
+            return True
+
+        gateway_ip = host_config.get('gateway_ip')
+        try:
+            new_network = ipaddress.IPv4Network(primary_ip, strict=False)
+            same_subnet = (ipaddress.IPv4Network(old_ip, strict=False) == new_network and
+                           gateway_ip and ipaddress.IPv4Address(gateway_ip) in new_network)
+        except ValueError as e:
+            self.logger.error(f"Invalid address for {host_name}: {e}")
+            return False
+        if not same_subnet or primary_ip.split('/')[0] == gateway_ip:
+            self.logger.error(f"Cannot readdress {host_name} from {old_ip} to {primary_ip}: "
+                              f"not a host address in the same subnet")
+            return False
+
+        def set_primary_ip(ip):
+            if self.registry_mgr:
+                return self.registry_mgr.readdress_host(host_name, ip)
+
+            def update_op(registry):
+                if host_name not in registry:
+                    return False, registry
+                registry[host_name]['primary_ip'] = ip
+                return True, registry
+
+            success, _ = self._atomic_json_operation(self.host_registry_file, update_op)
+            return success
+
+        if not set_primary_ip(primary_ip):
+            self.logger.error(f"Cannot readdress {host_name}: {primary_ip} already in use on "
+                              f"{host_config.get('connected_to')}")
+            return False
+
+        batch = (f"address flush dev eth0\n"
+                 f"address add {primary_ip} dev eth0\n"
+                 f"route replace default via {gateway_ip} dev eth0\n")
+        batch_file = None
+        try:
+            fd, batch_file = tempfile.mkstemp(prefix='tsim-readdress-', suffix='.batch')
+            with os.fdopen(fd, 'w') as f:
+                f.write(batch)
+            os.chmod(batch_file, 0o644)
+            result = self.run_command(f"ip -4 -batch {batch_file}", namespace=host_name, check=False)
+        finally:
+            if batch_file:
+                os.unlink(batch_file)
+
+        if result.returncode != 0:
+            self.logger.error(f"Failed to readdress {host_name}: {result.stderr.strip()}")
+            set_primary_ip(old_ip)
+            return False
+
+        # The router may still cache a MAC for the new address from an earlier host
+        router = host_config.get('connected_to')
+        router_iface = host_config.get('router_interface')
+        if router and router_iface and router_iface != 'unknown':
+            self.run_command(f"ip neigh del {primary_ip.split('/')[0]} dev {router_iface}",
+                             namespace=router, check=False)
+
+        bridge_name = host_config.get('mesh_bridge')
+        if bridge_name:
+            self.register_host_in_bridge_registry(host_name, primary_ip, bridge_name)
+
+        if self.verbose >= 1:
+            print(f"[SUCCESS] Host {host_name} readdressed {old_ip} -> {primary_ip}")
+        return True
+
+    def _run_batch_script(self, batches: List[Tuple[str, Optional[str], List[str]]],
+                          check: bool = True) -> subprocess.CompletedProcess:
+        """Run several iproute2 batches from one shell script.
+
+        Each entry is (tool, namespace, lines): `ip`, `tc` or `bridge` reading
+        lines as a -batch from a heredoc, with `-n namespace` when given, or
+        ('sh', None, lines) for plain shell lines. An iproute2 batch cannot
+        switch namespaces, so there is still one process per namespace, but
+        only one spawn and one timing entry here. With check the script stops
+        at the first failing batch; without it every batch runs with -force.
+        """
+        script = ['set -e' if check else 'set +e']
+        for tool, namespace, lines in batches:
+            if not lines:
+                continue
+            if tool == 'sh':
+                script.extend(lines)
+                continue
+            options = f"-n {namespace} " if namespace else ""
+            if not check:
+                options += "-force "
+            script.append(f"{tool} {options}-batch - <<'TSIM_BATCH'")
+            script.extend(lines)
+            script.append("TSIM_BATCH")
+
+        fd, script_file = tempfile.mkstemp(prefix='tsim-bulk-', suffix='.sh')
+        try:
+            with os.fdopen(fd, 'w') as f:
+                f.write('\n'.join(script) + '\n')
+            os.chmod(script_file, 0o644)
+            if self.verbose >= 3:
+                print(f"[BATCH] {script_file}:\n" + '\n'.join(script), file=sys.stderr)
+            return self.run_command(f"sh -e {script_file}", check=check)
+        finally:
+            os.unlink(script_file)
+
+    def _add_namespaces(self, names: List[str]) -> List[str]:
+        """Create namespaces in one `ip -force -batch`; returns the names this call created.
+
+        A failing line (e.g. a name another process created since validation)
+        does not stop the rest; iproute2 reports it as "Command failed -:N".
+        Names are also checked to exist afterwards.
+        """
+        result = self._run_batch_script([('ip', None, [f"netns add {name}" for name in names])], check=False)
+        failed = {int(line) for line in re.findall(r'Command failed -:(\d+)', result.stderr or '')}
+        listing = self.run_command("ip netns list", check=False).stdout
+        existing = set(re.findall(r'^([^\s(]+)', listing, re.M))
+        return [name for line, name in enumerate(names, 1) if line not in failed and name in existing]
+
+    def _router_addresses(self, router_name: str) -> Dict[str, str]:
+        """Map each IPv4 address configured on a router namespace to its interface."""
+        if router_name not in self.available_namespaces:
+            return {}
+        result = self.run_command("ip -4 -o addr show", namespace=router_name, check=False)
+        return {ip: iface.split('@')[0]
+                for iface, ip in re.findall(r'^\d+:\s+(\S+)\s+inet\s+([\d.]+)/', result.stdout, re.M)}
+
+    def add_hosts(self, hosts: List[Dict[str, Any]]) -> bool:
+        """Add a set of hosts with one batched setup and one registry transaction.
+
+        Each entry takes the add_host() arguments as keys: name, primary_ip
+        and optionally secondary_ips, connect_to and router_interface. The
+        whole set is validated before anything is created: names, addresses,
+        and collisions against router addresses, registered hosts and the
+        rest of the set, using indexes built once per call. Router lookups
+        and bridge discovery are done once per router subnet. Namespaces and
+        veth pairs are then created by a single root `ip -batch` (each veth is
+        created directly inside its host and mesh namespaces), followed by
+        one batch per namespace, and all registries are updated once.
+
+        Existing tsim-managed hosts are reused as in add_host(). If anything
+        fails, every namespace and router address added here is removed.
+
+        Returns:
+            True if every host in the set exists afterwards
+        """
+        operation_start = time.time()
+        registry = self.load_host_registry()
+
+        # (router, ip) -> host name, for all registered primary and secondary IPs
+        host_ips = {}
+        for name, config in registry.items():
+            router = config.get('connected_to', '')
+            for ip in [config.get('primary_ip', '')] + config.get('secondary_ips', []):
+                host_ips[(router, ip.split('/')[0])] = name
+
+        router_addrs: Dict[str, Dict[str, str]] = {}
+        attachments = {}   # (router, interface option, subnet) -> (iface, gateway_ip, gateway_missing)
+        bridges = {}       # (router, iface) or subnet -> (bridge, router mesh interface)
+        plans = []
+        reused = []
+
+        try:
+            names = set()
+            for spec in hosts:
+                host_name = spec.get('name')
+                primary_ip = spec.get('primary_ip', '')
+                secondary_ips = list(spec.get('secondary_ips') or [])
+                connect_to = spec.get('connect_to')
+                router_interface = spec.get('router_interface')
+
+                if not host_name or host_name in names:
+                    raise ValueError(f"Missing or duplicate host name: {host_name!r}")
+                names.add(host_name)
+
+                if host_name in self.available_namespaces:
+                    if host_name in registry and self._is_tsim_managed_namespace(host_name):
+                        print(f"[REUSED] Host {host_name} already exists, reusing")
+                        reused.append(host_name)
+                        continue
+                    raise ValueError(f"Namespace {host_name} already exists but is not a registered tsim host")
+                if host_name in registry:
+                    raise ValueError(f"Host {host_name} registered but namespace doesn't exist")
+
+                for ip in [primary_ip] + secondary_ips:
+                    if '/' not in ip:
+                        raise ValueError(f"IP {ip!r} of {host_name} must include prefix length (e.g., 10.1.1.100/24)")
+                host_network = ipaddress.IPv4Network(primary_ip, strict=False)
+                for ip in secondary_ips:
+                    ipaddress.IPv4Network(ip, strict=False)
+
+                if router_interface and not connect_to:
+                    raise ValueError(f"router_interface of {host_name} requires connect_to")
+
+                if connect_to:
+                    if connect_to not in self.routers and connect_to not in self.available_namespaces:
+                        raise ValueError(f"Router {connect_to} not found in facts or namespaces")
+                    target_router = connect_to
+                    key = (target_router, router_interface, str(host_network))
+                    if key not in attachments:
+                        if router_interface:
+                            interface_info = self.find_router_interface_info(target_router, router_interface)
+                            if not interface_info:
+                                raise ValueError(f"Interface {router_interface} not found on router {target_router}")
+                            attachments[key] = (*interface_info, False)
+                        else:
+                            route_info = self.determine_router_interface_by_routing(target_router, primary_ip)
+                            if not route_info:
+                                raise ValueError(f"Could not determine router interface for host IP {primary_ip}")
+                            gateway_ip = self.get_default_gateway(primary_ip, target_router)
+                            gateway_missing = False
+                            if not gateway_ip:
+                                gateway_ip = str(host_network.network_address + 1)
+                                if target_router not in router_addrs:
+                                    router_addrs[target_router] = self._router_addresses(target_router)
+                                gateway_missing = gateway_ip not in router_addrs[target_router]
+                            attachments[key] = (route_info[0], gateway_ip, gateway_missing)
+                    target_iface, gateway_ip, gateway_missing = attachments[key]
+                    # Only the first host of a subnet adds (and later removes) the gateway
+                    attachments[key] = (target_iface, gateway_ip, False)
+                else:
+                    router_info = self.find_router_for_subnet(primary_ip)
+                    if not router_info:
+                        raise ValueError(f"Could not find suitable router for IP {primary_ip}")
+                    target_router, target_iface, gateway_ip = router_info
+                    gateway_missing = False
+
+                # Collisions against the router, registered hosts and earlier entries
+                if target_router not in router_addrs:
+                    router_addrs[target_router] = self._router_addresses(target_router)
+                for ip in [primary_ip] + secondary_ips:
+                    ip_only = ip.split('/')[0]
+                    if ip_only in router_addrs[target_router]:
+                        raise ValueError(f"IP address collision detected: {ip_only} is already in use by router "
+                                         f"'{target_router}' on interface '{router_addrs[target_router][ip_only]}'")
+                    owner = host_ips.get((target_router, ip_only))
+                    if owner:
+                        raise ValueError(f"IP address collision detected: {ip_only} is already in use by host "
+                                         f"'{owner}' connected to router '{target_router}'")
+                    host_ips[(target_router, ip_only)] = host_name
+                if gateway_missing:
+                    router_addrs[target_router][gateway_ip] = target_iface
+
+                bridge_key = (target_router, target_iface) if connect_to and target_iface else str(host_network)
+                if bridge_key not in bridges:
+                    mesh_bridge = router_mesh_iface = None
+                    if connect_to and target_iface:
+                        mesh_bridge = self.find_router_bridge(target_router, target_iface)
+                        if mesh_bridge:
+                            router_mesh_iface = self.find_router_mesh_interface(target_router, target_iface)
+                    if not mesh_bridge:
+                        mesh_bridge = self.find_shared_mesh_bridge(primary_ip)
+                    bridges[bridge_key] = (mesh_bridge, router_mesh_iface)
+                mesh_bridge, router_mesh_iface = bridges[bridge_key]
+                if not mesh_bridge:
+                    raise ValueError(f"No shared mesh bridge found for IP {primary_ip}. Run netsetup first.")
+
+                name_hash = hashlib.md5(host_name.encode()).hexdigest()[:6]
+                plans.append({
+                    'name': host_name,
+                    'primary_ip': primary_ip,
+                    'secondary_ips': secondary_ips,
+                    'network': host_network,
+                    'router': target_router,
+                    'iface': target_iface,
+                    'gateway_ip': gateway_ip,
+                    'router_ip_added': gateway_missing,
+                    'mesh_bridge': mesh_bridge,
+                    'router_mesh_iface': router_mesh_iface,
+                    'host_veth': f"h{name_hash}",
+                    'mesh_veth': f"m{name_hash}"
+                })
+
+        except ValueError as e:
+            # Validation failed - nothing was created
+            print(f"[ERROR] {e}")
+            self.logger.error(f"Bulk host add rejected: {e}")
+            return False
+
+        if not plans:
+            return True
+
+        # Root namespace: all veth pairs in one netlink batch, after the namespaces
+        root_batch = [f"link add {p['host_veth']} netns {p['name']} type veth "
+                      f"peer name {p['mesh_veth']} netns {self.hidden_ns}" for p in plans]
+
+        router_batches: Dict[str, List[str]] = {}
+        for p in plans:
+            if p['router_ip_added']:
+                self.logger.info(f"Router {p['router']} has no IP in subnet {p['network']}, adding "
+                                 f"{p['gateway_ip']}/{p['network'].prefixlen} to interface {p['iface']}")
+                router_batches.setdefault(p['router'], []).append(
+                    f"address add {p['gateway_ip']}/{p['network'].prefixlen} dev {p['iface']}")
+
+        mesh_bridges = sorted({p['mesh_bridge'] for p in plans})
+        hidden_batch = []
+        for p in plans:
+            hidden_batch += [f"link set {p['mesh_veth']} master {p['mesh_bridge']}",
+                             f"link set {p['mesh_veth']} up"]
+        # Flush learned MACs once per bridge (hosts may be recreated with new MACs)
+        hidden_batch += [f"link set {b} type bridge ageing_time 0" for b in mesh_bridges]
+
+        host_batches = []
+        for p in plans:
+            lines = ["link set lo up",
+                     f"link set {p['host_veth']} name eth0",
+                     f"address add {p['primary_ip']} dev eth0",
+                     "link set eth0 up"]
+            for i, secondary_ip in enumerate(p['secondary_ips']):
+                lines += [f"link add dummy{i} type dummy",
+                          f"address add {secondary_ip} dev dummy{i}",
+                          f"link set dummy{i} up"]
+            if p['gateway_ip'] and ipaddress.IPv4Address(p['gateway_ip']) in p['network']:
+                lines.append(f"route add default via {p['gateway_ip']} dev eth0")
+            else:
+                self.logger.warning(f"Gateway {p['gateway_ip']} is not in host subnet {p['network']}, "
+                                    f"skipping default route for {p['name']}")
+            host_batches.append(('ip', p['name'], lines))
+
+        batches = [('ip', None, root_batch)]
+        batches += [('ip', router, lines) for router, lines in router_batches.items()]
+        batches.append(('ip', self.hidden_ns, hidden_batch))
+        if not self.no_delay:
+            batches.append(('sh', None, ["sleep 0.1"]))
+        batches.append(('ip', self.hidden_ns, [f"link set {b} type bridge ageing_time 30000" for b in mesh_bridges]))
+        batches += host_batches
+
+        created = []
+
+        def rollback():
+            # Only namespaces this call created: a name taken by another process
+            # since validation must not be deleted here
+            undo = [('ip', None, [f"netns del {name}" for name in created])]
+            undo += [('ip', p['router'], [f"address del {p['gateway_ip']}/{p['network'].prefixlen} dev {p['iface']}"])
+                     for p in plans if p['router_ip_added']]
+            self._run_batch_script(undo, check=False)
+
+        op_start = time.time()
+        created.extend(self._add_namespaces([p['name'] for p in plans]))
+        if len(created) != len(plans):
+            taken = [p['name'] for p in plans if p['name'] not in created]
+            print(f"[ERROR] Bulk host setup failed: namespaces already exist: {', '.join(taken)}")
+            self.logger.error(f"Bulk host setup failed, namespaces created concurrently: {taken}")
+            rollback()
+            return False
+        try:
+            self._run_batch_script(batches)
+        except subprocess.CalledProcessError as e:
+            print(f"[ERROR] Bulk host setup failed: {(e.stderr or '').strip()}")
+            self.logger.error(f"Bulk host setup failed, removing {len(plans)} hosts: {e.stderr}")
+            rollback()
+            return False
+        setup_ms = (time.time() - op_start) * 1000
+
+        # Best effort, as in create_mesh_connection: latency, FDB/ARP flushes, MAC learning.
+        # One ping from the router to each host teaches the bridge both MACs (ARP
+        # request and reply), so each router gets a single shell for all of them.
+        if not self.no_delay:
+            time.sleep(0.5)
+        followup = []
+        if self.check_command_availability("tc"):
+            for p in plans:
+                lines = ["qdisc replace dev eth0 root netem delay 1.0ms"]
+                lines += [f"qdisc replace dev dummy{i} root netem delay 0.0ms" for i in range(len(p['secondary_ips']))]
+                followup.append(('tc', p['name'], lines))
+        router_mesh_ifaces = sorted({p['router_mesh_iface'] for p in plans if p['router_mesh_iface']})
+        followup.append(('bridge', self.hidden_ns, [f"fdb flush dev {iface} master" for iface in router_mesh_ifaces]))
+        for router in sorted({p['router'] for p in plans if p['router'] in self.available_namespaces}):
+            followup.append(('ip', router, ["neigh flush all"]))
+        pings = []
+        for router in sorted({p['router'] for p in plans if p['router'] in self.available_namespaces}):
+            targets = ' '.join(p['primary_ip'].split('/')[0] for p in plans
+                               if p['router'] == router and p['gateway_ip'])
+            if targets:
+                pings.append(f"ip netns exec {router} sh -c 'for ip in {targets}; do "
+                             f"ping -c 1 -W 1 $ip >/dev/null 2>&1 & done' >/dev/null 2>&1 &")
+        followup.append(('sh', None, pings))
+        self._run_batch_script(followup, check=False)
+        if not self.no_delay:
+            time.sleep(0.3)
+
+        # All registries in one update each
+        created_at = str(subprocess.run("date", capture_output=True, text=True).stdout.strip())
+        host_configs = {}
+        for p in plans:
+            host_configs[p['name']] = {
+                "primary_ip": p['primary_ip'],
+                "secondary_ips": p['secondary_ips'],
+                "connected_to": p['router'],
+                "router_interface": p['iface'] if p['iface'] else "unknown",
+                "gateway_ip": p['gateway_ip'],
+                "router_ip_added": p['router_ip_added'],
+                "dummy_interfaces": [{"interface": f"dummy{i}", "ip": ip} for i, ip in enumerate(p['secondary_ips'])],
+                "created_at": created_at,
+                "connection_type": "sim_mesh_direct",
+                "mesh_bridge": p['mesh_bridge'],
+                "host_veth": p['host_veth'],
+                "mesh_veth": p['mesh_veth'],
+                "sim_namespace": "netsim"
+            }
+
+        op_start = time.time()
+        if not self._batch_register_hosts(host_configs):
+            print(f"[ERROR] Bulk host registration failed, removing {len(plans)} hosts")
+            rollback()
+            return False
+        registry_ms = (time.time() - op_start) * 1000
+
+        if self.verbose >= 2:
+            print(f"\n=== Bulk Host Creation Timing Summary ===")
+            print(f"Hosts: {len(plans)} created, {len(reused)} reused")
+            print(f"Namespace/link/address setup: {setup_ms:.1f}ms")
+            print(f"Registry update: {registry_ms:.1f}ms")
+            print(f"Total time: {(time.time() - operation_start) * 1000:.1f}ms")
+        for p in plans:
+            print(f"[CREATED] Host {p['name']} {p['primary_ip']} on {p['router']} "
+                  f"interface {p['iface'] or 'unknown'} (gateway: {p['gateway_ip']})")
+        return True
+
+    def _batch_register_hosts(self, host_configs: Dict[str, Dict]) -> bool:
+        """Register a set of new hosts with one update per registry.
+
+        The host registry update is a single all-or-nothing transaction;
+        interface, router code and bridge registries follow, one locked
+        read-modify-write each. The host registry is rolled back if the
+        code registries cannot be updated.
+        """
+        names = list(host_configs)
+        try:
+            if self.registry_mgr:
+                creator_tag = CreatorTagManager.get_creator_tag()
+                entries = []
+                for host_name, host_config in host_configs.items():
+                    additional_info = {field: host_config[field] for field in self.HOST_REGISTRY_FIELDS
+                                       if field in host_config}
+                    additional_info['created_by'] = creator_tag
+                    entries.append({
+                        'host_name': host_name,
+                        'primary_ip': host_config['primary_ip'],
+                        'connected_to': host_config['connected_to'],
+                        'mac_address': host_config.get('mac_address', generate_mac_address(host_name)),
+                        'additional_info': additional_info
+                    })
+                if not self.registry_mgr.check_and_register_hosts(entries):
+                    self.logger.error("Failed to register hosts: collision detected (name, IP, or MAC already in use)")
+                    return False
+            else:
+                self.logger.warning("TsimRegistryManager not available, using fallback method")
+
+                def add_hosts_op(registry):
+                    taken = [name for name in names if name in registry]
+                    if taken:
+                        self.logger.error(f"Host names already exist: {', '.join(taken)}")
+                        return False, registry
+                    registry.update(host_configs)
+                    return True, registry
+
+                success, _ = self._atomic_json_operation(self.host_registry_file, add_hosts_op)
+                if not success:
+                    return False
+
+            host_codes = {}
+
+            def assign_codes_op(router_registry):
+                existing_codes = set(router_registry.values())
+                for host_name in names:
+                    if host_name not in router_registry:
+                        for i in range(1000):
+                            if f"h{i:03d}" not in existing_codes:
+                                router_registry[host_name] = f"h{i:03d}"
+                                break
+                        else:
+                            router_registry[host_name] = f"h{hashlib.md5(host_name.encode()).hexdigest()[:3]}"
+                        existing_codes.add(router_registry[host_name])
+                    host_codes[host_name] = router_registry[host_name]
+                return True, router_registry
+
+            def update_interfaces_op(registry):
+                for host_name, host_config in host_configs.items():
+                    interfaces = registry.setdefault(host_codes[host_name], {})
+                    host_interfaces = ["lo", "eth0"] + [d['interface'] for d in host_config['dummy_interfaces']]
+                    for interface_name in host_interfaces:
+                        existing_codes = set(interfaces.values())
+                        for i in range(1000):
+                            if interface_name not in interfaces and f"i{i:03d}" not in existing_codes:
+                                interfaces[interface_name] = f"i{i:03d}"
+                                break
+                return True, registry
+
+            success, _ = self._atomic_json_operation(self.router_registry_file, assign_codes_op)
+            if success:
+                success, _ = self._atomic_json_operation(self.interface_registry_file, update_interfaces_op)
+            if not success:
+                self.logger.error("Failed to register host interfaces, rolling back host registry")
+                if self.registry_mgr:
+                    self.registry_mgr.unregister_hosts(names)
+                else:
+                    self._atomic_json_operation(
+                        self.host_registry_file,
+                        lambda registry: (True, {k: v for k, v in registry.items() if k not in host_configs}))
+                return False
+
+            def update_bridges_op(bridge_registry):
+                for host_name, host_config in host_configs.items():
+                    bridge_name = host_config.get('mesh_bridge')
+                    if bridge_name in bridge_registry:
+                        bridge_registry[bridge_name].setdefault('hosts', {})[host_name] = {
+                            "interface": "eth0",
+                            "ipv4": host_config['primary_ip'],
+                            "state": "UP"
+                        }
+                    else:
+                        self.logger.error(f"Bridge {bridge_name} not found in registry")
+                return True, bridge_registry
+
+            # Non-critical, as for single hosts
+            self._atomic_json_operation(str(self.bridge_registry_file), update_bridges_op)
+            return True
+
+        except Exception as e:
+            self.logger.error(f"Failed to batch register hosts: {e}")
+            return False
+
+    def remove_hosts(self, host_names: List[str]) -> bool:
+        """Remove a set of hosts with one batched teardown and one registry transaction.
+
+        Router addresses added for the hosts, their namespaces and mesh veths
+        are removed by a single _run_batch_script() run, bridge ageing is
+        flushed once per bridge, and each registry is updated once for the
+        whole set. Hosts that do not exist are skipped as in remove_host().
+
+        Returns:
+            True if none of the hosts exist afterwards
+
+        Raises:
+            RuntimeError: If namespaces survive deletion
+        """
+        registry = self.load_host_registry()
+        host_names = list(dict.fromkeys(host_names))
+        registered = [name for name in host_names if name in registry]
+        present = [name for name in host_names if name in self.available_namespaces or name in registry]
+        for name in host_names:
+            if name not in present and self.verbose >= 1:
+                print(f"[INFO] Host {name} does not exist, nothing to remove")
+        if not present:
+            return True
+
+        router_batches: Dict[str, List[str]] = {}
+        hidden_batch = []
+        bridges = set()
+        for name in registered:
+            host_config = registry[name]
+            router = host_config.get("connected_to")
+            if (host_config.get("router_ip_added") and router in self.available_namespaces and
+                    host_config.get("router_interface") and host_config.get("gateway_ip")):
+                prefixlen = ipaddress.IPv4Network(host_config['primary_ip'], strict=False).prefixlen
+                router_batches.setdefault(router, []).append(
+                    f"address del {host_config['gateway_ip']}/{prefixlen} dev {host_config['router_interface']}")
+            if host_config.get("connection_type") == "sim_mesh_direct" and host_config.get("mesh_veth"):
+                hidden_batch.append(f"link del {host_config['mesh_veth']}")
+            if host_config.get("mesh_bridge"):
+                bridges.add(host_config["mesh_bridge"])
+
+        batches = [('ip', router, lines + ["neigh flush all"]) for router, lines in router_batches.items()]
+        batches.append(('ip', None, [f"netns del {name}" for name in present if name in self.available_namespaces]))
+        batches.append(('ip', self.hidden_ns, hidden_batch + [f"link set {b} type bridge ageing_time 0"
+                                                              for b in sorted(bridges)]))
+        if not self.no_delay:
+            batches.append(('sh', None, ["sleep 0.1"]))
+        batches.append(('ip', self.hidden_ns, [f"link set {b} type bridge ageing_time 30000" for b in sorted(bridges)]))
+        self._run_batch_script(batches, check=False)
+
+        # CRITICAL: only hosts whose namespace is really gone leave the registries
+        result = self.run_command("ip netns list", check=False)
+        remaining = set(re.findall(r'^(\S+)', result.stdout, re.M))
+        failed = [name for name in present if name in remaining]
+        removed = [name for name in present if name not in remaining]
+
+        try:
+            if self.registry_mgr:
+                self.registry_mgr.unregister_hosts(removed)
+            else:
+                self._atomic_json_operation(
+                    self.host_registry_file,
+                    lambda registry: (True, {k: v for k, v in registry.items() if k not in removed}))
+
+            host_codes = []
+
+            def remove_codes_op(router_registry):
+                for name in removed:
+                    if name in router_registry:
+                        host_codes.append(router_registry.pop(name))
+                return True, router_registry
+
+            def remove_interfaces_op(interface_registry):
+                for code in host_codes:
+                    interface_registry.pop(code, None)
+                return True, interface_registry
+
+            def remove_bridges_op(bridge_registry):
+                for bridge_info in bridge_registry.values():
+                    for name in removed:
+                        bridge_info.get('hosts', {}).pop(name, None)
+                return True, bridge_registry
+
+            self._atomic_json_operation(self.router_registry_file, remove_codes_op)
+            self._atomic_json_operation(self.interface_registry_file, remove_interfaces_op)
+            self._atomic_json_operation(str(self.bridge_registry_file), remove_bridges_op)
+        except Exception as e:
+            self.logger.error(f"CRITICAL: Namespaces deleted but registry update failed: {e}")
+            raise RuntimeError(f"Registry update failed after namespace deletion: {e}")
+
+        if self.verbose >= 1:
+            for name in removed:
+                print(f"[SUCCESS] Host {name} removed successfully")
+        if failed:
+            self.logger.error(f"Failed to delete namespaces: {', '.join(failed)}")
+            raise RuntimeError(f"Failed to delete namespaces: {', '.join(failed)}")
+        return True
+
     def _recreate_host_namespace(self, host_name: str, host_config: Dict) -> bool:
         """Recreate host namespace from existing registry config without updating registry."""
         # Extract parameters from registry
@@ -2284,6 +2940,13 @@ Examples:
   
   # Remove host
   %(prog)s --host web1 --remove
+
+  # Move existing host to another address in its subnet
+  %(prog)s --host web1 --readdress --primary-ip 10.1.1.101/24
+
+  # Add or remove many hosts at once (JSON list, "-" reads stdin)
+  %(prog)s --hosts-file hosts.json
+  %(prog)s --hosts-file hosts.json --remove
   
   # List all hosts
   %(prog)s --list-hosts
@@ -2301,7 +2964,12 @@ Notes:
     # Action arguments
     parser.add_argument('--host', type=str, help='Host name to add or remove')
     parser.add_argument('--remove', action='store_true', help='Remove the specified host (use with --host)')
+    parser.add_argument('--readdress', action='store_true',
+                       help='Change primary IP of the specified host within its subnet (use with --host and --primary-ip)')
     parser.add_argument('--list-hosts', action='store_true', help='List all registered hosts')
+    parser.add_argument('--hosts-file', type=str,
+                       help='JSON list of hosts to add in one batch ({"name", "primary_ip", "connect_to", '
+                            '"secondary_ips", "router_interface"}), or to remove with --remove; "-" for stdin')
     
     # Configuration arguments for --host
     parser.add_argument('--primary-ip', type=str, help='Primary IP address with prefix (e.g., 10.1.1.100/24)')
@@ -2320,8 +2988,11 @@ Notes:
     args = parser.parse_args()
     
     # Validate arguments
-    if not args.host and not args.list_hosts:
-        parser.error("Either --host or --list-hosts is required")
+    if not args.host and not args.list_hosts and not args.hosts_file:
+        parser.error("Either --host, --hosts-file or --list-hosts is required")
+
+    if args.host and args.hosts_file:
+        parser.error("--host cannot be used with --hosts-file")
     
     if args.host and args.remove and args.primary_ip:
         parser.error("--primary-ip cannot be used with --remove")
@@ -2338,7 +3009,24 @@ Notes:
         manager.load_router_facts()
         manager.discover_namespaces()
         
-        if args.host and args.remove:
+        if args.hosts_file:
+            if args.hosts_file == '-':
+                hosts = json.load(sys.stdin)
+            else:
+                with open(args.hosts_file, 'r') as f:
+                    hosts = json.load(f)
+            if args.remove:
+                names = [h['name'] if isinstance(h, dict) else h for h in hosts]
+                success = manager.remove_hosts(names)
+            else:
+                success = manager.add_hosts(hosts)
+            sys.exit(0 if success else 1)
+
+        elif args.host and args.readdress:
+            success = manager.readdress_host(args.host, args.primary_ip)
+            sys.exit(0 if success else 1)
+
+        elif args.host and args.remove:
             # Remove host
             success = manager.remove_host(args.host)
             sys.exit(0 if success else 1)
@@ -9,6 +9,7 @@ other tsimsh commands.
 """
 
 import argparse
+import ipaddress
 import json
 import os
 import re
@@ -21,6 +22,7 @@ from pathlib import Path
 from typing import Dict, List, Tuple, Optional
 
 from tsim.core.config_loader import get_registry_paths
+from tsim.analyzers.iptables_save_index import IptablesSaveIndex
 
 # Global verbosity level
 VERBOSE = 0
@@ -129,6 +131,28 @@ def infer_routers_for_source(src_ip: str, bridges: Dict, hosts: Dict, ip_map: Di
     return routers
 
 
+def resolve_virtual_sources(specs: List[str], src_ip: str, hosts: Dict) -> Dict[str, str]:
+    """Map router -> injector namespace from ROUTER=NAMESPACE specs.
+
+    A virtual source has no host of its own: probes carrying src_ip are sent
+    from an injector host already attached to the router's bridge for that
+    subnet, so the router sees them arrive on the right interface.
+    """
+    virtual: Dict[str, str] = {}
+    for spec in specs:
+        router, sep, ns = spec.partition('=')
+        if not sep or not router or not ns:
+            raise ValueError(f"Invalid virtual source '{spec}' (expected ROUTER=NAMESPACE)")
+        info = hosts.get(ns)
+        if not info or info.get('connected_to') != router:
+            raise ValueError(f"Injector {ns} is not a host connected to {router}")
+        subnet = ipaddress.ip_network(info.get('primary_ip', ''), strict=False)
+        if ipaddress.ip_address(src_ip) not in subnet:
+            raise ValueError(f"Source {src_ip} is outside injector {ns} subnet {subnet}")
+        virtual[router] = ns
+    return virtual
+
+
 def parse_ports(port_spec: str, default_proto: str, max_services: int, range_limit: int = 100, force: bool = False) -> List[Tuple[int, str]]:
     """Parse port spec using the same logic as WSGI TsimPortParserService.
     Import the service by adding the wsgi dir to sys.path to avoid requiring 'wsgi' as a package.
@@ -315,64 +339,213 @@ def execute_iptables_script(rname: str, script_commands: List[str]) -> 'subproce
             pass
 
 
-def extract_counter(snapshot: str, comment: str) -> Tuple[int, int]:
-    # Lines look like: -A PREROUTING -c <pkts> <bytes> ... -m comment --comment "TSIM_KSMS=..."
-    pkts = bytes_ = 0
-    found = False
-    
-    # The comment might be quoted in the saved output
-    search_comment = comment.replace('"', '')  # Remove quotes for searching
-    
-    # Try to find the rule with our exact comment (including run ID)
-    for line in snapshot.splitlines():
-        # Check if this line contains our specific comment
-        # Lines can start with [counters] or just -A
-        if search_comment in line and ('-A ' in line):
-            # Also verify it's in a comment field (not just random text)
-            if '--comment' in line:
-                # Extract the actual comment from the line to verify exact match
-                comment_match = re.search(r'--comment\s+"([^"]+)"', line)
-                if not comment_match:
-                    # Try without quotes  
-                    comment_match = re.search(r'--comment\s+(\S+)', line)
-                
-                if comment_match:
-                    actual_comment = comment_match.group(1).replace('"', '')
-                    if actual_comment == search_comment:
-                        found = True
-                        # Extract counters - either from [X:Y] at start or -c X Y format
-                        if line.startswith('['):
-                            m = re.search(r'^\[(\d+):(\d+)\]', line)
-                            if m:
-                                pkts = int(m.group(1))
-                                bytes_ = int(m.group(2))
-                        else:
-                            m = re.search(r'-c\s+(\d+)\s+(\d+)', line)
-                            if m:
-                                pkts = int(m.group(1))
-                                bytes_ = int(m.group(2))
-                        if VERBOSE >= 3:
-                            _dbg(f"    [counter] Found exact rule match: '{search_comment[:40]}...' pkts={pkts} bytes={bytes_}", 3)
-                        return pkts, bytes_  # Return immediately
-    
-    if not found and VERBOSE >= 3:
-        _dbg(f"    [counter] No matching rule found for comment '{search_comment[:40]}...'", 3)
-        # Show what rules we do have with TSIM_KSMS in them
-        ksms_lines = [l for l in snapshot.splitlines() if 'TSIM_KSMS' in l and '--comment' in l]
-        if ksms_lines:
-            _dbg(f"    [counter] Found {len(ksms_lines)} TSIM_KSMS rules in snapshot:", 3)
-            for line in ksms_lines[:3]:
-                # Extract and show the comment
-                comment_match = re.search(r'--comment\s+"([^"]+)"', line)
-                if not comment_match:
-                    comment_match = re.search(r'--comment\s+(\S+)', line)
-                if comment_match:
-                    _dbg(f"    [counter]   Comment: {comment_match.group(1)[:60]}...", 3)
-    
-    return pkts, bytes_
+KSMS_COMMENT_PREFIX = 'TSIM_KSMS='
+
+
+def index_snapshot(snapshot: str) -> IptablesSaveIndex:
+    """Index the TSIM_KSMS rule counters of a snapshot in one pass."""
+    return IptablesSaveIndex(snapshot, KSMS_COMMENT_PREFIX)
+
+
+def extract_counter(snapshot, comment: str) -> Tuple[int, int]:
+    """Packet/byte counters of the rule with this exact comment.
+
+    Args:
+        snapshot: iptables-save output, or an index of it from index_snapshot()
+                  (build the index once when looking up many comments)
+        comment: Rule comment, quotes ignored
+    """
+    index = snapshot if isinstance(snapshot, IptablesSaveIndex) else index_snapshot(snapshot)
+    counters = index.counter(comment)
+    if counters is not None:
+        if VERBOSE >= 3:
+            _dbg(f"    [counter] Found exact rule match: '{comment[:40]}...' pkts={counters[0]} bytes={counters[1]}", 3)
+        return counters
+
+    if VERBOSE >= 3:
+        _dbg(f"    [counter] No matching rule found for comment '{comment[:40]}...'", 3)
+        if index.comments:
+            _dbg(f"    [counter] Found {len(index.comments)} TSIM_KSMS rules in snapshot:", 3)
+            for known in list(index.comments)[:3]:
+                _dbg(f"    [counter]   Comment: {known[:60]}...", 3)
+    return 0, 0
+
+
+class JobTag:
+    """Wire tag that separates THIS job's probes from other concurrent jobs.
+
+    'dscp' mode tags with the DSCP value itself (32 concurrent jobs). 'ipid'
+    mode tags with the IPv4 identification field under one shared marker
+    DSCP, giving thousands of concurrent jobs; only the native probe emitter
+    can set the IP ID. str() is the label used in chain, set and table names.
+    """
+
+    def __init__(self, dscp: int, mode: str = 'dscp', ip_id: Optional[int] = None):
+        if mode not in ('dscp', 'ipid'):
+            raise ValueError(f"Invalid tag mode {mode} (must be dscp or ipid)")
+        if mode == 'ipid' and not (ip_id and 1 <= ip_id <= 65535):
+            raise ValueError(f"Invalid IP ID tag {ip_id} (must be 1-65535)")
+        self.dscp = dscp
+        self.mode = mode
+        self.ip_id = ip_id if mode == 'ipid' else None
+
+    def __str__(self) -> str:
+        return f"I{self.ip_id}" if self.ip_id else str(self.dscp)
+
+    @property
+    def tos(self) -> int:
+        return self.dscp << 2
+
+    def ip_id_match(self) -> List[str]:
+        """iptables u32 match on the IP ID (bytes 4-5 of the IPv4 header)."""
+        return ['-m', 'u32', '--u32', f"0x2&0xffff=0x{self.ip_id:x}"]
+
+    def nft_match(self) -> str:
+        """nft expression selecting this job's packets."""
+        return f"ip dscp {self.dscp} ip id {self.ip_id}" if self.ip_id else f"ip dscp {self.dscp}"
+
+
+def _as_tag(job_tag) -> JobTag:
+    return job_tag if isinstance(job_tag, JobTag) else JobTag(int(job_tag))
+
+
+# Shared per-hook dispatch chains of 'ipid' mode: the marker DSCP jumps here
+# once, then one u32 rule per running job jumps to that job's tap chain.
+IPID_DISPATCH_PRE = 'TSIM_TAP_PRE_IPID'
+IPID_DISPATCH_POST = 'TSIM_TAP_POST_IPID'
 
 
-def initialize_job_dscp_chains(rname: str, job_dscp: int):
+def counting_set_names(job_dscp: int) -> Tuple[str, str]:
+    """Names of THIS job's PREROUTING/POSTROUTING counting sets (ipset) or nft sets."""
+    return f"TSIM_KSMS_PRE_{job_dscp}", f"TSIM_KSMS_POST_{job_dscp}"
+
+
+def counting_nft_table(job_dscp: int) -> str:
+    """nft table holding THIS job's counting sets and hooks."""
+    return f"tsim_ksms_{job_dscp}"
+
+
+def detect_set_backend(rname: str, preferred: str = 'auto') -> str:
+    """Pick the per-element counter backend for a router: ipset if usable, else nft."""
+    if preferred != 'auto':
+        return preferred
+    if run(['ip', 'netns', 'exec', rname, 'ipset', '-v']).returncode == 0:
+        return 'ipset'
+    return 'nft'
+
+
+def counting_set_payload(backend: str, job_dscp: int, dst_ip: str, services: List[Tuple[int, str]]) -> str:
+    """Restore payload creating THIS job's counting sets with one element per service.
+
+    Recreating the sets resets every element counter to zero, so no baseline
+    snapshot is needed.
+    """
+    set_pre, set_post = counting_set_names(job_dscp)
+    if backend == 'ipset':
+        lines = []
+        for name in (set_pre, set_post):
+            lines.append(f"create {name} hash:ip,port counters -exist")
+            lines.append(f"flush {name}")
+            lines.extend(f"add {name} {dst_ip},{proto}:{port}" for port, proto in services)
+        return "\n".join(lines) + "\n"
+
+    table = counting_nft_table(job_dscp)
+    elements = ", ".join(f"{dst_ip} . {proto} . {port}" for port, proto in services)
+    lines = [f"table ip {table}", f"delete table ip {table}", f"table ip {table} {{"]
+    for name, hook in ((set_pre, 'prerouting'), (set_post, 'postrouting')):
+        lines.append(f"  set {name} {{ type ipv4_addr . inet_proto . inet_service; counter; "
+                     f"elements = {{ {elements} }} }}")
+        lines.append(f"  chain {hook} {{ type filter hook {hook} priority mangle; policy accept; "
+                     f"{_as_tag(job_dscp).nft_match()} ip daddr . meta l4proto . th dport @{name} }}")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def install_counting_sets(rname: str, backend: str, job_dscp: int, dst_ip: str,
+                          services: List[Tuple[int, str]]) -> bool:
+    """Install THIS job's counting sets; ipset sets are matched from the DSCP tap chains."""
+    payload = counting_set_payload(backend, job_dscp, dst_ip, services)
+    if backend == 'nft':
+        return run(['ip', 'netns', 'exec', rname, 'nft', '-f', '-'], input_data=payload).returncode == 0
+
+    if run(['ip', 'netns', 'exec', rname, 'ipset', 'restore'], input_data=payload).returncode != 0:
+        return False
+    set_pre, set_post = counting_set_names(job_dscp)
+    # One rule per chain; the set match updates the matching element's counters
+    commands = [f"iptables -t mangle -A TSIM_TAP_PRE_{job_dscp} -m set --match-set {set_pre} dst,dst",
+                f"iptables -t mangle -A TSIM_TAP_POST_{job_dscp} -m set --match-set {set_post} dst,dst"]
+    return execute_iptables_script(rname, commands).returncode == 0
+
+
+def parse_ipset_counters(save_output: str) -> Dict[Tuple[str, int, str], int]:
+    """Element packet counters from `ipset save` output, keyed (set, port, proto)."""
+    counters: Dict[Tuple[str, int, str], int] = {}
+    for line in save_output.splitlines():
+        if not line.startswith('add '):
+            continue
+        parts = line.split()
+        if len(parts) < 3:
+            continue
+        _, _, port_spec = parts[2].partition(',')
+        proto, _, port = port_spec.partition(':')
+        packets = 0
+        if 'packets' in parts:
+            value = parts[parts.index('packets') + 1]
+            packets = int(value) if value.isdigit() else 0
+        if port.isdigit():
+            counters[(parts[1], int(port), proto)] = packets
+    return counters
+
+
+_PROTO_NAMES = {6: 'tcp', 17: 'udp'}
+
+
+def parse_nft_set_counters(json_output: str) -> Dict[Tuple[str, int, str], int]:
+    """Per-element counters from `nft -j list table` output, keyed like parse_ipset_counters."""
+    counters: Dict[Tuple[str, int, str], int] = {}
+    try:
+        items = json.loads(json_output).get('nftables', [])
+    except ValueError:
+        return counters
+    for item in items:
+        nft_set = item.get('set')
+        if not nft_set:
+            continue
+        for elem in nft_set.get('elem', []):
+            wrapped = elem.get('elem', elem) if isinstance(elem, dict) else {}
+            value = wrapped.get('val', {}) if isinstance(wrapped, dict) else {}
+            concat = value.get('concat') if isinstance(value, dict) else None
+            if not concat or len(concat) != 3:
+                continue
+            proto = _PROTO_NAMES.get(concat[1], concat[1])
+            packets = wrapped.get('counter', {}).get('packets', 0)
+            counters[(nft_set['name'], int(concat[2]), proto)] = packets
+    return counters
+
+
+def read_counting_sets(rname: str, backend: str, job_dscp: int) -> Dict[Tuple[str, int, str], int]:
+    """Read all element counters of THIS job's sets with a single dump."""
+    if backend == 'nft':
+        cp = run(['ip', 'netns', 'exec', rname, 'nft', '-j', 'list', 'table', 'ip', counting_nft_table(job_dscp)])
+        return parse_nft_set_counters(cp.stdout) if cp.returncode == 0 else {}
+    counters: Dict[Tuple[str, int, str], int] = {}
+    for name in counting_set_names(job_dscp):
+        cp = run(['ip', 'netns', 'exec', rname, 'ipset', 'save', name])
+        if cp.returncode == 0:
+            counters.update(parse_ipset_counters(cp.stdout))
+    return counters
+
+
+def remove_counting_sets(rname: str, backend: str, job_dscp: int):
+    """Remove THIS job's counting sets (tap chains must already be flushed for ipset)."""
+    if backend == 'nft':
+        run(['ip', 'netns', 'exec', rname, 'nft', 'delete', 'table', 'ip', counting_nft_table(job_dscp)])
+        return
+    for name in counting_set_names(job_dscp):
+        run(['ip', 'netns', 'exec', rname, 'ipset', 'destroy', name])
+
+
+def initialize_job_dscp_chains(rname: str, job_dscp):
     """Initialize chains and jump rules for THIS job's DSCP value only.
 
     Creates permanent infrastructure for this specific DSCP:
@@ -381,10 +554,19 @@ def initialize_job_dscp_chains(rname: str, job_dscp: int):
 
     IMPORTANT: Only works on chains for THIS job's DSCP. Never touches other DSCPs.
 
+    In 'ipid' tag mode the job chains hang off the shared dispatch chains
+    instead (see initialize_job_ipid_chains).
+
     Args:
         rname: Router namespace name
-        job_dscp: This job's DSCP value (32-63)
+        job_dscp: This job's DSCP value (32-63) or JobTag
     """
+    if isinstance(job_dscp, JobTag):
+        if job_dscp.ip_id:
+            initialize_job_ipid_chains(rname, job_dscp)
+            return
+        job_dscp = job_dscp.dscp
+
     if VERBOSE >= 3:
         _dbg(f"  [{rname}] Initializing DSCP {job_dscp} infrastructure...", 3)
 
@@ -422,8 +604,118 @@ def initialize_job_dscp_chains(rname: str, job_dscp: int):
         _dbg(f"  [{rname}] DSCP {job_dscp} infrastructure ready", 3)
 
 
-def emit_probes_in_source_ns(source_ns: str, dst_ip: str, services: List[Tuple[int, str]], svc_tokens: Dict[Tuple[int, str], Dict], tcp_timeout: float) -> int:
-    # Build a small python helper which sends all probes
+def _iptables_ensure(rname: str, chain: str, rule: List[str]) -> bool:
+    """Append a mangle rule unless an identical one exists (iptables -C)."""
+    base = ['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle']
+    if run(base + ['-C', chain] + rule).returncode == 0:
+        return True
+    return run(base + ['-A', chain] + rule).returncode == 0
+
+
+def initialize_job_ipid_chains(rname: str, job_tag: JobTag):
+    """Initialize THIS job's tap chains in 'ipid' tag mode.
+
+    The marker DSCP jumps from PREROUTING/POSTROUTING into the shared dispatch
+    chains once; each running job adds one IP ID rule there, so the per-packet
+    cost grows with concurrently running jobs, not with jobs ever run.
+    """
+    dscp_hex = f"0x{job_tag.dscp:02x}"
+    for hook, dispatch, chain in (('PREROUTING', IPID_DISPATCH_PRE, f"TSIM_TAP_PRE_{job_tag}"),
+                                  ('POSTROUTING', IPID_DISPATCH_POST, f"TSIM_TAP_POST_{job_tag}")):
+        run(['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle', '-N', dispatch])
+        run(['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle', '-N', chain])
+        if not _iptables_ensure(rname, hook, ['-m', 'dscp', '--dscp', dscp_hex, '-j', dispatch]):
+            _dbg(f"  [{rname}] WARNING: Failed to add {hook} jump for marker DSCP {job_tag.dscp}", 1)
+        if not _iptables_ensure(rname, dispatch, job_tag.ip_id_match() + ['-j', chain]):
+            _dbg(f"  [{rname}] WARNING: Failed to add {dispatch} jump for IP ID {job_tag.ip_id}", 1)
+
+    if VERBOSE >= 3:
+        _dbg(f"  [{rname}] IP ID tag {job_tag.ip_id} infrastructure ready", 3)
+
+
+def release_job_ipid_chains(rname: str, job_tag: JobTag):
+    """Remove THIS job's dispatch rules and (already flushed) tap chains in 'ipid' mode."""
+    base = ['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle']
+    for dispatch, chain in ((IPID_DISPATCH_PRE, f"TSIM_TAP_PRE_{job_tag}"),
+                            (IPID_DISPATCH_POST, f"TSIM_TAP_POST_{job_tag}")):
+        run(base + ['-D', dispatch] + job_tag.ip_id_match() + ['-j', chain])
+        run(base + ['-X', chain])
+
+
+PROBE_EMITTER = os.environ.get('TSIM_PROBE_EMITTER', '/usr/local/bin/probe_emitter')
+
+
+def probe_emitter_available(path: str = PROBE_EMITTER) -> bool:
+    """True when the native probe emitter is installed and executable."""
+    return bool(path) and os.path.isfile(path) and os.access(path, os.X_OK)
+
+
+def probe_emitter_input(services: List[Tuple[int, str]], svc_tokens: Dict[Tuple[int, str], Dict]) -> str:
+    """Probe list in the emitter's "<proto> <port> <tos>" stdin format."""
+    return ''.join(f"{proto} {port} {svc_tokens[(port, proto)]['tos']}\n" for port, proto in services)
+
+
+def parse_probe_results(output: str) -> Tuple[Dict[Tuple[int, str], Dict], Dict]:
+    """Per-probe results keyed (port, proto) and the summary of emitter output."""
+    results: Dict[Tuple[int, str], Dict] = {}
+    summary: Dict = {}
+    for line in output.splitlines():
+        try:
+            record = json.loads(line)
+        except ValueError:
+            continue
+        if record.get('event') == 'summary':
+            summary = record
+        elif 'port' in record and 'proto' in record:
+            results[(int(record['port']), record['proto'])] = record
+    return results, summary
+
+
+def emit_probes_native(source_ns: str, dst_ip: str, services: List[Tuple[int, str]],
+                       svc_tokens: Dict[Tuple[int, str], Dict], tcp_timeout: float,
+                       rate: int = 0, ip_id: Optional[int] = None, src_ip: Optional[str] = None) -> int:
+    """Send all probes with the native emitter (raw sockets, sendmmsg, one epoll loop).
+
+    The emitter enters the namespace itself (cap_sys_admin), so it runs without
+    ip netns exec. TCP probes are bare SYNs: the source kernel resets any
+    SYN-ACK, leaving no half-open connections on the destination. src_ip
+    overrides the routed source address (virtual sources).
+    """
+    wait_ms = max(0, int(tcp_timeout * 1000))
+    argv = [PROBE_EMITTER, source_ns, dst_ip, '--wait', str(wait_ms), '--rate', str(max(0, rate))]
+    if ip_id:
+        argv += ['--ip-id', str(ip_id)]
+    if src_ip:
+        argv += ['--src', src_ip]
+    if VERBOSE >= 2:
+        _dbg(f"  [probe] Native emitter in namespace {source_ns}: {len(services)} probes, "
+             f"rate={rate or 'unpaced'}", 2)
+    cp = subprocess.run(argv, input=probe_emitter_input(services, svc_tokens),
+                        stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, check=False)
+    if VERBOSE >= 2:
+        results, summary = parse_probe_results(cp.stdout)
+        if summary:
+            _dbg(f"  [probe] Sent {summary.get('probes')} probes in {summary.get('send_ms')}ms, "
+                 f"{summary.get('answered')} answered", 2)
+        for (port, proto), record in sorted(results.items()):
+            _dbg(f"  [probe] {port}/{proto} TOS={record.get('tos')}: {record.get('result')}", 3)
+        if cp.stderr:
+            _dbg(f"  [probe] stderr: {cp.stderr}", 2)
+        _dbg(f"  [probe] Return code: {cp.returncode}", 2)
+    return cp.returncode
+
+
+def emit_probes_in_source_ns(source_ns: str, dst_ip: str, services: List[Tuple[int, str]], svc_tokens: Dict[Tuple[int, str], Dict], tcp_timeout: float,
+                             rate: int = 0, ip_id: Optional[int] = None, src_ip: Optional[str] = None) -> int:
+    """Send all probes from source_ns; with src_ip, as that (non-local) address."""
+    if probe_emitter_available():
+        return emit_probes_native(source_ns, dst_ip, services, svc_tokens, tcp_timeout, rate, ip_id, src_ip)
+    if ip_id:
+        # Kernel sockets pick their own IP ID; the tag cannot be applied
+        _dbg(f"  [probe] IP ID tagging requires {PROBE_EMITTER}", 1)
+        return 2
+
+    # Fallback: a small python helper which sends all probes
     helper = r"""
 import socket, sys, json, time
 import threading
@@ -433,6 +725,15 @@ dst_ip = sys.argv[1]
 tcp_timeout = float(sys.argv[2])
 spec = json.loads(sys.argv[3])  # list of {port,proto,tos}
 verbose = int(sys.argv[4]) if len(sys.argv) > 4 else 0
+src_ip = sys.argv[5] if len(sys.argv) > 5 else ''
+
+def bind_source(s):
+    # Virtual source: the address is not configured in this namespace.
+    # FREEBIND allows the bind, TRANSPARENT lets the route lookup accept it.
+    if src_ip:
+        s.setsockopt(socket.IPPROTO_IP, getattr(socket, 'IP_FREEBIND', 15), 1)
+        s.setsockopt(socket.IPPROTO_IP, getattr(socket, 'IP_TRANSPARENT', 19), 1)
+        s.bind((src_ip, 0))
 
 if verbose >= 2:
     import os
@@ -442,6 +743,7 @@ def send_tcp(port, tos):
     try:
         s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         s.setsockopt(socket.IPPROTO_IP, socket.IP_TOS, tos)
+        bind_source(s)
         s.settimeout(tcp_timeout)
         if verbose >= 2:
             print(f"[probe] TCP SYN to {dst_ip}:{port} with TOS={tos} (DSCP={tos>>2})", file=sys.stderr)
@@ -461,6 +763,7 @@ def send_udp(port, tos):
     try:
         s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
         s.setsockopt(socket.IPPROTO_IP, socket.IP_TOS, tos)
+        bind_source(s)
         if verbose >= 2:
             print(f"[probe] UDP datagram to {dst_ip}:{port} with TOS={tos} (DSCP={tos>>2})", file=sys.stderr)
         bytes_sent = s.sendto(b"x", (dst_ip, port))
@@ -524,7 +827,8 @@ if udp_services:
             time.sleep(batch_delay)
 """
     spec = [ {'port': p, 'proto': pr, 'tos': svc_tokens[(p,pr)]['tos']} for (p,pr) in services ]
-    argv = ['ip', 'netns', 'exec', source_ns, sys.executable, '-c', helper, dst_ip, str(tcp_timeout), json.dumps(spec), str(VERBOSE)]
+    argv = ['ip', 'netns', 'exec', source_ns, sys.executable, '-c', helper, dst_ip, str(tcp_timeout), json.dumps(spec), str(VERBOSE),
+            src_ip or '']
     
     if VERBOSE >= 2:
         _dbg(f"  [probe] Executing probe helper in namespace {source_ns}", 2)
@@ -575,11 +879,18 @@ Examples:
   # Maximum verbosity for debugging
   ksms_tester -s 10.1.1.100 -d 10.2.1.200 -P "80" -vvv
   
+  # Many services with one counting set per router (near-constant time)
+  ksms_tester -s 10.1.1.100 -d 10.2.1.200 -P "8000-8199/tcp" --max-services 200 --counting set
+
   # Large port range with custom limit and force
   ksms_tester -s 10.1.1.100 -d 10.2.1.200 -P "1000-2000/tcp" --range-limit 1001 --force
 
+  # Virtual source: no host for 10.1.1.100, probes leave injector pool-3fa2c1 on hq-gw's bridge
+  ksms_tester -s 10.1.1.100 -d 10.2.1.200 -P "80,443" --virtual-source hq-gw=pool-3fa2c1
+
 The command tests service reachability by:
 1. Installing iptables PREROUTING/POSTROUTING counters on involved routers
+   (or, with --counting set, one counting set per router read once at the end)
 2. Emitting test probes (TCP SYN or UDP packets) with DSCP marking
 3. Analyzing packet counter deltas to determine forwarding behavior
 4. Results: YES (forwarded), NO (blocked), UNKNOWN (no packets seen)
@@ -602,11 +913,31 @@ Routers are automatically inferred from source IP using network registries.
                     help='Maximum ports per range (default: 100, max: 65535)')
     ap.add_argument('--tcp-timeout', type=float, default=1.0, metavar='SEC',
                     help='TCP connection timeout in seconds (default: 1.0)')
+    ap.add_argument('--probe-rate', type=int, default=int(os.environ.get('KSMS_PROBE_RATE', '0')), metavar='PPS',
+                    help='Probe send rate in packets/s for the native emitter (0: unpaced). '
+                         'Falls back to KSMS_PROBE_RATE')
     ap.add_argument('--force', action='store_true',
                     help='Force large ranges without confirmation prompts')
     ap.add_argument('--dscp', type=int, metavar='VALUE',
                     help='DSCP value for packet marking (32-63). Required for coordination. '
                          'Falls back to KSMS_JOB_DSCP environment variable if not specified.')
+    ap.add_argument('--tag-mode', choices=['dscp', 'ipid'], default=os.environ.get('KSMS_TAG_MODE', 'dscp'),
+                    help='Job tag on the wire: the DSCP value (dscp), or an IP ID under the --dscp marker '
+                         '(ipid, thousands of concurrent jobs, requires probe_emitter). '
+                         'Falls back to KSMS_TAG_MODE (default: dscp)')
+    ap.add_argument('--ip-id-tag', type=int, metavar='ID',
+                    default=int(os.environ['KSMS_JOB_IPID']) if os.environ.get('KSMS_JOB_IPID') else None,
+                    help='IP ID tag (1-65535) for --tag-mode ipid. Falls back to KSMS_JOB_IPID')
+    ap.add_argument('--counting', choices=['rules', 'set'],
+                    default=os.environ.get('KSMS_COUNTING', 'rules'),
+                    help='Counter layout: one rule per service (rules) or one set with per-element '
+                         'counters per router (set). Falls back to KSMS_COUNTING (default: rules)')
+    ap.add_argument('--set-backend', choices=['auto', 'ipset', 'nft'], default='auto',
+                    help='Set backend for --counting set: ipset hash:ip,port counters or nft set '
+                         'with counters (default: auto, ipset when available)')
+    ap.add_argument('--virtual-source', action='append', default=[], metavar='ROUTER=NAMESPACE',
+                    help='Send probes for ROUTER from injector host NAMESPACE using the source IP as a '
+                         'non-local address instead of a dedicated source host (repeatable)')
     ap.add_argument('-j', '--json', action='store_true',
                     help='Output results in JSON format')
     ap.add_argument('--run-id', type=str, metavar='RUN_ID',
@@ -691,18 +1022,27 @@ Routers are automatically inferred from source IP using network registries.
     bridges, hosts = load_registries()
     ip_map = build_ip_to_namespaces(bridges, hosts)
 
-    # Resolve all source namespaces (hosts) owning the IP
-    src_namespaces = ip_map.get(args.source, [])
+    try:
+        virtual_sources = resolve_virtual_sources(args.virtual_source, args.source, hosts)
+    except ValueError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    # Resolve all source namespaces (hosts) owning the IP, plus injectors standing in for it
+    src_namespaces = ip_map.get(args.source, []) + list(virtual_sources.values())
     if not src_namespaces:
         print(f"Error: Source IP {args.source} not found in registries", file=sys.stderr)
         sys.exit(1)
     
     if VERBOSE >= 1:
         print(f"[INFO] Source IP {args.source} found in namespace(s): {', '.join(src_namespaces)}", file=sys.stderr)
+        if virtual_sources:
+            print(f"[INFO] Virtual source injectors: {virtual_sources}", file=sys.stderr)
     _dbg(f"[DEBUG] Source namespaces for {args.source}: {src_namespaces}", 2)
 
     # Infer routers involved
     routers = infer_routers_for_source(args.source, bridges, hosts, ip_map)
+    routers += [r for r in virtual_sources if r not in routers]
     if not routers:
         print(f"Error: No routers inferred for source {args.source}", file=sys.stderr)
         sys.exit(1)
@@ -738,6 +1078,16 @@ Routers are automatically inferred from source IP using network registries.
     if not (32 <= job_dscp <= 63):
         raise ValueError(f"Invalid DSCP value {job_dscp} (must be 32-63, 0x20-0x3F)")
     
+    try:
+        job_tag = JobTag(job_dscp, args.tag_mode, args.ip_id_tag)
+    except ValueError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(2)
+    if job_tag.ip_id and not probe_emitter_available():
+        print(f"Error: --tag-mode ipid requires the native probe emitter ({PROBE_EMITTER}); "
+              f"install it with 'sudo make install-emitter'", file=sys.stderr)
+        sys.exit(2)
+
     # Assign single DSCP value to all services in this job
     svc_tokens: Dict[Tuple[int,str], Dict] = {}
     for port, proto in services:
@@ -748,7 +1098,8 @@ Routers are automatically inferred from source IP using network registries.
             _dbg(f"  Service {port}/{proto}: DSCP={job_dscp} (0x{job_dscp:02x}), TOS={job_dscp << 2}", 3)
     
     if VERBOSE >= 2:
-        _dbg(f"[INFO] Job {run_id}: Using DSCP={job_dscp} for all {len(services)} services", 2)
+        _dbg(f"[INFO] Job {run_id}: Using DSCP={job_dscp}"
+             f"{f' IP ID={job_tag.ip_id}' if job_tag.ip_id else ''} for all {len(services)} services", 2)
     
     if VERBOSE >= 1:
         _dbg(f"[INFO] Using run ID: {run_id}", 1)
@@ -815,15 +1166,21 @@ Routers are automatically inferred from source IP using network registries.
         print(f"\n[PHASE 1] Preparing routers for testing...", file=sys.stderr)
 
     # Per-router preparation in parallel
-    router_results: Dict[str, Dict] = {r: {'egress': None, 'nexthop': None, 'before': '', 'after': ''} for r in routers}
+    router_results: Dict[str, Dict] = {r: {'egress': None, 'nexthop': None, 'before': '', 'after': '',
+                                           'set_backend': None, 'counters': {}} for r in routers}
+    set_counting = args.counting == 'set'
 
     def prepare_router(rname: str):
         if VERBOSE >= 2:
             print(f"  [{rname}] Preparing router...", file=sys.stderr)
 
+        if set_counting:
+            router_results[rname]['set_backend'] = detect_set_backend(rname, args.set_backend)
+
         # Initialize THIS job's DSCP chains and jump rules if not already present
-        # Only touches chains for THIS job's DSCP value
-        initialize_job_dscp_chains(rname, job_dscp)
+        # Only touches chains for THIS job's DSCP value (nft sets hook independently)
+        if router_results[rname]['set_backend'] != 'nft':
+            initialize_job_dscp_chains(rname, job_tag)
 
         # Determine egress iface and next hop via ip route get
         iface, nexthop = egress_iface_and_nexthop_for(rname, args.destination)
@@ -835,92 +1192,101 @@ Routers are automatically inferred from source IP using network registries.
         _dbg(f"  [{rname}] DEBUG: egress iface = {iface}, nexthop = {nexthop}", 3)
 
         # Pre-run cleanup: Flush THIS job's chains only (never touch other DSCPs)
-        chain_pre = f"TSIM_TAP_PRE_{job_dscp}"
-        chain_post = f"TSIM_TAP_POST_{job_dscp}"
+        chain_pre = f"TSIM_TAP_PRE_{job_tag}"
+        chain_post = f"TSIM_TAP_POST_{job_tag}"
 
         # Flush both chains to remove any old rules from previous runs
         run(['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle', '-F', chain_pre])
         run(['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle', '-F', chain_post])
         # Ignore errors - chains may not exist yet (will be created by initialize_job_dscp_chains)
 
-        # Insert test rules INSIDE the DSCP-specific chains
-        # The chains already have permanent jump rules from PREROUTING/POSTROUTING based on DSCP
-        # We just add port/protocol matching rules inside the chains
-        insert_commands = []
-
-        # Insert rules for each service - one in PRE chain, one in POST chain
-        # No DSCP matching needed here - packets only reach these chains if DSCP already matched
-        for port, proto in services:
-            comment_pre = f"TSIM_KSMS={run_id}:PREROUTING:{port}/{proto}"
-            comment_post = f"TSIM_KSMS={run_id}:POSTROUTING:{port}/{proto}"
-
-            # PREROUTING counter rule (in PRE chain)
-            insert_commands.append(
-                f"iptables -t mangle -A {chain_pre} -p {proto} -m {proto} --dport {port} "
-                f"-m comment --comment {shlex.quote(comment_pre)}"
-            )
-
-            # POSTROUTING counter rule (in POST chain)
-            insert_commands.append(
-                f"iptables -t mangle -A {chain_post} -p {proto} -m {proto} --dport {port} "
-                f"-m comment --comment {shlex.quote(comment_post)}"
-            )
-
-            if VERBOSE >= 3:
-                _dbg(f"  [{rname}] DEBUG: Will insert rules for {port}/{proto} in chains {chain_pre} and {chain_post}", 3)
+        if set_counting:
+            # One set per hook with an element per service; fresh sets start at zero
+            backend = router_results[rname]['set_backend']
+            if install_counting_sets(rname, backend, job_tag, args.destination, services):
+                if VERBOSE >= 2:
+                    print(f"  [{rname}] Installed {backend} counting sets for {len(services)} service(s)", file=sys.stderr)
+            elif VERBOSE >= 1:
+                print(f"  [{rname}] FAILED to install {backend} counting sets", file=sys.stderr)
+        else:
+            # Insert test rules INSIDE the DSCP-specific chains
+            # The chains already have permanent jump rules from PREROUTING/POSTROUTING based on DSCP
+            # We just add port/protocol matching rules inside the chains
+            insert_commands = []
+
+            # Insert rules for each service - one in PRE chain, one in POST chain
+            # No DSCP matching needed here - packets only reach these chains if DSCP already matched
+            for port, proto in services:
+                comment_pre = f"TSIM_KSMS={run_id}:PREROUTING:{port}/{proto}"
+                comment_post = f"TSIM_KSMS={run_id}:POSTROUTING:{port}/{proto}"
+
+                # PREROUTING counter rule (in PRE chain)
+                insert_commands.append(
+                    f"iptables -t mangle -A {chain_pre} -p {proto} -m {proto} --dport {port} "
+                    f"-m comment --comment {shlex.quote(comment_pre)}"
+                )
 
-        # Execute all iptables commands
-        if VERBOSE >= 2:
-            print(f"  [{rname}] Inserting iptables taps...", file=sys.stderr)
+                # POSTROUTING counter rule (in POST chain)
+                insert_commands.append(
+                    f"iptables -t mangle -A {chain_post} -p {proto} -m {proto} --dport {port} "
+                    f"-m comment --comment {shlex.quote(comment_post)}"
+                )
 
-        try:
-            result = execute_iptables_script(rname, insert_commands)
+                if VERBOSE >= 3:
+                    _dbg(f"  [{rname}] DEBUG: Will insert rules for {port}/{proto} in chains {chain_pre} and {chain_post}", 3)
 
+            # Execute all iptables commands
             if VERBOSE >= 2:
-                print(f"  [{rname}] iptables script completed with code {result.returncode}", file=sys.stderr)
+                print(f"  [{rname}] Inserting iptables taps...", file=sys.stderr)
 
-            if VERBOSE >= 3:
-                _dbg(f"  [{rname}] DEBUG: iptables script returned code {result.returncode}", 3)
-                if result.stdout:
-                    _dbg(f"  [{rname}] DEBUG: stdout: {result.stdout[:500]}", 3)
-                if result.stderr:
-                    _dbg(f"  [{rname}] DEBUG: stderr: {result.stderr[:500]}", 3)
+            try:
+                result = execute_iptables_script(rname, insert_commands)
 
-            if result.returncode == 0:
                 if VERBOSE >= 2:
-                    print(f"  [{rname}] Inserted iptables taps for {len(services)} service(s)", file=sys.stderr)
+                    print(f"  [{rname}] iptables script completed with code {result.returncode}", file=sys.stderr)
 
-                # Verify rules were actually inserted
                 if VERBOSE >= 3:
-                    verify = iptables_save_mangle(rname, with_counters=False)
-                    ksms_count = sum(1 for line in verify.splitlines() if 'TSIM_KSMS' in line)
-                    _dbg(f"  [{rname}] DEBUG: Verification shows {ksms_count} TSIM_KSMS rules now present", 3)
-            else:
-                if VERBOSE >= 2:
-                    print(f"  [{rname}] FAILED to insert iptables taps (code {result.returncode})", file=sys.stderr)
+                    _dbg(f"  [{rname}] DEBUG: iptables script returned code {result.returncode}", 3)
+                    if result.stdout:
+                        _dbg(f"  [{rname}] DEBUG: stdout: {result.stdout[:500]}", 3)
                     if result.stderr:
-                        print(f"  [{rname}] Error: {result.stderr.strip()}", file=sys.stderr)
-                _dbg(f"  [{rname}] DEBUG: iptables script failed with code {result.returncode}", 3)
-        except Exception as e:
-            if VERBOSE >= 1:
-                print(f"  [{rname}] ERROR running iptables script: {e}", file=sys.stderr)
-                import traceback
-                if VERBOSE >= 3:
-                    _dbg(f"  [{rname}] DEBUG: Full traceback:\n{traceback.format_exc()}", 3)
-            _dbg(f"  [{rname}] DEBUG: Exception during iptables script: {e}", 2)
-        # Baseline snapshot
-        router_results[rname]['before'] = iptables_save_mangle(rname)
+                        _dbg(f"  [{rname}] DEBUG: stderr: {result.stderr[:500]}", 3)
+
+                if result.returncode == 0:
+                    if VERBOSE >= 2:
+                        print(f"  [{rname}] Inserted iptables taps for {len(services)} service(s)", file=sys.stderr)
+
+                    # Verify rules were actually inserted
+                    if VERBOSE >= 3:
+                        verify = iptables_save_mangle(rname, with_counters=False)
+                        ksms_count = sum(1 for line in verify.splitlines() if 'TSIM_KSMS' in line)
+                        _dbg(f"  [{rname}] DEBUG: Verification shows {ksms_count} TSIM_KSMS rules now present", 3)
+                else:
+                    if VERBOSE >= 2:
+                        print(f"  [{rname}] FAILED to insert iptables taps (code {result.returncode})", file=sys.stderr)
+                        if result.stderr:
+                            print(f"  [{rname}] Error: {result.stderr.strip()}", file=sys.stderr)
+                    _dbg(f"  [{rname}] DEBUG: iptables script failed with code {result.returncode}", 3)
+            except Exception as e:
+                if VERBOSE >= 1:
+                    print(f"  [{rname}] ERROR running iptables script: {e}", file=sys.stderr)
+                    import traceback
+                    if VERBOSE >= 3:
+                        _dbg(f"  [{rname}] DEBUG: Full traceback:\n{traceback.format_exc()}", 3)
+                _dbg(f"  [{rname}] DEBUG: Exception during iptables script: {e}", 2)
+            # Baseline snapshot
+            router_results[rname]['before'] = iptables_save_mangle(rname)
         
-        if VERBOSE >= 3:
-            print(f"  [{rname}] Captured baseline counter snapshot", file=sys.stderr)
-            # Check if our rules are in the snapshot
-            snapshot_lines = router_results[rname]['before'].splitlines()
-            ksms_rules = [l for l in snapshot_lines if 'TSIM_KSMS' in l]
-            _dbg(f"  [{rname}] DEBUG: Found {len(ksms_rules)} TSIM_KSMS rules in baseline snapshot", 3)
-            # Show ALL our rules to verify they match what we expect
-            for rule in ksms_rules:
-                if run_id in rule:  # Only show rules from this run
-                    _dbg(f"  [{rname}] DEBUG: Our rule: {rule}", 3)
+            if VERBOSE >= 3:
+                print(f"  [{rname}] Captured baseline counter snapshot", file=sys.stderr)
+                # Check if our rules are in the snapshot
+                snapshot_lines = router_results[rname]['before'].splitlines()
+                ksms_rules = [l for l in snapshot_lines if 'TSIM_KSMS' in l]
+                _dbg(f"  [{rname}] DEBUG: Found {len(ksms_rules)} TSIM_KSMS rules in baseline snapshot", 3)
+                # Show ALL our rules to verify they match what we expect
+                for rule in ksms_rules:
+                    if run_id in rule:  # Only show rules from this run
+                        _dbg(f"  [{rname}] DEBUG: Our rule: {rule}", 3)
         # Configure static neighbor for next hop (not destination!)
         if iface and nexthop:
             result = run(['ip', 'netns', 'exec', rname, 'ip', 'neigh', 'replace', nexthop, 'lladdr', '02:00:00:00:02:00', 'dev', iface, 'nud', 'permanent'])
@@ -943,7 +1309,7 @@ Routers are automatically inferred from source IP using network registries.
         print(f"[PHASE 1] Router preparation completed\n", file=sys.stderr)
 
     # Map each router to a best source namespace (a host with this IP connected to that router)
-    router_src_ns: Dict[str, Optional[str]] = {r: None for r in routers}
+    router_src_ns: Dict[str, Optional[str]] = {r: virtual_sources.get(r) for r in routers}
     for ns in src_namespaces:
         if ns in hosts:
             r = hosts.get(ns, {}).get('connected_to')
@@ -976,7 +1342,9 @@ Routers are automatically inferred from source IP using network registries.
         if VERBOSE >= 2:
             print(f"  [{rname}] Emitting probes from namespace {ns}", file=sys.stderr)
         
-        result = emit_probes_in_source_ns(ns, args.destination, services, svc_tokens, args.tcp_timeout)
+        result = emit_probes_in_source_ns(ns, args.destination, services, svc_tokens, args.tcp_timeout,
+                                          args.probe_rate, job_tag.ip_id,
+                                          args.source if rname in virtual_sources else None)
         
         if VERBOSE >= 2:
             if result == 0:
@@ -1015,7 +1383,11 @@ Routers are automatically inferred from source IP using network registries.
             print(f"  [{rname}] Taking final counter snapshot...", file=sys.stderr)
         
         # Final snapshot only; do not remove taps or neighbors here (pre-run reconcile handles stale state)
-        router_results[rname]['after'] = iptables_save_mangle(rname)
+        if set_counting:
+            router_results[rname]['counters'] = read_counting_sets(
+                rname, router_results[rname]['set_backend'], job_tag)
+        else:
+            router_results[rname]['after'] = iptables_save_mangle(rname)
         
         if VERBOSE >= 3:
             print(f"  [{rname}] Final snapshot captured", file=sys.stderr)
@@ -1032,22 +1404,21 @@ Routers are automatically inferred from source IP using network registries.
 
     # Build results
     results = []
+    set_pre, set_post = counting_set_names(job_tag)
     for r in routers:
         rres = {'name': r, 'iface': router_results[r]['egress'], 'services': []}
-        before = router_results[r]['before']
-        after = router_results[r]['after']
+        before = index_snapshot(router_results[r]['before'])
+        after = index_snapshot(router_results[r]['after'])
         
         # Debug: show what rules we have in the snapshots
         if VERBOSE >= 3:
             _dbg(f"\n  [{r}] DEBUG: Analyzing snapshots for run_id={run_id}", 3)
-            before_ksms = [l for l in before.splitlines() if 'TSIM_KSMS' in l]
-            after_ksms = [l for l in after.splitlines() if 'TSIM_KSMS' in l]
-            _dbg(f"  [{r}] DEBUG: Before snapshot has {len(before_ksms)} TSIM_KSMS rules", 3)
-            _dbg(f"  [{r}] DEBUG: After snapshot has {len(after_ksms)} TSIM_KSMS rules", 3)
-            if after_ksms and VERBOSE >= 3:
+            _dbg(f"  [{r}] DEBUG: Before snapshot has {len(before.comments)} TSIM_KSMS rules", 3)
+            _dbg(f"  [{r}] DEBUG: After snapshot has {len(after.comments)} TSIM_KSMS rules", 3)
+            if after.comments and VERBOSE >= 3:
                 _dbg(f"  [{r}] DEBUG: Sample rules from after snapshot:", 3)
-                for rule in after_ksms[:5]:  # Show first 5 rules
-                    _dbg(f"  [{r}] DEBUG:   {rule[:150]}", 3)
+                for comment, (_, chain, pkts, _) in list(after.comments.items())[:5]:  # Show first 5 rules
+                    _dbg(f"  [{r}] DEBUG:   {chain} {comment} pkts={pkts}", 3)
             
             # Check the catch-all rule to see if ANY packets traversed
             catch_all_comment = f"TSIM_KSMS={run_id}:DEBUG:CATCH_ALL"
@@ -1069,16 +1440,21 @@ Routers are automatically inferred from source IP using network registries.
             if VERBOSE >= 3:
                 _dbg(f"  [{r}] DEBUG: Service {port}/{proto}: DSCP={dscp_val} TOS={tos_val}", 3)
                 _dbg(f"  [{r}] DEBUG: Looking for PREROUTING comment: {pre_c}", 3)
-            b_pkts, _ = extract_counter(before, pre_c)
-            a_pkts, _ = extract_counter(after, pre_c)
-            
-            if VERBOSE >= 3:
-                _dbg(f"  [{r}] DEBUG: Looking for POSTROUTING comment: {post_c}", 3)
-            b2_pkts, _ = extract_counter(before, post_c)
-            a2_pkts, _ = extract_counter(after, post_c)
-            
-            pre_delta = a_pkts - b_pkts
-            post_delta = a2_pkts - b2_pkts
+            if set_counting:
+                counters = router_results[r]['counters']
+                pre_delta = counters.get((set_pre, port, proto), 0)
+                post_delta = counters.get((set_post, port, proto), 0)
+            else:
+                b_pkts, _ = extract_counter(before, pre_c)
+                a_pkts, _ = extract_counter(after, pre_c)
+                
+                if VERBOSE >= 3:
+                    _dbg(f"  [{r}] DEBUG: Looking for POSTROUTING comment: {post_c}", 3)
+                b2_pkts, _ = extract_counter(before, post_c)
+                a2_pkts, _ = extract_counter(after, post_c)
+                
+                pre_delta = a_pkts - b_pkts
+                post_delta = a2_pkts - b2_pkts
             if post_delta > 0:
                 verdict = 'YES'
             elif pre_delta > 0 and post_delta == 0:
@@ -1120,8 +1496,8 @@ Routers are automatically inferred from source IP using network registries.
         
         # Flush THIS job's DSCP-specific chains only (never delete permanent chains, never touch other DSCPs)
         # Chains persist across all test runs to save time on initialization and cleanup
-        chain_pre = f"TSIM_TAP_PRE_{job_dscp}"
-        chain_post = f"TSIM_TAP_POST_{job_dscp}"
+        chain_pre = f"TSIM_TAP_PRE_{job_tag}"
+        chain_post = f"TSIM_TAP_POST_{job_tag}"
 
         # Flush PRE chain (removes all rules, but chain remains for future use)
         result = run(['ip', 'netns', 'exec', rname, 'iptables', '-t', 'mangle', '-F', chain_pre])
@@ -1141,6 +1517,14 @@ Routers are automatically inferred from source IP using network registries.
             if VERBOSE >= 3:
                 _dbg(f"  [{rname}] Flushed permanent chain {chain_post}", 3)
 
+        # Counting sets are per run; remove them once no rule references them
+        if set_counting and router_results[rname]['set_backend']:
+            remove_counting_sets(rname, router_results[rname]['set_backend'], job_tag)
+
+        # IP ID tags come from a large range; drop this job's chains instead of keeping them
+        if job_tag.ip_id:
+            release_job_ipid_chains(rname, job_tag)
+
     # Cleanup in parallel
     with ThreadPoolExecutor(max_workers=len(routers)) as ex:
         futs = [ex.submit(cleanup_router, r) for r in routers]
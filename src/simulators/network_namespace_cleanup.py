@@ -36,6 +36,7 @@ from pathlib import Path
 
 # Import configuration loader
 from tsim.core.config_loader import get_registry_paths
+from tsim.core.registry_manager import TsimRegistryManager, TsimRegistryError, read_registry_file
 
 
 class NetworkNamespaceCleanup:
@@ -118,6 +119,18 @@ class NetworkNamespaceCleanup:
             datefmt='%H:%M:%S'
         )
         self.logger = logging.getLogger(__name__)
+
+    def _init_registry_manager(self):
+        """TsimRegistryManager from WSGI config.json, or None if not configured."""
+        config_path = os.environ.get('TSIM_CONFIG_PATH', '/opt/tsim/wsgi/conf/config.json')
+        try:
+            import json
+            with open(config_path, 'r') as f:
+                wsgi_config = json.load(f)
+            return TsimRegistryManager(wsgi_config, self.logger)
+        except Exception as e:
+            self.logger.debug(f"TsimRegistryManager not available, cleaning registry files directly: {e}")
+            return None
         
     def load_router_names_from_registries_and_namespaces(self):
         """Load router names from existing registries and running namespaces."""
@@ -726,12 +739,30 @@ class NetworkNamespaceCleanup:
                 self.logger.error(error_msg)
                 self.cleanup_errors.append(error_msg)
         
-        # Clean host registry
-        if self.host_registry_file.exists():
+        # Clean host registry (through TsimRegistryManager when configured, so
+        # updates still in its write-ahead log are neither lost nor restored)
+        registry_mgr = self._init_registry_manager()
+        if registry_mgr:
+            try:
+                host_registry = registry_mgr.list_all_hosts()
+                hosts_to_remove = [
+                    host_name for host_name, host_info in host_registry.items()
+                    if target_routers is None or
+                    (host_info.get('connected_to') or host_info.get('connected_router')) in target_routers
+                ]
+                if hosts_to_remove:
+                    cleaned_host_entries = len(registry_mgr.unregister_hosts(hosts_to_remove))
+                    self.logger.info(f"Cleaned {cleaned_host_entries} host registry entries")
+            except Exception as e:
+                error_msg = f"Error cleaning host registry: {e}"
+                self.logger.error(error_msg)
+                self.cleanup_errors.append(error_msg)
+            finally:
+                registry_mgr.cleanup()
+        elif self.host_registry_file.exists():
             try:
                 import json
-                with open(self.host_registry_file, 'r') as f:
-                    host_registry = json.load(f)
+                host_registry = read_registry_file(self.host_registry_file)
                 
                 if target_routers is None:
                     # Clean all entries
@@ -763,7 +794,7 @@ class NetworkNamespaceCleanup:
                             self.host_registry_file.unlink()
                             self.logger.info(f"Removed empty host registry")
                             
-            except (json.JSONDecodeError, IOError) as e:
+            except (json.JSONDecodeError, IOError, TsimRegistryError) as e:
                 error_msg = f"Error cleaning host registry: {e}"
                 self.logger.error(error_msg)
                 self.cleanup_errors.append(error_msg)
@@ -149,10 +149,9 @@ class NetworkStatusManager:
         if host_registry_file.exists():
             try:
                 import json
-                with open(host_registry_file, 'r') as f:
-                    host_registry = json.load(f)
-                    self.known_hosts.update(host_registry.keys())
-            except (json.JSONDecodeError, IOError) as e:
+                from tsim.core.registry_manager import read_registry_file, TsimRegistryError
+                self.known_hosts.update(read_registry_file(host_registry_file).keys())
+            except (json.JSONDecodeError, IOError, TsimRegistryError) as e:
                 logger.warning(f"Failed to load host registry: {e}")
         
         logger.debug(f"Loaded {len(self.known_routers)} routers, {len(self.known_hosts)} hosts")
@@ -42,6 +42,7 @@ from typing import Dict, List, Optional, Set, Any
 
 # Import configuration loader
 from tsim.core.config_loader import get_registry_paths
+from tsim.core.registry_manager import read_registry_file, TsimRegistryError
 
 
 class NetworkTopologyViewer:
@@ -135,12 +136,10 @@ class NetworkTopologyViewer:
             return
             
         try:
-            with open(self.host_registry_file, 'r') as f:
-                host_registry = json.load(f)
-                self.hosts = host_registry
+            self.hosts = read_registry_file(self.host_registry_file)
                 
             self.logger.info(f"Loaded registry for {len(self.hosts)} hosts")
-        except (json.JSONDecodeError, IOError) as e:
+        except (json.JSONDecodeError, IOError, TsimRegistryError) as e:
             self.logger.warning(f"Failed to load host registry: {e}")
         
     def build_subnet_topology(self):
@@ -23,6 +23,7 @@ from typing import Optional, Tuple, Dict, List, Set
 from tsim.simulators.service_manager import ServiceClient, ServiceProtocol, ServiceConfig, ServiceManager
 from tsim.core.exceptions import NetworkError, ConfigurationError
 from tsim.core.config_loader import get_registry_paths
+from tsim.core.registry_manager import read_registry_file, TsimRegistryError
 
 
 class ServiceTester:
@@ -65,11 +66,8 @@ class ServiceTester:
         
         hosts = {}
         try:
-            host_registry_file = Path(registry_paths['hosts'])
-            if host_registry_file.exists():
-                with open(host_registry_file, 'r') as f:
-                    hosts = json.load(f)
-        except (json.JSONDecodeError, IOError) as e:
+            hosts = read_registry_file(registry_paths['hosts'])
+        except (json.JSONDecodeError, IOError, TsimRegistryError) as e:
             if self.verbose >= 1:
                 print(f"Warning: Error loading host registry: {e}")
         
@@ -127,11 +125,8 @@ class ServiceTester:
         
         # Get additional host IPs from host registry (for secondary IPs)
         try:
-            host_registry_file = Path(registry_paths['hosts'])
-            if host_registry_file.exists():
-                with open(host_registry_file, 'r') as f:
-                    host_registry = json.load(f)
-                
+            host_registry = read_registry_file(registry_paths['hosts'])
+            if host_registry:
                 for host_name, host_info in host_registry.items():
                     # Add primary IP (might override bridge registry, but should be same)
                     primary_ip = host_info.get('primary_ip', '')
@@ -158,7 +153,7 @@ class ServiceTester:
                                 if self.verbose >= 3:
                                     print(f"Found host secondary IP {ip} in namespace {host_name}")
                                     
-        except (json.JSONDecodeError, IOError) as e:
+        except (json.JSONDecodeError, IOError, TsimRegistryError) as e:
             if self.verbose >= 1:
                 print(f"Warning: Error loading host registry: {e}")
                 
@@ -0,0 +1,722 @@
+/*
+ * nflog_collector - Stream per-packet netfilter rule traces from a namespace
+ *
+ * This program enters a router network namespace, subscribes to netfilter
+ * trace events and prints one JSON object per event on stdout. It is the
+ * native half of tsim.core.rule_trace_collector, which installs the trace
+ * rules (keyed by the job DSCP) and consumes the event stream.
+ *
+ * Two event sources are supported:
+ * - nftrace: nf_tables trace events (NFNLGRP_NFTRACE). Used with
+ *   iptables-nft where the TRACE target sets nftrace on the packet; each
+ *   event names the table, chain, rule handle and verdict.
+ * - nflog:   nfnetlink_log group. Used with legacy iptables where TRACE
+ *   logs through nf_log with prefix "TRACE: table:chain:type:rulenum".
+ *
+ * Security features:
+ * - Validates namespace names (no path traversal, must exist)
+ * - No shell execution, no configuration of rules
+ * - Drops privileges after the netlink socket is bound
+ *
+ * Usage:
+ *   nflog_collector <namespace> --nftrace [--dscp N] [--count N] [--timeout SEC]
+ *   nflog_collector <namespace> --nflog <group> [--dscp N] [--count N] [--timeout SEC]
+ *
+ * Output (one line per event, flushed):
+ *   {"event":"ready",...}  once the socket is bound
+ *   {"event":"trace",...}  per trace event; nftrace events without packet
+ *                          headers are kept for --dscp if their trace id matched
+ *
+ * Compile:
+ *   gcc -o nflog_collector nflog_collector.c
+ *   sudo setcap cap_sys_admin,cap_net_admin+ep nflog_collector
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_log.h>
+#include <linux/netfilter/nf_tables.h>
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
+#define NETNS_PATH "/var/run/netns"
+#define RECV_BUFFER (256 * 1024)
+#define COPY_RANGE 128
+#define MATCHED_IDS 1024
+
+/* Decoded IPv4 header fields of a traced packet */
+struct packet_info {
+    int valid;
+    int dscp;
+    int protocol;
+    char src[INET_ADDRSTRLEN];
+    char dst[INET_ADDRSTRLEN];
+    int sport;
+    int dport;
+};
+
+/* One decoded trace event, filled from either source */
+struct trace_event {
+    const char *table;
+    const char *chain;
+    const char *prefix;
+    const char *jump;
+    const char *type;
+    const char *verdict;
+    long long handle;
+    long long id;
+    int hook;
+    unsigned int iif;
+    unsigned int oif;
+    struct packet_info packet;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/*
+ * nf_tables attaches the packet headers only to the first trace event of
+ * each base-chain evaluation; later events of the same packet (verdicts
+ * after continue rules, rules in jumped-to chains) carry just its trace id.
+ * Recently matched ids are kept so those events pass the --dscp filter.
+ */
+static long long matched_ids[MATCHED_IDS];
+static unsigned int matched_next = 0;
+static unsigned int matched_count = 0;
+
+static int trace_id_matched(long long id) {
+    if (id < 0) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < matched_count; i++) {
+        if (matched_ids[(matched_next + MATCHED_IDS - 1 - i) % MATCHED_IDS] == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void remember_trace_id(long long id) {
+    if (id < 0 || trace_id_matched(id)) {
+        return;
+    }
+    matched_ids[matched_next] = id;
+    matched_next = (matched_next + 1) % MATCHED_IDS;
+    if (matched_count < MATCHED_IDS) {
+        matched_count++;
+    }
+}
+
+static void handle_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* Function to validate namespace name */
+static int validate_namespace(const char *nsname) {
+    /* Basic validation - no path traversal */
+    if (strstr(nsname, "/") != NULL || strstr(nsname, "..") != NULL) {
+        return 0;
+    }
+
+    /* Check if namespace exists */
+    char nspath[256];
+    snprintf(nspath, sizeof(nspath), "%s/%s", NETNS_PATH, nsname);
+
+    struct stat st;
+    if (stat(nspath, &st) != 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Function to enter a namespace by name */
+static int enter_namespace(const char *nsname) {
+    char nspath[256];
+    int nsfd;
+
+    snprintf(nspath, sizeof(nspath), "%s/%s", NETNS_PATH, nsname);
+    nsfd = open(nspath, O_RDONLY);
+    if (nsfd < 0) {
+        perror("open namespace");
+        return -1;
+    }
+    if (setns(nsfd, CLONE_NEWNET) < 0) {
+        perror("setns");
+        close(nsfd);
+        return -1;
+    }
+    close(nsfd);
+    return 0;
+}
+
+/* Parse a non-negative integer option value */
+static int parse_number(const char *text, long min, long max, long *out) {
+    char *endptr;
+    errno = 0;
+    long value = strtol(text, &endptr, 10);
+    if (errno != 0 || *text == '\0' || *endptr != '\0' || value < min || value > max) {
+        return 0;
+    }
+    *out = value;
+    return 1;
+}
+
+/* Write a JSON string literal with escaping */
+static void json_string(const char *text) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putchar('\\');
+            putchar(*p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+static void json_field_string(const char *name, const char *value) {
+    if (value == NULL) {
+        return;
+    }
+    printf(",\"%s\":", name);
+    json_string(value);
+}
+
+/* Decode IPv4 addresses, DSCP and ports from a network header */
+static void decode_ipv4(const unsigned char *data, size_t len,
+                        const unsigned char *transport, size_t transport_len,
+                        struct packet_info *info) {
+    if (len < 20 || (data[0] >> 4) != 4) {
+        return;
+    }
+    size_t ihl = (size_t)(data[0] & 0x0f) * 4;
+    if (ihl < 20) {
+        return;
+    }
+    info->valid = 1;
+    info->dscp = data[1] >> 2;
+    info->protocol = data[9];
+    inet_ntop(AF_INET, data + 12, info->src, sizeof(info->src));
+    inet_ntop(AF_INET, data + 16, info->dst, sizeof(info->dst));
+
+    /* nftrace carries the transport header separately; nflog payloads
+     * carry the full packet so ports follow the IP header. */
+    if (transport == NULL && len >= ihl + 4) {
+        transport = data + ihl;
+        transport_len = len - ihl;
+    }
+    if (transport != NULL && transport_len >= 4 &&
+        (info->protocol == IPPROTO_TCP || info->protocol == IPPROTO_UDP)) {
+        info->sport = (transport[0] << 8) | transport[1];
+        info->dport = (transport[2] << 8) | transport[3];
+    } else if (transport != NULL && transport_len >= 2 && info->protocol == IPPROTO_ICMP) {
+        /* Report ICMP type/code in the port fields */
+        info->sport = transport[0];
+        info->dport = transport[1];
+    }
+}
+
+static const char *verdict_name(int code) {
+    switch (code) {
+        case NF_DROP: return "drop";
+        case NF_ACCEPT: return "accept";
+        case NF_QUEUE: return "queue";
+        case NFT_CONTINUE: return "continue";
+        case NFT_BREAK: return "break";
+        case NFT_JUMP: return "jump";
+        case NFT_GOTO: return "goto";
+        case NFT_RETURN: return "return";
+        default: return "unknown";
+    }
+}
+
+static const char *trace_type_name(unsigned int type) {
+    switch (type) {
+        case NFT_TRACETYPE_POLICY: return "policy";
+        case NFT_TRACETYPE_RETURN: return "return";
+        case NFT_TRACETYPE_RULE: return "rule";
+        default: return "unspec";
+    }
+}
+
+static const char *protocol_name(int protocol) {
+    switch (protocol) {
+        case IPPROTO_TCP: return "tcp";
+        case IPPROTO_UDP: return "udp";
+        case IPPROTO_ICMP: return "icmp";
+        default: return NULL;
+    }
+}
+
+/* Print one event as a JSON line */
+static void emit_event(const char *source, const char *nsname, const struct trace_event *ev) {
+    struct timeval now;
+    char ifname[IF_NAMESIZE];
+
+    gettimeofday(&now, NULL);
+    printf("{\"event\":\"trace\",\"source\":\"%s\"", source);
+    json_field_string("namespace", nsname);
+    printf(",\"time\":%ld.%06ld", (long)now.tv_sec, (long)now.tv_usec);
+    if (ev->id >= 0) {
+        printf(",\"id\":%lld", ev->id);
+    }
+    json_field_string("table", ev->table);
+    json_field_string("chain", ev->chain);
+    json_field_string("type", ev->type);
+    if (ev->handle >= 0) {
+        printf(",\"handle\":%lld", ev->handle);
+    }
+    json_field_string("verdict", ev->verdict);
+    json_field_string("jump", ev->jump);
+    json_field_string("prefix", ev->prefix);
+    if (ev->hook >= 0) {
+        printf(",\"hook\":%d", ev->hook);
+    }
+    if (ev->iif != 0 && if_indextoname(ev->iif, ifname) != NULL) {
+        json_field_string("in", ifname);
+    }
+    if (ev->oif != 0 && if_indextoname(ev->oif, ifname) != NULL) {
+        json_field_string("out", ifname);
+    }
+    if (ev->packet.valid) {
+        printf(",\"dscp\":%d", ev->packet.dscp);
+        const char *proto = protocol_name(ev->packet.protocol);
+        if (proto != NULL) {
+            json_field_string("protocol", proto);
+        } else {
+            printf(",\"protocol\":\"%d\"", ev->packet.protocol);
+        }
+        json_field_string("src", ev->packet.src);
+        json_field_string("dst", ev->packet.dst);
+        printf(",\"sport\":%d,\"dport\":%d", ev->packet.sport, ev->packet.dport);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* Copy a netlink string attribute into a bounded buffer */
+static const char *attr_string(const struct nlattr *attr, char *buf, size_t size) {
+    size_t len = attr->nla_len - NLA_HDRLEN;
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(buf, (const char *)attr + NLA_HDRLEN, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+static uint32_t attr_u32(const struct nlattr *attr) {
+    uint32_t value = 0;
+    if (attr->nla_len >= NLA_HDRLEN + sizeof(value)) {
+        memcpy(&value, (const char *)attr + NLA_HDRLEN, sizeof(value));
+    }
+    return ntohl(value);
+}
+
+static uint64_t attr_u64(const struct nlattr *attr) {
+    uint32_t parts[2] = {0, 0};
+    if (attr->nla_len >= NLA_HDRLEN + sizeof(parts)) {
+        memcpy(parts, (const char *)attr + NLA_HDRLEN, sizeof(parts));
+    }
+    return ((uint64_t)ntohl(parts[0]) << 32) | ntohl(parts[1]);
+}
+
+#define ATTR_FOREACH(attr, start, len) \
+    for (attr = (const struct nlattr *)(start); \
+         (len) >= (int)NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN && attr->nla_len <= (len); \
+         (len) -= NLA_ALIGN(attr->nla_len), \
+         attr = (const struct nlattr *)((const char *)attr + NLA_ALIGN(attr->nla_len)))
+
+#define ATTR_TYPE(attr) ((attr)->nla_type & NLA_TYPE_MASK)
+#define ATTR_DATA(attr) ((const unsigned char *)(attr) + NLA_HDRLEN)
+#define ATTR_LEN(attr) ((size_t)((attr)->nla_len - NLA_HDRLEN))
+
+/* Decode an nf_tables trace message; returns 1 if an event was filled */
+static int parse_nftrace(const struct nlmsghdr *nlh, struct trace_event *ev,
+                         char *table, char *chain, char *jump, size_t size) {
+    const struct nlattr *attr;
+    const unsigned char *network = NULL, *transport = NULL;
+    size_t network_len = 0, transport_len = 0;
+    int len = (int)nlh->nlmsg_len - (int)NLMSG_SPACE(sizeof(struct nfgenmsg));
+
+    ATTR_FOREACH(attr, (const char *)NLMSG_DATA(nlh) + NLMSG_ALIGN(sizeof(struct nfgenmsg)), len) {
+        switch (ATTR_TYPE(attr)) {
+            case NFTA_TRACE_TABLE:
+                ev->table = attr_string(attr, table, size);
+                break;
+            case NFTA_TRACE_CHAIN:
+                ev->chain = attr_string(attr, chain, size);
+                break;
+            case NFTA_TRACE_RULE_HANDLE:
+                ev->handle = (long long)attr_u64(attr);
+                break;
+            case NFTA_TRACE_TYPE:
+                ev->type = trace_type_name(attr_u32(attr));
+                break;
+            case NFTA_TRACE_ID:
+                ev->id = attr_u32(attr);
+                break;
+            case NFTA_TRACE_IIF:
+                ev->iif = attr_u32(attr);
+                break;
+            case NFTA_TRACE_OIF:
+                ev->oif = attr_u32(attr);
+                break;
+            case NFTA_TRACE_POLICY:
+                ev->verdict = verdict_name((int)attr_u32(attr));
+                break;
+            case NFTA_TRACE_NETWORK_HEADER:
+                network = ATTR_DATA(attr);
+                network_len = ATTR_LEN(attr);
+                break;
+            case NFTA_TRACE_TRANSPORT_HEADER:
+                transport = ATTR_DATA(attr);
+                transport_len = ATTR_LEN(attr);
+                break;
+            case NFTA_TRACE_VERDICT: {
+                const struct nlattr *nested;
+                int nested_len = (int)ATTR_LEN(attr);
+                ATTR_FOREACH(nested, ATTR_DATA(attr), nested_len) {
+                    if (ATTR_TYPE(nested) == NFTA_VERDICT_CODE) {
+                        ev->verdict = verdict_name((int)attr_u32(nested));
+                    } else if (ATTR_TYPE(nested) == NFTA_VERDICT_CHAIN) {
+                        ev->jump = attr_string(nested, jump, size);
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (network != NULL) {
+        decode_ipv4(network, network_len, transport, transport_len, &ev->packet);
+    }
+    return ev->chain != NULL;
+}
+
+/* Decode an nfnetlink_log packet message; returns 1 if an event was filled */
+static int parse_nflog(const struct nlmsghdr *nlh, struct trace_event *ev,
+                       char *prefix, size_t size) {
+    const struct nlattr *attr;
+    int len = (int)nlh->nlmsg_len - (int)NLMSG_SPACE(sizeof(struct nfgenmsg));
+
+    ATTR_FOREACH(attr, (const char *)NLMSG_DATA(nlh) + NLMSG_ALIGN(sizeof(struct nfgenmsg)), len) {
+        switch (ATTR_TYPE(attr)) {
+            case NFULA_PACKET_HDR:
+                if (ATTR_LEN(attr) >= sizeof(struct nfulnl_msg_packet_hdr)) {
+                    ev->hook = ((const struct nfulnl_msg_packet_hdr *)ATTR_DATA(attr))->hook;
+                }
+                break;
+            case NFULA_PREFIX:
+                ev->prefix = attr_string(attr, prefix, size);
+                break;
+            case NFULA_IFINDEX_INDEV:
+                ev->iif = attr_u32(attr);
+                break;
+            case NFULA_IFINDEX_OUTDEV:
+                ev->oif = attr_u32(attr);
+                break;
+            case NFULA_PAYLOAD:
+                decode_ipv4(ATTR_DATA(attr), ATTR_LEN(attr), NULL, 0, &ev->packet);
+                break;
+            default:
+                break;
+        }
+    }
+    return ev->prefix != NULL;
+}
+
+/* Send one nfnetlink_log config request and wait for its ack */
+static int nflog_config(int fd, uint8_t family, uint16_t group, uint16_t attr_type,
+                        const void *payload, size_t payload_len) {
+    char buf[NLMSG_SPACE(sizeof(struct nfgenmsg)) + NLA_HDRLEN + 16];
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    struct nfgenmsg *nfg;
+    struct nlattr *attr;
+    static uint32_t seq = 0;
+
+    memset(buf, 0, sizeof(buf));
+    nlh->nlmsg_len = NLMSG_SPACE(sizeof(struct nfgenmsg)) + NLA_ALIGN(NLA_HDRLEN + payload_len);
+    nlh->nlmsg_type = (NFNL_SUBSYS_ULOG << 8) | NFULNL_MSG_CONFIG;
+    nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    nlh->nlmsg_seq = ++seq;
+    nfg = NLMSG_DATA(nlh);
+    nfg->nfgen_family = family;
+    nfg->version = NFNETLINK_V0;
+    nfg->res_id = htons(group);
+    attr = (struct nlattr *)(buf + NLMSG_SPACE(sizeof(struct nfgenmsg)));
+    attr->nla_type = attr_type;
+    attr->nla_len = NLA_HDRLEN + payload_len;
+    memcpy((char *)attr + NLA_HDRLEN, payload, payload_len);
+
+    if (send(fd, buf, nlh->nlmsg_len, 0) < 0) {
+        return -errno;
+    }
+
+    char reply[4096];
+    ssize_t n = recv(fd, reply, sizeof(reply), 0);
+    if (n < 0) {
+        return -errno;
+    }
+    struct nlmsghdr *ack = (struct nlmsghdr *)reply;
+    if (NLMSG_OK(ack, (size_t)n) && ack->nlmsg_type == NLMSG_ERROR) {
+        return ((struct nlmsgerr *)NLMSG_DATA(ack))->error;
+    }
+    return 0;
+}
+
+/* Open and bind a netfilter netlink socket for the chosen source */
+static int open_socket(int use_nftrace, uint16_t group) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int bufsize = RECV_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    if (use_nftrace) {
+        int nlgroup = NFNLGRP_NFTRACE;
+        if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &nlgroup, sizeof(nlgroup)) < 0) {
+            perror("join NFNLGRP_NFTRACE");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    /* PF (un)bind is a no-op on current kernels but required on old ones */
+    struct nfulnl_msg_config_cmd cmd;
+    cmd.command = NFULNL_CFG_CMD_PF_UNBIND;
+    nflog_config(fd, AF_INET, 0, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+    cmd.command = NFULNL_CFG_CMD_PF_BIND;
+    nflog_config(fd, AF_INET, 0, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+
+    cmd.command = NFULNL_CFG_CMD_BIND;
+    int err = nflog_config(fd, AF_UNSPEC, group, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+    if (err < 0) {
+        fprintf(stderr, "Error: cannot bind nflog group %u: %s\n", group, strerror(-err));
+        close(fd);
+        return -1;
+    }
+
+    struct nfulnl_msg_config_mode mode;
+    memset(&mode, 0, sizeof(mode));
+    mode.copy_range = htonl(COPY_RANGE);
+    mode.copy_mode = NFULNL_COPY_PACKET;
+    err = nflog_config(fd, AF_UNSPEC, group, NFULA_CFG_MODE, &mode, sizeof(mode));
+    if (err < 0) {
+        fprintf(stderr, "Error: cannot set nflog copy mode: %s\n", strerror(-err));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <namespace> --nftrace [--dscp N] [--count N] [--timeout SEC]\n", prog);
+    fprintf(stderr, "       %s <namespace> --nflog <group> [--dscp N] [--count N] [--timeout SEC]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int use_nftrace = -1;
+    long group = 0, dscp = -1, count = 0, timeout = 0;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    const char *nsname = argv[1];
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--nftrace") == 0) {
+            use_nftrace = 1;
+        } else if (strcmp(argv[i], "--nflog") == 0 && i + 1 < argc) {
+            use_nftrace = 0;
+            if (!parse_number(argv[++i], 0, 65535, &group)) {
+                fprintf(stderr, "Error: Invalid nflog group '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--dscp") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 0, 63, &dscp)) {
+                fprintf(stderr, "Error: Invalid DSCP '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, 100000000, &count)) {
+                fprintf(stderr, "Error: Invalid count '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, 86400, &timeout)) {
+                fprintf(stderr, "Error: Invalid timeout '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else {
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (use_nftrace < 0) {
+        fprintf(stderr, "Error: One of --nftrace or --nflog is required\n");
+        exit(1);
+    }
+
+    /* Validate namespace */
+    if (!validate_namespace(nsname)) {
+        fprintf(stderr, "Error: Invalid or non-existent namespace '%s'\n", nsname);
+        exit(1);
+    }
+    if (enter_namespace(nsname) < 0) {
+        exit(1);
+    }
+
+    int fd = open_socket(use_nftrace, (uint16_t)group);
+    if (fd < 0) {
+        exit(1);
+    }
+
+    /* Drop privileges back to original user; the bound socket keeps
+     * receiving events without any capability. */
+    if (setgid(getgid()) < 0 || setuid(getuid()) < 0) {
+        perror("Failed to drop privileges");
+        exit(1);
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, handle_signal);
+
+    const char *source = use_nftrace ? "nftrace" : "nflog";
+    printf("{\"event\":\"ready\",\"source\":\"%s\"", source);
+    json_field_string("namespace", nsname);
+    printf(",\"pid\":%d}\n", (int)getpid());
+    fflush(stdout);
+
+    static char buf[RECV_BUFFER];
+    char text_a[256], text_b[256], text_c[256];
+    double deadline = timeout > 0 ? monotonic_seconds() + timeout : 0;
+    long emitted = 0;
+    int status = 0;
+
+    while (!stop_requested) {
+        int wait_ms = -1;
+        if (deadline > 0) {
+            double remaining = deadline - monotonic_seconds();
+            if (remaining <= 0) {
+                break;
+            }
+            wait_ms = (int)(remaining * 1000) + 1;
+        }
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            status = 1;
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                /* Kernel dropped events; report it and keep going */
+                printf("{\"event\":\"overrun\",\"source\":\"%s\"}\n", source);
+                fflush(stdout);
+                continue;
+            }
+            perror("recv");
+            status = 1;
+            break;
+        }
+
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)n);
+             nlh = NLMSG_NEXT(nlh, n)) {
+            struct trace_event ev;
+            int subsys = nlh->nlmsg_type >> 8;
+            int msg = nlh->nlmsg_type & 0xff;
+            int ok = 0;
+
+            memset(&ev, 0, sizeof(ev));
+            ev.handle = -1;
+            ev.id = -1;
+            ev.hook = -1;
+            if (use_nftrace && subsys == NFNL_SUBSYS_NFTABLES && msg == NFT_MSG_TRACE) {
+                ok = parse_nftrace(nlh, &ev, text_a, text_b, text_c, sizeof(text_a));
+            } else if (!use_nftrace && subsys == NFNL_SUBSYS_ULOG && msg == NFULNL_MSG_PACKET) {
+                ok = parse_nflog(nlh, &ev, text_a, sizeof(text_a));
+            }
+            if (!ok) {
+                continue;
+            }
+            if (dscp >= 0) {
+                if (ev.packet.valid) {
+                    if (ev.packet.dscp != dscp) {
+                        continue;
+                    }
+                    remember_trace_id(ev.id);
+                } else if (!trace_id_matched(ev.id)) {
+                    continue;
+                }
+            }
+            emit_event(source, nsname, &ev);
+            if (count > 0 && ++emitted >= count) {
+                stop_requested = 1;
+                break;
+            }
+        }
+    }
+
+    close(fd);
+    return status;
+}
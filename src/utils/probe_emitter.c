@@ -0,0 +1,674 @@
+/*
+ * probe_emitter - Paced TCP SYN / UDP probe emitter for KSMS
+ *
+ * This program enters a source host network namespace, builds one probe
+ * per service on a raw socket with the requested TOS/DSCP, sends them with
+ * sendmmsg at a fixed rate and collects the answers (SYN-ACK, RST, ICMP
+ * errors) in a single epoll loop. It replaces the per-probe Python sockets
+ * and thread pools of ksms_tester for large service sets.
+ *
+ * Security features:
+ * - Validates namespace names (no path traversal, must exist)
+ * - Only talks to the single destination given on the command line
+ * - No shell execution
+ * - Drops privileges once the raw sockets are open
+ *
+ * Usage:
+ *   probe_emitter <namespace> <dst_ip> [--rate PPS] [--batch N] [--wait MS]
+ *                 [--src IP] [--sport-base PORT] [--ip-id ID] < probes
+ *
+ *   probes: one "<tcp|udp> <port> <tos>" line per probe on stdin
+ *
+ * Output (JSON lines):
+ *   {"port":80,"proto":"tcp","tos":128,"result":"open","rtt_ms":0.21}
+ *   {"event":"summary","probes":N,"send_ms":...,"answered":M}
+ *
+ * --ip-id stamps every probe with the same IPv4 identification value, the
+ * per-job tag of KSMS 'ipid' tag mode (default: probe index + 1).
+ *
+ * Results: open (SYN-ACK), closed (RST or ICMP port unreachable),
+ *          filtered (ICMP administratively prohibited), unreachable (other
+ *          ICMP errors) and no_response.
+ *
+ * Compile:
+ *   gcc -o probe_emitter probe_emitter.c
+ *   sudo setcap cap_sys_admin,cap_net_raw+ep probe_emitter
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <arpa/inet.h>
+
+#define NETNS_PATH "/var/run/netns"
+#define MAX_PROBES 65535
+#define PACKET_SIZE 48
+#define MAX_BATCH 1024
+#define RECV_SIZE 2048
+#define SPORT_RANDOM_MIN 20000  /* Lowest random source port base */
+
+/* Result states */
+enum {
+    PROBE_PENDING = 0,
+    PROBE_OPEN,
+    PROBE_CLOSED,
+    PROBE_FILTERED,
+    PROBE_UNREACHABLE
+};
+
+static const char *result_names[] = {"no_response", "open", "closed", "filtered", "unreachable"};
+
+struct probe {
+    uint8_t proto;
+    uint8_t tos;
+    uint16_t port;
+    uint16_t sport;
+    uint32_t seq;
+    int state;
+    int icmp_type;
+    int icmp_code;
+    struct in_addr from;
+    struct timespec sent;
+    double rtt_ms;
+    unsigned char packet[PACKET_SIZE];
+    size_t length;
+};
+
+static struct probe *probes;
+static int probe_count;
+static uint16_t sport_base;
+
+/* Function to validate namespace name */
+static int validate_namespace(const char *nsname) {
+    /* Basic validation - no path traversal */
+    if (strstr(nsname, "/") != NULL || strstr(nsname, "..") != NULL) {
+        return 0;
+    }
+
+    /* Check if namespace exists */
+    char nspath[256];
+    snprintf(nspath, sizeof(nspath), "%s/%s", NETNS_PATH, nsname);
+
+    struct stat st;
+    if (stat(nspath, &st) != 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Function to enter a namespace by name */
+static int enter_namespace(const char *nsname) {
+    char nspath[256];
+    int nsfd;
+
+    snprintf(nspath, sizeof(nspath), "%s/%s", NETNS_PATH, nsname);
+    nsfd = open(nspath, O_RDONLY);
+    if (nsfd < 0) {
+        perror("open namespace");
+        return -1;
+    }
+    if (setns(nsfd, CLONE_NEWNET) < 0) {
+        perror("setns");
+        close(nsfd);
+        return -1;
+    }
+    close(nsfd);
+    return 0;
+}
+
+/* Parse an integer option value within bounds */
+static int parse_number(const char *text, long min, long max, long *out) {
+    char *endptr;
+    errno = 0;
+    long value = strtol(text, &endptr, 10);
+    if (errno != 0 || *text == '\0' || *endptr != '\0' || value < min || value > max) {
+        return 0;
+    }
+    *out = value;
+    return 1;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Internet checksum over a buffer, continuing from a partial sum */
+static uint32_t checksum_add(uint32_t sum, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    while (len > 1) {
+        sum += (uint32_t)((bytes[0] << 8) | bytes[1]);
+        bytes += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += (uint32_t)(bytes[0] << 8);
+    }
+    return sum;
+}
+
+static uint16_t checksum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
+
+/* Build the IPv4 + TCP SYN or UDP packet of a probe */
+static void build_packet(struct probe *p, struct in_addr src, struct in_addr dst, uint16_t ip_id) {
+    unsigned char *pkt = p->packet;
+    size_t l4_len = p->proto == IPPROTO_TCP ? 20 : 9;
+    unsigned char *l4 = pkt + 20;
+
+    memset(pkt, 0, sizeof(p->packet));
+    p->length = 20 + l4_len;
+
+    pkt[0] = 0x45;
+    pkt[1] = p->tos;
+    pkt[2] = (uint8_t)(p->length >> 8);
+    pkt[3] = (uint8_t)p->length;
+    pkt[4] = (uint8_t)(ip_id >> 8);
+    pkt[5] = (uint8_t)ip_id;
+    pkt[6] = 0x40;                 /* DF */
+    pkt[8] = 64;                   /* TTL */
+    pkt[9] = p->proto;
+    memcpy(pkt + 12, &src, 4);
+    memcpy(pkt + 16, &dst, 4);
+    uint16_t ip_sum = checksum_fold(checksum_add(0, pkt, 20));
+    memcpy(pkt + 10, &ip_sum, 2);
+
+    l4[0] = (uint8_t)(p->sport >> 8);
+    l4[1] = (uint8_t)p->sport;
+    l4[2] = (uint8_t)(p->port >> 8);
+    l4[3] = (uint8_t)p->port;
+    if (p->proto == IPPROTO_TCP) {
+        uint32_t seq = htonl(p->seq);
+        memcpy(l4 + 4, &seq, 4);
+        l4[12] = 5 << 4;           /* data offset */
+        l4[13] = 0x02;             /* SYN */
+        l4[14] = 0xfa;             /* window 64240 */
+        l4[15] = 0xf0;
+    } else {
+        l4[4] = 0;
+        l4[5] = (uint8_t)l4_len;
+        l4[8] = 'x';
+    }
+
+    /* Transport checksum with the IPv4 pseudo-header */
+    unsigned char pseudo[12];
+    memcpy(pseudo, &src, 4);
+    memcpy(pseudo + 4, &dst, 4);
+    pseudo[8] = 0;
+    pseudo[9] = p->proto;
+    pseudo[10] = (uint8_t)(l4_len >> 8);
+    pseudo[11] = (uint8_t)l4_len;
+    uint16_t l4_sum = checksum_fold(checksum_add(checksum_add(0, pseudo, 12), l4, l4_len));
+    if (p->proto == IPPROTO_UDP && l4_sum == 0) {
+        l4_sum = 0xffff;
+    }
+    memcpy(l4 + (p->proto == IPPROTO_TCP ? 16 : 6), &l4_sum, 2);
+}
+
+/* Read "<proto> <port> <tos>" lines from stdin */
+static int read_probes(FILE *in) {
+    char line[128];
+    int capacity = 256;
+
+    probes = calloc(capacity, sizeof(*probes));
+    if (probes == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char proto[8];
+        long port, tos;
+        if (line[0] == '\n' || line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%7s %ld %ld", proto, &port, &tos) != 3 ||
+            port < 1 || port > 65535 || tos < 0 || tos > 255 ||
+            (strcmp(proto, "tcp") != 0 && strcmp(proto, "udp") != 0)) {
+            fprintf(stderr, "Error: Invalid probe line: %s", line);
+            return -1;
+        }
+        if (probe_count >= MAX_PROBES) {
+            fprintf(stderr, "Error: Too many probes (max %d)\n", MAX_PROBES);
+            return -1;
+        }
+        if (probe_count == capacity) {
+            capacity *= 2;
+            struct probe *grown = realloc(probes, capacity * sizeof(*probes));
+            if (grown == NULL) {
+                perror("realloc");
+                return -1;
+            }
+            probes = grown;
+            memset(probes + probe_count, 0, (capacity - probe_count) * sizeof(*probes));
+        }
+        struct probe *p = &probes[probe_count++];
+        p->proto = strcmp(proto, "tcp") == 0 ? IPPROTO_TCP : IPPROTO_UDP;
+        p->port = (uint16_t)port;
+        p->tos = (uint8_t)tos;
+    }
+    return probe_count;
+}
+
+/* Source address the namespace would use towards the destination */
+static int route_source(struct in_addr dst, struct in_addr *src) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9);
+    addr.sin_addr = dst;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    *src = addr.sin_addr;
+    return 0;
+}
+
+/* Map a reply's destination port back to the probe it answers */
+static struct probe *probe_for(uint16_t our_port, uint16_t their_port, uint8_t proto) {
+    int index = (int)our_port - (int)sport_base;
+    if (index < 0 || index >= probe_count) {
+        return NULL;
+    }
+    struct probe *p = &probes[index];
+    if (p->port != their_port || p->proto != proto) {
+        return NULL;
+    }
+    return p;
+}
+
+static void record(struct probe *p, int state, const struct timespec *now) {
+    if (p->state != PROBE_PENDING) {
+        return;
+    }
+    p->state = state;
+    p->rtt_ms = elapsed_ms(&p->sent, now);
+}
+
+/* Handle one packet from the TCP raw socket; returns 1 if it answered a probe */
+static int handle_tcp(const unsigned char *buf, ssize_t len, struct in_addr dst) {
+    if (len < 20 || (buf[0] >> 4) != 4) {
+        return 0;
+    }
+    size_t ihl = (size_t)(buf[0] & 0x0f) * 4;
+    if ((size_t)len < ihl + 14 || memcmp(buf + 12, &dst, 4) != 0) {
+        return 0;
+    }
+    const unsigned char *tcp = buf + ihl;
+    uint16_t sport = (uint16_t)((tcp[0] << 8) | tcp[1]);
+    uint16_t dport = (uint16_t)((tcp[2] << 8) | tcp[3]);
+    struct probe *p = probe_for(dport, sport, IPPROTO_TCP);
+    if (p == NULL || p->state != PROBE_PENDING) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint8_t flags = tcp[13];
+    if ((flags & 0x12) == 0x12) {
+        record(p, PROBE_OPEN, &now);
+    } else if (flags & 0x04) {
+        record(p, PROBE_CLOSED, &now);
+    } else {
+        return 0;
+    }
+    p->from = dst;
+    return 1;
+}
+
+/* Handle one packet from the ICMP raw socket; returns 1 if it answered a probe */
+static int handle_icmp(const unsigned char *buf, ssize_t len, struct in_addr dst) {
+    if (len < 20 || (buf[0] >> 4) != 4) {
+        return 0;
+    }
+    size_t ihl = (size_t)(buf[0] & 0x0f) * 4;
+    if ((size_t)len < ihl + 8 + 20) {
+        return 0;
+    }
+    const unsigned char *icmp = buf + ihl;
+    if (icmp[0] != ICMP_DEST_UNREACH && icmp[0] != ICMP_TIME_EXCEEDED) {
+        return 0;
+    }
+    /* The quoted datagram: original IP header plus 8 transport bytes */
+    const unsigned char *inner = icmp + 8;
+    size_t inner_ihl = (size_t)(inner[0] & 0x0f) * 4;
+    if ((size_t)len < ihl + 8 + inner_ihl + 4 || memcmp(inner + 16, &dst, 4) != 0) {
+        return 0;
+    }
+    const unsigned char *l4 = inner + inner_ihl;
+    uint16_t sport = (uint16_t)((l4[0] << 8) | l4[1]);
+    uint16_t dport = (uint16_t)((l4[2] << 8) | l4[3]);
+    struct probe *p = probe_for(sport, dport, inner[9]);
+    if (p == NULL || p->state != PROBE_PENDING) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int state = PROBE_UNREACHABLE;
+    if (icmp[0] == ICMP_DEST_UNREACH && icmp[1] == ICMP_PORT_UNREACH) {
+        state = PROBE_CLOSED;
+    } else if (icmp[0] == ICMP_DEST_UNREACH &&
+               (icmp[1] == ICMP_PKT_FILTERED || icmp[1] == ICMP_NET_ANO || icmp[1] == ICMP_HOST_ANO)) {
+        state = PROBE_FILTERED;
+    }
+    record(p, state, &now);
+    p->icmp_type = icmp[0];
+    p->icmp_code = icmp[1];
+    memcpy(&p->from, buf + 12, 4);
+    return 1;
+}
+
+/* Send up to `count` probes starting at `next`; returns the number sent */
+static int send_batch(int fd, struct sockaddr_in *dst, int next, int count) {
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    struct timespec now;
+
+    if (count > MAX_BATCH) {
+        count = MAX_BATCH;
+    }
+    if (next + count > probe_count) {
+        count = probe_count - next;
+    }
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for (int i = 0; i < count; i++) {
+        struct probe *p = &probes[next + i];
+        iovs[i].iov_base = p->packet;
+        iovs[i].iov_len = p->length;
+        msgs[i].msg_hdr.msg_name = dst;
+        msgs[i].msg_hdr.msg_namelen = sizeof(*dst);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int sent = sendmmsg(fd, msgs, (unsigned int)count, 0);
+    if (sent < 0) {
+        if (errno == ENOBUFS || errno == EAGAIN) {
+            return 0;
+        }
+        perror("sendmmsg");
+        return -1;
+    }
+    for (int i = 0; i < sent; i++) {
+        probes[next + i].sent = now;
+    }
+    return sent;
+}
+
+static void drain(int fd, int is_icmp, struct in_addr dst, int *answered) {
+    unsigned char buf[RECV_SIZE];
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0) {
+            return;
+        }
+        *answered += is_icmp ? handle_icmp(buf, n, dst) : handle_tcp(buf, n, dst);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <namespace> <dst_ip> [--rate PPS] [--batch N] [--wait MS] "
+                    "[--src IP] [--sport-base PORT] [--ip-id ID] < probes\n", prog);
+    fprintf(stderr, "       probes: one \"<tcp|udp> <port> <tos>\" line per probe\n");
+}
+
+int main(int argc, char *argv[]) {
+    long rate = 0, batch = 64, wait_ms = 1000, base = 0, ip_id = 0;
+    struct in_addr dst, src;
+    int have_src = 0;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        exit(1);
+    }
+    const char *nsname = argv[1];
+    if (inet_pton(AF_INET, argv[2], &dst) != 1) {
+        fprintf(stderr, "Error: Invalid destination '%s'\n", argv[2]);
+        exit(1);
+    }
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 0, 10000000, &rate)) {
+                fprintf(stderr, "Error: Invalid rate '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, MAX_BATCH, &batch)) {
+                fprintf(stderr, "Error: Invalid batch '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--wait") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 0, 60000, &wait_ms)) {
+                fprintf(stderr, "Error: Invalid wait '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--sport-base") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1024, 65535, &base)) {
+                fprintf(stderr, "Error: Invalid source port base '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--ip-id") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, 65535, &ip_id)) {
+                fprintf(stderr, "Error: Invalid IP ID '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--src") == 0 && i + 1 < argc) {
+            if (inet_pton(AF_INET, argv[++i], &src) != 1) {
+                fprintf(stderr, "Error: Invalid source '%s'\n", argv[i]);
+                exit(1);
+            }
+            have_src = 1;
+        } else {
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (read_probes(stdin) < 0) {
+        exit(1);
+    }
+    if (probe_count == 0) {
+        printf("{\"event\":\"summary\",\"probes\":0,\"send_ms\":0,\"answered\":0}\n");
+        return 0;
+    }
+
+    /* Source ports identify probes: base + index must stay below 65536 */
+    srandom((unsigned int)(getpid() ^ time(NULL)));
+    if (base == 0) {
+        if (probe_count > 65535 - SPORT_RANDOM_MIN) {
+            fprintf(stderr, "Error: %d probes do not fit above port %d, give --sport-base\n",
+                    probe_count, SPORT_RANDOM_MIN);
+            exit(1);
+        }
+        /* Any base in [SPORT_RANDOM_MIN, 65535 - probe_count] */
+        base = SPORT_RANDOM_MIN + random() % (65535 - SPORT_RANDOM_MIN - probe_count + 1);
+    }
+    if (base + probe_count > 65535) {
+        fprintf(stderr, "Error: Source port base %ld too high for %d probes\n", base, probe_count);
+        exit(1);
+    }
+    sport_base = (uint16_t)base;
+
+    /* Validate namespace */
+    if (!validate_namespace(nsname)) {
+        fprintf(stderr, "Error: Invalid or non-existent namespace '%s'\n", nsname);
+        exit(1);
+    }
+    if (enter_namespace(nsname) < 0) {
+        exit(1);
+    }
+    if (!have_src && route_source(dst, &src) < 0) {
+        fprintf(stderr, "Error: No route to %s in namespace '%s'\n", argv[2], nsname);
+        exit(1);
+    }
+
+    int send_fd = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_RAW);
+    int tcp_fd = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, IPPROTO_TCP);
+    int icmp_fd = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, IPPROTO_ICMP);
+    if (send_fd < 0 || tcp_fd < 0 || icmp_fd < 0) {
+        perror("raw socket");
+        exit(1);
+    }
+    int bufsize = 4 * 1024 * 1024;
+    setsockopt(tcp_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(icmp_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(send_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+    /* Drop privileges back to original user; open raw sockets stay usable */
+    if (setgid(getgid()) < 0 || setuid(getuid()) < 0) {
+        perror("Failed to drop privileges");
+        exit(1);
+    }
+
+    for (int i = 0; i < probe_count; i++) {
+        probes[i].sport = (uint16_t)(sport_base + i);
+        probes[i].seq = (uint32_t)random();
+        build_packet(&probes[i], src, dst, (uint16_t)(ip_id ? ip_id : i + 1));
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (epfd < 0 || timer_fd < 0) {
+        perror("epoll/timerfd");
+        exit(1);
+    }
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = tcp_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tcp_fd, &ev);
+    ev.data.fd = icmp_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, icmp_fd, &ev);
+    ev.data.fd = timer_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timer_fd, &ev);
+
+    /* Paced mode sends one batch per timer tick; unpaced mode sends at once */
+    struct itimerspec tick = {{0, 0}, {0, 1}};
+    if (rate > 0) {
+        long long interval_ns = batch * 1000000000LL / rate;
+        if (interval_ns < 1) {
+            interval_ns = 1;
+        }
+        tick.it_interval.tv_sec = interval_ns / 1000000000LL;
+        tick.it_interval.tv_nsec = interval_ns % 1000000000LL;
+    } else {
+        batch = MAX_BATCH;
+        tick.it_interval.tv_nsec = 1000;
+    }
+    timerfd_settime(timer_fd, 0, &tick, NULL);
+
+    struct sockaddr_in dst_addr;
+    memset(&dst_addr, 0, sizeof(dst_addr));
+    dst_addr.sin_family = AF_INET;
+    dst_addr.sin_addr = dst;
+
+    struct timespec start, sent_done = {0, 0}, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next = 0, answered = 0, status = 0;
+
+    for (;;) {
+        int timeout = -1;
+        if (next >= probe_count) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double left = wait_ms - elapsed_ms(&sent_done, &now);
+            if (left <= 0 || answered >= probe_count) {
+                break;
+            }
+            timeout = (int)left + 1;
+        }
+
+        struct epoll_event events[4];
+        int n = epoll_wait(epfd, events, 4, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            status = 1;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == timer_fd) {
+                uint64_t ticks = 0;
+                if (read(timer_fd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+                    continue;
+                }
+                /* Catch up on missed ticks so the average rate holds */
+                long long budget = (long long)ticks * batch;
+                while (budget > 0 && next < probe_count) {
+                    int sent = send_batch(send_fd, &dst_addr, next, budget > MAX_BATCH ? MAX_BATCH : (int)budget);
+                    if (sent <= 0) {
+                        if (sent < 0) {
+                            status = 1;
+                            next = probe_count;
+                        }
+                        break;
+                    }
+                    next += sent;
+                    budget -= sent;
+                }
+                if (next >= probe_count) {
+                    struct itimerspec off = {{0, 0}, {0, 0}};
+                    timerfd_settime(timer_fd, 0, &off, NULL);
+                    clock_gettime(CLOCK_MONOTONIC, &sent_done);
+                }
+            } else {
+                drain(fd, fd == icmp_fd, dst, &answered);
+            }
+        }
+    }
+
+    for (int i = 0; i < probe_count; i++) {
+        struct probe *p = &probes[i];
+        char from[INET_ADDRSTRLEN] = "";
+        printf("{\"port\":%u,\"proto\":\"%s\",\"tos\":%u,\"sport\":%u,\"result\":\"%s\"",
+               p->port, p->proto == IPPROTO_TCP ? "tcp" : "udp", p->tos, p->sport,
+               result_names[p->state]);
+        if (p->state != PROBE_PENDING) {
+            inet_ntop(AF_INET, &p->from, from, sizeof(from));
+            printf(",\"rtt_ms\":%.3f,\"from\":\"%s\"", p->rtt_ms, from);
+        }
+        if (p->icmp_type || p->icmp_code) {
+            printf(",\"icmp_type\":%d,\"icmp_code\":%d", p->icmp_type, p->icmp_code);
+        }
+        printf("}\n");
+    }
+    printf("{\"event\":\"summary\",\"probes\":%d,\"send_ms\":%.3f,\"answered\":%d}\n",
+           probe_count, elapsed_ms(&start, &sent_done), answered);
+    fflush(stdout);
+
+    close(timer_fd);
+    close(epfd);
+    close(send_fd);
+    close(tcp_fd);
+    close(icmp_fd);
+    free(probes);
+    return status;
+}
@@ -5,6 +5,7 @@ Test script for DSCP Registry functionality
 
 import sys
 import os
+import json
 import time
 import threading
 from pathlib import Path
@@ -186,14 +187,21 @@ def test_stale_cleanup():
     print(f"Allocated DSCP {dscp} for test job")
     
     # Manually modify the registry to simulate a dead process
-    with registry.semaphore:
-        with registry._file_lock():
-            reg_data = registry._load_registry()
-            # Set a bogus PID to simulate dead process
-            reg_data['allocations']['test_stale_job']['pid'] = 999999
-            # Set old timestamp to simulate timeout
-            reg_data['allocations']['test_stale_job']['allocated_at'] = time.time() - 7200  # 2 hours ago
-            registry._save_registry(reg_data)
+    if registry.slots is not None:
+        # Shared-memory backend: swap in an owner word with a bogus PID and a claim 2 hours ago
+        slot = dscp - registry.tag_min
+        owner = registry.slots._owner(slot)
+        stale_owner = (999999 << 32) | (int(time.time() - 7200) & 0xffffffff)
+        assert registry.slots._compare_and_swap(slot, owner, stale_owner), "Failed to fake stale owner"
+    else:
+        with registry.semaphore:
+            with registry._file_lock():
+                reg_data = registry._load_registry()
+                # Set a bogus PID to simulate dead process
+                reg_data['allocations']['test_stale_job']['pid'] = 999999
+                # Set old timestamp to simulate timeout
+                reg_data['allocations']['test_stale_job']['allocated_at'] = time.time() - 7200  # 2 hours ago
+                registry._save_registry(reg_data)
     
     print("Simulated stale allocation (dead PID + old timestamp)")
     
@@ -240,6 +248,129 @@ def test_disabled_registry():
     print("✅ Disabled registry test passed\n")
 
 
+def test_ipid_tag_mode():
+    """Test IP ID tag allocation beyond the 32 DSCP values"""
+    print("=== Test: IP ID Tag Mode ===")
+    
+    config = TsimConfigService()
+    config.config['dscp_registry'] = dict(config.get('dscp_registry', {}), tag_mode='ipid',
+                                          ipid_range_min=100, ipid_range_max=199)
+    
+    registry = TsimDscpRegistry(config)
+    assert registry.capacity == 100, f"Expected capacity 100, got {registry.capacity}"
+    assert TsimDscpRegistry.tag_capacity(config) == 100
+    
+    tags = [registry.allocate_dscp(f"ipid_job_{i}", "test_user") for i in range(40)]
+    print(f"Allocated {len(tags)} IP ID tags: {tags[0]}..{tags[-1]}")
+    assert tags == list(range(100, 140)), f"Unexpected tags {tags}"
+    
+    args = registry.ksms_tag_args(tags[0])
+    assert args == ['--dscp', str(registry.marker_dscp), '--tag-mode', 'ipid', '--ip-id-tag', '100'], args
+    
+    status = registry.get_allocation_status()
+    assert status['tag_mode'] == 'ipid' and status['available_slots'] == 60, status
+    
+    for i in range(40):
+        registry.release_dscp(f"ipid_job_{i}")
+    
+    print("✅ IP ID tag mode test passed\n")
+
+
+def test_cross_process_allocation():
+    """Test that processes sharing the slot table never hand out the same tag"""
+    print("=== Test: Cross-Process Allocation ===")
+    
+    config = TsimConfigService()
+    registry = TsimDscpRegistry(config)
+    if registry.slots is None:
+        print("⚠️  Shared-memory backend unavailable, skipping")
+        return
+    
+    # Children stay alive until all tags are collected, or their slots would rightly be reclaimed
+    read_fd, write_fd = os.pipe()
+    go_read, go_write = os.pipe()
+    children = []
+    for worker in range(4):
+        pid = os.fork()
+        if pid == 0:
+            os.close(read_fd)
+            os.close(go_write)
+            child = TsimDscpRegistry(config)
+            tags = [child.allocate_dscp(f"xproc_{worker}_{i}", "test_user") for i in range(6)]
+            os.write(write_fd, (" ".join(str(t) for t in tags) + "\n").encode())
+            os.read(go_read, 1)
+            os._exit(0)
+        children.append(pid)
+    os.close(write_fd)
+    os.close(go_read)
+    with os.fdopen(read_fd) as f:
+        lines = [f.readline() for _ in children]
+    tags = [int(t) for line in lines for t in line.split() if t != 'None']
+    os.close(go_write)
+    for pid in children:
+        os.waitpid(pid, 0)
+    print(f"Children allocated {len(tags)} tags")
+    assert len(tags) == len(set(tags)) == 24, f"Duplicate or missing tags: {sorted(tags)}"
+    
+    # Children exited without releasing: their slots are stale now
+    cleaned = registry.cleanup_stale_allocations()
+    assert cleaned == 24, f"Expected 24 reclaimed slots, got {cleaned}"
+    
+    started = time.perf_counter()
+    for i in range(1000):
+        registry.allocate_dscp("latency_job", "test_user")
+        registry.release_dscp("latency_job")
+    per_pair = (time.perf_counter() - started) / 1000 * 1e6
+    print(f"Allocate+release: {per_pair:.1f} us")
+    
+    print("✅ Cross-process allocation test passed\n")
+
+
+def test_release_ownership_and_snapshot():
+    """Test that release never clears a re-claimed slot and snapshots are periodic"""
+    print("=== Test: Release Ownership and Periodic Snapshot ===")
+    
+    config = TsimConfigService()
+    config.config['dscp_registry'] = dict(config.get('dscp_registry', {}), snapshot_interval=0.1)
+    TsimDscpRegistry._snapshot_thread = None  # Start a fresh thread with the short interval
+    registry = TsimDscpRegistry(config)
+    slots = registry.slots
+    if slots is None:
+        print("⚠️  Shared-memory backend unavailable, skipping")
+        return
+    
+    # rel_a's slot is reclaimed and handed to rel_b while rel_a's release is in flight
+    tag = registry.allocate_dscp("rel_a", "test_user")
+    slot = tag - slots.tag_min
+    assert slots._compare_and_swap(slot, slots._owner(slot), 0)
+    assert registry.allocate_dscp("rel_b", "test_user") == tag
+    find = slots._find
+    slots._find = lambda job_id: slot
+    try:
+        assert not registry.release_dscp("rel_a"), "Released a slot owned by another job"
+    finally:
+        slots._find = find
+    assert registry.get_job_dscp("rel_b") == tag, "Slot fields of rel_b were cleared"
+    assert registry.release_dscp("rel_b")
+    
+    # A claim made behind the registry's back reaches the audit file without further calls
+    slots.allocate("snap_job", "test_user")
+    deadline = time.time() + 5.0
+    while time.time() < deadline:
+        time.sleep(0.05)
+        try:
+            with open(registry.registry_file) as f:
+                if 'snap_job' in json.load(f).get('allocations', {}):
+                    break
+        except (OSError, ValueError):
+            pass
+    else:
+        raise AssertionError("Audit snapshot was not refreshed by the timer")
+    slots.release("snap_job")
+    
+    print("✅ Release ownership and periodic snapshot test passed\n")
+
+
 def main():
     """Run all tests"""
     print("Starting DSCP Registry Tests\n")
@@ -250,6 +381,9 @@ def main():
         test_concurrent_allocation()
         test_stale_cleanup()
         test_disabled_registry()
+        test_ipid_tag_mode()
+        test_cross_process_allocation()
+        test_release_ownership_and_snapshot()
         
         print("🎉 All DSCP Registry tests passed!")
         
@@ -282,6 +282,136 @@ class TestIptablesLogProcessor(unittest.TestCase):
             self.assertIn('matched_rules', entry)
             self.assertIsInstance(entry['matched_rules'], list)
 
+    def test_15_columnar_log_parsing(self):
+        """Test columnar parsing yields the same fields as parse_log_line."""
+        lines = self.test_log_data + [
+            "Jul  1 10:30:19 hq-gw sshd: Connection from 10.1.1.1",
+            "Jul  1 10:30:20 hq-gw kernel: FWD-DROP: IN=eth0 OUT=eth1 SRC=2001:db8::1 DST=2001:db8::2 "
+            "LEN=80 TTL=64 PROTO=TCP SPT=1 DPT=2",
+            "Jul 12 23:59:59 hq-gw kernel: FWD-REJECT: IN=eth1 OUT=eth0 "
+            "MAC=00:11:22:33:44:55:66:77:88:99:aa:bb:08:00 SRC=10.1.1.5 DST=10.3.1.1 LEN=52 TOS=0x00 "
+            "PREC=0x00 TTL=63 ID=1 DF PROTO=UDP SPT=5353 DPT=53 LEN=32"
+        ]
+        with tempfile.NamedTemporaryFile(mode='w', delete=False, suffix='.log') as f:
+            f.write('\n'.join(lines) + '\n')
+            temp_file = Path(f.name)
+        
+        try:
+            batch = self.processor.parse_logs_columnar(temp_file, year=2024)
+            self.assertEqual(len(batch), 5)
+            self.assertEqual(batch.skipped, 1)
+            self.assertEqual(batch.src.typecode, 'I')
+            
+            expected = [self.processor.parse_log_line(line, None) for line in lines]
+            expected = [e for e in expected if e and ':' not in e.source_ip]
+            for row, entry in enumerate(expected):
+                columnar = batch.entry(row)
+                for field in ('router', 'prefix', 'protocol', 'source_ip', 'dest_ip', 'source_port',
+                              'dest_port', 'interface_in', 'interface_out', 'packet_length', 'ttl',
+                              'action', 'raw_line'):
+                    self.assertEqual(getattr(columnar, field), getattr(entry, field), field)
+            
+            self.assertEqual(batch.timestamp_datetime(0), datetime(2024, 7, 1, 10, 30, 15))
+            self.assertEqual(batch.timestamp_datetime(4), datetime(2024, 7, 12, 23, 59, 59))
+            self.assertEqual(batch.entry(2).interface_out, None)
+            self.assertEqual(batch.dictionary.routers[batch.router[2]], 'br-gw')
+            
+            # Batches share one dictionary so ids stay comparable
+            from analyzers.iptables_log_columnar import ColumnarLogParser
+            parser = ColumnarLogParser(2024)
+            batches = list(parser.iter_file_batches(temp_file, 'test-router', batch_rows=2))
+            self.assertEqual([len(b) for b in batches], [2, 2, 1])
+            self.assertEqual(len(parser.dictionary.routers), 2)
+            self.assertEqual(batches[2].entry(0).router, 'test-router')
+            
+            # More routers and protocols than one or two bytes of intern id hold
+            wide = ''.join(f"Jul  1 10:30:15 r{i} kernel: FWD-DROP: IN=eth0 OUT=eth1 SRC=10.1.1.1 "
+                           f"DST=10.2.1.1 LEN=60 TTL=64 PROTO=P{i % 300} SPT=1 DPT=2\n" for i in range(66000))
+            wide_batch = parser.parse_bytes(wide.encode())
+            self.assertEqual(wide_batch.entry(65999).router, 'r65999')
+            self.assertEqual(wide_batch.entry(299).protocol, 'p299')
+            mask = LogFilter().filter_columnar(wide_batch, FilterCriteria(routers=['r65999', 'r299'],
+                                                                          protocols=['P299']))
+            self.assertEqual([row for row, selected in enumerate(mask) if selected], [299, 65999])
+            
+            # Timestamp and address conversion caches stay bounded in a long-lived parser
+            parser.CONVERSION_CACHE_LIMIT = 100
+            many = ''.join(f"Jul  1 10:{i // 60 % 60:02d}:{i % 60:02d} r1 kernel: FWD-DROP: IN=eth0 OUT=eth1 "
+                           f"SRC=10.1.{i // 256}.{i % 256} DST=10.2.1.1 LEN=60 TTL=64 PROTO=TCP\n"
+                           for i in range(1000))
+            many_batch = parser.parse_bytes(many.encode())
+            self.assertLessEqual(len(parser._timestamp_cache), 100)
+            self.assertLessEqual(len(parser._ip_cache), 100)
+            self.assertEqual(many_batch.entry(999).source_ip, '10.1.3.231')
+            self.assertEqual(many_batch.timestamp_datetime(999), datetime(2024, 7, 1, 10, 16, 39))
+        finally:
+            temp_file.unlink()
+
+    def test_16_log_store(self):
+        """Test the segment log store fed by the tailing ingester."""
+        import shutil
+        from analyzers.iptables_log_columnar import ColumnarLogParser
+        from analyzers.iptables_log_store import LogStore, LogTailer
+        
+        temp_dir = Path(tempfile.mkdtemp())
+        log_file = temp_dir / 'kern.log'
+        try:
+            log_file.write_text('\n'.join(self.test_log_data[:3]) + '\n' + self.test_log_data[3][:40])
+            store = LogStore(temp_dir / 'store', segment_rows=2)
+            tailer = LogTailer(store, [log_file])
+            self.assertEqual(tailer.poll_once(), 3)
+            
+            # Complete the partial line, then rotate
+            with open(log_file, 'a') as f:
+                f.write(self.test_log_data[3][40:] + '\n')
+            log_file.rename(temp_dir / 'kern.log.1')
+            log_file.write_text(self.test_log_data[1].replace('10:30:16', '10:31:00') + '\n')
+            self.assertEqual(tailer.poll_once(), 2)
+            self.assertEqual(len(store.segments), 3)
+            
+            # Only one segment can hold dc-gw rows
+            year = datetime.now().year
+            entries = store.query(router='dc-gw')
+            self.assertEqual([e.source_ip for e in entries], ['10.3.1.1'])
+            self.assertEqual(store.last_scan['segments_scanned'], 1)
+            
+            entries = store.query(since=datetime(year, 7, 1, 10, 30, 16), address='10.1.1.1')
+            self.assertEqual([e.timestamp.second for e in entries], [16, 17, 0])
+            self.assertEqual(entries[0].raw_line, self.test_log_data[1])
+            self.assertEqual(entries[1].action, 'DROP')
+            self.assertEqual(store.query(router='unknown-gw'), [])
+            with self.assertRaises(RuntimeError):
+                LogStore(temp_dir / 'store')
+            store.close()
+            
+            # Reopened store and tailer continue where they stopped
+            store = LogStore(temp_dir / 'store', segment_rows=2)
+            self.assertEqual(store.rows, 5)
+            self.assertEqual(LogTailer(store, [log_file]).poll_once(), 0)
+            processor = IptablesLogProcessor(log_store=store)
+            recent = processor.get_recent_logs('hq-gw', minutes=10 ** 6, address='10.2.1.1')
+            self.assertEqual(len(recent), 3)
+            store.close()
+            
+            # Intern ids wider than one or two bytes round-trip through the records
+            wide = ''.join(f"Jul  1 10:30:15 hq-gw kernel: FWD-DROP: IN=if{i} OUT=eth1 SRC=10.1.1.1 "
+                           f"DST=10.2.1.1 LEN=60 TTL=64 PROTO=P{i % 300} SPT=1 DPT=2\n" for i in range(66000))
+            store = LogStore(temp_dir / 'wide')
+            self.assertEqual(store.append_batch(ColumnarLogParser(year).parse_bytes(wide.encode())), 66000)
+            store.close()
+            entries = LogStore(temp_dir / 'wide', readonly=True).query()
+            self.assertEqual((entries[65999].interface_in, entries[65999].protocol), ('if65999', 'p299'))
+            self.assertEqual(len({e.protocol for e in entries}), 300)
+            
+            # Stores written with another record layout are refused, not misread
+            (temp_dir / 'wide' / 'format.json').unlink()
+            with self.assertRaises(RuntimeError):
+                LogStore(temp_dir / 'wide', readonly=True)
+            LogStore(temp_dir / 'new').close()
+            self.assertEqual(json.loads((temp_dir / 'new' / 'format.json').read_text())['version'], 2)
+        finally:
+            shutil.rmtree(temp_dir)
+
 
 class TestLogFilter(unittest.TestCase):
     """Test suite for log filter functionality."""
@@ -468,6 +598,111 @@ class TestLogFilter(unittest.TestCase):
         self.assertTrue(self.log_filter.match_regex_patterns("IN-DROP", patterns))
         self.assertFalse(self.log_filter.match_regex_patterns("OUT-ACCEPT", patterns))
 
+    def test_13_columnar_filtering(self):
+        """Test compiled columnar filtering agrees with filter_entries."""
+        from analyzers.iptables_log_columnar import ColumnarLogParser
+        from core.log_filter import mask_rows
+        
+        lines = [
+            "Jul  1 10:30:15 hq-gw kernel: FWD-ALLOW: IN=eth1 OUT=eth0 SRC=10.1.1.1 DST=10.2.1.1 "
+            "LEN=60 TTL=64 PROTO=TCP SPT=1025 DPT=80",
+            "Jul  1 10:31:15 br-gw kernel: FWD-DROP: IN=eth0 OUT=eth1 SRC=192.168.1.1 DST=10.1.1.1 "
+            "LEN=1400 TTL=20 PROTO=TCP SPT=4000 DPT=22",
+            "Jul  1 10:32:15 dc-gw kernel: OUT-ACCEPT: IN= OUT=eth0 SRC=10.3.1.1 DST=8.8.8.8 "
+            "LEN=76 TTL=63 PROTO=UDP SPT=5353 DPT=53",
+            "Jul  2 09:00:00 hq-gw kernel: IN-REJECT: IN=eth0 OUT= SRC=224.0.0.5 DST=10.1.1.255 "
+            "LEN=84 TTL=1 PROTO=ICMP"
+        ]
+        batch = ColumnarLogParser(2025).parse_bytes(('\n'.join(lines) + '\n').encode())
+        entries = [batch.entry(row, with_raw_line=False).__dict__ for row in range(len(batch))]
+        
+        for criteria in (
+            FilterCriteria(source_networks=["10.0.0.0/8"], protocols=["TCP"]),
+            FilterCriteria(routers=["hq-gw", "dc-gw"], dest_ports=[53, 80]),
+            FilterCriteria(interfaces_out=["eth1"], actions=["drop"]),
+            FilterCriteria(prefix_patterns=["^fwd"], max_packet_length=100),
+            FilterCriteria(include_only_errors=True),
+            FilterCriteria(exclude_multicast=True, ttl_range=(2, 64)),
+            FilterCriteria(time_start=datetime(2025, 7, 1, 10, 31), time_end=datetime(2025, 7, 1, 12))
+        ):
+            kept = {id(entry) for entry in self.log_filter.filter_entries(entries, criteria)}
+            expected = [row for row, entry in enumerate(entries) if id(entry) in kept]
+            mask = self.log_filter.filter_columnar(batch, criteria)
+            self.assertEqual(len(mask), len(batch))
+            self.assertEqual(list(mask_rows(mask)), expected, criteria)
+            
+            # Chunked and forked evaluation give the same mask
+            compiled = self.log_filter.compile_criteria(criteria)
+            self.assertEqual(compiled.evaluate(batch, chunk_rows=3, workers=2), mask)
+        
+        # Forked evaluations started from several threads at once keep their own filter
+        from concurrent.futures import ThreadPoolExecutor
+        compiled = [self.log_filter.compile_criteria(FilterCriteria(protocols=[protocol]))
+                    for protocol in ("TCP", "UDP", "ICMP")]
+        expected = [program.evaluate(batch) for program in compiled]
+        with ThreadPoolExecutor(3) as executor:
+            masks = list(executor.map(lambda program: program.evaluate(batch, chunk_rows=2, workers=2),
+                                      compiled * 3))
+        self.assertEqual(masks, expected * 3)
+
+    def test_14_columnar_aggregation(self):
+        """Test hash aggregation over columns agrees with group_entries/deduplicate_entries."""
+        from analyzers.iptables_log_columnar import ColumnarLogParser
+        from analyzers.iptables_log_aggregate import LogAggregator
+        
+        lines = [
+            "Jul  1 10:30:15 hq-gw kernel: FWD-DROP: IN=eth0 OUT=eth1 SRC=10.1.1.1 DST=10.2.1.1 "
+            "LEN=60 TTL=64 PROTO=TCP SPT=1025 DPT=22",
+            "Jul  1 10:30:16 hq-gw kernel: FWD-DROP: IN=eth0 OUT=eth1 SRC=10.1.1.7 DST=10.2.1.1 "
+            "LEN=80 TTL=64 PROTO=TCP SPT=1026 DPT=22",
+            "Jul  1 10:30:16 hq-gw kernel: FWD-DROP: IN=eth0 OUT=eth1 SRC=10.1.1.7 DST=10.2.1.1 "
+            "LEN=80 TTL=64 PROTO=TCP SPT=1026 DPT=22",
+            "Jul  1 10:31:00 br-gw kernel: FWD-ALLOW: IN=eth0 OUT=eth1 SRC=10.1.2.9 DST=10.2.1.1 "
+            "LEN=40 TTL=63 PROTO=UDP SPT=5353 DPT=53",
+            "Jul  1 11:05:00 br-gw kernel: IN-ALLOW: IN=eth0 OUT= SRC=10.1.2.9 DST=10.2.1.2 "
+            "LEN=84 TTL=64 PROTO=ICMP"
+        ]
+        batch = ColumnarLogParser(2025).parse_bytes(('\n'.join(lines) + '\n').encode())
+        entries = [batch.entry(row, with_raw_line=False).__dict__ for row in range(len(batch))]
+        
+        grouped = self.log_filter.group_entries(entries, ['source_ip', 'dest_port', 'action'])
+        result = LogAggregator(batch).group_by(['source_ip', 'dest_port', 'action'])
+        self.assertEqual({'|'.join(str(v) for v in (r['source_ip'], r['dest_port'], r['action'])): r['count']
+                          for r in result.rows()},
+                         {key: len(group) for key, group in grouped.items()})
+        
+        aggregator = LogAggregator(batch, chunk_rows=2, workers=2)
+        top = aggregator.top_k(['src/24', 'action'], 2, ['distinct:src', 'sum:length', 'max:timestamp'])
+        self.assertEqual(top[0], {'src/24': '10.1.1.0/24', 'action': 'DROP', 'count': 3, 'distinct:src': 2,
+                                  'sum:length': 220, 'max:timestamp': datetime(2025, 7, 1, 10, 30, 16)})
+        self.assertEqual(top[1]['count'], 2)
+        hourly = aggregator.group_by(['timestamp/3600', 'protocol']).rows()
+        self.assertEqual([(r['timestamp/3600'].hour, r['protocol'], r['count']) for r in hourly],
+                         [(10, 'tcp', 3), (10, 'udp', 1), (11, 'icmp', 1)])
+        self.assertEqual(aggregator.count_distinct('dst'), 2)
+        
+        unique = self.log_filter.deduplicate_entries(entries, ['timestamp', 'source_ip', 'dest_ip', 'protocol'])
+        rows = aggregator.distinct_rows(['timestamp', 'src', 'dst', 'protocol'])
+        self.assertEqual([entries[row] for row in rows], unique)
+        
+        mask = self.log_filter.filter_columnar(batch, FilterCriteria(routers=['br-gw']))
+        self.assertEqual(aggregator.count_distinct('dst', mask), 2)
+        self.assertEqual(aggregator.group_by('dport', mask=mask).rows(),
+                         [{'dport': 53, 'count': 1}, {'dport': None, 'count': 1}])
+        
+        # Rows without ports (ICMP) do not contribute to port sums and extremes
+        mixed = aggregator.group_by('router', ['sum:dport', 'min:dport', 'max:dport'], mask).rows()
+        self.assertEqual(mixed, [{'router': 'br-gw', 'count': 2, 'sum:dport': 53, 'min:dport': 53,
+                                  'max:dport': 53}])
+        icmp = aggregator.group_by('protocol', ['sum:sport', 'min:sport', 'max:sport'], mask).rows()
+        self.assertEqual(icmp[1], {'protocol': 'icmp', 'count': 1, 'sum:sport': 0, 'min:sport': None,
+                                   'max:sport': None})
+        
+        with self.assertRaises(ValueError):
+            aggregator.group_by(['dport/8'])
+        with self.assertRaises(ValueError):
+            aggregator.group_by(['rule'])
+
 
 class TestNetLogIntegration(unittest.TestCase):
     """Test suite for netlog CLI integration."""
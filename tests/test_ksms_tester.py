@@ -0,0 +1,176 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+Test suite for the KSMS tester helpers
+
+Covers the pieces of the fast KSMS path that run without namespaces:
+
+1. iptables-save Index Tests - Single-pass counter and rule lookups
+2. KSMS Tester Tests - Counting sets, probe emitter I/O, job tags and
+   virtual sources
+
+Author: Network Analysis Tool
+License: MIT
+"""
+
+import unittest
+import os
+import sys
+import json
+
+# Add src directory to path for imports
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'src'))
+
+
+class TestIptablesSaveIndex(unittest.TestCase):
+    """Test the iptables-save index used for KSMS counter lookups."""
+
+    def test_01_save_snapshot_index(self):
+        """Test the single-pass iptables-save index used for counter lookups."""
+        from tsim.analyzers.iptables_save_index import IptablesSaveIndex
+
+        snapshot = '\n'.join([
+            '# Generated by iptables-save',
+            '*mangle',
+            ':PREROUTING ACCEPT [120:9000]',
+            ':TSIM_TAP_FW_40 - [0:0]',
+            '[3:180] -A PREROUTING -p tcp -m tcp --dport 80 -m comment --comment "TSIM_KSMS=r1:PREROUTING:80/tcp" -j TSIM_TAP_FW_40',
+            '[0:0] -A PREROUTING -p udp -m comment --comment TSIM_KSMS=r1:PREROUTING:53/udp -j TSIM_TAP_FW_40',
+            '-A PREROUTING -c 7 420 -m comment --comment "other rule" -j ACCEPT',
+            'COMMIT',
+            '*filter',
+            ':FORWARD DROP [4:240]',
+            '[2:120] -A FORWARD -s 10.1.0.0/16 -j ACCEPT',
+            'COMMIT'
+        ]) + '\n'
+        index = IptablesSaveIndex(snapshot, 'TSIM_KSMS=')
+        self.assertEqual(index.counter('TSIM_KSMS=r1:PREROUTING:80/tcp'), (3, 180))
+        self.assertEqual(index.counter('"TSIM_KSMS=r1:PREROUTING:53/udp"'), (0, 0))
+        self.assertIsNone(index.counter('other rule'))
+        self.assertEqual(len(index.comments), 2)
+
+        index = IptablesSaveIndex(snapshot)
+        self.assertEqual(index.comments['other rule'], ('mangle', 'PREROUTING', 7, 420))
+        self.assertEqual(index.policies('mangle'), {'PREROUTING': 'ACCEPT', 'TSIM_TAP_FW_40': '-'})
+        self.assertEqual([rule['target'] for rule in index.chain_rules('mangle')['PREROUTING']],
+                         ['TSIM_TAP_FW_40', 'TSIM_TAP_FW_40', 'ACCEPT'])
+        self.assertEqual(index.tables['filter']['chains']['FORWARD']['packets'], 4)
+        rules = index.rule_list('filter')
+        self.assertEqual([(r['chain'], r['rule_number'], r['rule']['packets']) for r in rules], [('FORWARD', 1, 2)])
+
+
+class TestKsmsTester(unittest.TestCase):
+    """Test KSMS tester payload builders and result parsers."""
+
+    def test_01_counting_set_readers(self):
+        """Test KSMS counting-set payloads and per-element counter parsing."""
+        from tsim.simulators import ksms_tester as ksms
+
+        services = [(80, 'tcp'), (53, 'udp')]
+        payload = ksms.counting_set_payload('ipset', 42, '10.2.1.5', services)
+        self.assertIn('create TSIM_KSMS_PRE_42 hash:ip,port counters -exist', payload)
+        self.assertIn('add TSIM_KSMS_POST_42 10.2.1.5,udp:53', payload)
+        payload = ksms.counting_set_payload('nft', 42, '10.2.1.5', services)
+        self.assertIn('elements = { 10.2.1.5 . tcp . 80, 10.2.1.5 . udp . 53 }', payload)
+        self.assertIn('ip dscp 42 ip daddr . meta l4proto . th dport @TSIM_KSMS_PRE_42', payload)
+
+        saved = ('create TSIM_KSMS_PRE_42 hash:ip,port family inet hashsize 1024 maxelem 65536 counters\n'
+                 'add TSIM_KSMS_PRE_42 10.2.1.5,tcp:80 packets 3 bytes 180\n'
+                 'add TSIM_KSMS_PRE_42 10.2.1.5,udp:53 packets 0 bytes 0\n')
+        self.assertEqual(ksms.parse_ipset_counters(saved),
+                         {('TSIM_KSMS_PRE_42', 80, 'tcp'): 3, ('TSIM_KSMS_PRE_42', 53, 'udp'): 0})
+        listed = {'nftables': [{'metainfo': {}}, {'set': {'name': 'TSIM_KSMS_POST_42', 'elem': [
+            {'elem': {'val': {'concat': ['10.2.1.5', 'tcp', 80]}, 'counter': {'packets': 2, 'bytes': 120}}},
+            {'elem': {'val': {'concat': ['10.2.1.5', 17, 53]}, 'counter': {'packets': 1, 'bytes': 60}}}]}}]}
+        self.assertEqual(ksms.parse_nft_set_counters(json.dumps(listed)),
+                         {('TSIM_KSMS_POST_42', 80, 'tcp'): 2, ('TSIM_KSMS_POST_42', 53, 'udp'): 1})
+        self.assertEqual(ksms.parse_nft_set_counters('not json'), {})
+
+    def test_02_probe_emitter_io(self):
+        """Test the native probe emitter stdin format and result parsing."""
+        from tsim.simulators import ksms_tester as ksms
+
+        services = [(80, 'tcp'), (53, 'udp')]
+        tokens = {(80, 'tcp'): {'dscp': 32, 'tos': 128}, (53, 'udp'): {'dscp': 33, 'tos': 132}}
+        self.assertEqual(ksms.probe_emitter_input(services, tokens), 'tcp 80 128\nudp 53 132\n')
+
+        output = ('{"port":80,"proto":"tcp","tos":128,"sport":40000,"result":"open","rtt_ms":0.2,"from":"10.2.1.5"}\n'
+                  '{"port":53,"proto":"udp","tos":132,"sport":40001,"result":"no_response"}\n'
+                  'garbage\n'
+                  '{"event":"summary","probes":2,"send_ms":0.05,"answered":1}\n')
+        results, summary = ksms.parse_probe_results(output)
+        self.assertEqual(results[(80, 'tcp')]['result'], 'open')
+        self.assertEqual(results[(53, 'udp')]['result'], 'no_response')
+        self.assertEqual(summary['answered'], 1)
+        self.assertFalse(ksms.probe_emitter_available('/nonexistent/probe_emitter'))
+
+    def test_03_job_tag(self):
+        """Test DSCP and IP ID job tags in chain names and matches."""
+        from tsim.simulators import ksms_tester as ksms
+
+        tag = ksms.JobTag(42)
+        self.assertEqual(str(tag), '42')
+        self.assertEqual(tag.nft_match(), 'ip dscp 42')
+
+        tag = ksms.JobTag(32, 'ipid', 1234)
+        self.assertEqual(str(tag), 'I1234')
+        self.assertEqual(tag.tos, 128)
+        self.assertEqual(tag.ip_id_match(), ['-m', 'u32', '--u32', '0x2&0xffff=0x4d2'])
+        self.assertEqual(ksms.counting_set_names(tag), ('TSIM_KSMS_PRE_I1234', 'TSIM_KSMS_POST_I1234'))
+        payload = ksms.counting_set_payload('nft', tag, '10.2.1.5', [(80, 'tcp')])
+        self.assertIn('table ip tsim_ksms_I1234 {', payload)
+        self.assertIn('ip dscp 32 ip id 1234 ip daddr . meta l4proto . th dport @TSIM_KSMS_PRE_I1234', payload)
+        with self.assertRaises(ValueError):
+            ksms.JobTag(32, 'ipid', None)
+
+    def test_04_virtual_sources(self):
+        """Test resolving virtual source injectors per router."""
+        from tsim.simulators import ksms_tester as ksms
+
+        hosts = {'pool-a1': {'primary_ip': '10.1.1.253/24', 'connected_to': 'hq-gw'},
+                 'pool-b2': {'primary_ip': '10.2.1.253/24', 'connected_to': 'br-gw'}}
+        self.assertEqual(ksms.resolve_virtual_sources(['hq-gw=pool-a1'], '10.1.1.100', hosts),
+                         {'hq-gw': 'pool-a1'})
+        self.assertEqual(ksms.resolve_virtual_sources([], '10.1.1.100', hosts), {})
+        for spec, src in (('hq-gw', '10.1.1.100'),             # no namespace
+                          ('br-gw=pool-a1', '10.1.1.100'),     # wrong router
+                          ('br-gw=pool-b2', '10.1.1.100'),     # outside subnet
+                          ('hq-gw=missing', '10.1.1.100')):
+            with self.assertRaises(ValueError):
+                ksms.resolve_virtual_sources([spec], src, hosts)
+
+    def test_05_probe_emitter_port_range(self):
+        """Test the probe emitter's source port range check at its boundary."""
+        import shutil
+        import subprocess
+        import tempfile
+
+        if not shutil.which('gcc'):
+            self.skipTest('gcc not available')
+        source = os.path.join(os.path.dirname(__file__), '..', 'src', 'utils', 'probe_emitter.c')
+        with tempfile.TemporaryDirectory() as temp_dir:
+            binary = os.path.join(temp_dir, 'probe_emitter')
+            subprocess.run(['gcc', '-O2', '-o', binary, source], check=True)
+
+            def run(count, *args):
+                return subprocess.run([binary, 'tsim-no-such-ns', '10.2.1.5', *args],
+                                      input='tcp 80 0\n' * count, capture_output=True, text=True).stderr
+
+            # Range errors come before the namespace check
+            self.assertIn('non-existent namespace', run(45535))
+            self.assertIn('45536 probes do not fit above port 20000', run(45536))
+            self.assertIn('do not fit', run(65535))
+            self.assertIn('non-existent namespace', run(45536, '--sport-base', '1024'))
+            self.assertIn('too high for 64512 probes', run(64512, '--sport-base', '1024'))
+
+
+def main():
+    """Run the test suite."""
+    # Change to script directory for relative paths
+    script_dir = os.path.dirname(os.path.abspath(__file__))
+    os.chdir(os.path.dirname(script_dir))
+    
+    unittest.main(verbosity=2)
+
+
+if __name__ == '__main__':
+    main()
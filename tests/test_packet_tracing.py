@@ -12,6 +12,7 @@ Test Categories:
 4. Performance Tests - Tracing efficiency and scale
 5. Real-time Tests - Live packet monitoring
 6. Export Tests - Trace data export functionality
+7. Compiled Classifier Tests - Compiled FORWARD evaluation and path verdicts
 
 Author: Network Analysis Tool
 License: MIT
@@ -31,7 +32,62 @@ from unittest.mock import patch, MagicMock
 sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'src'))
 
 from core.packet_tracer import PacketTracerEngine, PacketTrace, PacketHop
+from core.trace_store import TraceStore
 from core.rule_database import RuleDatabase, IptablesRule, RoutingEntry, PolicyRule
+from tsim.analyzers.iptables_forward_analyzer import IptablesForwardAnalyzer
+from tsim.analyzers.iptables_classifier import IptablesClassifier, Flow
+from tsim.analyzers.iptables_shadow_analyzer import RuleShadowAnalyzer
+
+
+def write_router_facts(facts_dir, router_name, forward_rules, custom_chains=None,
+                       ipsets=None, routes=None):
+    """Write a minimal unified facts file with structured iptables rules."""
+    table = {'FORWARD': forward_rules}
+    table.update(custom_chains or {})
+    facts = {
+        'firewall': {
+            'iptables': {'available': True, 'filter': [table]},
+            'ipset': {'available': True, 'lists': [{name: info} for name, info in (ipsets or {}).items()]}
+        },
+        'routing': {'tables': routes or []}
+    }
+    with open(os.path.join(facts_dir, f"{router_name}.json"), 'w') as f:
+        json.dump(facts, f)
+
+
+def sample_forward_rules():
+    """Small FORWARD chain exercising jumps, ipsets, ports, states and interfaces."""
+    return {
+        'forward': [
+            {'number': 1, 'target': 'ACCEPT', 'state': ['RELATED', 'ESTABLISHED']},
+            {'number': 2, 'target': 'LOG', 'protocol': 'tcp', 'source': '10.1.0.0/16'},
+            {'number': 3, 'target': 'MGMT', 'protocol': 'tcp', 'destination': '10.2.1.0/24'},
+            {'number': 4, 'target': 'DROP', 'extensions': {'match_sets': [{'set_name': 'blocked', 'direction': 'src'}]}},
+            {'number': 5, 'target': 'ACCEPT', 'protocol': 'tcp', 'source': '10.1.1.0/24', 'dports': '80,443,8000:8080'},
+            {'number': 6, 'target': 'REJECT', 'protocol': 'udp', 'out_interface': 'eth2'},
+            {'number': 7, 'target': 'ACCEPT', 'protocol': 'icmp'},
+            {'number': 8, 'target': 'DROP'}
+        ],
+        'chains': {
+            'MGMT': [
+                {'number': 1, 'target': 'RETURN', 'source': '10.1.9.0/24'},
+                {'number': 2, 'target': 'ACCEPT', 'dport': '22',
+                 'extensions': {'match_sets': [{'set_name': 'admins', 'direction': 'src'}]}},
+                {'number': 3, 'target': 'ACCEPT', 'extensions': {
+                    'match_sets': [{'set_name': 'services', 'direction': 'dst,dst'}]}}
+            ]
+        },
+        'ipsets': {
+            'blocked': {'type': 'hash:net', 'members': ['10.1.66.0/24', '10.1.77.7']},
+            'admins': {'type': 'hash:ip', 'members': ['10.1.1.10', '10.1.1.11']},
+            'services': {'type': 'hash:ip,port', 'members': ['10.2.1.5,tcp:3306', '10.2.1.6,udp:53']}
+        },
+        'routes': [
+            {'dst': 'default', 'dev': 'eth0'},
+            {'dst': '10.1.0.0/16', 'dev': 'eth1'},
+            {'dst': '10.2.0.0/16', 'dev': 'eth2'}
+        ]
+    }
 
 
 class TestPacketTracerEngine(unittest.TestCase):
@@ -286,6 +342,88 @@ class TestPacketTracerEngine(unittest.TestCase):
         rtt1 = self.tracer._calculate_rtt(hop, 1)
         rtt3 = self.tracer._calculate_rtt(hop, 3)
         self.assertLess(rtt1, rtt3)  # RTT should increase with distance
+    
+    def _completed_trace(self, trace_id, source_ip='10.1.1.1', dest_ip='10.2.1.1', status='completed'):
+        trace = PacketTrace(trace_id=trace_id, source_ip=source_ip, dest_ip=dest_ip,
+                            protocol='tcp', dest_port=443)
+        for number in range(1, 4):
+            hop = PacketHop(number, f'router-{number}', f'10.0.0.{number}', interface_in='eth0')
+            hop.rtt_ms = number * 0.5
+            hop.iptables_decision = 'ACCEPT'
+            hop.iptables_rule = f'FORWARD:{number}'
+            trace.hops.append(hop)
+        trace.end_time = datetime.now()
+        trace.status = status
+        return trace
+    
+    def test_11_trace_store_budget_and_indexes(self):
+        """Test trace store LRU budget and secondary indexes."""
+        store = TraceStore(max_bytes=4096)
+        for i in range(50):
+            status = 'completed' if i % 2 else 'dropped'
+            store[f't{i}'] = self._completed_trace(f't{i}', dest_ip=f'10.2.1.{i % 5}', status=status)
+        
+        self.assertLessEqual(store.bytes_used, 4096)
+        self.assertGreater(store.evictions, 0)
+        self.assertIn('t49', store)
+        self.assertNotIn('t0', store)
+        
+        # Indexed queries only return stored traces
+        dropped = store.query(status='dropped')
+        self.assertTrue(dropped)
+        self.assertTrue(all(store.peek(t).status == 'dropped' for t in dropped))
+        by_dest = store.query(dest_ip='10.2.1.4', status='completed')
+        self.assertTrue(all(store.peek(t).dest_ip == '10.2.1.4' for t in by_dest))
+        
+        # Reading a trace refreshes it so it survives eviction
+        oldest = next(iter(store))
+        _ = store[oldest]
+        store['new'] = self._completed_trace('new')
+        self.assertIn(oldest, store)
+        
+        # Evicted, replaced and deleted traces do not pile up in the age heap
+        for i in range(2000):
+            store[f'many{i % 1500}'] = self._completed_trace(f'many{i % 1500}')
+        del store[next(iter(store))]
+        self.assertLessEqual(len(store._age_heap), 2 * len(store) + 16)
+        stored = len(store)
+        self.assertEqual(store.evict_older_than(datetime.now() + timedelta(seconds=1)), stored)
+        
+        # Engine list_traces uses the indexes
+        self.tracer.completed_traces['x1'] = self._completed_trace('x1', source_ip='10.9.9.9')
+        self.tracer.completed_traces['x2'] = self._completed_trace('x2', status='dropped')
+        self.assertEqual([t.trace_id for t in self.tracer.list_traces(source_ip='10.9.9.9')], ['x1'])
+        self.assertEqual([t.trace_id for t in self.tracer.list_traces(status='dropped')], ['x2'])
+    
+    def test_12_trace_store_streaming_export(self):
+        """Test streamed JSON and binary export of stored traces."""
+        import io
+        original = self._completed_trace('stream_trace')
+        self.tracer.completed_traces['stream_trace'] = original
+        self.tracer.completed_traces['other'] = self._completed_trace('other', status='dropped')
+        
+        # Streamed single-trace JSON is identical in content to to_dict()
+        self.assertEqual(json.loads(self.tracer.export_trace('stream_trace', 'json')), original.to_dict())
+        
+        out = io.StringIO()
+        self.tracer.export_traces(out, 'json', status='completed')
+        exported = json.loads(out.getvalue())
+        self.assertEqual([t['trace_id'] for t in exported], ['stream_trace'])
+        self.assertEqual(exported[0]['hops'][2]['iptables_rule'], 'FORWARD:3')
+        
+        binary = io.BytesIO()
+        self.tracer.export_traces(binary, 'binary')
+        binary.seek(0)
+        restored = list(TraceStore.read_binary(binary))
+        self.assertEqual([t.trace_id for t in restored], ['stream_trace', 'other'])
+        self.assertEqual(restored[0].to_dict(), original.to_dict())
+        
+        # Over-long strings are truncated on a character boundary
+        from core.trace_store import encode_trace, decode_trace
+        long_trace = self._completed_trace('long_trace')
+        long_trace.hops[0].policy_rule = 'a' + '\u00e9' * 40000
+        decoded = decode_trace(encode_trace(long_trace)).hops[0].policy_rule
+        self.assertEqual(decoded, 'a' + '\u00e9' * 32766)
 
 
 class TestRuleDatabase(unittest.TestCase):
@@ -745,6 +883,337 @@ class TestPacketTracingIntegration(unittest.TestCase):
         self.assertEqual(hop_dict['iptables_decision'], 'ACCEPT')
 
 
+class TestCompiledClassifier(unittest.TestCase):
+    """Test suite for the compiled FORWARD classifier and whole-path evaluation."""
+    
+    def setUp(self):
+        """Write synthetic router facts."""
+        self.temp_dir = tempfile.TemporaryDirectory()
+        sample = sample_forward_rules()
+        write_router_facts(self.temp_dir.name, 'fw1', sample['forward'], sample['chains'],
+                           sample['ipsets'], sample['routes'])
+        self.analyzer = IptablesForwardAnalyzer(self.temp_dir.name, 'fw1', 0)
+        self.classifier = IptablesClassifier.from_analyzer(self.analyzer)
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def test_01_verdicts_match_analyzer(self):
+        """Test compiled verdicts are identical to the interpreting analyzer."""
+        ips = ['10.1.1.10', '10.1.1.20', '10.1.9.1', '10.1.66.3', '10.1.77.7',
+               '10.2.1.5', '10.2.1.6', '10.2.7.1', '192.168.1.1']
+        ports = [None, 22, 53, 80, 443, 3306, 8001, 9000]
+        checked = 0
+        for src in ips:
+            for dst in ips:
+                for protocol in ['tcp', 'udp', 'icmp', 'all']:
+                    for dport in ports:
+                        for state in ['NEW', 'ESTABLISHED']:
+                            expected, _ = self.analyzer.analyze_packet(src, 1234, dst, dport, protocol, state)
+                            verdict = self.classifier.classify(src, 1234, dst, dport, protocol, state)
+                            self.assertEqual(verdict.allowed, expected,
+                                             f"{src}->{dst} {protocol}/{dport} {state}: {verdict}")
+                            checked += 1
+        self.assertGreater(checked, 1000)
+    
+    def test_02_matching_rule_ids(self):
+        """Test matching rule IDs include jumps, logs and the terminal rule."""
+        verdict = self.classifier.classify('10.1.1.10', 1234, '10.2.1.9', 22, 'tcp')
+        self.assertTrue(verdict.allowed)
+        self.assertEqual(verdict.rule_ids, ['FORWARD:2', 'FORWARD:3', 'MGMT:2'])
+        self.assertEqual(verdict.terminal_rule, 'MGMT:2')
+        
+        verdict = self.classifier.classify('10.1.9.1', 1234, '10.2.1.9', 22, 'tcp')
+        self.assertEqual(verdict.action, 'DROP')
+        self.assertEqual(verdict.rule_ids, ['FORWARD:2', 'FORWARD:3', 'MGMT:1', 'FORWARD:8'])
+        
+        verdict = self.classifier.classify('10.1.1.10', 1234, '10.2.7.1', 53, 'udp')
+        self.assertEqual(verdict.action, 'REJECT')
+        
+        with self.assertRaises(ValueError):
+            self.classifier.classify('not-an-ip', None, '10.2.1.1', None, 'tcp')
+    
+    def test_03_evaluate_path(self):
+        """Test whole-path evaluation stops at the first denying router."""
+        sample = sample_forward_rules()
+        write_router_facts(self.temp_dir.name, 'fw2', [{'number': 1, 'target': 'DROP', 'protocol': 'udp'}],
+                           routes=sample['routes'])
+        tracer = PacketTracerEngine(facts_dir=self.temp_dir.name, verbose=False, verbose_level=0)
+        hops = [
+            {'router': 'fw1', 'ip': '10.1.1.1', 'interface_in': 'eth1', 'interface_out': 'eth2',
+             'next_hop': '10.2.1.1', 'local': False},
+            {'router': 'fw2', 'ip': '10.2.1.1', 'interface_in': 'eth1', 'interface_out': 'eth2',
+             'next_hop': None, 'local': False}
+        ]
+        with patch.object(tracer, '_router_hops', return_value=(hops, True)):
+            result = tracer.evaluate_path('10.1.1.10', '10.2.1.9', 'tcp', dest_port=22)
+            self.assertTrue(result.allowed)
+            self.assertEqual([hop.verdict for hop in result.hops], ['ACCEPT', 'POLICY'])
+            self.assertEqual(result.hops[0].rule_ids[-1], 'MGMT:2')
+            
+            result = tracer.evaluate_path('10.1.1.10', '10.2.1.6', 'udp', dest_port=53)
+            self.assertFalse(result.allowed)
+            self.assertEqual(result.blocked_at, 'fw1')
+            self.assertEqual(len(result.hops), 1)
+            
+            flows = [Flow('10.1.1.10', '10.2.1.5', 'tcp', None, 3306),
+                     Flow('10.1.1.10', '10.2.1.5', 'udp', None, 123)]
+            results = tracer.evaluate_paths(flows)
+            self.assertEqual([r.allowed for r in results], [True, False])
+            self.assertIn('hops', results[0].to_dict())
+        
+        # A router owning the destination is not classified through FORWARD,
+        # neither by evaluate_path nor by trace_packet_path
+        write_router_facts(self.temp_dir.name, 'fw3', [{'number': 1, 'target': 'DROP'}],
+                           routes=sample['routes'])
+        tracer = PacketTracerEngine(facts_dir=self.temp_dir.name, verbose=False, verbose_level=0)
+        hops = [dict(hops[0], next_hop='10.2.1.9'),
+                {'router': 'fw3', 'ip': '10.2.1.9', 'interface_in': 'eth1', 'interface_out': None,
+                 'next_hop': None, 'local': True}]
+        with patch.object(tracer, '_router_hops', return_value=(hops, True)):
+            result = tracer.evaluate_path('10.1.1.10', '10.2.1.9', 'tcp', dest_port=22)
+            self.assertTrue(result.allowed)
+            self.assertEqual([hop.verdict for hop in result.hops], ['ACCEPT', 'LOCAL'])
+            
+            trace = tracer.trace_packet_path(tracer.start_trace('10.1.1.10', '10.2.1.9', 'tcp', dest_port=22))
+            self.assertEqual(trace.status, 'completed')
+            self.assertEqual([hop.iptables_decision for hop in trace.hops], ['ACCEPT', 'ACCEPT'])
+        
+        # Route lookups are cached per pair up to a bounded number of pairs
+        tracer.ROUTE_CACHE_LIMIT = 2
+        for host in range(1, 6):
+            tracer._router_hops('10.1.1.10', f'10.2.1.{host}')
+            self.assertLessEqual(len(tracer.route_cache), 2)
+        self.assertIn(('10.1.1.10', '10.2.1.5'), tracer.route_cache)
+    
+    def test_04_rule_profiling(self):
+        """Test per-rule counters, never-hit rules and hot-rule reordering hints."""
+        self.classifier.enable_profiling()
+        for host in range(1, 101):
+            self.classifier.classify(f'10.3.1.{host}', None, '10.2.7.1', None, 'icmp')
+        self.classifier.classify('10.1.1.10', 1234, '10.2.1.9', 22, 'tcp')
+        
+        snapshot = {r['rule_id']: r for r in self.classifier.profile_snapshot()['rules']}
+        self.assertEqual(self.classifier.flows_classified, 101)
+        self.assertEqual(snapshot['FORWARD:7']['matches'], 100)
+        self.assertEqual(snapshot['FORWARD:1']['evaluations'], 101)
+        self.assertEqual(snapshot['MGMT:2']['matches'], 1)
+        
+        report = self.classifier.profile_report(hot_fraction=0.5, min_depth=5)
+        never_hit = {r['rule_id'] for r in report['never_hit']}
+        self.assertIn('FORWARD:4', never_hit)
+        self.assertNotIn('FORWARD:7', never_hit)
+        hot = {r['rule_id']: r for r in report['hot_deep']}
+        # ICMP ACCEPT may not move above the udp REJECT: a protocol 'all' packet
+        # routed out of eth2 matches both, and the REJECT decides it today
+        self.assertEqual(hot['FORWARD:7']['safe_position'], 7)
+        self.assertEqual(hot['FORWARD:7']['estimated_evaluations_saved'], 0)
+        self.assertEqual(self.classifier.classify('10.3.1.1', None, '10.2.7.1', None, 'all').terminal_rule,
+                         'FORWARD:6')
+        
+        # Only addresses and states prove rules disjoint; protocols, ports and
+        # interfaces are skipped for protocol 'all', port-less or unrouted packets
+        compile_rule = self.classifier.compile_rule_spec
+        tcp_web = compile_rule('FORWARD', '-s 10.1.0.0/16 -p tcp --dport 80 -j ACCEPT')
+        self.assertTrue(tcp_web.may_overlap(compile_rule('FORWARD', '-p udp --dport 53 -o eth1 -j DROP')))
+        self.assertFalse(tcp_web.may_overlap(compile_rule('FORWARD', '-s 10.9.0.0/16 -p tcp -j DROP')))
+        
+        self.classifier.reset_profile()
+        self.assertEqual(self.classifier.flows_classified, 0)
+        self.assertTrue(all(r['evaluations'] == 0 for r in self.classifier.profile_snapshot()['rules']))
+        
+        tracer = PacketTracerEngine(facts_dir=self.temp_dir.name, verbose=False, verbose_level=0)
+        tracer.enable_rule_profiling()
+        tracer.get_classifier('fw1').classify('10.1.1.10', None, '10.2.7.1', None, 'icmp')
+        self.assertEqual(tracer.export_rule_profiles()['fw1']['flows_classified'], 1)
+        self.assertIn('fw1', tracer.rule_profile_report())
+    
+    def test_05_shadow_analysis_and_pruning(self):
+        """Test shadowed, redundant and dead rules are found and pruned without changing verdicts."""
+        sample = sample_forward_rules()
+        forward = [
+            {'number': 1, 'target': 'ACCEPT', 'protocol': 'tcp', 'source': '10.1.0.0/16', 'dports': '80,443'},
+            {'number': 2, 'target': 'ACCEPT', 'protocol': 'tcp', 'source': '10.1.1.0/24', 'dport': '443'},
+            {'number': 3, 'target': 'DROP', 'protocol': 'tcp', 'source': '10.1.1.5', 'dport': '443'},
+            {'number': 4, 'target': 'DROP', 'extensions': {'match_sets': [{'set_name': 'blocked', 'direction': 'src'}]}},
+            {'number': 5, 'target': 'DROP', 'protocol': 'udp', 'source': '10.1.66.0/25'},
+            {'number': 6, 'target': 'ACCEPT', 'extensions': {'match_sets': [{'set_name': 'missing', 'direction': 'src'}]}},
+            {'number': 7, 'target': 'LOG', 'protocol': 'tcp', 'source': '10.1.2.0/24', 'dport': '80'},
+            {'number': 8, 'target': 'ACCEPT', 'protocol': 'udp', 'source': '10.1.0.0/16', 'out_interface': 'eth2'},
+            {'number': 9, 'target': 'REJECT', 'protocol': 'udp', 'source': '10.1.3.0/24', 'out_interface': 'eth2'},
+            {'number': 10, 'target': 'DROP', 'protocol': 'udp', 'source': '10.1.3.0/24'}
+        ]
+        write_router_facts(self.temp_dir.name, 'fw3', forward, ipsets=sample['ipsets'], routes=sample['routes'])
+        classifier = IptablesClassifier.from_facts(self.temp_dir.name, 'fw3')
+        report = RuleShadowAnalyzer(classifier).analyze()
+        findings = {f.rule_id: (f.category, f.covered_by) for f in report.findings}
+        self.assertEqual(findings, {
+            'FORWARD:2': ('redundant', 'FORWARD:1'),
+            'FORWARD:3': ('shadowed', 'FORWARD:1'),
+            'FORWARD:5': ('redundant', 'FORWARD:4'),
+            'FORWARD:6': ('dead', None),
+            'FORWARD:7': ('shadowed', 'FORWARD:1'),
+            'FORWARD:9': ('shadowed', 'FORWARD:8')
+        })
+        
+        pruned = IptablesClassifier.from_facts(self.temp_dir.name, 'fw3', prune=True)
+        self.assertEqual(pruned.rule_count, 4)
+        self.assertEqual([rule.position for rule in pruned.forward_rules], [1, 2, 3, 4])
+        last = pruned.forward_rules[-1]
+        self.assertEqual(last.rule_id, 'FORWARD:10')
+        self.assertEqual(pruned.earliest_safe_position(last), 4)
+        for src in ['10.1.1.5', '10.1.2.9', '10.1.3.1', '10.1.66.7', '10.2.1.1']:
+            for dst in ['10.2.1.5', '192.168.1.1']:
+                for protocol in ['tcp', 'udp', 'all']:
+                    for dport in [None, 80, 443, 53]:
+                        full = classifier.classify(src, 1234, dst, dport, protocol)
+                        fast = pruned.classify(src, 1234, dst, dport, protocol)
+                        self.assertEqual((full.action, full.rule_ids), (fast.action, fast.rule_ids))
+        
+        tracer = PacketTracerEngine(facts_dir=self.temp_dir.name, verbose=False, verbose_level=0,
+                                    prune_rules=True)
+        self.assertEqual(tracer.get_classifier('fw3').rule_count, 4)
+    
+    def test_06_what_if_edits(self):
+        """Test what-if edits re-evaluate only affected flows and report verdict changes."""
+        flows = [Flow(f'10.1.{net}.{host}', '10.2.1.9', protocol, None, dport)
+                 for net in (1, 2, 9) for host in (10, 11, 20)
+                 for protocol, dport in (('tcp', 22), ('tcp', 80), ('udp', 53), ('icmp', None))]
+        tracer = PacketTracerEngine(facts_dir=self.temp_dir.name, verbose=False, verbose_level=0)
+        session = tracer.what_if_session('fw1', flows)
+        self.assertIsNot(session.classifier, tracer.get_classifier('fw1'))
+        
+        # Deleting the ICMP accept only touches the 9 ICMP flows
+        result = session.delete_rule('FORWARD:7')
+        self.assertEqual(result.flows_reevaluated, 9)
+        self.assertEqual(len(result.changes), 9)
+        self.assertTrue(all(c.before.allowed and not c.after.allowed for c in result.changes))
+        
+        # A DROP for one host at the top only affects that host's flows
+        result = session.insert_rule('FORWARD', 1, '-s 10.1.1.10 -p tcp -j DROP')
+        self.assertEqual(result.rule_id, 'FORWARD:9')
+        self.assertEqual(result.flows_reevaluated, 2)
+        self.assertEqual({c.flow.dest_port for c in result.changes}, {22, 80})
+        
+        # Opening SSH in MGMT for everyone changes the non-admin flows
+        result = session.modify_rule('MGMT:2', '-p tcp --dport 22 -j ACCEPT')
+        changed = {c.flow.src_ip for c in result.changes}
+        self.assertEqual(changed, {'10.1.1.20', '10.1.2.10', '10.1.2.11', '10.1.2.20'})
+        rules, index = session.classifier.find_rule('MGMT:2')
+        self.assertEqual((index, rules[index].dport), (1, ((22, 22),)))
+        
+        # Cached verdicts stay identical to a full re-evaluation
+        for index, flow in enumerate(flows):
+            self.assertEqual(session.verdicts[index].rule_ids, session.classifier.classify_flow(flow).rule_ids)
+        
+        for _ in range(3):
+            session.undo()
+        self.assertIsNone(session.undo())
+        for index, flow in enumerate(flows):
+            self.assertEqual(session.verdicts[index].action, self.classifier.classify_flow(flow).action)
+        
+        with self.assertRaises(ValueError):
+            session.delete_rule('FORWARD:99')
+        with self.assertRaises(ValueError):
+            session.insert_rule('FORWARD', 1, '-s 10.1.1.10')
+
+    def test_07_log_rule_correlation(self):
+        """Test log rows are mapped to their LOG rule and deciding rule."""
+        from tsim.analyzers.iptables_log_columnar import ColumnarLogParser
+        from tsim.analyzers.iptables_log_aggregate import RuleCorrelator, LogAggregator
+        from tsim.analyzers.iptables_log_processor import IptablesLogProcessor
+        
+        rule = self.classifier.compile_rule_spec('FORWARD', '-p udp -j LOG --log-prefix "FWD-UDP: "')
+        self.classifier.insert_compiled(rule, 0)
+        lines = [
+            "Jul  1 10:30:15 fw1 kernel: FWD-UDP: IN=eth1 OUT=eth2 SRC=10.1.1.20 DST=10.2.1.5 "
+            "LEN=60 TTL=64 PROTO=UDP SPT=1000 DPT=53",
+            "Jul  1 10:30:16 fw1 kernel: FWD-TCP: IN=eth1 OUT=eth2 SRC=10.1.1.20 DST=10.2.1.5 "
+            "LEN=60 TTL=64 PROTO=TCP SPT=1000 DPT=80",
+            "Jul  1 10:30:17 fw1 kernel: FWD-TCP: IN=eth1 OUT=eth2 SRC=10.1.66.3 DST=10.2.7.1 "
+            "LEN=60 TTL=64 PROTO=TCP SPT=1000 DPT=80",
+            "Jul  1 10:30:18 fw2 kernel: FWD-TCP: IN=eth1 OUT=eth2 SRC=10.1.66.3 DST=10.2.7.1 "
+            "LEN=60 TTL=64 PROTO=TCP SPT=1000 DPT=80"
+        ]
+        batch = ColumnarLogParser(2025).parse_bytes(('\n'.join(lines) + '\n').encode())
+        correlator = RuleCorrelator({'fw1': self.classifier})
+        rules = correlator.correlate(batch)
+        self.assertEqual([rules.names[i] for i in rules.rule], [rule.rule_id, 'FORWARD:2', 'FORWARD:2', None])
+        self.assertEqual([rules.names[i] for i in rules.decision], ['FORWARD:6', 'FORWARD:5', 'FORWARD:4', None])
+        
+        # Header caches live only as long as their batch
+        import gc
+        extra = ColumnarLogParser(2025).parse_bytes((lines[0] + '\n').encode())
+        self.assertEqual([rules.names[i] for i in correlator.correlate(extra).rule], [rule.rule_id])
+        self.assertEqual(len(correlator._cache), 2)
+        del extra
+        gc.collect()
+        self.assertEqual(len(correlator._cache), 1)
+        
+        counts = LogAggregator(batch, rules).group_by(['router', 'rule']).rows()
+        self.assertEqual(counts[0], {'router': 'fw1', 'rule': 'FORWARD:2', 'count': 2})
+        self.assertEqual(len(counts), 3)
+        
+        processor = IptablesLogProcessor()
+        processor.attach_classifier(self.classifier)
+        correlated = processor.correlate_with_rules(
+            [processor.parse_log_line(line, None) for line in lines[:3]])
+        self.assertEqual([c['rule_id'] for c in correlated], [rule.rule_id, 'FORWARD:2', 'FORWARD:2'])
+        self.assertEqual([c['decision'] for c in correlated], ['REJECT', 'ACCEPT', 'DROP'])
+        self.assertEqual(correlated[1]['matched_rules'],
+                         self.classifier.classify('10.1.1.20', 1000, '10.2.1.5', 80, 'tcp').rule_ids)
+
+    def test_08_live_rule_trace(self):
+        """Test TRACE events are attributed to rules and drive hop decisions."""
+        from tsim.core.rule_trace_collector import RuleTraceCollector
+
+        def nflog(prefix, protocol='tcp', dst='10.2.1.5', dport=80):
+            return json.dumps({'event': 'trace', 'source': 'nflog', 'namespace': 'fw1', 'time': 1.0,
+                               'prefix': prefix, 'dscp': 42, 'protocol': protocol,
+                               'src': '10.1.1.20', 'dst': dst, 'sport': 1000, 'dport': dport})
+
+        def nftrace(handle, verdict, trace_type='rule', headers=True, trace_id=7):
+            # nf_tables sends packet headers only with the first event of a chain evaluation
+            data = {'event': 'trace', 'source': 'nftrace', 'namespace': 'fw1', 'time': 2.0,
+                    'id': trace_id, 'table': 'filter', 'chain': 'FORWARD', 'type': trace_type,
+                    'handle': handle, 'verdict': verdict}
+            if headers:
+                data.update({'dscp': 42, 'protocol': 'udp', 'src': '10.1.1.20', 'dst': '10.2.1.6',
+                             'sport': 1000, 'dport': 53})
+            return json.dumps(data)
+
+        collector = RuleTraceCollector(['fw1'], 42)
+        collector._handle_positions[('fw1', 'filter', 'FORWARD')] = {10: 2, 17: 6}
+        self.assertIsNone(collector.ingest('fw1', '{"event":"ready","source":"nflog"}'))
+        self.assertIsNone(collector.ingest('fw1', nflog('FWD-TCP: ')))
+        for prefix in ['TRACE: raw:PREROUTING:policy:2 ', 'TRACE: filter:FORWARD:rule:2 ',
+                       'TRACE: filter:FORWARD:rule:3 ', 'TRACE: filter:MGMT:return:4 ',
+                       'TRACE: filter:FORWARD:rule:5 ']:
+            collector.ingest('fw1', nflog(prefix))
+        collector.ingest('fw1', nftrace(10, 'continue'))
+        collector.ingest('fw1', nftrace(10, 'accept', headers=False, trace_id=8))
+        event = collector.ingest('fw1', nftrace(17, 'drop', headers=False))
+        self.assertEqual((event.rule_id, event.decision, event.dst_port), ('FORWARD:6', 'DROP', 53))
+        self.assertEqual(len(collector.events), 8)
+        self.assertEqual([e.handle for e in collector.packet_events('fw1', '10.1.1.20', '10.2.1.6', 'udp', 53)],
+                         [10, 17])
+        self.assertEqual([e.rule_id for e in collector.packet_events('fw1', '10.1.1.20', '10.2.1.5', 'tcp', 80)],
+                         [None, 'FORWARD:2', 'FORWARD:3', None, 'FORWARD:5'])
+        self.assertEqual(collector.terminal_event('fw1', '10.1.1.20', '10.2.1.5', 'tcp', 80).rule_id, 'FORWARD:5')
+        self.assertIsNone(collector.terminal_event('fw1', '10.1.1.20', '10.2.1.5', 'tcp', 443))
+
+        engine = PacketTracerEngine(facts_dir=self.temp_dir.name)
+        engine.router_classifiers['fw1'] = self.classifier
+        engine.attach_rule_trace(collector)
+        for protocol, dst, dport, rule_id, decision in [('tcp', '10.2.1.5', 80, 'FORWARD:5', 'ACCEPT'),
+                                                        ('udp', '10.2.1.6', 53, 'FORWARD:6', 'REJECT')]:
+            trace = PacketTrace('t1', '10.1.1.20', dst, protocol, source_port=1000, dest_port=dport)
+            hop = PacketHop(hop_number=1, router_name='fw1', router_ip='10.1.1.1')
+            engine._correlate_real_time_logs(trace, hop)
+            self.assertEqual((hop.iptables_rule, hop.iptables_decision, hop.iptables_table),
+                             (rule_id, decision, 'filter'))
+
+
 def main():
     """Run the test suite."""
     # Change to script directory for relative paths
@@ -1,4 +1,5 @@
 import sys
+import json
 import time
 from pathlib import Path
 import tempfile
@@ -28,6 +29,7 @@ def test_fifo_and_single_run_execution():
         cfg.set('run_dir', str(run_dir))
         cfg.set('lock_dir', str(lock_dir))
         cfg.set('session_dir', str(session_dir))
+        cfg.set('queue_journal', str(base / 'disk' / 'queue.journal'))
         cfg.set('session_timeout', 5)
 
         locks = TsimLockManagerService(cfg)
@@ -104,6 +106,7 @@ def test_same_user_multiple_jobs_queue_and_run_serially():
         cfg.set('run_dir', str(run_dir))
         cfg.set('lock_dir', str(lock_dir))
         cfg.set('session_dir', str(session_dir))
+        cfg.set('queue_journal', str(base / 'disk' / 'queue.journal'))
         cfg.set('session_timeout', 5)
 
         locks = TsimLockManagerService(cfg)
@@ -172,3 +175,437 @@ def test_active_run_clears_on_completion_cross_process():
         tracker_B.set_active_run_for_user('user1', run_id)
         # Now B should consult file and clear it
         assert tracker_B.get_active_run_for_user('user1') is None
+
+
+def test_doorbell_wakeup_and_leader_failover():
+    import os
+    import threading
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_config_service import TsimConfigService
+    from services.tsim_doorbell import TsimDoorbell
+    from services.tsim_lock_manager_service import TsimLockManagerService
+
+    with tempfile.TemporaryDirectory() as td:
+        base = Path(td)
+        bell = TsimDoorbell(base / 'doorbell')
+
+        # Ringing with nobody listening is a harmless no-op
+        assert bell.ring() is False
+
+        # A ring between "nothing to do" and wait() is not lost
+        bell.listen()
+        assert bell.ring() is True
+        assert bell.wait(5.0) is True
+        assert bell.wait(0.01) is False
+
+        # The waiter wakes on the ring, not on its timeout
+        woke = []
+        waiter = threading.Thread(target=lambda: woke.append((bell.wait(5.0), time.perf_counter())))
+        waiter.start()
+        time.sleep(0.1)
+        rung_at = time.perf_counter()
+        TsimDoorbell(base / 'doorbell').ring()
+        waiter.join(5.0)
+        assert woke and woke[0][0] is True
+        assert woke[0][1] - rung_at < 0.05, f"wakeup took {woke[0][1] - rung_at:.4f}s"
+        bell.close()
+
+        # A standby blocked on the leader lock takes over as soon as the leader dies
+        cfg = TsimConfigService()
+        cfg.set('lock_dir', str(base / 'locks'))
+        locks = TsimLockManagerService(cfg)
+        ready_r, ready_w = os.pipe()
+        die_r, die_w = os.pipe()
+        pid = os.fork()
+        if pid == 0:
+            child_locks = TsimLockManagerService(cfg)
+            child_locks.wait_for_lock('scheduler_leader')
+            os.write(ready_w, b'1')
+            os.read(die_r, 1)
+            os._exit(0)  # Dies holding the lock
+        os.read(ready_r, 1)
+        assert locks.is_locked('scheduler_leader')
+        killed_at = []
+        threading.Timer(0.1, lambda: (killed_at.append(time.perf_counter()), os.write(die_w, b'1'))).start()
+        assert locks.wait_for_lock('scheduler_leader')
+        took_over_at = time.perf_counter()
+        os.waitpid(pid, 0)
+        assert took_over_at - killed_at[0] < 0.1, f"takeover took {took_over_at - killed_at[0]:.4f}s"
+        locks.release_lock('scheduler_leader', unlink=False)
+        assert not locks.is_locked('scheduler_leader')
+
+
+def test_shm_queue_lanes_positions_and_journal_recovery():
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_config_service import TsimConfigService
+    from services.tsim_queue_service import TsimQueueService
+
+    with tempfile.TemporaryDirectory() as td:
+        base = Path(td)
+        cfg = TsimConfigService()
+        cfg.set('data_dir', str(base / 'data'))
+        cfg.set('run_dir', str(base / 'runs'))
+        cfg.set('queue_journal', str(base / 'disk' / 'queue.journal'))
+        cfg.set('queue_capacity', 16)
+
+        queue = TsimQueueService(cfg)
+        modes = ['detailed', 'quick', 'quick', 'detailed', 'quick']
+        for i, mode in enumerate(modes):
+            assert queue.enqueue(f'j{i}', f'user{i}', {'analysis_mode': mode}) == i + 1
+        # Re-enqueueing keeps the original place
+        assert queue.enqueue('j2', 'user2', {'analysis_mode': 'quick'}) == 3
+
+        assert queue.request_cancel('j1', 'admin')
+        assert [queue.get_position(f'j{i}') for i in range(5)] == [1, None, 2, 3, 4]
+        queue.update_status('j3', 'STARTING')
+        assert queue.has_user_job('user3') and not queue.has_user_job('user1')
+
+        # Head is detailed: exactly that job is popped
+        assert [j['run_id'] for j in queue.pop_compatible_jobs({})] == ['j0']
+        # Quick lane is popped past the queued detailed job
+        popped = queue.pop_compatible_jobs({}, max_jobs=8)
+        assert [j['run_id'] for j in popped] == ['j2', 'j4']
+        assert popped[0]['params'] == {'analysis_mode': 'quick'}
+
+        # Losing the shared-memory table: a new process replays the journal
+        for i in range(5, 20):
+            queue.enqueue(f'j{i}', 'burst', {'analysis_mode': 'quick'})
+        queue.table.close()
+        queue.table_file.unlink()
+        recovered = TsimQueueService(cfg)
+        jobs = recovered.list_jobs()
+        assert [j['run_id'] for j in jobs] == ['j3'] + [f'j{i}' for i in range(5, 20)]
+        assert jobs[0]['status'] == 'STARTING' and jobs[-1]['position'] == 16
+
+        # Draining the queue truncates the journal
+        while recovered.pop_next():
+            pass
+        assert recovered.journal_file.stat().st_size == 0
+
+        # Journal directory can't be created: fall back to the (volatile) data dir
+        (base / 'blocked').write_text('')
+        cfg.set('queue_journal', str(base / 'blocked' / 'queue.journal'))
+        assert TsimQueueService(cfg).journal_file == base / 'data' / 'queue' / 'queue.journal'
+
+
+def test_router_scoped_admission():
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_router_planner import select_admissible, job_hosts, PLANNED, PENDING, FAILED
+
+    plans = {
+        'run-d1': {'state': PLANNED, 'routers': frozenset({'r1', 'r2'})},
+        'q-d2': {'state': PLANNED, 'routers': frozenset({'r3'})},
+        'q-q1': {'state': PLANNED, 'routers': frozenset({'r1'})},
+        'q-q2': {'state': PLANNED, 'routers': frozenset({'r4'})},
+        'q-q3': {'state': PENDING, 'routers': None},
+        'q-d4': {'state': PENDING, 'routers': None},
+        'q-d5': {'state': PLANNED, 'routers': frozenset()},
+    }
+    plan_of = plans.get
+    job = lambda run_id, kind: {'run_id': run_id, 'type': kind}
+    running = {'run-d1': {'type': 'detailed'}}
+
+    # Hosts are named by router index, so jobs on disjoint routers still share source-1
+    assert job_hosts('detailed', frozenset({'r1', 'r2'})) == \
+        {'source-1', 'source-2', 'destination-1', 'destination-2'}
+    assert job_hosts('quick', frozenset({'r4'})) == {'source-1'}
+
+    # d2 shares no router with the running detailed job but would reuse its source-1;
+    # quick jobs collide with it the same way; d5 (no routers on its path) creates no
+    # hosts and is free; q3 has no routers yet so it must avoid detailed work; d4
+    # waits for planning without reserving
+    queued = [job('q-d2', 'detailed'), job('q-q2', 'quick'), job('q-d5', 'detailed'),
+              job('q-q3', 'quick'), job('q-d4', 'detailed')]
+    assert select_admissible(queued, running, plan_of, 10, 32) == ['q-d5']
+
+    # With nothing running d2 starts, and the quick jobs behind it may not take source-1
+    assert select_admissible(queued, {}, plan_of, 10, 32) == ['q-d2', 'q-d5']
+    # Quick jobs share pool hosts; quick concurrency and free slots are respected
+    quick = [job('q-q1', 'quick'), job('q-q2', 'quick'), job('q-q3', 'quick')]
+    assert select_admissible(quick, {}, plan_of, 10, 32) == ['q-q1', 'q-q2', 'q-q3']
+    assert select_admissible(quick, {}, plan_of, 10, 1) == ['q-q1']
+    assert select_admissible(quick, {}, plan_of, 2, 32) == ['q-q1', 'q-q2']
+    # An older detailed job that cannot start reserves its hosts ahead of later quick jobs
+    assert select_admissible([job('q-d2', 'detailed')] + quick, running, plan_of, 10, 32) == []
+
+    # A job whose path discovery failed runs exclusively, as before
+    plans['q-d2'] = {'state': FAILED, 'routers': None}
+    assert select_admissible(queued[:1], {'run-q': {'type': 'quick', 'routers': []}},
+                             plan_of, 10, 32) == []
+    assert select_admissible(queued[:2], {}, plan_of, 10, 32) == ['q-d2']
+
+
+def test_router_disjoint_detailed_jobs_do_not_share_hosts():
+    import json
+    import threading
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_config_service import TsimConfigService
+    from services.tsim_lock_manager_service import TsimLockManagerService
+    from services.tsim_queue_service import TsimQueueService
+    from services.tsim_progress_tracker import TsimProgressTracker
+    from services.tsim_scheduler_service import TsimSchedulerService
+
+    with tempfile.TemporaryDirectory() as td:
+        base = Path(td)
+        cfg = TsimConfigService()
+        for key in ('data_dir', 'run_dir', 'lock_dir', 'session_dir'):
+            (base / key).mkdir()
+            cfg.set(key, str(base / key))
+        cfg.set('queue_journal', str(base / 'disk' / 'queue.journal'))
+        cfg.set('wsgi_execution_mode', 'parallel')
+        cfg.set('wsgi_parallel_config', {'thread_pool_workers': 4, 'max_quick_jobs': 4,
+                                         'scheduling_policy': 'router'})
+
+        locks = TsimLockManagerService(cfg)
+        queue = TsimQueueService(cfg)
+        progress = TsimProgressTracker(cfg)
+        spans = {}
+        traces = {}
+
+        class FakeExecutor:
+            def execute(self, run_id, source_ip, dest_ip, source_port, port_protocol_list,
+                        user_trace_data=None, *args, **kwargs):
+                traces[run_id] = user_trace_data
+                start = time.time()
+                time.sleep(0.4)
+                spans[run_id] = (start, time.time())
+                return {'success': True}
+
+        scheduler = TsimSchedulerService(cfg, queue, progress, FakeExecutor(), locks)
+        scheduler.host_pool = None
+
+        def trace(*routers):
+            return json.dumps({'path': [{'name': r, 'is_router': True} for r in routers]})
+
+        jobs = {'det-a': trace('r1', 'r2'), 'det-b': trace('r3'), 'det-c': trace('r2', 'r3')}
+        for run_id, trace_data in jobs.items():
+            progress.create_run_directory(run_id)
+            queue.enqueue(run_id, 'user', {'run_id': run_id, 'analysis_mode': 'detailed',
+                                           'user_trace_data': trace_data})
+        scheduler.start()
+        t0 = time.time()
+        while len(spans) < 3 and time.time() - t0 < 10:
+            time.sleep(0.05)
+        scheduler.stop()
+
+        assert set(spans) == set(jobs)
+        # a and b share no router but both create source-1: no two of them overlap
+        ordered = sorted(spans.values())
+        assert all(prev[1] <= nxt[0] for prev, nxt in zip(ordered, ordered[1:]))
+        assert traces['det-a'] == jobs['det-a']
+
+
+def test_router_planning_only_next_to_detailed_jobs():
+    import json
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_config_service import TsimConfigService
+    from services.tsim_lock_manager_service import TsimLockManagerService
+    from services.tsim_queue_service import TsimQueueService
+    from services.tsim_progress_tracker import TsimProgressTracker
+    from services.tsim_scheduler_service import TsimSchedulerService
+    from services.tsim_router_planner import PENDING
+
+    with tempfile.TemporaryDirectory() as td:
+        base = Path(td)
+        cfg = TsimConfigService()
+        for key in ('data_dir', 'run_dir', 'lock_dir', 'session_dir'):
+            (base / key).mkdir()
+            cfg.set(key, str(base / key))
+        cfg.set('queue_journal', str(base / 'disk' / 'queue.journal'))
+        cfg.set('wsgi_execution_mode', 'parallel')
+        cfg.set('wsgi_parallel_config', {'thread_pool_workers': 4, 'max_quick_jobs': 4,
+                                         'scheduling_policy': 'router'})
+
+        queue = TsimQueueService(cfg)
+        progress = TsimProgressTracker(cfg)
+        scheduler = TsimSchedulerService(cfg, queue, progress, None, TsimLockManagerService(cfg))
+        routes = {'quick-c': ['r2'], 'det-d': ['r1']}
+        traced = []
+
+        def trace_fn(job):
+            traced.append(job['run_id'])
+            return json.dumps({'path': [{'name': r, 'is_router': True} for r in routes[job['run_id']]]})
+
+        scheduler.router_planner.trace_fn = trace_fn
+
+        def enqueue(run_id, mode):
+            progress.create_run_directory(run_id)
+            queue.enqueue(run_id, 'user', {'run_id': run_id, 'analysis_mode': mode})
+
+        # Quick jobs alone never conflict: no path discovery at all
+        enqueue('quick-a', 'quick')
+        enqueue('quick-b', 'quick')
+        jobs = scheduler._pop_router_scoped_jobs({}, 4)
+        assert [j['run_id'] for j in jobs] == ['quick-a', 'quick-b']
+        assert traced == [] and 'routers' not in jobs[0]
+
+        # With a detailed job queued, queued quick jobs are planned too and carry their routers
+        enqueue('quick-c', 'quick')
+        enqueue('det-d', 'detailed')
+        running = {'quick-a': {'type': 'quick', 'routers': None}}
+        assert scheduler._pop_router_scoped_jobs(running, 0) == []
+        t0 = time.time()
+        while any(scheduler.router_planner.plan_of(r)['state'] == PENDING for r in routes) and time.time() - t0 < 5:
+            time.sleep(0.01)
+        jobs = scheduler._pop_router_scoped_jobs(running, 4)
+        # det-d waits for quick-a, whose routers were never needed and are unknown
+        assert [(j['run_id'], j['routers']) for j in jobs] == [('quick-c', ['r2'])]
+        assert sorted(traced) == ['det-d', 'quick-c']
+
+        # Cached router sets stand in for dropped plans of running jobs (an empty
+        # path creates no hosts, so it is the only quick job det-d can run beside)
+        scheduler.router_planner.forget('quick-c')
+        running = {'quick-c': {'type': 'quick', 'routers': []}}
+        assert [j['run_id'] for j in scheduler._pop_router_scoped_jobs(running, 4)] == ['det-d']
+        assert sorted(traced) == ['det-d', 'quick-c']
+        scheduler.router_planner.shutdown()
+
+
+def test_progress_event_log_push_stream():
+    import threading
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_config_service import TsimConfigService
+    from services.tsim_progress_tracker import TsimProgressTracker
+    from services.tsim_progress_log import TsimProgressLogReader, KIND_FINAL
+    from handlers.tsim_progress_stream_handler import TsimProgressStreamHandler
+
+    with tempfile.TemporaryDirectory() as td:
+        run_dir = Path(td) / 'runs'
+        cfg = TsimConfigService()
+        cfg.set('run_dir', str(run_dir))
+        cfg.set('queue_journal', str(Path(td) / 'disk' / 'queue.journal'))
+        tracker = TsimProgressTracker(cfg)
+        run_id = 'run-P'
+        tracker.create_run_directory(run_id)
+
+        # Readers see each record once, in order
+        reader = TsimProgressLogReader(run_dir / run_id)
+        assert [e['phase'] for e in reader.read_new()] == ['START']
+        tracker.log_phase(run_id, 'parse_args', 'Parsing arguments', {'note': 'x' * 2000})
+        events = reader.read_new()
+        assert [e['phase'] for e in events] == ['parse_args']
+        assert events[0]['message'] == 'Parsing arguments' and 'details' not in events[0]
+        assert reader.read_new() == []
+
+        # A waiting reader wakes on the append, not on its timeout
+        woke = []
+        waiter = threading.Thread(target=lambda: woke.append((reader.wait(5.0), time.perf_counter())))
+        waiter.start()
+        time.sleep(0.1)
+        logged_at = time.perf_counter()
+        tracker.log_phase(run_id, 'MULTI_REACHABILITY_PHASE1_start', 'Phase 1')
+        waiter.join(5.0)
+        assert woke and woke[0][0] is True
+        assert woke[0][1] - logged_at < 0.05, f"wakeup took {woke[0][1] - logged_at:.4f}s"
+        assert [e['phase'] for e in reader.read_new()] == ['MULTI_REACHABILITY_PHASE1_start']
+
+        # Phase bursts coalesce into one deferred progress.json snapshot
+        snapshot = run_dir / run_id / 'progress.json'
+        for i in range(20):
+            tracker.log_phase(run_id, f'step{i}', '')
+        assert len(json.loads(snapshot.read_text())['phases']) < 20
+        tracker.mark_complete(run_id, True)
+        data = json.loads(snapshot.read_text())
+        assert data['complete'] is True and data['phases'][-1]['phase'] == 'TOTAL'
+        assert reader.read_new()[-1]['kind'] == KIND_FINAL
+        reader.close()
+
+        # The SSE stream replays the log and ends on the final record without polling
+        handler = TsimProgressStreamHandler(cfg, None, None, progress_tracker=tracker, queue_service=None)
+        started = time.perf_counter()
+        chunks = list(handler._stream_progress(run_id, {}))
+        assert time.perf_counter() - started < 1.0
+        payloads = [json.loads(c[6:]) for c in chunks if c.startswith(b'data: ')]
+        final = payloads[-1]
+        assert final['complete'] is True and final['success'] is True
+        assert final['phase'] == 'TOTAL' and final['percent'] == 100
+        assert [p['phase'] for p in final['all_phases']][:3] == ['START', 'parse_args', 'PHASE1_start']
+        assert final['redirect_url'] == f'/pdf_viewer_final.html?id={run_id}'
+
+
+def test_warm_host_pool_lease_and_recycle():
+    sys.path.insert(0, str(Path('wsgi').resolve()))
+    from services.tsim_config_service import TsimConfigService
+    from services.tsim_warm_host_pool import TsimWarmHostPool
+
+    registry = {}
+    commands = []
+
+    class FakeRegistry:
+        def list_all_hosts(self):
+            return dict(registry)
+
+        def unregister_host(self, host_name):
+            return registry.pop(host_name, None) is not None
+
+    class FakeHostManager:
+        # The router is .254 on this subnet, not .1
+        routers = {'r1': {'routing': {'tables': [
+            {'dst': '10.1.1.0/24', 'dev': 'eth1', 'protocol': 'kernel', 'scope': 'link',
+             'prefsrc': '10.1.1.254'}]}}}
+
+        def readdress_host(self, host_name, primary_ip):
+            ip = primary_ip.split('/')[0]
+            router = registry[host_name]['connected_to']
+            if any(h != host_name and i['primary_ip'].split('/')[0] == ip and i['connected_to'] == router
+                   for h, i in registry.items()):
+                return False
+            registry[host_name]['primary_ip'] = primary_ip
+            return True
+
+    def fake_exec(command, capture_output=False, verbose=0, env=None):
+        commands.append(command)
+        args = command.split()
+        if args[1] == 'add':
+            registry[args[3]] = {'primary_ip': args[5], 'connected_to': args[7]}
+            return '[SUCCESS]'
+        registry.pop(args[3], None)
+        return '[SUCCESS]'
+
+    cfg = TsimConfigService()
+    cfg.set('quick_job_warm_pool_size', 2)
+    pool = TsimWarmHostPool(cfg, FakeRegistry(), fake_exec, host_manager=FakeHostManager())
+
+    # Unknown subnet: miss, but demand is recorded and the pool fills
+    assert pool.lease('r1', '10.1.1.5', ['job-a']) is None
+    pool.note_demand('r1', '10.1.1.5')
+    registry['user-host'] = {'primary_ip': '10.1.1.253/24', 'connected_to': 'r1',
+                             'gateway_ip': '10.1.1.252'}
+    pool.maintain()
+    idle = pool.get_status()['subnets'][0]['idle']
+    assert len(idle) == 2
+    parked = {registry[h]['primary_ip'] for h in idle}
+    assert parked == {'10.1.1.251/24', '10.1.1.250/24'}
+
+    # Lease re-addresses; a second job with the same source shares the host
+    host = pool.lease('r1', '10.1.1.5', ['job-a'])
+    assert host in idle and registry[host]['primary_ip'] == '10.1.1.5/24'
+    assert pool.lease('r1', '10.1.1.5', ['job-b']) == host
+    # IP already used on the router: miss, host stays idle
+    assert pool.lease('r1', '10.1.1.253', ['job-c']) is None
+    assert pool.get_status()['leases'] == 1
+
+    # Release parks the host again instead of removing it
+    pool.release(host, 'job-a')
+    assert host in pool.get_status()['leased']
+    pool.release(host, 'job-b')
+    pool.maintain()
+    status = pool.get_status()
+    assert host in status['subnets'][0]['idle'] and not status['leased']
+    assert registry[host]['primary_ip'].split('/')[0] in {'10.1.1.251', '10.1.1.250'}
+    assert not any(c.startswith('host remove') for c in commands)
+
+    # Virtual sources share one injector per subnet without re-addressing it
+    injector = pool.injector('r1', '10.1.1.7', ['job-d'])
+    assert pool.injector('r1', '10.1.1.8', ['job-e']) == injector
+    assert registry[injector]['primary_ip'] in parked
+    pool.release(injector, 'job-d')
+    assert pool.get_status()['injector_jobs'] == {injector: ['job-e']}
+    pool.release(injector, 'job-e')
+
+    # Subnets not seen within the window are drained
+    pool.recent_window = 0
+    time.sleep(0.01)
+    pool.maintain()
+    assert pool.get_status()['host_count'] == 0
+    assert set(registry) == {'user-host'}
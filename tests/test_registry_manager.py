@@ -11,6 +11,8 @@ Tests cover:
 - Deadlock prevention
 - Transaction rollback
 - Concurrent access (multiple threads)
+- Journaled registry backend and shared-memory lock backend
+- Lock contention statistics
 """
 
 import unittest
@@ -21,6 +23,7 @@ import time
 import logging
 import threading
 from pathlib import Path
+from unittest import mock
 from typing import List
 
 # Import the module under test
@@ -33,7 +36,8 @@ from core.registry_manager import (
     TsimRegistryLockTimeout,
     TsimRegistryCollision,
     TsimRegistryCorruption,
-    TsimRegistryNotFound
+    TsimRegistryNotFound,
+    read_registry_file
 )
 
 
@@ -582,6 +586,385 @@ class TestRegistryManagerNeighborLeases(unittest.TestCase):
         self.assertFalse(should_delete)
 
 
+
+class TestRegistryManagerJournalBackend(unittest.TestCase):
+    """Test the write-ahead-log registry backend."""
+
+    def setUp(self):
+        """Create temporary directories for testing."""
+        self.test_dir = tempfile.mkdtemp()
+        self.registry_dir = Path(self.test_dir) / "registry"
+        self.lock_dir = Path(self.test_dir) / "locks"
+
+        self.config = {
+            'data_dir': str(self.registry_dir),
+            'lock_dir': str(self.lock_dir),
+            'registry_files': {
+                'hosts': str(self.registry_dir / 'host_registry.json'),
+                'host_leases': str(self.registry_dir / 'host_leases.json'),
+                'neighbor_leases': str(self.registry_dir / 'neighbor_leases.json')
+            },
+            'registry_manager': {
+                'enabled': True,
+                'backend': 'journal',
+                'wal_compact_interval': 0.2,
+                'wal_compact_bytes': 4096,
+                'wal_fsync': True
+            }
+        }
+
+        self.logger = logging.getLogger(__name__)
+        self.mgr = TsimRegistryManager(self.config, self.logger)
+        self.snapshot = self.registry_dir / 'host_registry.json'
+        self.wal = self.registry_dir / 'host_registry.json.wal'
+
+    def tearDown(self):
+        """Cleanup."""
+        self.mgr.cleanup()
+        shutil.rmtree(self.test_dir, ignore_errors=True)
+
+    def _register(self, mgr, index):
+        return mgr.check_and_register_host(
+            f"host-{index}", f"10.0.{index // 250}.{index % 250 + 1}/24",
+            "router-1", f"02:00:00:00:{index // 256:02x}:{index % 256:02x}")
+
+    def test_updates_go_to_log_and_other_instances_catch_up(self):
+        """Updates append to the log; a second manager sees them without a snapshot."""
+        self.assertTrue(self._register(self.mgr, 1))
+        self.assertFalse(self.snapshot.exists())
+        self.assertEqual(len(self.wal.read_text().splitlines()), 2)
+
+        other = TsimRegistryManager(self.config, self.logger)
+        try:
+            self.assertIn("host-1", other.list_all_hosts())
+            self.assertFalse(self._register(other, 1))
+            self.assertEqual(other.acquire_source_host_lease("job-1", "host-1", "quick", "router-1"), 1)
+            self.assertEqual(self.mgr.acquire_source_host_lease("job-2", "host-1", "quick", "router-1"), 2)
+            self.assertEqual(other.release_source_host_lease("job-1", "host-1"), (1, False))
+            self.assertEqual(self.mgr.get_host_lease_count("host-1"), 1)
+        finally:
+            other.cleanup()
+
+    def test_compaction_keeps_json_snapshot_current(self):
+        """The JSON file external tools read is compacted from the log."""
+        for i in range(40):
+            self.assertTrue(self._register(self.mgr, i))
+        self.assertTrue(self.mgr.unregister_host("host-0"))
+
+        # Size-triggered compaction has run at least once
+        self.assertTrue(self.snapshot.exists())
+        self.assertLess(self.wal.stat().st_size, 4096 + 512)
+
+        # Time-triggered compaction folds in the rest
+        deadline = time.time() + 5.0
+        while time.time() < deadline:
+            hosts = json.loads(self.snapshot.read_text())
+            if len(hosts) == 39 and len(self.wal.read_text().splitlines()) == 1:
+                break
+            time.sleep(0.05)
+        self.assertEqual(len(hosts), 39)
+        self.assertNotIn("host-0", hosts)
+        self.assertEqual(len(self.wal.read_text().splitlines()), 1)
+
+    def test_bulk_register_is_one_update(self):
+        """A host set registers and unregisters as one log record each, all or nothing."""
+        entries = [{'host_name': f"host-{i}", 'primary_ip': f"10.0.0.{i + 1}/24",
+                    'connected_to': "router-1", 'mac_address': f"02:00:00:00:00:{i:02x}"}
+                   for i in range(10)]
+        self.assertTrue(self.mgr.check_and_register_hosts(entries))
+        self.assertEqual(len(self.mgr.list_all_hosts()), 10)
+        self.assertEqual(len(self.wal.read_text().splitlines()), 2)
+
+        # Collision with a registered host, and within the set itself
+        clash = [{'host_name': "new-1", 'primary_ip': "10.0.0.200/24", 'connected_to': "router-1",
+                  'mac_address': "02:00:00:00:01:01"},
+                 {'host_name': "new-2", 'primary_ip': "10.0.0.1/24", 'connected_to': "router-1",
+                  'mac_address': "02:00:00:00:01:02"}]
+        self.assertFalse(self.mgr.check_and_register_hosts(clash))
+        clash[1]['primary_ip'] = "10.0.0.200/24"
+        self.assertFalse(self.mgr.check_and_register_hosts(clash))
+        clash[1]['connected_to'] = "router-2"
+        self.assertTrue(self.mgr.check_and_register_hosts(clash))
+
+        removed = self.mgr.unregister_hosts([f"host-{i}" for i in range(10)] + ["no-such-host"])
+        self.assertEqual(len(removed), 10)
+        self.assertEqual(sorted(self.mgr.list_all_hosts()), ["new-1", "new-2"])
+        self.assertEqual(len(self.wal.read_text().splitlines()), 4)
+
+    def test_readdress_host(self):
+        """Test moving a host to a new IP with collision detection."""
+        self.mgr.check_and_register_host(
+            host_name="test-host-1",
+            primary_ip="10.0.0.1/24",
+            connected_to="router-1",
+            mac_address="aa:bb:cc:dd:ee:01"
+        )
+        self.mgr.check_and_register_host(
+            host_name="test-host-2",
+            primary_ip="10.0.0.2/24",
+            connected_to="router-1",
+            mac_address="aa:bb:cc:dd:ee:02"
+        )
+
+        self.assertTrue(self.mgr.readdress_host("test-host-1", "10.0.0.5/24"))
+        self.assertEqual(self.mgr.get_host_info("test-host-1")['primary_ip'], "10.0.0.5/24")
+
+        # IP of another host on the same router, and unknown host
+        self.assertFalse(self.mgr.readdress_host("test-host-1", "10.0.0.2/24"))
+        self.assertFalse(self.mgr.readdress_host("no-such-host", "10.0.0.9/24"))
+        self.assertEqual(self.mgr.get_host_info("test-host-1")['primary_ip'], "10.0.0.5/24")
+
+    def test_direct_readers_see_uncompacted_log(self):
+        """read_registry_file applies the log; closing at exit compacts it."""
+        self.assertTrue(self._register(self.mgr, 1))
+        self.assertFalse(self.snapshot.exists())
+        self.assertIn("host-1", read_registry_file(self.snapshot))
+
+        self.mgr._io.compact(self.mgr.hosts_registry)
+        self.assertTrue(self.mgr.unregister_host("host-1"))
+        self.assertTrue(self._register(self.mgr, 2))
+        self.assertEqual(list(json.loads(self.snapshot.read_text())), ["host-1"])
+        self.assertEqual(list(read_registry_file(self.snapshot)), ["host-2"])
+
+        # What the atexit hook runs for processes that never call cleanup()
+        self.mgr._io.close()
+        self.assertEqual(list(json.loads(self.snapshot.read_text())), ["host-2"])
+        self.assertEqual(read_registry_file(self.registry_dir / 'no_such.json'), {})
+
+    def test_log_replaced_after_stat_is_reloaded(self):
+        """A log compacted away between stat and open is not read at the old offset."""
+        self.assertTrue(self._register(self.mgr, 1))
+        other = TsimRegistryManager(self.config, self.logger)
+        try:
+            self.assertIn("host-1", other.list_all_hosts())
+            io = other._io
+            paths = io._paths(other.hosts_registry)
+            stale = {path: io._signature(path) for path in paths}
+            stale[paths[1]][1] += 100   # As if records were appended first
+
+            self.mgr._io.compact(self.mgr.hosts_registry)
+            self.assertTrue(self._register(self.mgr, 2))
+
+            # The first stat of each file still sees the old log
+            signature = io._signature
+            pending = dict(stale)
+            with mock.patch.object(io, '_signature',
+                                   side_effect=lambda path: pending.pop(path) if path in pending
+                                   else signature(path)):
+                self.assertEqual(sorted(other.list_all_hosts()), ["host-1", "host-2"])
+        finally:
+            other.cleanup()
+
+    def test_externally_removed_snapshot_discards_stale_log(self):
+        """Cleanup tools deleting the JSON file also reset the journaled state."""
+        self.assertTrue(self._register(self.mgr, 1))
+        self.mgr._io.compact(self.mgr.hosts_registry)
+        self.assertTrue(self._register(self.mgr, 2))
+
+        self.snapshot.unlink()
+        self.assertEqual(self.mgr.list_all_hosts(), {})
+        self.assertTrue(self._register(self.mgr, 2))
+        self.assertEqual(list(self.mgr.list_all_hosts()), ["host-2"])
+
+
+class TestRegistryManagerShmLocks(unittest.TestCase):
+    """Test the blocking shared-memory lock backend."""
+
+    def setUp(self):
+        """Create temporary directories for testing."""
+        self.test_dir = tempfile.mkdtemp()
+        self.registry_dir = Path(self.test_dir) / "registry"
+        self.lock_dir = Path(self.test_dir) / "locks"
+
+        self.config = {
+            'data_dir': str(self.registry_dir),
+            'lock_dir': str(self.lock_dir),
+            'registry_files': {
+                'hosts': str(self.registry_dir / 'host_registry.json'),
+                'host_leases': str(self.registry_dir / 'host_leases.json'),
+                'neighbor_leases': str(self.registry_dir / 'neighbor_leases.json')
+            },
+            'registry_manager': {
+                'enabled': True,
+                'lock_backend': 'shm',
+                'lock_table_size': 64
+            }
+        }
+
+        self.logger = logging.getLogger(__name__)
+        self.mgr = TsimRegistryManager(self.config, self.logger)
+
+    def tearDown(self):
+        """Cleanup."""
+        self.mgr.cleanup()
+        shutil.rmtree(self.test_dir, ignore_errors=True)
+
+    def test_release_hands_over_without_polling(self):
+        """A blocked waiter gets the router as soon as it is released."""
+        self.assertTrue(self.mgr.acquire_router_lock("router-1", "job-1"))
+        self.assertTrue(self.mgr.is_router_locked("router-1"))
+        self.assertFalse(self.mgr.wait_for_router("router-1", timeout=0.1))
+
+        got = []
+        waiter = threading.Thread(target=lambda: got.append(
+            (self.mgr.acquire_router_lock("router-1", "job-2", timeout=5.0), time.perf_counter())))
+        waiter.start()
+        time.sleep(0.1)
+        released_at = time.perf_counter()
+        self.mgr.release_router_lock("router-1", "job-1")
+        waiter.join(5.0)
+        self.assertTrue(got[0][0])
+        self.assertLess(got[0][1] - released_at, 0.05)
+
+    def test_waiters_are_served_in_arrival_order(self):
+        """Router locks are granted first-come first-served."""
+        self.assertTrue(self.mgr.acquire_router_lock("router-1", "job-0"))
+        order = []
+
+        def job(i):
+            with self.mgr.router_lock("router-1", f"job-{i}", timeout=10.0):
+                order.append(i)
+
+        threads = []
+        for i in range(1, 6):
+            thread = threading.Thread(target=job, args=(i,))
+            thread.start()
+            threads.append(thread)
+            time.sleep(0.05)
+        self.mgr.release_router_lock("router-1", "job-0")
+        for thread in threads:
+            thread.join(10.0)
+        self.assertEqual(order, [1, 2, 3, 4, 5])
+
+    def test_dead_holder_lock_passes_to_waiter(self):
+        """A crashed holder's router lock is recovered without a stale-lock sweep."""
+        import os
+        ready_r, ready_w = os.pipe()
+        pid = os.fork()
+        if pid == 0:
+            child = TsimRegistryManager(self.config, self.logger)
+            child.acquire_router_lock("router-1", "job-dead")
+            os.write(ready_w, b'1')
+            time.sleep(0.2)
+            os._exit(0)  # Dies holding the lock
+        os.read(ready_r, 1)
+        self.assertTrue(self.mgr.is_router_locked("router-1"))
+        self.assertTrue(self.mgr.acquire_router_lock("router-1", "job-2", timeout=5.0))
+        os.waitpid(pid, 0)
+        self.mgr.release_router_lock("router-1", "job-2")
+        self.assertFalse(self.mgr.is_router_locked("router-1"))
+
+
+class TestRegistryManagerLockStats(unittest.TestCase):
+    """Test lock contention statistics in the shared stats segment."""
+
+    def setUp(self):
+        """Point the stats segment at a temporary file."""
+        import os
+        from core.lock_stats import get_lock_stats
+        self.test_dir = tempfile.mkdtemp()
+        self.registry_dir = Path(self.test_dir) / "registry"
+        self.lock_dir = Path(self.test_dir) / "locks"
+        os.environ['TSIM_LOCK_STATS'] = str(Path(self.test_dir) / 'lock_stats.shm')
+        self.stats = get_lock_stats()
+        self.assertIsNotNone(self.stats)
+
+        self.config = {
+            'data_dir': str(self.registry_dir),
+            'lock_dir': str(self.lock_dir),
+            'registry_files': {
+                'hosts': str(self.registry_dir / 'host_registry.json'),
+                'host_leases': str(self.registry_dir / 'host_leases.json'),
+                'neighbor_leases': str(self.registry_dir / 'neighbor_leases.json')
+            },
+            'registry_manager': {
+                'enabled': True,
+                'lock_backend': 'shm',
+                'lock_table_size': 64
+            }
+        }
+        self.logger = logging.getLogger(__name__)
+        self.mgr = TsimRegistryManager(self.config, self.logger)
+
+    def tearDown(self):
+        """Cleanup."""
+        import os
+        self.mgr.cleanup()
+        os.environ.pop('TSIM_LOCK_STATS', None)
+        shutil.rmtree(self.test_dir, ignore_errors=True)
+
+    def _router_stats(self, router: str):
+        locks = [l for l in self.stats.snapshot()['locks'] if router in l['name']]
+        self.assertEqual(len(locks), 1)
+        return locks[0]
+
+    def test_contended_acquisition_records_wait_hold_and_waiter(self):
+        """A blocked waiter shows up with its wait time, the holder with its hold time."""
+        def second_job():
+            if self.mgr.acquire_router_lock("router-1", "job-2", timeout=5.0):
+                self.mgr.release_router_lock("router-1", "job-2")
+
+        self.assertTrue(self.mgr.acquire_router_lock("router-1", "job-1"))
+        waiter = threading.Thread(target=second_job)
+        waiter.start()
+        time.sleep(0.1)
+        self.mgr.release_router_lock("router-1", "job-1")
+        waiter.join(5.0)
+
+        stats = self._router_stats("router-1")
+        self.assertEqual(stats['acquisitions'], 2)
+        self.assertEqual(stats['contended'], 1)
+        self.assertEqual(stats['releases'], 2)
+        self.assertGreaterEqual(stats['wait_max_ms'], 50)
+        self.assertGreaterEqual(stats['hold_max_ms'], 50)
+        self.assertEqual(sum(stats['wait_histogram']), 2)
+        self.assertEqual(len(stats['top_waiters']), 1)
+        self.assertEqual(stats['top_waiters'][0]['count'], 1)
+
+    def test_timeouts_and_reset(self):
+        """Timed-out attempts are counted, and reset zeroes the counters."""
+        self.assertTrue(self.mgr.acquire_router_lock("router-2", "job-1"))
+        result = []
+        waiter = threading.Thread(target=lambda: result.append(
+            self.mgr.acquire_router_lock("router-2", "job-2", timeout=0.05)))
+        waiter.start()
+        waiter.join(5.0)
+        self.mgr.release_router_lock("router-2", "job-1")
+        self.assertEqual(result, [False])
+
+        stats = self._router_stats("router-2")
+        self.assertEqual(stats['timeouts'], 1)
+        self.assertEqual(stats['acquisitions'], 1)
+
+        self.stats.reset()
+        stats = self._router_stats("router-2")
+        self.assertEqual(stats['acquisitions'], 0)
+        self.assertEqual(stats['top_waiters'], [])
+
+    def test_layout_change_replaces_segment_group_writable(self):
+        """A new layout replaces the file instead of truncating it under live mappings."""
+        import os
+        from core.lock_stats import TsimLockStats
+        path = Path(os.environ['TSIM_LOCK_STATS'])
+        old_inode = path.stat().st_ino
+        self.assertTrue(self.mgr.acquire_router_lock("router-3", "job-1"))
+        self.mgr.release_router_lock("router-3", "job-1")
+
+        umask = os.umask(0o022)
+        try:
+            resized = TsimLockStats(path, records=8)
+        finally:
+            os.umask(umask)
+        self.assertNotEqual(path.stat().st_ino, old_inode)
+        self.assertEqual(path.stat().st_mode & 0o777, 0o660)
+        self.assertEqual(resized.snapshot()['locks'], [])
+        # The old mapping still reads its (now unlinked) segment
+        self.assertEqual(self._router_stats("router-3")['acquisitions'], 1)
+        # The same layout maps the existing file
+        resized_inode = path.stat().st_ino
+        TsimLockStats(path, records=8)
+        self.assertEqual(path.stat().st_ino, resized_inode)
+
 if __name__ == '__main__':
     # Set up logging
     logging.basicConfig(
@@ -9,6 +9,8 @@ import logging
 from pathlib import Path
 from typing import Dict, Any, Generator, List
 from .tsim_base_handler import TsimBaseHandler
+from services.tsim_lock_stats import lock_stats_snapshot
+from tsim.core.registry_manager import read_registry_file
 
 
 class TsimAdminQueueStreamHandler(TsimBaseHandler):
@@ -207,7 +209,8 @@ class TsimAdminQueueStreamHandler(TsimBaseHandler):
             'locks': {
                 'scheduler_leader': self.lock_manager.is_locked('scheduler_leader'),
                 'network_test': self.lock_manager.is_locked('network_test')
-            }
+            },
+            'lock_stats': lock_stats_snapshot()
         }
 
     def _get_current_hosts(self) -> List[Dict[str, Any]]:
@@ -249,10 +252,9 @@ class TsimAdminQueueStreamHandler(TsimBaseHandler):
             registry_files = self.config.get('registry_files', {})
             host_registry_path = registry_files.get('hosts', '/dev/shm/tsim/host_registry.json')
 
-            import json
             try:
-                with open(host_registry_path, 'r') as f:
-                    host_registry = json.load(f)
+                # Snapshot plus its journal log, as the registry manager sees it
+                host_registry = read_registry_file(host_registry_path)
             except Exception:
                 host_registry = {}
 
@@ -1,15 +1,16 @@
 #!/usr/bin/env -S python3 -B -u
 """
 TSIM Progress Stream Handler
-Handles Server-Sent Events (SSE) for real-time progress updates
+Handles Server-Sent Events (SSE) for real-time progress updates pushed from the run event log
 """
 
 import json
 import time
 import logging
 from pathlib import Path
-from typing import Dict, Any, Generator
+from typing import Dict, Any, Generator, List
 from .tsim_base_handler import TsimBaseHandler
+from services.tsim_progress_log import TsimProgressLogReader, KIND_FINAL
 
 
 class TsimProgressStreamHandler(TsimBaseHandler):
@@ -75,6 +76,12 @@ class TsimProgressStreamHandler(TsimBaseHandler):
     def _stream_progress(self, run_id: str, session: Dict[str, Any]) -> Generator[bytes, None, None]:
         """Stream progress updates via SSE
         
+        Follows the run's append-only event log: each wakeup reads only the
+        records appended since the last one and pushes a single event. The
+        handler sleeps on inotify between appends, waking every second only
+        while the job waits in the queue (to refresh its position) and
+        otherwise just for heartbeats.
+        
         Args:
             run_id: Run identifier
             session: Session data
@@ -82,260 +89,137 @@ class TsimProgressStreamHandler(TsimBaseHandler):
         Yields:
             SSE formatted progress events
         """
-        progress_dir = Path(self.config.get('run_dir', '/dev/shm/tsim/runs'))
-        run_dir = progress_dir / run_id
-        progress_file = run_dir / "progress.json"
+        run_dir = Path(self.config.get('run_dir', '/dev/shm/tsim/runs')) / run_id
+        deadline = time.monotonic() + float(self.config.get('progress_stream_timeout', 300))
+        reader = TsimProgressLogReader(run_dir)
         
-        all_phases = []  # Track all phases seen so far  
-        last_phase_count = 0
-        retry_count = 0
-        max_retries = 600  # 5 minutes at 0.5 second intervals
+        all_phases = []  # Track all phases seen so far
+        last = {'phase': 'WAITING', 'details': 'Waiting for test to start...', 'duration': 0}
+        state = {'percent': 0, 'expected_steps': None, 'success': None, 'error': None}
+        terminal = False       # COMPLETE/FAILED/ERROR phase seen
+        last_position = -1     # Forces the initial event
         
         self.logger.info(f"Starting progress stream for run_id {run_id}")
         
-        while retry_count < max_retries:
-            try:
-                # Check if progress file exists
-                if progress_file.exists():
-                    # Read the entire progress JSON file
-                    current_phases = []
-                    is_complete = False
-                    has_error = False
-                    
-                    with open(progress_file, 'r') as f:
-                        try:
-                            progress_data = json.load(f)
-                            # Extract phases from the JSON structure
-                            current_phases = progress_data.get('phases', [])
-                            expected_steps = progress_data.get('expected_steps') or len(current_phases) or 1
-                            percent = int(progress_data.get('overall_progress', 0))
-                            
-                            # Prefer explicit flags for completion/success if present
-                            is_complete = bool(progress_data.get('complete', False))
-                            has_error = (progress_data.get('success') is False)
-                            
-                            # Fallback to phases to infer state
-                            if not is_complete or not has_error:
-                                for phase in current_phases:
-                                    p = phase.get('phase')
-                                    if p in ('COMPLETE', 'FAILED'):
-                                        is_complete = True
-                                    if p in ('ERROR', 'FAILED'):
-                                        has_error = True
-                        except json.JSONDecodeError:
-                            self.logger.error(f"Failed to parse progress.json for {run_id}")
-                            continue
-                    
-                    # Always sync all_phases with current_phases to ensure we have the latest (including TOTAL)
-                    if len(current_phases) > len(all_phases):
-                        # Add new phases to our collection
-                        for i in range(len(all_phases), len(current_phases)):
-                            phase = current_phases[i]
-                            phase_name = phase.get('phase', 'UNKNOWN')
-                            
-                            # Strip prefixes like CGI does
-                            if phase_name.startswith('MULTI_REACHABILITY_'):
-                                phase_name = phase_name.replace('MULTI_REACHABILITY_', '')
-                            elif phase_name.startswith('REACHABILITY_'):
-                                phase_name = phase_name.replace('REACHABILITY_', '')
-                            
-                            all_phases.append({
-                                'phase': phase_name,
-                                'details': phase.get('message', phase.get('details', '')),
-                                'duration': phase.get('duration', 0)
-                            })
-                    elif is_complete and len(current_phases) == len(all_phases):
-                        # When complete, ensure the last phase (likely TOTAL) is properly included
-                        # This handles the case where TOTAL phase is added in the same write as complete=true
-                        if current_phases and all_phases:
-                            last_current = current_phases[-1]
-                            last_all = all_phases[-1] if all_phases else {}
-                            # If the last phase content differs, update it
-                            if (last_current.get('phase') != last_all.get('phase') or 
-                                last_current.get('message') != last_all.get('details')):
-                                
-                                phase_name = last_current.get('phase', 'UNKNOWN')
-                                if phase_name.startswith('MULTI_REACHABILITY_'):
-                                    phase_name = phase_name.replace('MULTI_REACHABILITY_', '')
-                                elif phase_name.startswith('REACHABILITY_'):
-                                    phase_name = phase_name.replace('REACHABILITY_', '')
-                                
-                                all_phases[-1] = {
-                                    'phase': phase_name,
-                                    'details': last_current.get('message', last_current.get('details', '')),
-                                    'duration': last_current.get('duration', 0)
-                                }
-                            
-                            # Send SSE event for this phase update (matching CGI format)
-                            # Live queue position if waiting
-                            queue_position = None
-                            if self.queue_service and not is_complete and phase_name in ('QUEUED', 'WAITING_FOR_ENVIRONMENT'):
-                                try:
-                                    queue_position = self.queue_service.get_position(run_id)
-                                except Exception:
-                                    queue_position = None
-
-                            data = {
-                                'phase': phase_name,
-                                'details': phase.get('message', phase.get('details', '')),
-                                'duration': phase.get('duration', 0),
-                                'all_phases': all_phases,
-                                'complete': is_complete,
-                                'expected_steps': expected_steps,
-                                'percent': percent,
-                                'queue_position': queue_position,
-                                'success': progress_data.get('success'),
-                                'error': progress_data.get('error'),
-                                'redirect_url': f'/pdf_viewer_final.html?id={run_id}' if (is_complete and not has_error) else None
-                            }
-                            
-                            # Use CGI format: "data: json\n\n"
-                            event = f"data: {json.dumps(data)}\n\n"
-                            yield event.encode('utf-8')
-                        
-                        # Check if test is complete
-                        if is_complete:
-                            self.logger.info(f"Progress stream completed for run_id {run_id}")
-                            break
-                    elif is_complete:
-                        # Run is complete but no new phases (e.g., race during cancellation) -> emit final state once
-                        last = current_phases[-1] if current_phases else {}
-                        phase_name = last.get('phase', 'UNKNOWN')
-                        if phase_name.startswith('MULTI_REACHABILITY_'):
-                            phase_name = phase_name.replace('MULTI_REACHABILITY_', '')
-                        elif phase_name.startswith('REACHABILITY_'):
-                            phase_name = phase_name.replace('REACHABILITY_', '')
-                        data = {
-                            'phase': phase_name,
-                            'details': last.get('message', last.get('details', '')),
-                            'duration': last.get('duration', 0),
-                            'all_phases': all_phases,
-                            'complete': True,
-                            'expected_steps': expected_steps,
-                            'percent': percent,
-                            'queue_position': None,
-                            'success': progress_data.get('success'),
-                            'error': progress_data.get('error'),
-                            'redirect_url': f'/pdf_viewer_final.html?id={run_id}' if not has_error else None
-                        }
-                        event = f"data: {json.dumps(data)}\n\n"
-                        yield event.encode('utf-8')
-                        self.logger.info(f"Final completion event sent for run_id {run_id}")
-                        break
-                    else:
-                        # Emit a lightweight snapshot periodically to refresh UI (e.g., queue position cleared after cancel)
-                        if retry_count % 2 == 0:  # every ~1s (loop is 0.5s)
-                            last = current_phases[-1] if current_phases else {}
-                            phase_name = last.get('phase', 'UNKNOWN')
-                            if phase_name.startswith('MULTI_REACHABILITY_'):
-                                phase_name = phase_name.replace('MULTI_REACHABILITY_', '')
-                            elif phase_name.startswith('REACHABILITY_'):
-                                phase_name = phase_name.replace('REACHABILITY_', '')
-                            snapshot = {
-                                'phase': phase_name,
-                                'details': last.get('message', last.get('details', '')),
-                                'duration': last.get('duration', 0),
-                                'all_phases': all_phases,
-                                'complete': is_complete,
-                                'expected_steps': expected_steps,
-                                'percent': percent,
-                                'queue_position': None if is_complete else None,
-                                'success': progress_data.get('success'),
-                                'error': progress_data.get('error'),
-                                'redirect_url': None
-                            }
-                            event = f"data: {json.dumps(snapshot)}\n\n"
-                            yield event.encode('utf-8')
-                else:
-                    # No progress file yet - check audit log for queue status
-                    audit_file = run_dir / "audit.log"
-                    queue_position = None
-                    in_queue = False
-
-                    if audit_file.exists():
-                        # Read audit log to find queue position
-                        try:
-                            with open(audit_file, 'r') as f:
-                                for line in f:
-                                    try:
-                                        entry = json.loads(line.strip())
-                                        if entry.get('phase') == 'QUEUED':
-                                            in_queue = True
-                                            # Try to extract position from message like "In queue (position 2)"
-                                            msg = entry.get('message', '')
-                                            import re
-                                            match = re.search(r'position\s+(\d+)', msg)
-                                            if match:
-                                                queue_position = int(match.group(1))
-                                    except (json.JSONDecodeError, ValueError):
-                                        continue
-                        except Exception as e:
-                            self.logger.debug(f"Could not read audit log for {run_id}: {e}")
-
-                    # Also try to get live queue position from queue service
-                    if self.queue_service and not queue_position:
-                        try:
-                            queue_position = self.queue_service.get_position(run_id)
-                            if queue_position:
-                                in_queue = True
-                        except Exception:
-                            pass
-
-                    # Send waiting event with queue position if available
-                    if retry_count % 2 == 0:  # Every 1 second
-                        if in_queue and queue_position:
-                            details_msg = f'In queue (position {queue_position})'
-                        else:
-                            details_msg = 'Waiting for test to start...'
-
-                        data = {
-                            'phase': 'QUEUED' if in_queue else 'WAITING',
-                            'details': details_msg,
-                            'duration': 0,
-                            'all_phases': all_phases,
-                            'complete': False,
-                            'queue_position': queue_position,
-                            'redirect_url': None
-                        }
-                        event = f"data: {json.dumps(data)}\n\n"
-                        yield event.encode('utf-8')
+        try:
+            while time.monotonic() < deadline:
+                events = reader.read_new()
+                final = None
+                for event in events:
+                    if event['kind'] == KIND_FINAL:
+                        final = event
+                        continue
+                    phase_name = self._strip_phase_prefix(event['phase'])
+                    last = {
+                        'phase': phase_name,
+                        'details': event.get('message') or event.get('details', ''),
+                        'duration': event.get('duration', 0)
+                    }
+                    all_phases.append(last)
+                    state['percent'] = int(event.get('percent', state['percent']))
+                    state['expected_steps'] = event.get('expected_steps') or state['expected_steps']
+                    if event['phase'] in ('COMPLETE', 'FAILED', 'ERROR'):
+                        terminal = True
+                        state['success'] = event['phase'] == 'COMPLETE'
+                        if event['phase'] != 'COMPLETE':
+                            state['error'] = event.get('message')
                 
-                # Send heartbeat to keep connection alive (matching CGI format)
-                yield b": heartbeat\n\n"
+                if final is not None:
+                    state['success'] = final.get('success')
+                    state['error'] = final.get('error') or state['error']
+                    state['percent'] = 100
+                    yield self._progress_event(run_id, last, all_phases, state, True, None)
+                    self.logger.info(f"Progress stream completed for run_id {run_id}")
+                    return
                 
-                # Wait before next check
-                time.sleep(0.5)
-                retry_count += 1
+                queued = not reader.exists() or last['phase'] in ('START', 'parse_args', 'QUEUED',
+                                                                  'WAITING_FOR_ENVIRONMENT')
+                position = None
+                if queued and self.queue_service:
+                    try:
+                        position = self.queue_service.get_position(run_id)
+                    except Exception:
+                        position = None
                 
-            except Exception as e:
-                self.logger.error(f"Error in progress stream for {run_id}: {e}")
-                # Send error in CGI format
-                data = {
-                    'phase': 'ERROR',
-                    'details': str(e),
-                    'duration': 0,
-                    'all_phases': all_phases,
-                    'complete': False,
-                    'redirect_url': None,
-                    'error': str(e)
-                }
-                event = f"data: {json.dumps(data)}\n\n"
-                yield event.encode('utf-8')
-                break
+                if events or position != last_position:
+                    if not reader.exists():
+                        waiting = dict(last)
+                        if position:
+                            waiting.update(phase='QUEUED', details=f'In queue (position {position})')
+                        yield self._progress_event(run_id, waiting, all_phases, state, False, position)
+                    else:
+                        yield self._progress_event(run_id, last, all_phases, state, False, position)
+                    last_position = position
+                
+                # A terminal phase without a final record: allow the writer a moment
+                # to append TOTAL/final, then report completion from what we have
+                if terminal:
+                    if not reader.wait(1.0):
+                        state['percent'] = 100
+                        yield self._progress_event(run_id, last, all_phases, state, True, None)
+                        self.logger.info(f"Final completion event sent for run_id {run_id}")
+                        return
+                    continue
+                
+                if not reader.wait(1.0 if queued else 15.0):
+                    # Heartbeat keeps proxies from closing an idle connection
+                    yield b": heartbeat\n\n"
         
-        # Timeout reached
-        if retry_count >= max_retries:
+        except Exception as e:
+            self.logger.error(f"Error in progress stream for {run_id}: {e}")
             data = {
-                'phase': 'TIMEOUT',
-                'details': 'Progress stream timeout',
+                'phase': 'ERROR',
+                'details': str(e),
                 'duration': 0,
                 'all_phases': all_phases,
                 'complete': False,
-                'redirect_url': None
+                'redirect_url': None,
+                'error': str(e)
             }
-            event = f"data: {json.dumps(data)}\n\n"
-            yield event.encode('utf-8')
-            self.logger.warning(f"Progress stream timeout for run_id {run_id}")
+            yield f"data: {json.dumps(data)}\n\n".encode('utf-8')
+            return
+        finally:
+            reader.close()
+        
+        # Timeout reached
+        data = {
+            'phase': 'TIMEOUT',
+            'details': 'Progress stream timeout',
+            'duration': 0,
+            'all_phases': all_phases,
+            'complete': False,
+            'redirect_url': None
+        }
+        yield f"data: {json.dumps(data)}\n\n".encode('utf-8')
+        self.logger.warning(f"Progress stream timeout for run_id {run_id}")
+    
+    @staticmethod
+    def _strip_phase_prefix(phase_name: str) -> str:
+        """Strip prefixes like CGI does"""
+        if phase_name.startswith('MULTI_REACHABILITY_'):
+            return phase_name.replace('MULTI_REACHABILITY_', '')
+        if phase_name.startswith('REACHABILITY_'):
+            return phase_name.replace('REACHABILITY_', '')
+        return phase_name
+    
+    def _progress_event(self, run_id: str, last: Dict[str, Any], all_phases: List[Dict[str, Any]],
+                        state: Dict[str, Any], complete: bool, queue_position) -> bytes:
+        """Format one progress update in the CGI's "data: json" format"""
+        has_error = state.get('success') is False
+        data = {
+            'phase': last['phase'],
+            'details': last['details'],
+            'duration': last.get('duration', 0),
+            'all_phases': all_phases,
+            'complete': complete,
+            'expected_steps': state.get('expected_steps') or len(all_phases) or 1,
+            'percent': state.get('percent', 0),
+            'queue_position': queue_position,
+            'success': state.get('success'),
+            'error': state.get('error'),
+            'redirect_url': f'/pdf_viewer_final.html?id={run_id}' if (complete and not has_error) else None
+        }
+        return f"data: {json.dumps(data)}\n\n".encode('utf-8')
     
     def _format_sse_event(self, event_type: str, data: Dict[str, Any]) -> bytes:
         """Format data as SSE event
@@ -13,6 +13,7 @@ from typing import Dict, Any, List
 from .tsim_base_handler import TsimBaseHandler
 from services.tsim_queue_service import TsimQueueService
 from services.tsim_lock_manager_service import TsimLockManagerService
+from services.tsim_lock_stats import lock_stats_snapshot
 
 
 class TsimQueueAdminHandler(TsimBaseHandler):
@@ -76,7 +77,8 @@ class TsimQueueAdminHandler(TsimBaseHandler):
             'locks': {
                 'scheduler_leader': self.lock_manager.is_locked('scheduler_leader'),
                 'network_test': self.lock_manager.is_locked('network_test')
-            }
+            },
+            'lock_stats': lock_stats_snapshot()
         }
         return self.json_response(start_response, response)
 
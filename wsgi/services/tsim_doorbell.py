@@ -0,0 +1,93 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Doorbell
+Cross-process wakeup for the scheduler leader via a named pipe in /dev/shm
+
+Producers (enqueue, job completion) write one byte without blocking; the
+leader keeps the FIFO open and sleeps in poll() until a byte arrives or the
+timeout expires. Bytes written while the leader is busy stay in the pipe,
+so a ring between "queue looked empty" and "wait" is never lost, and many
+rings coalesce into one wakeup. Ringing with no leader listening is a no-op.
+"""
+
+import errno
+import logging
+import os
+import select
+import stat
+from pathlib import Path
+from typing import Optional
+
+
+class TsimDoorbell:
+    """Named-pipe doorbell: ring() from anywhere, wait() from one listener"""
+
+    def __init__(self, path: Path):
+        self.path = Path(path)
+        self.logger = logging.getLogger('tsim.doorbell')
+        self._fd: Optional[int] = None
+        self._poller = None
+        self._ensure_fifo()
+
+    def _ensure_fifo(self):
+        try:
+            if not stat.S_ISFIFO(os.stat(self.path).st_mode):
+                self.path.unlink()
+                os.mkfifo(self.path, 0o664)
+        except FileNotFoundError:
+            try:
+                self.path.parent.mkdir(parents=True, exist_ok=True)
+                os.mkfifo(self.path, 0o664)
+            except FileExistsError:
+                pass
+        try:
+            os.chmod(self.path, 0o664)
+        except OSError:
+            pass
+
+    def ring(self) -> bool:
+        """Wake the listener; returns False if nobody is listening."""
+        try:
+            fd = os.open(str(self.path), os.O_WRONLY | os.O_NONBLOCK)
+        except OSError as e:
+            if e.errno in (errno.ENXIO, errno.ENOENT):
+                return False
+            self.logger.debug(f"Doorbell ring failed: {e}")
+            return False
+        try:
+            os.write(fd, b'\0')
+        except BlockingIOError:
+            pass  # Pipe full: a wakeup is already pending
+        except OSError as e:
+            self.logger.debug(f"Doorbell ring failed: {e}")
+            return False
+        finally:
+            os.close(fd)
+        return True
+
+    def listen(self):
+        """Open the listening end; rings from now on are kept until wait()."""
+        if self._fd is None:
+            self._ensure_fifo()
+            # O_RDWR keeps a writer on the pipe so poll() never reports a permanent EOF
+            self._fd = os.open(str(self.path), os.O_RDWR | os.O_NONBLOCK)
+            self._poller = select.poll()
+            self._poller.register(self._fd, select.POLLIN)
+
+    def wait(self, timeout: float) -> bool:
+        """Block until rung or timeout (seconds); returns True if rung."""
+        self.listen()
+        if not self._poller.poll(max(0, int(timeout * 1000))):
+            return False
+        try:
+            while os.read(self._fd, 4096):
+                pass
+        except BlockingIOError:
+            pass
+        return True
+
+    def close(self):
+        if self._fd is not None:
+            os.close(self._fd)
+            self._fd = None
+            self._poller = None
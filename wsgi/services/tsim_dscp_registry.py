@@ -2,6 +2,16 @@
 """
 TSIM DSCP Registry Service
 Thread-safe DSCP allocation registry for parallel KSMS jobs
+
+Jobs are told apart on the wire by a per-job tag. In the default 'dscp'
+tag mode the tag is the DSCP value itself, which caps concurrency at the
+32 values of the 32-63 range. In 'ipid' tag mode every job shares one
+marker DSCP and the tag is the IPv4 identification field of its probes,
+so thousands of quick jobs can run at once (requires probe_emitter).
+
+Allocations live in a shared-memory slot table claimed by compare-and-swap
+(tsim_shm_slots); dscp_registry.json is only a periodic audit snapshot.
+The 'file' backend keeps the original flock + JSON rewrite per call.
 """
 
 import os
@@ -11,11 +21,21 @@ import fcntl
 import logging
 import threading
 from pathlib import Path
-from typing import Dict, Any, Optional, List
+from typing import Dict, Any, Optional, List, Tuple
+
+from .tsim_lock_stats import flock_exclusive, record_release
+from .tsim_shm_slots import TsimShmSlotAllocator
 
 
 class TsimDscpRegistry:
     """Thread-safe DSCP allocation registry for parallel KSMS jobs"""
+
+    # Last audit snapshot (time and contents), shared by all instances of this process
+    _last_snapshot_at = 0.0
+    _last_snapshot: Optional[Dict[str, Any]] = None
+    # Periodic snapshot thread, one per process
+    _snapshot_thread: Optional[threading.Thread] = None
+    _snapshot_thread_lock = threading.Lock()
     
     def __init__(self, config_service):
         """Initialize DSCP registry
@@ -44,12 +64,34 @@ class TsimDscpRegistry:
         # Validate DSCP range
         if self.dscp_min < 0 or self.dscp_max > 63 or self.dscp_min > self.dscp_max:
             raise ValueError(f"Invalid DSCP range: {self.dscp_min}-{self.dscp_max} (must be 0-63)")
+
+        # Tag mode: 'dscp' allocates DSCP values, 'ipid' allocates IP IDs under a marker DSCP
+        self.tag_mode, self.tag_min, self.tag_max = self.tag_range(dscp_config)
+        self.marker_dscp = dscp_config.get('tag_marker_dscp', self.dscp_min)
+        if self.tag_mode == 'ipid' and not (32 <= self.marker_dscp <= 63):
+            raise ValueError(f"Invalid marker DSCP: {self.marker_dscp} (must be 32-63)")
+        self.capacity = self.tag_max - self.tag_min + 1
+        self.default_tag = 32 if self.tag_mode == 'dscp' else self.tag_min
         
         # Ensure base directory exists (should already exist)
         try:
             base_dir.mkdir(parents=True, exist_ok=True, mode=0o2775)  # Set group sticky bit
         except Exception as e:
             self.logger.warning(f"Failed to ensure base directory exists: {e}")
+
+        # Allocation backend: 'shm' (CAS slot table) or 'file' (flock + JSON per call)
+        self.backend = dscp_config.get('backend', 'shm')
+        self.snapshot_interval = dscp_config.get('snapshot_interval', 5.0)
+        self.slots: Optional[TsimShmSlotAllocator] = None
+        if self.enabled and self.backend == 'shm':
+            try:
+                self.slots = TsimShmSlotAllocator(base_dir / f'dscp_slots_{self.tag_mode}.bin',
+                                                  self.tag_min, self.capacity, self.max_age)
+            except (RuntimeError, OSError) as e:
+                self.logger.warning(f"Shared-memory tag slots unavailable ({e}), using file registry")
+                self.backend = 'file'
+            else:
+                self._start_snapshot_thread()
         
         # Initialize registry if missing
         if not self.registry_file.exists():
@@ -69,25 +111,65 @@ class TsimDscpRegistry:
             except Exception as e:
                 self.logger.warning(f"Failed to cleanup stale allocations on startup: {e}")
 
-        self.logger.info(f"DSCP Registry initialized: range {self.dscp_min}-{self.dscp_max} "
+        self.logger.info(f"DSCP Registry initialized: {self.tag_mode} tags {self.tag_min}-{self.tag_max} "
                         f"({'enabled' if self.enabled else 'disabled'})")
     
+    @staticmethod
+    def tag_range(dscp_config: Dict[str, Any]) -> Tuple[str, int, int]:
+        """Tag mode and tag range of a dscp_registry config section
+        
+        Args:
+            dscp_config: The 'dscp_registry' configuration section
+            
+        Returns:
+            (tag_mode, tag_min, tag_max)
+            
+        Raises:
+            ValueError: If the tag mode or range is invalid
+        """
+        tag_mode = dscp_config.get('tag_mode', 'dscp')
+        if tag_mode == 'dscp':
+            return tag_mode, dscp_config.get('dscp_range_min', 32), dscp_config.get('dscp_range_max', 63)
+        if tag_mode != 'ipid':
+            raise ValueError(f"Invalid tag mode: {tag_mode} (must be dscp or ipid)")
+        tag_min = dscp_config.get('ipid_range_min', 1)
+        tag_max = dscp_config.get('ipid_range_max', 4095)
+        if tag_min < 1 or tag_max > 65535 or tag_min > tag_max:
+            raise ValueError(f"Invalid IP ID range: {tag_min}-{tag_max} (must be 1-65535)")
+        return tag_mode, tag_min, tag_max
+
+    @classmethod
+    def tag_capacity(cls, config_service) -> int:
+        """Number of distinct job tags (concurrent quick jobs) the configuration
+        allows, without opening the registry"""
+        _, tag_min, tag_max = cls.tag_range(config_service.get('dscp_registry', {}))
+        return tag_max - tag_min + 1
+
     def allocate_dscp(self, job_id: str, username: str = None) -> Optional[int]:
-        """Allocate unique DSCP value for job
+        """Allocate unique DSCP value (or IP ID tag in 'ipid' mode) for job
         
         Args:
             job_id: Unique job identifier
             username: Optional username for tracking
             
         Returns:
-            DSCP value (32-63) or None if no DSCP available
+            Job tag (DSCP 32-63, or IP ID in 'ipid' mode) or None if no tag available
             
         Raises:
             RuntimeError: If registry operations fail
         """
         if not self.enabled:
-            self.logger.debug("DSCP registry disabled - using default DSCP 32")
-            return 32
+            self.logger.debug(f"DSCP registry disabled - using default tag {self.default_tag}")
+            return self.default_tag
+
+        if self.slots is not None:
+            dscp = self.slots.allocate(job_id, username)
+            if dscp is None:
+                self.logger.warning(f"No {self.tag_mode} tags available for job {job_id}")
+            else:
+                self.logger.info(f"Allocated {self.tag_mode} tag {dscp} to job {job_id}")
+            self._maybe_snapshot()
+            return dscp
         
         with self.semaphore:
             try:
@@ -106,21 +188,21 @@ class TsimDscpRegistry:
                         self.logger.debug(f"Job {job_id} already has DSCP {existing['dscp']}")
                         return existing['dscp']
                     
-                    # Find available DSCP
-                    used_dscps = {entry['dscp'] for entry in registry['allocations'].values()}
-                    available_dscps = set(range(self.dscp_min, self.dscp_max + 1)) - used_dscps
+                    # Allocate lowest available tag of this mode
+                    used_dscps = {entry['dscp'] for entry in registry['allocations'].values()
+                                  if entry.get('tag_mode', 'dscp') == self.tag_mode}
+                    dscp = next((tag for tag in range(self.tag_min, self.tag_max + 1)
+                                 if tag not in used_dscps), None)
                     
-                    if not available_dscps:
-                        self.logger.warning(f"No DSCP values available for job {job_id} "
+                    if dscp is None:
+                        self.logger.warning(f"No {self.tag_mode} tags available for job {job_id} "
                                           f"({len(used_dscps)} allocated)")
                         return None
                     
-                    # Allocate lowest available DSCP
-                    dscp = min(available_dscps)
-                    
                     # Create allocation record
                     allocation = {
                         'dscp': dscp,
+                        'tag_mode': self.tag_mode,
                         'job_id': job_id,
                         'username': username or 'unknown',
                         'allocated_at': time.time(),
@@ -135,7 +217,7 @@ class TsimDscpRegistry:
                     self._save_registry(registry)
                     
                     self.logger.info(f"Allocated DSCP {dscp} to job {job_id} "
-                                   f"({len(registry['allocations'])}/{self.dscp_max - self.dscp_min + 1} used)")
+                                   f"({len(registry['allocations'])}/{self.capacity} used)")
                     
                     return dscp
                     
@@ -154,6 +236,15 @@ class TsimDscpRegistry:
         """
         if not self.enabled:
             return True  # No allocation to release when disabled
+
+        if self.slots is not None:
+            released = self.slots.release(job_id)
+            if released:
+                self.logger.info(f"Released {self.tag_mode} tag from job {job_id}")
+            else:
+                self.logger.debug(f"No DSCP allocation found for job {job_id}")
+            self._maybe_snapshot()
+            return released
         
         with self.semaphore:
             try:
@@ -176,7 +267,7 @@ class TsimDscpRegistry:
                     self._save_registry(registry)
                     
                     self.logger.info(f"Released DSCP {dscp} from job {job_id} "
-                                   f"({len(registry['allocations'])}/{self.dscp_max - self.dscp_min + 1} used)")
+                                   f"({len(registry['allocations'])}/{self.capacity} used)")
                     
                     return True
                     
@@ -194,7 +285,10 @@ class TsimDscpRegistry:
             DSCP value or None if not allocated
         """
         if not self.enabled:
-            return 32
+            return self.default_tag
+
+        if self.slots is not None:
+            return self.slots.tag_of(job_id)
         
         try:
             registry = self._load_registry()
@@ -213,22 +307,28 @@ class TsimDscpRegistry:
         if not self.enabled:
             return {
                 'enabled': False,
+                'tag_mode': self.tag_mode,
                 'total_allocations': 0,
-                'available_dscps': self.dscp_max - self.dscp_min + 1,
+                'available_dscps': self.capacity,
                 'used_dscps': []
             }
         
         try:
-            registry = self._load_registry()
-            allocations = registry['allocations']
+            if self.slots is not None:
+                allocations = self.slots.allocations()
+            else:
+                allocations = self._load_registry()['allocations']
             used_dscps = sorted([alloc['dscp'] for alloc in allocations.values()])
             
             return {
                 'enabled': True,
+                'backend': self.backend,
+                'tag_mode': self.tag_mode,
                 'dscp_range': f"{self.dscp_min}-{self.dscp_max}",
-                'total_capacity': self.dscp_max - self.dscp_min + 1,
+                'tag_range': f"{self.tag_min}-{self.tag_max}",
+                'total_capacity': self.capacity,
                 'total_allocations': len(allocations),
-                'available_slots': (self.dscp_max - self.dscp_min + 1) - len(allocations),
+                'available_slots': self.capacity - len(allocations),
                 'used_dscps': used_dscps,
                 'allocations': {
                     job_id: {
@@ -255,6 +355,9 @@ class TsimDscpRegistry:
         """
         if not self.enabled:
             return None
+
+        if self.slots is not None:
+            return self.slots.tag_of(job_id)
         
         try:
             registry = self._load_registry()
@@ -268,6 +371,19 @@ class TsimDscpRegistry:
             self.logger.error(f"Failed to get DSCP for job {job_id}: {e}")
             return None
     
+    def ksms_tag_args(self, tag: int) -> List[str]:
+        """ksms_tester arguments that select this registry's tagging for a job
+        
+        Args:
+            tag: Value returned by allocate_dscp()
+            
+        Returns:
+            ['--dscp', tag] in 'dscp' mode, or the marker DSCP plus '--ip-id-tag' in 'ipid' mode
+        """
+        if self.tag_mode == 'ipid':
+            return ['--dscp', str(self.marker_dscp), '--tag-mode', 'ipid', '--ip-id-tag', str(tag)]
+        return ['--dscp', str(tag)]
+    
     def cleanup_stale_allocations(self) -> int:
         """Clean up stale allocations (public method)
         
@@ -276,6 +392,13 @@ class TsimDscpRegistry:
         """
         if not self.enabled:
             return 0
+
+        if self.slots is not None:
+            cleaned = self.slots.reclaim_stale()
+            if cleaned > 0:
+                self.logger.info(f"Cleaned up {cleaned} stale DSCP allocations")
+                self._maybe_snapshot(force=True)
+            return cleaned
         
         with self.semaphore:
             try:
@@ -290,17 +413,59 @@ class TsimDscpRegistry:
                 self.logger.error(f"Failed to cleanup stale allocations: {e}")
                 return 0
     
+    def _start_snapshot_thread(self):
+        """Refresh the audit snapshot every snapshot_interval, so changes made
+        after the last allocate/release call still reach the JSON file"""
+        with TsimDscpRegistry._snapshot_thread_lock:
+            if TsimDscpRegistry._snapshot_thread is not None or self.snapshot_interval <= 0:
+                return
+            thread = threading.Thread(target=self._snapshot_loop, name='tsim-dscp-snapshot', daemon=True)
+            TsimDscpRegistry._snapshot_thread = thread
+            thread.start()
+
+    def _snapshot_loop(self):
+        while True:
+            time.sleep(self.snapshot_interval)
+            self._maybe_snapshot()
+
+    def _maybe_snapshot(self, force: bool = False):
+        """Write the shared-memory allocations to the JSON audit file, at most
+        once per snapshot_interval per process and only when they changed
+        (last writer wins, no lock)"""
+        now = time.time()
+        if not force and now - TsimDscpRegistry._last_snapshot_at < self.snapshot_interval:
+            return
+        TsimDscpRegistry._last_snapshot_at = now
+        allocations = self.slots.allocations()
+        if not force and allocations == TsimDscpRegistry._last_snapshot:
+            return
+        tmp_file = self.registry_file.with_suffix(f'.{os.getpid()}.{threading.get_ident()}.tmp')
+        try:
+            with open(tmp_file, 'w') as f:
+                json.dump({'version': 1, 'backend': 'shm', 'tag_mode': self.tag_mode,
+                           'updated_at': now, 'allocations': allocations}, f, indent=2)
+            os.chmod(tmp_file, 0o664)
+            tmp_file.replace(self.registry_file)
+            TsimDscpRegistry._last_snapshot = allocations
+        except Exception as e:
+            self.logger.debug(f"Failed to write DSCP audit snapshot: {e}")
+            try:
+                tmp_file.unlink()
+            except Exception:
+                pass
+
     def _file_lock(self):
         """Context manager for file-based locking"""
         class FileLock:
             def __init__(self, lock_file: Path):
                 self.lock_file = lock_file
                 self.fd = None
+                self.acquired_at = None
                 
             def __enter__(self):
                 try:
                     self.fd = os.open(str(self.lock_file), os.O_CREAT | os.O_RDWR, 0o664)
-                    fcntl.flock(self.fd, fcntl.LOCK_EX)
+                    self.acquired_at = flock_exclusive(self.fd, 'tsim-dscp-registry')
                     return self
                 except Exception:
                     if self.fd is not None:
@@ -312,6 +477,7 @@ class TsimDscpRegistry:
                     if self.fd is not None:
                         fcntl.flock(self.fd, fcntl.LOCK_UN)
                         os.close(self.fd)
+                        record_release('tsim-dscp-registry', self.acquired_at)
                 except Exception:
                     pass
         
@@ -445,4 +611,5 @@ class TsimDscpRegistry:
     
     def __repr__(self) -> str:
         """String representation"""
-        return f"TsimDscpRegistry(range={self.dscp_min}-{self.dscp_max}, enabled={self.enabled})"
\ No newline at end of file
+        return (f"TsimDscpRegistry(mode={self.tag_mode}, range={self.tag_min}-{self.tag_max}, "
+                f"backend={self.backend}, enabled={self.enabled})")
\ No newline at end of file
@@ -207,12 +207,17 @@ class TsimKsmsService:
 
             # Step 3: Setup source hosts from trace
             # Check if hosts are managed by host pool service (batch quick jobs)
+            virtual_sources = []
             if params.get('host_pool_managed'):
                 # Hosts already created by host pool - skip creation
                 allocated_hosts = params.get('allocated_hosts', {})
                 self.logger.info(f"Using {len(allocated_hosts)} hosts from host pool: {list(allocated_hosts.keys())}")
                 log_progress('PHASE2_host_setup', f'Using {len(allocated_hosts)} pre-created hosts from pool')
 
+                # Injector hosts send with the source IP as a non-local address
+                virtual_sources = [f"{info['router']}={host}" for host, info in allocated_hosts.items()
+                                   if info.get('virtual')]
+
                 # Don't track hosts for cleanup - host pool will handle it
                 created_hosts = []
             else:
@@ -226,7 +231,8 @@ class TsimKsmsService:
             # Step 4: Execute KSMS bulk scan
             log_progress('PHASE3_ksms_scan', f'Executing KSMS bulk scan with DSCP {job_dscp}')
 
-            ksms_results = self._execute_ksms_scan(source_ip, dest_ip, services, job_dscp, run_id)
+            ksms_results = self._execute_ksms_scan(source_ip, dest_ip, services, job_dscp, run_id,
+                                                   virtual_sources)
 
             # Check for errors in KSMS results
             if 'error' in ksms_results:
@@ -323,7 +329,8 @@ class TsimKsmsService:
             raise
     
     def _execute_ksms_scan(self, source_ip: str, dest_ip: str, services: List[Dict],
-                          job_dscp: int, run_id: str) -> Dict[str, Any]:
+                          job_dscp: int, run_id: str,
+                          virtual_sources: Optional[List[str]] = None) -> Dict[str, Any]:
         """Execute ksms_tester directly or via subprocess
 
         NOTE: DSCP is now passed via --dscp CLI argument (not environment variable).
@@ -337,6 +344,7 @@ class TsimKsmsService:
         for svc in services:
             port_specs.append(f"{svc['port']}/{svc['protocol']}")
         ports_arg = ",".join(port_specs)
+        virtual_args = [arg for spec in virtual_sources or [] for arg in ('--virtual-source', spec)]
 
         # DIRECT EXECUTION: Call ksms_tester directly without subprocess
         # Results are written to file instead of stdout to avoid Apache/mod_wsgi FD issues
@@ -359,10 +367,11 @@ class TsimKsmsService:
                         '-s', source_ip,
                         '-d', dest_ip,
                         '-P', ports_arg,
-                        '--dscp', str(job_dscp),
+                        *self.dscp_registry.ksms_tag_args(job_dscp),
                         '--max-services', str(max_services),
                         '--range-limit', str(max_services),
-                        '--run-id', run_id  # Write results to file
+                        '--run-id', run_id,  # Write results to file
+                        *virtual_args
                     ]
 
                     # Call ksms_tester.main() directly with explicit argv (thread-safe)
@@ -406,7 +415,8 @@ class TsimKsmsService:
                 # Fall through to tsimsh fallback
 
         # Fallback to tsimsh subprocess
-        ksms_command = f"ksms_tester -s {source_ip} -d {dest_ip} -P {ports_arg} --dscp {job_dscp} -j"
+        tag_args = ' '.join(self.dscp_registry.ksms_tag_args(job_dscp))
+        ksms_command = f"ksms_tester -s {source_ip} -d {dest_ip} -P {ports_arg} {tag_args} {' '.join(virtual_args)} -j"
         self.logger.debug(f"Executing KSMS via tsimsh: {ksms_command}")
 
         ksms_output = tsimsh_exec(ksms_command, capture_output=True, verbose=1, env=None)
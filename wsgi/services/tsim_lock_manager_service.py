@@ -34,6 +34,8 @@ from pathlib import Path
 from typing import Optional, Dict, Any
 from contextlib import contextmanager
 
+from .tsim_lock_stats import get_lock_stats
+
 
 class TsimLockManagerService:
     """Lock management service for preventing concurrent test execution
@@ -73,6 +75,8 @@ class TsimLockManagerService:
         self.file_locks = {}
         # Optional legacy lock FDs (for network_test compatibility)
         self.legacy_file_locks = {}
+        # Acquisition time per held lock, for hold-time statistics
+        self.held_since = {}
     
     def acquire_lock(self, lock_name: str, timeout: float = 60.0,
                     retry_interval: float = 0.5) -> bool:
@@ -110,7 +114,10 @@ class TsimLockManagerService:
             thread_lock = self.thread_locks[lock_name]
         
         # Try to acquire thread lock
-        if not thread_lock.acquire(timeout=timeout):
+        wait_start = time.monotonic()
+        contended = not thread_lock.acquire(blocking=False)
+        if contended and not thread_lock.acquire(timeout=timeout):
+            self._record_timeout(lock_name, wait_start)
             return False
         
         # Now try file-based lock for inter-process synchronization
@@ -150,6 +157,7 @@ class TsimLockManagerService:
                             del self.file_locks[lock_name]
                         except Exception:
                             pass
+                        contended = True
                         time.sleep(retry_interval)
                         continue
                     except Exception as _e:
@@ -157,11 +165,13 @@ class TsimLockManagerService:
                         self.logger.debug(f"Legacy lock acquisition issue: {_e}")
 
                 # self.logger.debug(f"Acquired lock: {lock_name}")  # Suppressed to reduce noise
+                self._record_acquired(lock_name, wait_start, contended)
                 return True
 
             except BlockingIOError:
                 # Lock is held by another process
                 os.close(fd)
+                contended = True
                 time.sleep(retry_interval)
                 
             except Exception as e:
@@ -172,13 +182,72 @@ class TsimLockManagerService:
         
         # Timeout reached
         thread_lock.release()
+        self._record_timeout(lock_name, wait_start)
         return False
     
-    def release_lock(self, lock_name: str) -> bool:
+    def wait_for_lock(self, lock_name: str) -> bool:
+        """Block until a named lock is acquired, without retry polling
+
+        The waiter sleeps in flock(); the kernel hands the lock over the moment
+        the holder releases it or its process dies, so a standby takes over
+        immediately. Release with release_lock(lock_name, unlink=False): other
+        waiters are blocked on this lock file's inode.
+
+        Args:
+            lock_name: Name of the lock
+
+        Returns:
+            True once the lock is held, False on error
+        """
+        with self.thread_lock_mutex:
+            if lock_name not in self.thread_locks:
+                self.thread_locks[lock_name] = threading.Lock()
+            thread_lock = self.thread_locks[lock_name]
+        wait_start = time.monotonic()
+        contended = not thread_lock.acquire(blocking=False)
+        if contended:
+            thread_lock.acquire()
+
+        lock_file = self.lock_dir / f"{lock_name}.lock"
+        while True:
+            try:
+                fd = os.open(str(lock_file), os.O_CREAT | os.O_WRONLY, 0o644)
+            except Exception as e:
+                self.logger.error(f"Error acquiring lock {lock_name}: {e}")
+                thread_lock.release()
+                return False
+            try:
+                try:
+                    fcntl.flock(fd, fcntl.LOCK_EX | fcntl.LOCK_NB)
+                except BlockingIOError:
+                    contended = True
+                    fcntl.flock(fd, fcntl.LOCK_EX)
+                # A holder using release_lock() unlinks the file; the lock on a
+                # removed inode protects nothing, so reopen and wait again
+                try:
+                    same_file = os.fstat(fd).st_ino == os.stat(lock_file).st_ino
+                except FileNotFoundError:
+                    same_file = False
+                if not same_file:
+                    os.close(fd)
+                    continue
+                os.ftruncate(fd, 0)
+                os.pwrite(fd, f"{os.getpid()}\n{time.time()}\n".encode(), 0)
+                self.file_locks[lock_name] = fd
+                self._record_acquired(lock_name, wait_start, contended)
+                return True
+            except Exception as e:
+                self.logger.error(f"Error acquiring lock {lock_name}: {e}")
+                os.close(fd)
+                thread_lock.release()
+                return False
+
+    def release_lock(self, lock_name: str, unlink: bool = True) -> bool:
         """Release a named lock
         
         Args:
             lock_name: Name of the lock
+            unlink: Remove the lock file (must be False for wait_for_lock() locks)
             
         Returns:
             True if released successfully
@@ -192,13 +261,15 @@ class TsimLockManagerService:
                 fcntl.flock(fd, fcntl.LOCK_UN)
                 os.close(fd)
                 del self.file_locks[lock_name]
+                self._record_release(lock_name)
                 
                 # Optionally remove lock file
-                lock_file = self.lock_dir / f"{lock_name}.lock"
-                try:
-                    lock_file.unlink()
-                except:
-                    pass  # Non-critical
+                if unlink:
+                    lock_file = self.lock_dir / f"{lock_name}.lock"
+                    try:
+                        lock_file.unlink()
+                    except:
+                        pass  # Non-critical
                 
                 # self.logger.debug(f"Released lock: {lock_name}")  # Suppressed to reduce noise
             except Exception as e:
@@ -226,6 +297,24 @@ class TsimLockManagerService:
         
         return success
     
+    def _record_acquired(self, lock_name: str, wait_start: float, contended: bool):
+        now = time.monotonic()
+        self.held_since[lock_name] = now
+        stats = get_lock_stats()
+        if stats is not None:
+            stats.acquired(f"tsim-lockmgr-{lock_name}", now - wait_start, contended)
+
+    def _record_timeout(self, lock_name: str, wait_start: float):
+        stats = get_lock_stats()
+        if stats is not None:
+            stats.timed_out(f"tsim-lockmgr-{lock_name}", time.monotonic() - wait_start)
+
+    def _record_release(self, lock_name: str):
+        held_since = self.held_since.pop(lock_name, None)
+        stats = get_lock_stats()
+        if stats is not None and held_since is not None:
+            stats.released(f"tsim-lockmgr-{lock_name}", time.monotonic() - held_since)
+
     @contextmanager
     def lock(self, lock_name: str, timeout: float = 60.0):
         """Context manager for locks
@@ -0,0 +1,39 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Lock Statistics
+Web-service access to the shared lock contention segment
+
+Re-exports tsim.core.lock_stats. When the tsim package is not importable
+the services still lock normally and simply record nothing.
+"""
+
+import fcntl
+import time
+from typing import Optional
+
+try:
+    from tsim.core.lock_stats import get_lock_stats, flock_exclusive, record_release
+except ImportError:
+    def get_lock_stats(path: Optional[str] = None):
+        return None
+
+    def flock_exclusive(fd: int, name: str, waiter: Optional[str] = None) -> float:
+        fcntl.flock(fd, fcntl.LOCK_EX)
+        return time.monotonic()
+
+    def record_release(name: str, acquired_at: Optional[float]):
+        pass
+
+
+def lock_stats_snapshot(limit: int = 20) -> Optional[dict]:
+    """Most-waited-on locks for the admin pages, or None if unavailable."""
+    stats = get_lock_stats()
+    if stats is None:
+        return None
+    snapshot = stats.snapshot()
+    locks = []
+    for lock in snapshot['locks'][:limit]:
+        lock = {k: v for k, v in lock.items() if k not in ('wait_histogram', 'hold_histogram')}
+        lock['top_waiters'] = lock['top_waiters'][:3]
+        locks.append(lock)
+    return {'since': snapshot['since'], 'locks': locks}
@@ -0,0 +1,245 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Progress Event Log
+Append-only per-run progress events in /dev/shm with inotify wakeups
+
+The tracker appends one fixed-size record per phase to
+<run_dir>/<run_id>/progress.events with a single O_APPEND write, and a
+final record once the run's outcome is known. Records are 512 bytes and
+512-aligned, so a record never straddles a page and a reader sees either
+all of it or none of it. Stream handlers keep a byte offset, read only
+the records past it, and sleep on an inotify watch of the run directory
+between appends, so each connected client costs O(new events) and sees
+a phase as soon as it is written.
+
+Record layout (512 bytes):
+    0   u16  payload length (0 = not yet written)
+    2   u8   kind (1 = phase, 2 = final)
+    3   pad
+    4   f64  timestamp
+    12  48s  phase name (NUL padded)
+    60  452s payload: JSON object (message, details, percent, ...)
+"""
+
+import ctypes
+import ctypes.util
+import errno
+import json
+import logging
+import os
+import select
+import struct
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional
+
+
+EVENTS_FILE = 'progress.events'
+RECORD_SIZE = 512
+PHASE_SIZE = 48
+PAYLOAD_SIZE = 452
+_RECORD = struct.Struct('<HBxd48s452s')
+
+KIND_PHASE = 1
+KIND_FINAL = 2
+
+_IN_MODIFY = 0x00000002
+_IN_CREATE = 0x00000100
+_IN_MOVED_TO = 0x00000080
+_IN_NONBLOCK = os.O_NONBLOCK
+_IN_CLOEXEC = os.O_CLOEXEC
+_EVENT_HEADER = struct.Struct('iIII')
+
+
+def _load_inotify():
+    """inotify_init1/inotify_add_watch from libc, or None when unavailable."""
+    try:
+        libc = ctypes.CDLL(ctypes.util.find_library('c') or 'libc.so.6', use_errno=True)
+        init1 = libc.inotify_init1
+        add_watch = libc.inotify_add_watch
+    except (OSError, AttributeError):
+        return None
+    init1.argtypes = [ctypes.c_int]
+    init1.restype = ctypes.c_int
+    add_watch.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.c_uint32]
+    add_watch.restype = ctypes.c_int
+    return init1, add_watch
+
+
+_INOTIFY = _load_inotify()
+
+
+def _encode_payload(payload: Dict[str, Any]) -> bytes:
+    """JSON payload that fits a record, shedding details and message text as needed."""
+    data = json.dumps(payload, separators=(',', ':')).encode()
+    if len(data) <= PAYLOAD_SIZE:
+        return data
+    payload = {k: v for k, v in payload.items() if k != 'details'}
+    data = json.dumps(payload, separators=(',', ':')).encode()
+    if len(data) <= PAYLOAD_SIZE:
+        return data
+    message = str(payload.get('message', ''))
+    while len(data) > PAYLOAD_SIZE and message:
+        message = message[:max(0, len(message) - (len(data) - PAYLOAD_SIZE) - 3)]
+        payload['message'] = message + '...'
+        data = json.dumps(payload, separators=(',', ':')).encode()
+    return data if len(data) <= PAYLOAD_SIZE else b'{}'
+
+
+class TsimProgressLog:
+    """Writer side: appends fixed-size records to a run's event file"""
+
+    def __init__(self, run_path: Path):
+        self.path = Path(run_path) / EVENTS_FILE
+        self.logger = logging.getLogger('tsim.progress_log')
+
+    def append(self, kind: int, phase: str, payload: Dict[str, Any],
+               timestamp: Optional[float] = None) -> bool:
+        """Append one record; False if the run directory is gone."""
+        body = _encode_payload(payload)
+        record = _RECORD.pack(len(body), kind, timestamp or time.time(),
+                              phase.encode()[:PHASE_SIZE - 1], body)
+        try:
+            fd = os.open(str(self.path), os.O_WRONLY | os.O_APPEND | os.O_CREAT, 0o664)
+        except FileNotFoundError:
+            return False
+        try:
+            os.write(fd, record)
+        finally:
+            os.close(fd)
+        return True
+
+    def phase(self, phase: str, message: str, details: Optional[Dict[str, Any]],
+              percent: int, expected_steps: int, timestamp: Optional[float] = None) -> bool:
+        payload = {'message': message, 'percent': percent, 'expected_steps': expected_steps}
+        if details:
+            payload['details'] = details
+        return self.append(KIND_PHASE, phase, payload, timestamp)
+
+    def final(self, success: bool, error: Optional[str] = None,
+              pdf_url: Optional[str] = None) -> bool:
+        return self.append(KIND_FINAL, 'FINAL',
+                           {'success': success, 'error': error, 'pdf_url': pdf_url})
+
+
+class TsimProgressLogReader:
+    """Reader side: returns records past its offset and waits for new ones"""
+
+    def __init__(self, run_path: Path):
+        self.run_path = Path(run_path)
+        self.path = self.run_path / EVENTS_FILE
+        self.offset = 0
+        self._fd: Optional[int] = None
+        self._inotify: Optional[int] = None
+        self._poller = None
+        self._watching = False
+        self.logger = logging.getLogger('tsim.progress_log')
+
+    def exists(self) -> bool:
+        return self._fd is not None or self.path.exists()
+
+    def read_new(self) -> List[Dict[str, Any]]:
+        """Complete records appended since the last call."""
+        if self._fd is None:
+            try:
+                self._fd = os.open(str(self.path), os.O_RDONLY)
+            except FileNotFoundError:
+                return []
+        size = os.fstat(self._fd).st_size
+        available = (size - self.offset) // RECORD_SIZE * RECORD_SIZE
+        if available <= 0:
+            return []
+        data = os.pread(self._fd, available, self.offset)
+        events = []
+        for start in range(0, len(data), RECORD_SIZE):
+            length, kind, timestamp, phase, payload = _RECORD.unpack_from(data, start)
+            if length == 0:
+                break  # Size already grown but bytes not yet visible: retry next time
+            try:
+                body = json.loads(payload[:length])
+            except ValueError:
+                body = {}
+            events.append({
+                'kind': kind,
+                'phase': phase.split(b'\0', 1)[0].decode(errors='replace'),
+                'timestamp': timestamp,
+                **body
+            })
+            self.offset += RECORD_SIZE
+        return events
+
+    def _watch(self):
+        """Watch the run directory for creation of and appends to the event file."""
+        if self._watching or _INOTIFY is None:
+            return
+        init1, add_watch = _INOTIFY
+        if self._inotify is None:
+            fd = init1(_IN_NONBLOCK | _IN_CLOEXEC)
+            if fd < 0:
+                return
+            self._inotify = fd
+            self._poller = select.poll()
+            self._poller.register(fd, select.POLLIN)
+        if add_watch(self._inotify, str(self.run_path).encode(),
+                     _IN_MODIFY | _IN_CREATE | _IN_MOVED_TO) >= 0:
+            self._watching = True
+        elif ctypes.get_errno() != errno.ENOENT:
+            self.logger.debug(f"inotify watch on {self.run_path} failed: errno {ctypes.get_errno()}")
+
+    def wait(self, timeout: float) -> bool:
+        """Sleep until the event file changes or timeout; True if it changed.
+
+        Without inotify (or before the run directory exists) this falls back
+        to checking the file size every 0.5s.
+        """
+        self._watch()
+        deadline = time.monotonic() + timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return False
+            if not self._watching:
+                time.sleep(min(remaining, 0.5))
+                self._watch()
+                if self._has_more():
+                    return True
+                continue
+            if not self._poller.poll(max(1, int(remaining * 1000))):
+                return False
+            if self._drain():
+                return True
+
+    def _has_more(self) -> bool:
+        try:
+            return os.stat(self.path).st_size >= self.offset + RECORD_SIZE
+        except FileNotFoundError:
+            return False
+
+    def _drain(self) -> bool:
+        """Consume queued inotify events; True if one concerned the event file."""
+        name = EVENTS_FILE.encode()
+        hit = False
+        while True:
+            try:
+                data = os.read(self._inotify, 4096)
+            except BlockingIOError:
+                return hit
+            if not data:
+                return hit
+            pos = 0
+            while pos + _EVENT_HEADER.size <= len(data):
+                _, _, _, length = _EVENT_HEADER.unpack_from(data, pos)
+                pos += _EVENT_HEADER.size
+                if data[pos:pos + length].split(b'\0', 1)[0] == name:
+                    hit = True
+                pos += length
+
+    def close(self):
+        if self._fd is not None:
+            os.close(self._fd)
+            self._fd = None
+        if self._inotify is not None:
+            os.close(self._inotify)
+            self._inotify = None
+            self._poller = None
+            self._watching = False
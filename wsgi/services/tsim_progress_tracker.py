@@ -13,6 +13,8 @@ from typing import Dict, Any, Optional, List
 from datetime import datetime
 from collections import defaultdict
 
+from .tsim_progress_log import TsimProgressLog
+
 
 class TsimProgressTracker:
     """In-memory progress tracking with optional file persistence"""
@@ -36,6 +38,11 @@ class TsimProgressTracker:
         # Optional file persistence for SSE
         self.run_dir = Path(config_service.get('run_dir', '/dev/shm/tsim/runs'))
         self.run_dir.mkdir(parents=True, exist_ok=True)
+
+        # progress.json is a coalesced snapshot; live updates go to the event log
+        self.snapshot_interval = float(config_service.get('progress_snapshot_interval', 1.0))
+        self._snapshot_written = {}  # run_id -> time of last progress.json write
+        self._snapshot_timers = {}   # run_id -> pending threading.Timer
         
         # Phase definitions for progress calculation (using actual CGI phase names)
         self.expected_phases = [
@@ -82,6 +89,8 @@ class TsimProgressTracker:
             }
         
         # Write initial files for SSE compatibility
+        TsimProgressLog(run_path).phase('START', 'Test execution started', None,
+                                        0, len(self.expected_phases))
         self._write_timing_file(run_id, 'START', 'Test execution started')
         self._write_audit_file(run_id, 'START', 'Test execution started')
         
@@ -150,13 +159,18 @@ class TsimProgressTracker:
                 expected = max(1, progress.get('expected_steps') or len(self.expected_phases))
                 # Cap at 99% until completion
                 progress['overall_progress'] = min(99, int(100 * completed / expected))
+            percent = progress['overall_progress']
+            expected_steps = progress.get('expected_steps') or len(self.expected_phases)
+            complete = progress['complete']
         
-        # Write to files for SSE
+        # Push the event to stream readers first, then the compatibility files
+        TsimProgressLog(self.run_dir / run_id).phase(phase, message, details, percent,
+                                                     expected_steps, timestamp)
         self._write_timing_file(run_id, phase, message)
         self._write_audit_file(run_id, phase, message, details)
         
-        # Also write progress.json for easy reading
-        self._write_progress_json(run_id)
+        # progress.json is rewritten at most once per snapshot interval (completion at once)
+        self._schedule_progress_json(run_id, immediate=complete)
     
     def get_progress(self, run_id: str) -> Optional[Dict[str, Any]]:
         """Get current progress for a run
@@ -361,6 +375,7 @@ class TsimProgressTracker:
             
             for run_id in to_remove:
                 del self.progress[run_id]
+                self._snapshot_written.pop(run_id, None)
                 self.logger.debug(f"Removed old progress data for {run_id}")
         
         if to_remove:
@@ -412,6 +427,35 @@ class TsimProgressTracker:
         except Exception as e:
             self.logger.warning(f"Failed to write timing file: {e}")
     
+    def _schedule_progress_json(self, run_id: str, immediate: bool = False):
+        """Write progress.json now, or once the snapshot interval has passed
+
+        Bursts of phases coalesce into one write; the last phase of a burst
+        lands on disk at most snapshot_interval seconds late.
+        """
+        with self.lock:
+            if immediate:
+                timer = self._snapshot_timers.pop(run_id, None)
+                if timer:
+                    timer.cancel()
+            elif run_id in self._snapshot_timers:
+                return
+            wait = self._snapshot_written.get(run_id, 0) + self.snapshot_interval - time.time()
+            if wait > 0 and not immediate:
+                timer = threading.Timer(wait, self._flush_progress_json, args=(run_id,))
+                timer.daemon = True
+                self._snapshot_timers[run_id] = timer
+                timer.start()
+                return
+            self._snapshot_written[run_id] = time.time()
+        self._write_progress_json(run_id)
+
+    def _flush_progress_json(self, run_id: str):
+        with self.lock:
+            self._snapshot_timers.pop(run_id, None)
+            self._snapshot_written[run_id] = time.time()
+        self._write_progress_json(run_id)
+
     def _write_progress_json(self, run_id: str):
         """Write progress.json for easy reading (only if in memory)
 
@@ -446,6 +490,11 @@ class TsimProgressTracker:
 
         try:
             with self.lock:
+                timer = self._snapshot_timers.pop(run_id, None)
+                if timer:
+                    timer.cancel()
+                self._snapshot_written[run_id] = time.time()
+
                 # Try to get from memory first
                 if run_id in self.progress:
                     progress_data = dict(self.progress[run_id])
@@ -487,6 +536,10 @@ class TsimProgressTracker:
                 self.logger.debug(f"Wrote completion status to progress.json for {run_id} "
                                 f"(complete={success}, error={error})")
 
+            # Final record ends every open progress stream for this run
+            TsimProgressLog(self.run_dir / run_id).final(success, progress_data.get('error'),
+                                                         progress_data.get('pdf_url'))
+
         except Exception as e:
             self.logger.error(f"Failed to force write progress.json for {run_id}: {e}")
     
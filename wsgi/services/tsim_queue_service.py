@@ -1,10 +1,11 @@
 #!/usr/bin/env -S python3 -B -u
 """
 TSIM Queue Service
-Simple file-backed FIFO queue to serialize test runs across users.
+FIFO queue to serialize test runs across users.
 
-Stores a queue file in /dev/shm (RAM disk) with an accompanying lock file
-to coordinate access across WSGI processes/threads.
+Queued jobs live in a shared-memory slot table in /dev/shm (RAM disk) backed
+by an append-only journal (see tsim_shm_queue); an accompanying lock file
+coordinates access across WSGI processes/threads.
 """
 
 import os
@@ -15,6 +16,12 @@ import logging
 from pathlib import Path
 from typing import Dict, Any, List, Optional
 
+from .tsim_doorbell import TsimDoorbell
+from .tsim_lock_stats import flock_exclusive, record_release
+from .tsim_shm_queue import TsimShmJobQueue
+
+DEFAULT_QUEUE_JOURNAL = '/var/lib/tsim/queue/queue.journal'
+
 
 class TsimQueueService:
     """File-backed FIFO queue for test run jobs."""
@@ -26,20 +33,38 @@ class TsimQueueService:
         base_dir = Path(self.config.get('data_dir', '/dev/shm/tsim'))
         self.queue_dir = base_dir / 'queue'
         self.queue_file = self.queue_dir / 'queue.json'
+        self.table_file = self.queue_dir / 'queue.shm'
+        # The journal rebuilds the queue after /dev/shm is wiped, so it must
+        # live on persistent storage
+        self.journal_file = Path(self.config.get('queue_journal') or DEFAULT_QUEUE_JOURNAL)
         self.lock_file = self.queue_dir / 'queue.lock'
         self.current_file = self.queue_dir / 'current.json'
 
-        # Ensure directory exists
+        # Ensure directories exist
         try:
             self.queue_dir.mkdir(parents=True, exist_ok=True, mode=0o775)
         except Exception:
             pass
+        try:
+            self.journal_file.parent.mkdir(parents=True, exist_ok=True, mode=0o775)
+        except OSError as e:
+            fallback = self.queue_dir / 'queue.journal'
+            self.logger.warning(f"Cannot create {self.journal_file.parent} ({e}); journaling to "
+                                f"{fallback}, queued jobs will not survive a reboot")
+            self.journal_file = fallback
 
-        # Initialize queue file if missing
-        if not self.queue_file.exists():
-            self._save_queue({'version': 1, 'updated_at': time.time(), 'jobs': []})
+        with self._lock():
+            self.table = TsimShmJobQueue(
+                self.table_file, self.journal_file,
+                capacity=self.config.get('queue_capacity', 4096),
+                journal_max_bytes=self.config.get('queue_journal_max_bytes', 8 * 1024 * 1024)
+            )
+            self._migrate_queue_file()
+
+        # Rung on enqueue and job completion to wake the scheduler leader
+        self.doorbell = TsimDoorbell(self.queue_dir / 'doorbell')
 
-        self.logger.info(f"Queue service using {self.queue_file}")
+        self.logger.info(f"Queue service using {self.table_file} (journal {self.journal_file})")
 
     # --------------- internal helpers ---------------
     def _lock(self):
@@ -47,129 +72,89 @@ class TsimQueueService:
             def __init__(self, path: Path):
                 self.path = path
                 self.fd = None
+                self.acquired_at = None
             def __enter__(self):
                 self.fd = os.open(str(self.path), os.O_CREAT | os.O_RDWR, 0o664)
-                fcntl.flock(self.fd, fcntl.LOCK_EX)
+                self.acquired_at = flock_exclusive(self.fd, 'tsim-queue')
                 return self
             def __exit__(self, exc_type, exc, tb):
                 try:
                     if self.fd is not None:
                         fcntl.flock(self.fd, fcntl.LOCK_UN)
                         os.close(self.fd)
+                        record_release('tsim-queue', self.acquired_at)
                 except Exception:
                     pass
         return _Lock(self.lock_file)
 
-    def _load_queue(self) -> Dict[str, Any]:
+    def _migrate_queue_file(self):
+        """Move jobs from a queue.json left by the file-backed queue into the table."""
+        if not self.queue_file.exists():
+            return
         try:
             with open(self.queue_file, 'r') as f:
-                return json.load(f)
-        except Exception:
-            return {'version': 1, 'updated_at': time.time(), 'jobs': []}
-
-    def _save_queue(self, data: Dict[str, Any]):
-        tmp = self.queue_file.with_suffix('.tmp')
-        with open(tmp, 'w') as f:
-            json.dump(data, f, indent=2)
-            f.flush()
-            os.fsync(f.fileno())
-        tmp.replace(self.queue_file)
+                jobs = json.load(f).get('jobs', [])
+            for job in jobs:
+                job.setdefault('type', job.get('analysis_mode', 'detailed'))
+                self.table.enqueue(job)
+            self.queue_file.rename(self.queue_file.with_suffix('.json.migrated'))
+            self.logger.info(f"Migrated {len(jobs)} queued jobs from {self.queue_file}")
+        except Exception as e:
+            self.logger.warning(f"Could not migrate {self.queue_file}: {e}")
 
     # --------------- public api ---------------
     def enqueue(self, run_id: str, username: str, params: Dict[str, Any]) -> int:
         """Enqueue a new job and return its 1-based position."""
+        # Store analysis_mode in job metadata for parallel execution support
+        # IMPORTANT: Every job must have a type field set to 'quick' or 'detailed'
+        analysis_mode = params.get('analysis_mode', 'detailed')
+        if analysis_mode not in ('quick', 'detailed'):
+            raise ValueError(f"Invalid analysis_mode '{analysis_mode}' - must be 'quick' or 'detailed'")
+
+        job = {
+            'run_id': run_id,
+            'username': username,
+            'created_at': time.time(),
+            'status': 'QUEUED',
+            'params': params,
+            'analysis_mode': analysis_mode,  # For backward compatibility
+            'type': analysis_mode,  # NEW: Always set type field explicitly
+        }
+        # An already queued run_id keeps its place
         with self._lock():
-            q = self._load_queue()
-            jobs: List[Dict[str, Any]] = q.get('jobs', [])
-
-            # Avoid duplicating existing run_id
-            for idx, j in enumerate(jobs):
-                if j.get('run_id') == run_id:
-                    return idx + 1
-
-            # Store analysis_mode in job metadata for parallel execution support
-            # IMPORTANT: Every job must have a type field set to 'quick' or 'detailed'
-            analysis_mode = params.get('analysis_mode', 'detailed')
-            if analysis_mode not in ('quick', 'detailed'):
-                raise ValueError(f"Invalid analysis_mode '{analysis_mode}' - must be 'quick' or 'detailed'")
-
-            jobs.append({
-                'run_id': run_id,
-                'username': username,
-                'created_at': time.time(),
-                'status': 'QUEUED',
-                'params': params,
-                'analysis_mode': analysis_mode,  # For backward compatibility
-                'type': analysis_mode,  # NEW: Always set type field explicitly
-            })
-            q['jobs'] = jobs
-            q['updated_at'] = time.time()
-            self._save_queue(q)
-            return len(jobs)
+            position = self.table.enqueue(job)
+        self.doorbell.ring()
+        return position
 
     def has_user_job(self, username: str) -> bool:
         """True if user has a queued/starting/running job."""
         with self._lock():
-            jobs = self._load_queue().get('jobs', [])
-            return any(j.get('username') == username and j.get('status') in ('QUEUED', 'STARTING', 'RUNNING') for j in jobs)
+            return self.table.has_user_job(username, ('QUEUED', 'STARTING', 'RUNNING'))
 
     def get_position(self, run_id: str) -> Optional[int]:
         with self._lock():
-            for idx, j in enumerate(self._load_queue().get('jobs', [])):
-                if j.get('run_id') == run_id:
-                    return idx + 1
-            return None
+            return self.table.position(run_id)
 
     def pop_next(self) -> Optional[Dict[str, Any]]:
         """Pop and return the next job (FIFO)."""
         with self._lock():
-            q = self._load_queue()
-            jobs = q.get('jobs', [])
-            if not jobs:
-                return None
-            job = jobs.pop(0)
-            q['jobs'] = jobs
-            q['updated_at'] = time.time()
-            self._save_queue(q)
-            return job
+            return self.table.pop_head()
 
     def update_status(self, run_id: str, status: str) -> None:
         with self._lock():
-            q = self._load_queue()
-            jobs = q.get('jobs', [])
-            updated = False
-            for j in jobs:
-                if j.get('run_id') == run_id:
-                    j['status'] = status
-                    updated = True
-                    break
-            if updated:
-                q['updated_at'] = time.time()
-                self._save_queue(q)
+            self.table.update_status(run_id, status)
 
     def remove(self, run_id: str) -> bool:
         with self._lock():
-            q = self._load_queue()
-            jobs = q.get('jobs', [])
-            new_jobs = [j for j in jobs if j.get('run_id') != run_id]
-            if len(new_jobs) != len(jobs):
-                q['jobs'] = new_jobs
-                q['updated_at'] = time.time()
-                self._save_queue(q)
-                return True
-            return False
+            return self.table.remove(run_id) is not None
 
     def list_jobs(self) -> List[Dict[str, Any]]:
         """Return a shallow copy of queued jobs with positions."""
         with self._lock():
-            q = self._load_queue()
-            jobs = q.get('jobs', [])
-            out = []
-            for idx, j in enumerate(jobs):
-                item = dict(j)
-                item['position'] = idx + 1
-                out.append(item)
-            return out
+            jobs = self.table.jobs()
+        for idx, item in enumerate(jobs):
+            item['position'] = idx + 1
+        return jobs
 
     # --------------- current running job ---------------
     def set_current(self, job: Dict[str, Any]):
@@ -200,7 +185,8 @@ class TsimQueueService:
                 pass
 
     # --------------- parallel execution support ---------------
-    def pop_compatible_jobs(self, running_jobs: Dict[str, Dict], max_jobs: int = 32) -> List[Dict[str, Any]]:
+    def pop_compatible_jobs(self, running_jobs: Dict[str, Dict], max_jobs: int = 32,
+                            max_quick: int = 32) -> List[Dict[str, Any]]:
         """Pop compatible jobs based on current running jobs.
 
         Parallel Execution Logic:
@@ -211,61 +197,55 @@ class TsimQueueService:
         Args:
             running_jobs: Dict of {run_id: {'type': 'quick'|'detailed', 'dscp': int}}
             max_jobs: Maximum number of jobs to pop (respects thread pool capacity)
+            max_quick: Maximum concurrent quick jobs (bounded by the job tag capacity)
 
         Returns:
             List of job dicts to execute
         """
-        with self._lock():
-            q = self._load_queue()
-            jobs = q.get('jobs', [])
-            if not jobs:
-                return []
+        # Determine what's currently running
+        has_detailed = any(j['type'] == 'detailed' for j in running_jobs.values())
+        quick_count = sum(1 for j in running_jobs.values() if j['type'] == 'quick')
 
-            # Determine what's currently running
-            has_detailed = any(j['type'] == 'detailed' for j in running_jobs.values())
-            quick_count = sum(1 for j in running_jobs.values() if j['type'] == 'quick')
+        # If detailed job running, nothing can start
+        if has_detailed:
+            return []
 
-            # If detailed job running, nothing can start
-            if has_detailed:
+        with self._lock():
+            if not len(self.table):
                 return []
 
             # If quick jobs running, only more quick jobs can start
             if quick_count > 0:
-                max_quick = 32  # From dscp_registry max_concurrent_jobs
                 slots_available = min(max_quick - quick_count, max_jobs)
                 if slots_available <= 0:
                     return []
 
                 # Pop up to slots_available quick jobs (limited by max_jobs)
-                quick_jobs = [j for j in jobs if j.get('analysis_mode') == 'quick']
-                to_pop = quick_jobs[:slots_available]
-
-                # Remove from queue
-                remaining = [j for j in jobs if j not in to_pop]
-                q['jobs'] = remaining
-                q['updated_at'] = time.time()
-                self._save_queue(q)
-                return to_pop
+                return self.table.pop_lane('quick', slots_available)
 
             # Nothing running - check first job
-            first_job = jobs[0]
+            first_job = self.table.head()
             if first_job.get('analysis_mode') == 'quick':
-                # Pop multiple quick jobs (limited by max_jobs and DSCP limit)
-                quick_jobs = [j for j in jobs if j.get('analysis_mode') == 'quick']
-                to_pop = quick_jobs[:min(32, max_jobs)]
-
-                remaining = [j for j in jobs if j not in to_pop]
-                q['jobs'] = remaining
-                q['updated_at'] = time.time()
-                self._save_queue(q)
-                return to_pop
+                # Pop multiple quick jobs (limited by max_jobs and job tag limit)
+                return self.table.pop_lane('quick', min(max_quick, max_jobs))
             else:
                 # Pop one detailed job
-                jobs.pop(0)
-                q['jobs'] = jobs
-                q['updated_at'] = time.time()
-                self._save_queue(q)
-                return [first_job]
+                return [self.table.pop_head()]
+
+    def peek_jobs(self, limit: int) -> List[Dict[str, Any]]:
+        """Return the oldest queued jobs without removing them."""
+        with self._lock():
+            return self.table.jobs(limit)
+
+    def pop_jobs(self, run_ids: List[str]) -> List[Dict[str, Any]]:
+        """Pop specific queued jobs atomically (used by router-scoped scheduling).
+
+        Jobs cancelled since they were peeked are silently skipped.
+        """
+        if not run_ids:
+            return []
+        with self._lock():
+            return self.table.pop_ids(run_ids)
 
     def set_running(self, jobs: List[Dict[str, Any]]):
         """Set multiple jobs as running (for parallel execution).
@@ -351,19 +331,8 @@ class TsimQueueService:
         """
         # Try queued removal first, while preserving job metadata
         with self._lock():
-            q = self._load_queue()
-            jobs = q.get('jobs', [])
-            removed_job = None
-            new_jobs = []
-            for j in jobs:
-                if j.get('run_id') == run_id and removed_job is None:
-                    removed_job = j
-                else:
-                    new_jobs.append(j)
+            removed_job = self.table.remove(run_id)
             if removed_job is not None:
-                q['jobs'] = new_jobs
-                q['updated_at'] = time.time()
-                self._save_queue(q)
                 # Write cancel marker and minimal run.json for history/details
                 try:
                     from datetime import datetime
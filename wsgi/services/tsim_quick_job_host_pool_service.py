@@ -10,26 +10,32 @@ Architecture:
 1. Execute traces in parallel for all queued quick jobs
 2. Parse traces to determine all required hosts
 3. Create all hosts atomically before launching any job
+   (leasing pre-created hosts from the warm pool where possible)
 4. Track reference counts (which jobs use which hosts)
 5. Remove hosts after grace period when no jobs are using them
+   (warm pool hosts are parked for reuse instead)
 
 This design eliminates deadlocks that occur when jobs try to create
 hosts one-by-one while running in parallel.
 """
 
 import os
+import re
 import sys
 import json
 import time
 import logging
 import threading
 import subprocess
+import tempfile
 from pathlib import Path
 from typing import Dict, List, Any, Optional, Set, Tuple
 from concurrent.futures import ThreadPoolExecutor, as_completed
 
 from tsim.core.creator_tag import CreatorTagManager
 
+from .tsim_warm_host_pool import TsimWarmHostPool
+
 
 def tsimsh_exec(command: str, capture_output: bool = False, verbose: int = 0, env: dict = None) -> Optional[str]:
     """Execute tsimsh command (copied exactly from MultiServiceTester pattern)"""
@@ -118,6 +124,19 @@ class TsimQuickJobHostPoolService:
         # Path to tsimsh
         self.tsimsh_path = config_service.tsimsh_path
 
+        # Send probes from shared per-subnet injector hosts instead of per-source hosts
+        self.virtual_sources = bool(config_service.get('quick_job_virtual_sources', False))
+
+        # Pre-created hosts re-addressed at lease time (0 disables)
+        self.warm_pool = None
+        if config_service.get('quick_job_warm_pool_size', 2) > 0:
+            try:
+                self.warm_pool = TsimWarmHostPool(config_service, registry_manager, tsimsh_exec)
+                self.warm_pool.start()
+            except Exception as e:
+                self.logger.warning(f"Warm host pool unavailable, hosts will be created on demand: {e}")
+                self.warm_pool = None
+
         self.logger.info(f"Host pool service initialized (cleanup grace period: {self.cleanup_grace_period}s)")
 
     def prepare_and_execute_jobs(self, job_list: List[Dict[str, Any]],
@@ -195,6 +214,9 @@ class TsimQuickJobHostPoolService:
             with self.lock:
                 for job_id, hosts in host_requirements.items():
                     for host_name in hosts.keys():
+                        if self.warm_pool and self.warm_pool.owns(host_name):
+                            # Warm pool tracks its own leases
+                            continue
                         if host_name not in self.host_refcounts:
                             self.host_refcounts[host_name] = set()
                         self.host_refcounts[host_name].add(job_id)
@@ -470,9 +492,13 @@ class TsimQuickJobHostPoolService:
                              job_list: List[Dict[str, Any]]) -> Set[str]:
         """Create all required hosts atomically
 
-        This creates hosts in order, using atomic registry operations to prevent conflicts.
-        If any host creation fails, we don't rollback already-created hosts since they
-        might be in use by other jobs.
+        All missing hosts are created by a single `host add-bulk`, which
+        validates the whole set first and registers it in one transaction,
+        so either every host exists afterwards or none of the new ones do.
+        Hosts that already existed are reused and left alone.
+
+        Hosts leased from the warm pool replace their on-demand name in
+        host_requirements, so callers see the name actually in use.
 
         Args:
             host_requirements: Dictionary of job_id -> host_name -> {ip, router}
@@ -483,11 +509,16 @@ class TsimQuickJobHostPoolService:
         Raises:
             RuntimeError: If critical host creation fails
         """
+        if self.warm_pool:
+            self._lease_warm_hosts(host_requirements)
+
         # Collect all unique hosts needed
         all_hosts = {}  # host_name -> {ip, router, jobs: [job_id1, ...]}
 
         for job_id, hosts in host_requirements.items():
             for host_name, host_info in hosts.items():
+                if host_info.get('warm'):
+                    continue
                 if host_name not in all_hosts:
                     all_hosts[host_name] = {
                         'ip': host_info['ip'],
@@ -507,49 +538,91 @@ class TsimQuickJobHostPoolService:
         creator_tag = f"wsgi:{username}"
         self.logger.info(f"Creating hosts with creator tag: {creator_tag} (username from job params)")
 
+        if not all_hosts:
+            return created_hosts
+
         for host_name, host_info in sorted(all_hosts.items()):
-            ip = host_info['ip']
-            router = host_info['router']
-            jobs = host_info['jobs']
+            self.logger.info(f"Creating host {host_name} on {host_info['router']} "
+                             f"(used by {len(host_info['jobs'])} jobs)")
 
-            try:
-                # Create host using tsimsh (which handles registry internally)
-                self.logger.info(f"Creating host {host_name} on {router} (used by {len(jobs)} jobs)")
-
-                # Set environment with creator tag so subprocess can use it
-                env = os.environ.copy()
-                env['TSIM_CREATOR_TAG'] = creator_tag
-                self.logger.info(f"Passing TSIM_CREATOR_TAG={creator_tag} to subprocess for {host_name}")
-
-                # Use exact same method as KSMS service
-                result = tsimsh_exec(
-                    f"host add --name {host_name} --primary-ip {ip}/24 --connect-to {router} --no-delay",
-                    capture_output=True, verbose=3, env=env
-                )
-
-                if result is None:
-                    # Physical creation failed
-                    error_msg = f"Host add command failed for {host_name} on {router}"
-                    self.logger.error(error_msg)
-                    raise RuntimeError(error_msg)
-                else:
-                    # Check if host was reused (already existed physically) or created
-                    if "[REUSED]" in result:
-                        reused_hosts.add(host_name)
-                        self.logger.info(f"Host {host_name} was reused (pre-existing physically), will not clean up")
-                    else:
-                        created_hosts.add(host_name)
-                        self.logger.info(f"Host {host_name} was created, will clean up after test")
+        hosts_file = None
+        try:
+            fd, hosts_file = tempfile.mkstemp(prefix='tsim-hosts-', suffix='.json')
+            with os.fdopen(fd, 'w') as f:
+                json.dump([{'name': host_name, 'primary_ip': f"{host_info['ip']}/24",
+                            'connect_to': host_info['router']}
+                           for host_name, host_info in sorted(all_hosts.items())], f)
+            os.chmod(hosts_file, 0o644)
+
+            # Set environment with creator tag so subprocess can use it
+            env = os.environ.copy()
+            env['TSIM_CREATOR_TAG'] = creator_tag
+            self.logger.info(f"Passing TSIM_CREATOR_TAG={creator_tag} to subprocess for {len(all_hosts)} hosts")
 
-            except Exception as e:
-                error_msg = f"Failed to create host {host_name}: {e}"
-                self.logger.error(error_msg)
-                # Don't rollback - other jobs might be using already-created hosts
-                raise RuntimeError(error_msg)
+            result = tsimsh_exec(
+                f"host add-bulk --file {hosts_file} --no-delay",
+                capture_output=True, verbose=3, env=env
+            )
+        finally:
+            if hosts_file:
+                os.unlink(hosts_file)
+
+        if result is None:
+            # Physical creation failed - bulk add already removed anything it created
+            error_msg = f"Bulk host add failed for {', '.join(sorted(all_hosts))}"
+            self.logger.error(error_msg)
+            raise RuntimeError(error_msg)
+
+        # Hosts that already existed physically are reused and not cleaned up
+        reused_hosts = set(re.findall(r'\[REUSED\] Host (\S+)', result)) & set(all_hosts)
+        created_hosts = set(all_hosts) - reused_hosts
+        for host_name in sorted(reused_hosts):
+            self.logger.info(f"Host {host_name} was reused (pre-existing physically), will not clean up")
 
         self.logger.info(f"Host creation complete: {len(created_hosts)} created, {len(reused_hosts)} reused")
         return created_hosts
 
+    def _lease_warm_hosts(self, host_requirements: Dict[str, Dict[str, Dict[str, str]]]) -> None:
+        """Lease warm pool hosts for every (router, source IP) pair
+
+        Jobs with the same source on the same router share one host. In
+        virtual source mode all sources in a subnet share the injector.
+        Pairs the pool cannot serve keep their on-demand host name.
+        """
+        targets = {}  # (router, ip) -> [job_id, ...]
+        for job_id, hosts in host_requirements.items():
+            for host_info in hosts.values():
+                target = (host_info['router'], host_info['ip'])
+                self.warm_pool.note_demand(*target)
+                targets.setdefault(target, []).append(job_id)
+
+        leased = {}
+        virtual = set()
+        for (router, ip), jobs in targets.items():
+            host_name = None
+            if self.virtual_sources:
+                host_name = self.warm_pool.injector(router, ip, jobs)
+                if host_name:
+                    virtual.add((router, ip))
+            if not host_name:
+                host_name = self.warm_pool.lease(router, ip, jobs)
+            if host_name:
+                leased[(router, ip)] = host_name
+
+        for job_id, hosts in host_requirements.items():
+            renamed = {}
+            for host_name, host_info in hosts.items():
+                target = (host_info['router'], host_info['ip'])
+                pool_host = leased.get(target)
+                if pool_host:
+                    renamed[pool_host] = dict(host_info, warm=True, virtual=target in virtual)
+                else:
+                    renamed[host_name] = host_info
+            host_requirements[job_id] = renamed
+
+        self.logger.info(f"Leased {len(leased)}/{len(targets)} hosts from warm pool "
+                         f"({len(virtual)} as virtual sources)")
+
     def release_job(self, job_id: str, hosts: List[str]) -> None:
         """Release hosts used by a completed job
 
@@ -561,6 +634,8 @@ class TsimQuickJobHostPoolService:
         """
         with self.lock:
             for host_name in hosts:
+                if self.warm_pool and self.warm_pool.release(host_name, job_id):
+                    continue
                 if host_name in self.host_refcounts:
                     self.host_refcounts[host_name].discard(job_id)
 
@@ -761,6 +836,7 @@ class TsimQuickJobHostPoolService:
             - active_hosts: dict of {host_name: [job_ids]}
             - cleanup_pending: list of host names pending cleanup
             - host_expiry_times: dict of {host_name: expiry_timestamp}
+            - warm_pool: warm host pool status (None if disabled)
         """
         with self.lock:
             active_hosts = {
@@ -774,12 +850,19 @@ class TsimQuickJobHostPoolService:
             # Copy expiry times for hosts pending cleanup
             expiry_times = dict(self.host_expiry_times)
 
+        warm_status = self.warm_pool.get_status() if self.warm_pool else None
+        if warm_status:
+            for host, lease in warm_status['leased'].items():
+                active_hosts[host] = lease['jobs']
+            active_hosts.update(warm_status['injector_jobs'])
+
         return {
             'active_hosts': active_hosts,
             'active_host_count': len(active_hosts),
             'cleanup_pending': cleanup_pending,
             'cleanup_pending_count': len(cleanup_pending),
-            'host_expiry_times': expiry_times
+            'host_expiry_times': expiry_times,
+            'warm_pool': warm_status
         }
 
     def remove_host_manual(self, host_name: str) -> Dict[str, Any]:
@@ -794,6 +877,9 @@ class TsimQuickJobHostPoolService:
         Returns:
             Dictionary with 'success' (bool) and 'message' (str) keys
         """
+        if self.warm_pool and self.warm_pool.owns(host_name):
+            return self.warm_pool.remove_idle(host_name)
+
         with self.lock:
             # Check if host is currently in use
             if host_name in self.host_refcounts and len(self.host_refcounts[host_name]) > 0:
@@ -0,0 +1,223 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Router Planner
+Up-front path discovery and router-scoped admission for the scheduler
+
+Each queued job's router set is computed ahead of execution by running the
+same `trace -s SRC -d DST -j` path discovery the executor would run (or by
+parsing user-provided trace data). The trace is saved as the run's trace
+file and handed to the job, so it is not traced twice. Router sets only
+matter next to detailed jobs, so the scheduler plans only while a detailed
+job is queued or running, and caches the set on the job (job['routers'])
+once it is known.
+
+Admission (select_admissible) treats routers and host names as the
+contended resources:
+- quick + quick never conflict (job tags isolate their traffic)
+- any pair involving a detailed job conflicts iff their router sets or their
+  host names intersect. Hosts are named per router index, not per job
+  (source-N/destination-N for detailed jobs, source-N for quick jobs), and
+  `host add` reuses an existing tsim namespace of the same name, so two jobs
+  on disjoint routers would still share source-1
+- a job whose router set is unknown (planning failed) conflicts with every
+  detailed job, and a detailed one with every job: the old exclusive rule
+Jobs are considered in FIFO order and an older job that cannot start yet
+reserves its routers, so each router serves its jobs first-come
+first-served: later jobs may overtake it only where they do not collide.
+"""
+
+import json
+import logging
+import os
+import subprocess
+import threading
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+from typing import Any, Callable, Dict, FrozenSet, Iterable, List, Optional
+
+
+# Planning state of a job
+PENDING = 'pending'
+PLANNED = 'planned'
+FAILED = 'failed'
+
+
+def routers_from_trace(trace_data: Dict[str, Any]) -> FrozenSet[str]:
+    """Router names on a trace path."""
+    return frozenset(hop.get('name') for hop in trace_data.get('path', [])
+                     if hop.get('is_router') and hop.get('name'))
+
+
+def job_kind(job: Dict[str, Any]) -> str:
+    """'quick' or 'detailed' for a queued job."""
+    return job.get('type') or job.get('analysis_mode', 'detailed')
+
+
+def job_hosts(kind: str, routers: FrozenSet[str]) -> FrozenSet[str]:
+    """Host names a job creates for its router set (named by router index)."""
+    hosts = {f"source-{i}" for i in range(1, len(routers) + 1)}
+    if kind == 'detailed':
+        hosts.update(f"destination-{i}" for i in range(1, len(routers) + 1))
+    return frozenset(hosts)
+
+
+def _conflicts(type_a: str, routers_a: Optional[FrozenSet[str]],
+               type_b: str, routers_b: Optional[FrozenSet[str]]) -> bool:
+    if type_a == 'quick' and type_b == 'quick':
+        return False
+    if routers_a is None or routers_b is None:
+        return True
+    if not routers_a.isdisjoint(routers_b):
+        return True
+    return not job_hosts(type_a, routers_a).isdisjoint(job_hosts(type_b, routers_b))
+
+
+def select_admissible(queued: List[Dict[str, Any]], running: Dict[str, Dict[str, Any]],
+                      plan_of: Callable[[str], Dict[str, Any]],
+                      max_jobs: int, max_quick: int) -> List[str]:
+    """Pick the queued jobs that can start now without a router conflict
+
+    Args:
+        queued: Queued jobs in FIFO order (need run_id and type/analysis_mode)
+        running: {run_id: {'type': 'quick'|'detailed', 'routers': list|None}} of running
+                 jobs; routers cached on the job win over plan_of
+        plan_of: run_id -> {'state': PENDING|PLANNED|FAILED, 'routers': frozenset|None}
+        max_jobs: Free execution slots
+        max_quick: Maximum concurrent quick jobs
+
+    Returns:
+        run_ids to start, in queue order
+    """
+    busy = [(info['type'], frozenset(info['routers']) if info.get('routers') is not None
+             else plan_of(run_id).get('routers')) for run_id, info in running.items()]
+    reserved = []
+    admitted = []
+    quick_running = sum(1 for kind, _ in busy if kind == 'quick')
+
+    for job in queued:
+        if len(admitted) >= max_jobs:
+            break
+        kind = job_kind(job)
+        plan = plan_of(job['run_id'])
+        if kind == 'detailed' and plan['state'] == PENDING:
+            # Wait for its routers before it either starts or reserves anything
+            continue
+        routers = plan.get('routers') if plan['state'] == PLANNED else None
+
+        blocked = any(_conflicts(kind, routers, k, r) for k, r in busy + reserved)
+        if not blocked and kind == 'quick' and quick_running >= max_quick:
+            blocked = True
+        if blocked:
+            reserved.append((kind, routers))
+            continue
+
+        admitted.append(job['run_id'])
+        busy.append((kind, routers))
+        if kind == 'quick':
+            quick_running += 1
+    return admitted
+
+
+class TsimRouterPlanner:
+    """Background path discovery for queued jobs"""
+
+    def __init__(self, config_service, on_planned: Optional[Callable[[], None]] = None,
+                 trace_fn: Optional[Callable[[Dict[str, Any]], str]] = None):
+        """Initialize planner
+
+        Args:
+            config_service: TsimConfigService instance
+            on_planned: Called after a job's plan is ready (e.g. ring the scheduler doorbell)
+            trace_fn: job -> trace JSON text; defaults to tsimsh path discovery
+        """
+        self.config = config_service
+        self.logger = logging.getLogger('tsim.planner')
+        self.on_planned = on_planned
+        self.trace_fn = trace_fn or self._tsimsh_trace
+        self.run_dir = Path(config_service.get('run_dir', '/dev/shm/tsim/runs'))
+        self.tsimsh_path = config_service.tsimsh_path
+        workers = config_service.get('wsgi_parallel_config', {}).get('router_planner_workers', 4)
+        self.pool = ThreadPoolExecutor(max_workers=workers, thread_name_prefix='tsim-planner')
+        self.plans: Dict[str, Dict[str, Any]] = {}
+        self.lock = threading.Lock()
+
+    def plan(self, jobs: Iterable[Dict[str, Any]]):
+        """Start path discovery for jobs that have no plan yet.
+
+        A router set cached on the job (job['routers']) is taken as is.
+        """
+        for job in jobs:
+            run_id = job['run_id']
+            with self.lock:
+                if run_id in self.plans:
+                    continue
+                if job.get('routers') is not None:
+                    self.plans[run_id] = {'state': PLANNED, 'routers': frozenset(job['routers']),
+                                          'trace_data': None}
+                    continue
+                self.plans[run_id] = {'state': PENDING, 'routers': None, 'trace_data': None}
+            self.pool.submit(self._plan_job, job)
+
+    def plan_of(self, run_id: str) -> Dict[str, Any]:
+        with self.lock:
+            return self.plans.get(run_id) or {'state': PENDING, 'routers': None, 'trace_data': None}
+
+    def trace_data(self, run_id: str) -> Optional[str]:
+        """Trace JSON text from planning, if planning succeeded."""
+        return self.plan_of(run_id).get('trace_data')
+
+    def forget(self, run_id: str):
+        with self.lock:
+            self.plans.pop(run_id, None)
+
+    def retain(self, run_ids: Iterable[str]):
+        """Drop plans of jobs that are neither queued nor running anymore."""
+        keep = set(run_ids)
+        with self.lock:
+            for run_id in [r for r in self.plans if r not in keep]:
+                del self.plans[run_id]
+
+    def shutdown(self):
+        self.pool.shutdown(wait=False)
+
+    def _plan_job(self, job: Dict[str, Any]):
+        run_id = job['run_id']
+        params = job.get('params', {})
+        try:
+            trace_text = params.get('user_trace_data') or self.trace_fn(job)
+            routers = routers_from_trace(json.loads(trace_text))
+            if not routers:
+                raise ValueError("no routers on path")
+            trace_file = self.run_dir / run_id / f"{run_id}.trace"
+            trace_file.parent.mkdir(parents=True, exist_ok=True)
+            trace_file.write_text(trace_text)
+            plan = {'state': PLANNED, 'routers': routers, 'trace_data': trace_text}
+            self.logger.info(f"Planned {run_id}: routers {', '.join(sorted(routers))}")
+        except Exception as e:
+            plan = {'state': FAILED, 'routers': None, 'trace_data': None}
+            self.logger.warning(f"Path discovery for {run_id} failed, scheduling it exclusively: {e}")
+        with self.lock:
+            if run_id in self.plans:
+                self.plans[run_id] = plan
+        if self.on_planned:
+            self.on_planned()
+
+    def _tsimsh_trace(self, job: Dict[str, Any]) -> str:
+        params = job.get('params', {})
+        env = os.environ.copy()
+        env['TRACEROUTE_SIMULATOR_CONF'] = self.config.get('traceroute_simulator_conf',
+                                                           '/opt/tsim/wsgi/conf/traceroute_simulator.yaml')
+        env.setdefault('PYTHONDONTWRITEBYTECODE', '1')
+        env.setdefault('PYTHONPYCACHEPREFIX', '/dev/shm/tsim/pycache')
+        result = subprocess.run(
+            [self.tsimsh_path, '-q'],
+            input=f"trace -s {params['source_ip']} -d {params['dest_ip']} -j\n",
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True,
+            timeout=60,
+            env=env
+        )
+        if result.returncode != 0:
+            raise RuntimeError(f"trace failed: {result.stderr.strip()}")
+        return result.stdout
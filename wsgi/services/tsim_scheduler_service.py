@@ -19,6 +19,8 @@ from pathlib import Path
 from typing import Optional, Dict, Any, List
 from concurrent.futures import ThreadPoolExecutor, Future
 
+from .tsim_router_planner import TsimRouterPlanner, select_admissible, job_kind, PLANNED
+
 
 class TsimSchedulerService:
     """Background scheduler with centralized coordination via TsimRegistryManager.
@@ -42,6 +44,9 @@ class TsimSchedulerService:
         self._stop_event = threading.Event()
         self._thread: Optional[threading.Thread] = None
 
+        # Upper bound on a doorbell wait; jobs normally start on the ring itself
+        self.wakeup_timeout = config_service.get('scheduler_wakeup_timeout', 5.0)
+
         # Execution mode configuration
         # Note: serial is just parallel with max_workers=1
         self.execution_mode = config_service.get('wsgi_execution_mode', 'serial')
@@ -58,6 +63,19 @@ class TsimSchedulerService:
         if self.execution_mode == 'parallel':
             self.max_workers = self.parallel_config.get('thread_pool_workers', 33)
             self.max_quick_jobs = self.parallel_config.get('max_quick_jobs', 32)
+            # Concurrent quick jobs cannot exceed the distinct job tags on the wire
+            try:
+                from services.tsim_dscp_registry import TsimDscpRegistry
+                tag_capacity = TsimDscpRegistry.tag_capacity(config_service)
+                if self.max_quick_jobs > tag_capacity:
+                    self.logger.warning(f"max_quick_jobs {self.max_quick_jobs} exceeds job tag capacity "
+                                        f"{tag_capacity}, limiting")
+                    self.max_quick_jobs = tag_capacity
+                elif self.max_quick_jobs < tag_capacity:
+                    self.logger.info(f"max_quick_jobs {self.max_quick_jobs} (not job tag capacity "
+                                     f"{tag_capacity}) limits concurrent quick jobs")
+            except Exception as e:
+                self.logger.warning(f"Could not read job tag capacity: {e}")
         else:
             # Serial mode: override all batch/parallel settings to 1
             self.max_workers = 1
@@ -73,6 +91,18 @@ class TsimSchedulerService:
 
         self.logger.info(f"Scheduler execution mode: {self.execution_mode} (max_workers={self.max_workers}, max_quick_jobs={self.max_quick_jobs})")
 
+        # Scheduling policy (parallel mode only):
+        # - router: admit any jobs whose router sets and host names do not conflict
+        # - type: a running detailed job blocks everything, quick jobs only run together
+        self.scheduling_policy = self.parallel_config.get('scheduling_policy', 'type') \
+            if self.execution_mode == 'parallel' else 'type'
+        self.scheduling_lookahead = self.parallel_config.get('scheduling_lookahead', 256)
+        self.router_planner = None
+        if self.scheduling_policy == 'router':
+            self.router_planner = TsimRouterPlanner(config_service,
+                                                    on_planned=lambda: self.queue.doorbell.ring())
+        self.logger.info(f"Scheduling policy: {self.scheduling_policy}")
+
         # Initialize TsimRegistryManager for coordination visibility
         # (scripts initialize their own instances, but this provides monitoring capability)
         self.registry_mgr = None
@@ -143,24 +173,38 @@ class TsimSchedulerService:
 
     def stop(self, timeout: float = 2.0):
         self._stop_event.set()
+        self.queue.doorbell.ring()
         if self._thread:
             self._thread.join(timeout=timeout)
 
     def _run(self):
-        # Leader election via file lock in /dev/shm/tsim/locks
+        # Leader election via file lock in /dev/shm/tsim/locks. Standbys block in
+        # flock(); the kernel hands the lock to one of them as soon as the leader
+        # releases it or dies, so failover needs no polling.
         leader_name = 'scheduler_leader'
         while not self._stop_event.is_set():
-            # Try to become leader briefly; if not, sleep and retry
-            if not self.lock_manager.acquire_lock(leader_name, timeout=0.1, retry_interval=0.05):
-                time.sleep(0.5)
+            if not self.lock_manager.wait_for_lock(leader_name):
+                self._stop_event.wait(self.wakeup_timeout)
                 continue
+            if self._stop_event.is_set():
+                self.lock_manager.release_lock(leader_name, unlink=False)
+                break
             try:
                 # Always use parallel loop (serial mode is just parallel with max_workers=1)
                 self._leader_loop_parallel()
             finally:
-                self.lock_manager.release_lock(leader_name)
-            # Yield to others briefly
-            time.sleep(0.25)
+                self.lock_manager.release_lock(leader_name, unlink=False)
+
+    def _wait_for_work(self):
+        """Sleep until the queue doorbell rings (enqueue, job completion, stop).
+
+        The timeout is only a safety net for state changes that do not ring,
+        such as host pool capacity freeing up.
+        """
+        self.queue.doorbell.wait(self.wakeup_timeout)
+
+    def _ring_on_completion(self, future: Future):
+        future.add_done_callback(lambda _f: self.queue.doorbell.ring())
 
     def _leader_loop_parallel(self):
         """While leader, manage job execution via thread pool.
@@ -175,18 +219,23 @@ class TsimSchedulerService:
             with self.running_lock:
                 current_running = len(self.running_jobs)
                 running_jobs_info = {
-                    run_id: {'type': info['type'], 'dscp': info.get('dscp')}
+                    run_id: {'type': info['type'], 'dscp': info.get('dscp'),
+                             'routers': info.get('job', {}).get('routers')}
                     for run_id, info in self.running_jobs.items()
                 }
 
             available_slots = self.max_workers - current_running
             if available_slots <= 0:
                 # No capacity available - wait for jobs to complete
-                time.sleep(0.5)
+                self._wait_for_work()
                 continue
 
             # Pop compatible jobs (limited by available capacity)
-            jobs_to_start = self.queue.pop_compatible_jobs(running_jobs_info, max_jobs=available_slots)
+            if self.router_planner:
+                jobs_to_start = self._pop_router_scoped_jobs(running_jobs_info, available_slots)
+            else:
+                jobs_to_start = self.queue.pop_compatible_jobs(running_jobs_info, max_jobs=available_slots,
+                                                              max_quick=self.max_quick_jobs)
 
             # Debug logging for serial mode
             if jobs_to_start and self.execution_mode == 'serial':
@@ -194,23 +243,55 @@ class TsimSchedulerService:
                                f"available_slots={available_slots}, jobs_popped={len(jobs_to_start)}")
 
             if not jobs_to_start:
-                time.sleep(0.5)
+                self._wait_for_work()
                 continue
 
-            # Check if ALL jobs are quick jobs - if so, use host pool service
-            all_quick = all(j.get('analysis_mode') == 'quick' for j in jobs_to_start)
+            # Quick jobs go through the host pool service; detailed jobs start individually
+            quick_jobs = [j for j in jobs_to_start if j.get('analysis_mode') == 'quick']
+            other_jobs = [j for j in jobs_to_start if j.get('analysis_mode') != 'quick']
 
-            if all_quick and len(jobs_to_start) > 0 and self.host_pool:
-                # Use host pool service for quick job execution
+            if quick_jobs and self.host_pool:
                 # Works for both serial (batch=1) and parallel (batch=N) modes
-                self.logger.info(f"Using host pool for {len(jobs_to_start)} quick job(s)")
-                self._start_quick_jobs_batch(jobs_to_start)
+                self.logger.info(f"Using host pool for {len(quick_jobs)} quick job(s)")
+                self._start_quick_jobs_batch(quick_jobs)
             else:
-                # Start jobs individually (fallback or detailed jobs)
-                for job in jobs_to_start:
-                    self._start_job_parallel(job)
+                # No host pool: start quick jobs individually too (fallback)
+                other_jobs = jobs_to_start
+
+            for job in other_jobs:
+                self._start_job_parallel(job)
 
-            time.sleep(0.25)
+    def _pop_router_scoped_jobs(self, running_jobs_info: Dict[str, Dict], available_slots: int) -> List[Dict[str, Any]]:
+        """Pop the queued jobs whose router sets do not conflict with running or older jobs.
+
+        Router sets come from path discovery started here for queued jobs, but only
+        while a detailed job is queued or running: quick jobs never conflict with
+        each other. The discovered trace is handed to the job so the executor does
+        not trace again, and the router set is cached on the job.
+        """
+        queued = self.queue.peek_jobs(self.scheduling_lookahead)
+        self.router_planner.retain([j['run_id'] for j in queued] + list(running_jobs_info))
+        if not queued:
+            return []
+        if any(job_kind(job) == 'detailed' for job in queued) or \
+                any(info['type'] == 'detailed' for info in running_jobs_info.values()):
+            self.router_planner.plan(queued)
+
+        selected = select_admissible(queued, running_jobs_info, self.router_planner.plan_of,
+                                     available_slots, self.max_quick_jobs)
+        jobs = self.queue.pop_jobs(selected)
+        for job in jobs:
+            params = job.setdefault('params', {})
+            plan = self.router_planner.plan_of(job['run_id'])
+            if plan['state'] == PLANNED:
+                job['routers'] = sorted(plan['routers'])
+            trace = plan.get('trace_data')
+            if trace and not params.get('user_trace_data'):
+                params['user_trace_data'] = trace
+        if jobs:
+            self.logger.info(f"Admitted {len(jobs)} job(s) by router scope: "
+                             f"{', '.join(j['run_id'] for j in jobs)}")
+        return jobs
 
     def _start_quick_jobs_batch(self, jobs: List[Dict[str, Any]]):
         """Start batch of quick jobs using host pool service.
@@ -296,6 +377,7 @@ class TsimSchedulerService:
 
             # Submit to thread pool
             future = self.thread_pool.submit(self._execute_job_wrapper, job, dscp, start_time)
+            self._ring_on_completion(future)
 
             with self.running_lock:
                 self.running_jobs[run_id]['future'] = future
@@ -394,6 +476,7 @@ class TsimSchedulerService:
 
         # Submit to thread pool
         future = self.thread_pool.submit(self._execute_job_wrapper, job, dscp, start_time)
+        self._ring_on_completion(future)
 
         with self.running_lock:
             self.running_jobs[run_id]['future'] = future
@@ -495,3 +578,5 @@ class TsimSchedulerService:
 
                 del self.running_jobs[run_id]
                 self.queue.remove_running(run_id)
+                if self.router_planner:
+                    self.router_planner.forget(run_id)
@@ -0,0 +1,502 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Shared-Memory Job Queue
+Fixed-slot FIFO job queue in /dev/shm with an append-only recovery journal
+
+The queue is an mmap'd ring of fixed-size slots ordered by enqueue sequence.
+Quick and detailed jobs are additionally chained into per-type lanes
+(doubly linked through the slots), so a batch of quick jobs is popped by
+walking its lane instead of filtering the whole queue. A Fenwick tree over
+the ring counts live slots, which makes a queue position a prefix sum
+instead of a scan. Full job dicts live in the journal; a slot only records
+where its enqueue record starts.
+
+Every mutation appends one JSON line to the journal (enqueue records are
+fsynced before the job is acknowledged). When the table is missing or
+invalid, or a process died halfway through a mutation (the header's dirty
+flag is still set), the queue is rebuilt by replaying the journal. The journal is
+truncated whenever the queue drains and rewritten with only the live jobs
+when it grows past its size limit.
+
+All mutations run under the caller's queue lock (flock); the critical
+sections are a handful of slot writes plus one journal append.
+
+Slot layout (192 bytes):
+    0   u8   state (0 = free, 1 = queued)
+    1   u8   lane (0 = quick, 1 = detailed)
+    4   i32  previous slot in lane (-1 = none)
+    8   i32  next slot in lane (-1 = none)
+    16  u64  sequence number
+    24  f64  created_at
+    32  u64  journal offset of the enqueue record
+    40  u32  journal record length
+    44  64s  run_id (NUL padded)
+    108 48s  username (NUL padded)
+    156 16s  status (NUL padded)
+"""
+
+import json
+import logging
+import mmap
+import os
+import struct
+import time
+from contextlib import contextmanager
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Tuple
+
+
+MAGIC = b'TSIMJOBQ'
+VERSION = 1
+HEADER_SIZE = 64
+SLOT_SIZE = 192
+LANES = ('quick', 'detailed')
+
+# magic, version, capacity, head seq, tail seq, live, journal generation,
+# lane heads (quick, detailed), lane tails (quick, detailed), dirty flag
+_HEADER = struct.Struct('<8sIIQQIIiiiiI')
+_SLOT = struct.Struct('<BBxxiiQdQI64s48s16s')
+RUN_ID_OFFSET = 44
+RUN_ID_SIZE = 64
+USERNAME_SIZE = 48
+STATUS_SIZE = 16
+
+
+def _pad(value: str, size: int) -> bytes:
+    return value.encode()[:size - 1].ljust(size, b'\0')
+
+
+def _unpad(value: bytes) -> str:
+    return value.split(b'\0', 1)[0].decode(errors='replace')
+
+
+class TsimShmJobQueue:
+    """Slot-ring job queue with per-type lanes; callers serialize mutations"""
+
+    def __init__(self, path: Path, journal_path: Path, capacity: int = 4096,
+                 journal_max_bytes: int = 8 * 1024 * 1024):
+        """Map (creating or recovering if needed) the queue table
+
+        Args:
+            path: Table file, normally <data_dir>/queue/queue.shm
+            journal_path: Append-only journal; point it at persistent storage
+                to survive reboots
+            capacity: Number of slots (maximum queued jobs)
+            journal_max_bytes: Journal size that triggers a rewrite with live jobs only
+
+        The caller must hold the queue lock while constructing the queue.
+        """
+        self.logger = logging.getLogger('tsim.queue')
+        self.path = Path(path)
+        self.journal_path = Path(journal_path)
+        self.capacity = capacity
+        self.journal_max_bytes = journal_max_bytes
+        self.fenwick_offset = HEADER_SIZE
+        self.slots_offset = HEADER_SIZE + ((capacity * 4 + 63) // 64) * 64
+        self.size = self.slots_offset + capacity * SLOT_SIZE
+
+        fd = os.open(str(self.path), os.O_RDWR | os.O_CREAT, 0o664)
+        try:
+            magic, version, cap = struct.unpack('<8sII', os.pread(fd, 16, 0).ljust(16, b'\0'))
+            fresh = (magic, version, cap) != (MAGIC, VERSION, capacity)
+            if fresh:
+                os.ftruncate(fd, 0)
+                os.ftruncate(fd, self.size)
+            self._mm = mmap.mmap(fd, self.size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        self._view = memoryview(self._mm)
+        self._tree = self._view[self.fenwick_offset:self.fenwick_offset + capacity * 4].cast('I')
+        self._index: Dict[str, int] = {}
+        self._journal_fd: Optional[int] = None
+        self._journal_gen = -1
+
+        if fresh:
+            self._rebuild()
+
+    def _rebuild(self):
+        """Reset the table and replay the journal into it."""
+        # A new journal generation makes other processes reopen the rewritten journal
+        generation = (self._header()[6] + 1) & 0xffffffff
+        self._mm[:] = bytes(self.size)
+        _HEADER.pack_into(self._mm, 0, MAGIC, VERSION, self.capacity, 0, 0, 0, generation, -1, -1, -1, -1, 0)
+        self._index.clear()
+        self._recover()
+
+    def _check(self):
+        """Rebuild from the journal if a process died halfway through a mutation."""
+        if self._header()[11]:
+            self.logger.warning("Queue table left mid-update by a dead process; rebuilding from journal")
+            self._rebuild()
+
+    @contextmanager
+    def _mutation(self):
+        """Mark the table dirty while it is being changed."""
+        self._check()
+        h = self._header()
+        h[11] = 1
+        self._put_header(h)
+        yield
+        h = self._header()
+        h[11] = 0
+        self._put_header(h)
+
+    # --------------- header / slots ---------------
+    def _header(self) -> list:
+        return list(_HEADER.unpack_from(self._mm, 0))
+
+    def _put_header(self, h: list):
+        _HEADER.pack_into(self._mm, 0, *h)
+
+    def _slot(self, idx: int) -> list:
+        return list(_SLOT.unpack_from(self._mm, self.slots_offset + idx * SLOT_SIZE))
+
+    def _put_slot(self, idx: int, s: list):
+        _SLOT.pack_into(self._mm, self.slots_offset + idx * SLOT_SIZE, *s)
+
+    # --------------- Fenwick tree of live slots ---------------
+    def _tree_add(self, idx: int, delta: int):
+        i = idx + 1
+        while i <= self.capacity:
+            self._tree[i - 1] += delta
+            i += i & -i
+
+    def _tree_prefix(self, idx: int) -> int:
+        """Live slots in ring indices 0..idx."""
+        total = 0
+        i = idx + 1
+        while i > 0:
+            total += self._tree[i - 1]
+            i -= i & -i
+        return total
+
+    # --------------- journal ---------------
+    def _journal(self) -> int:
+        gen = self._header()[6]
+        if self._journal_fd is None or gen != self._journal_gen:
+            if self._journal_fd is not None:
+                os.close(self._journal_fd)
+            self.journal_path.parent.mkdir(parents=True, exist_ok=True)
+            self._journal_fd = os.open(str(self.journal_path), os.O_RDWR | os.O_CREAT | os.O_APPEND, 0o664)
+            self._journal_gen = gen
+        return self._journal_fd
+
+    def _append(self, record: Dict[str, Any], sync: bool = False) -> Tuple[int, int]:
+        fd = self._journal()
+        data = (json.dumps(record, separators=(',', ':')) + '\n').encode()
+        offset = os.lseek(fd, 0, os.SEEK_END)
+        os.write(fd, data)
+        if sync:
+            os.fsync(fd)
+        return offset, len(data)
+
+    def _read_job(self, s: list) -> Dict[str, Any]:
+        data = os.pread(self._journal(), s[7], s[6])
+        job = json.loads(data)['job']
+        job['status'] = _unpad(s[10])
+        return job
+
+    def _compact_journal(self, force: bool = False):
+        """Truncate the drained journal, or rewrite it when it outgrew its limit."""
+        h = self._header()
+        fd = self._journal()
+        if h[5] == 0:
+            os.ftruncate(fd, 0)
+            return
+        if not force and os.fstat(fd).st_size <= self.journal_max_bytes:
+            return
+
+        tmp = self.journal_path.with_suffix('.tmp')
+        offset = 0
+        updates = []
+        with open(tmp, 'wb') as f:
+            for idx in self._ring():
+                s = self._slot(idx)
+                job = self._read_job(s)
+                data = (json.dumps({'op': 'enqueue', 'seq': s[4], 'job': job},
+                                   separators=(',', ':')) + '\n').encode()
+                f.write(data)
+                updates.append((idx, offset, len(data)))
+                offset += len(data)
+            f.flush()
+            os.fsync(f.fileno())
+        tmp.replace(self.journal_path)
+        for idx, off, length in updates:
+            s = self._slot(idx)
+            s[6], s[7] = off, length
+            self._put_slot(idx, s)
+        h = self._header()
+        h[6] = (h[6] + 1) & 0xffffffff
+        self._put_header(h)
+        self.logger.info(f"Compacted queue journal to {offset} bytes ({len(updates)} jobs)")
+
+    def _recover(self):
+        """Rebuild the table from the journal after the shared memory was lost."""
+        try:
+            with open(self.journal_path, 'rb') as f:
+                raw = f.read()
+        except FileNotFoundError:
+            return
+        pending: Dict[str, Dict[str, Any]] = {}
+        offset = 0
+        for line in raw.splitlines(keepends=True):
+            start, offset = offset, offset + len(line)
+            try:
+                rec = json.loads(line)
+            except ValueError:
+                continue  # Torn final write
+            op = rec.get('op')
+            if op == 'enqueue':
+                job = rec['job']
+                pending[job['run_id']] = {'job': job, 'seq': rec.get('seq', 0), 'offset': start,
+                                          'length': len(line), 'status': job.get('status', 'QUEUED')}
+            elif op == 'pop':
+                for run_id in rec.get('run_ids', []):
+                    pending.pop(run_id, None)
+            elif op == 'remove':
+                pending.pop(rec.get('run_id'), None)
+            elif op == 'status' and rec.get('run_id') in pending:
+                pending[rec['run_id']]['status'] = rec.get('status')
+
+        entries = sorted(pending.values(), key=lambda e: e['seq'])[:self.capacity]
+        for entry in entries:
+            self._insert(entry['job'], entry['offset'], entry['length'], entry['status'])
+        # Sequences restart with the rebuilt ring; rewrite the journal to match
+        self._compact_journal(force=True)
+        if entries:
+            self.logger.warning(f"Recovered {len(entries)} queued jobs from journal {self.journal_path}")
+
+    # --------------- ring / lanes ---------------
+    def _ring(self):
+        """Ring indices of queued jobs in FIFO order."""
+        h = self._header()
+        for seq in range(h[3], h[4]):
+            idx = seq % self.capacity
+            if self._mm[self.slots_offset + idx * SLOT_SIZE]:
+                yield idx
+
+    def _insert(self, job: Dict[str, Any], offset: int, length: int, status: str) -> int:
+        lane = 0 if job.get('type', job.get('analysis_mode')) == 'quick' else 1
+        return self._place(lane, job.get('created_at', time.time()), offset, length,
+                           _pad(job['run_id'], RUN_ID_SIZE), _pad(job.get('username') or '', USERNAME_SIZE),
+                           _pad(status, STATUS_SIZE))
+
+    def _place(self, lane: int, created_at: float, offset: int, length: int,
+               run_id: bytes, username: bytes, status: bytes) -> int:
+        """Append a slot at the ring tail and link it into its lane."""
+        h = self._header()
+        if h[4] - h[3] >= self.capacity:
+            if h[5] >= self.capacity:
+                raise RuntimeError(f"Job queue full ({self.capacity} slots)")
+            self._defragment()
+            h = self._header()
+        idx = h[4] % self.capacity
+        prev = h[9 + lane]
+        self._put_slot(idx, [1, lane, prev, -1, h[4], created_at, offset, length, run_id, username, status])
+        if prev >= 0:
+            p = self._slot(prev)
+            p[3] = idx
+            self._put_slot(prev, p)
+        else:
+            h[7 + lane] = idx
+        h[9 + lane] = idx
+        h[4] += 1
+        h[5] += 1
+        self._put_header(h)
+        self._tree_add(idx, 1)
+        self._index[_unpad(run_id)] = idx
+        return idx
+
+    def _defragment(self):
+        """Close the holes left by removed jobs so the ring has room at its tail.
+
+        Live jobs keep their order; they are re-placed from the current tail
+        sequence so sequences stay monotonic with the journal.
+        """
+        live = [self._slot(idx) for idx in self._ring()]
+        h = self._header()
+        start = h[4]
+        self._mm[self.fenwick_offset:self.size] = bytes(self.size - self.fenwick_offset)
+        h[3] = h[4] = start
+        h[5] = 0
+        h[7:11] = [-1, -1, -1, -1]
+        self._put_header(h)
+        self._index.clear()
+        for s in live:
+            self._place(s[1], s[5], s[6], s[7], s[8], s[9], s[10])
+
+    def _unlink(self, idx: int):
+        """Drop a queued slot from its lane and advance the ring head past free slots."""
+        s = self._slot(idx)
+        h = self._header()
+        lane, prev, nxt = s[1], s[2], s[3]
+        if prev >= 0:
+            p = self._slot(prev)
+            p[3] = nxt
+            self._put_slot(prev, p)
+        else:
+            h[7 + lane] = nxt
+        if nxt >= 0:
+            n = self._slot(nxt)
+            n[2] = prev
+            self._put_slot(nxt, n)
+        else:
+            h[9 + lane] = prev
+        self._mm[self.slots_offset + idx * SLOT_SIZE] = 0
+        self._tree_add(idx, -1)
+        self._index.pop(_unpad(s[8]), None)
+        h[5] -= 1
+        while h[3] < h[4] and not self._mm[self.slots_offset + (h[3] % self.capacity) * SLOT_SIZE]:
+            h[3] += 1
+        self._put_header(h)
+
+    def _find(self, run_id: str) -> Optional[int]:
+        """Slot of a queued run_id, or None."""
+        idx = self._index.get(run_id)
+        if idx is not None and self._mm[self.slots_offset + idx * SLOT_SIZE] and \
+                _unpad(self._slot(idx)[8]) == run_id:
+            return idx
+        self._index.pop(run_id, None)
+
+        needle = run_id.encode()[:RUN_ID_SIZE - 1] + b'\0'
+        pos = self._mm.find(needle, self.slots_offset)
+        while pos >= 0:
+            rel = pos - self.slots_offset - RUN_ID_OFFSET
+            if rel >= 0 and rel % SLOT_SIZE == 0:
+                idx = rel // SLOT_SIZE
+                if self._mm[self.slots_offset + idx * SLOT_SIZE]:
+                    self._index[run_id] = idx
+                    return idx
+            pos = self._mm.find(needle, pos + 1)
+        return None
+
+    # --------------- public API ---------------
+    def __len__(self) -> int:
+        self._check()
+        return self._header()[5]
+
+    def enqueue(self, job: Dict[str, Any]) -> int:
+        """Append a job (must carry run_id and type); returns its 1-based position.
+
+        Raises:
+            RuntimeError: If every slot is in use
+        """
+        existing = self._find(job['run_id'])
+        if existing is not None:
+            return self._position_of(existing)
+        if len(self) >= self.capacity:
+            raise RuntimeError(f"Job queue full ({self.capacity} slots)")
+        with self._mutation():
+            offset, length = self._append({'op': 'enqueue', 'seq': self._header()[4], 'job': job}, sync=True)
+            idx = self._insert(job, offset, length, job.get('status', 'QUEUED'))
+        return self._position_of(idx)
+
+    def _position_of(self, idx: int) -> int:
+        head = self._header()[3] % self.capacity
+        if idx >= head:
+            return self._tree_prefix(idx) - (self._tree_prefix(head - 1) if head else 0)
+        return len(self) - self._tree_prefix(head - 1) + self._tree_prefix(idx)
+
+    def position(self, run_id: str) -> Optional[int]:
+        self._check()
+        idx = self._find(run_id)
+        return self._position_of(idx) if idx is not None else None
+
+    def update_status(self, run_id: str, status: str) -> bool:
+        idx = self._find(run_id)
+        if idx is None:
+            return False
+        with self._mutation():
+            s = self._slot(idx)
+            s[10] = _pad(status, STATUS_SIZE)
+            self._put_slot(idx, s)
+            self._append({'op': 'status', 'run_id': run_id, 'status': status})
+        return True
+
+    def remove(self, run_id: str) -> Optional[Dict[str, Any]]:
+        """Remove a queued job; returns its dict or None if not queued."""
+        idx = self._find(run_id)
+        if idx is None:
+            return None
+        job = self._read_job(self._slot(idx))
+        with self._mutation():
+            self._unlink(idx)
+            self._append({'op': 'remove', 'run_id': run_id})
+            self._compact_journal()
+        return job
+
+    def head(self) -> Optional[Dict[str, Any]]:
+        """Oldest queued job without removing it."""
+        self._check()
+        for idx in self._ring():
+            return self._read_job(self._slot(idx))
+        return None
+
+    def pop_lane(self, lane: str, limit: int) -> List[Dict[str, Any]]:
+        """Atomically pop up to limit oldest jobs of one type."""
+        jobs = []
+        with self._mutation():
+            idx = self._header()[7 + LANES.index(lane)]
+            while idx >= 0 and len(jobs) < limit:
+                s = self._slot(idx)
+                jobs.append(self._read_job(s))
+                self._unlink(idx)
+                idx = s[3]
+            self._record_pop(jobs)
+        return jobs
+
+    def pop_head(self) -> Optional[Dict[str, Any]]:
+        """Atomically pop the oldest job of any type."""
+        for idx in self._ring():
+            job = self._read_job(self._slot(idx))
+            with self._mutation():
+                self._unlink(idx)
+                self._record_pop([job])
+            return job
+        return None
+
+    def pop_ids(self, run_ids: List[str]) -> List[Dict[str, Any]]:
+        """Atomically pop the given queued jobs (missing run_ids are skipped)."""
+        jobs = []
+        with self._mutation():
+            for run_id in run_ids:
+                idx = self._find(run_id)
+                if idx is None:
+                    continue
+                jobs.append(self._read_job(self._slot(idx)))
+                self._unlink(idx)
+            self._record_pop(jobs)
+        return jobs
+
+    def _record_pop(self, jobs: List[Dict[str, Any]]):
+        if jobs:
+            self._append({'op': 'pop', 'run_ids': [j['run_id'] for j in jobs]})
+            self._compact_journal()
+
+    def jobs(self, limit: Optional[int] = None) -> List[Dict[str, Any]]:
+        """Queued jobs in FIFO order (the oldest limit jobs if given)."""
+        self._check()
+        result = []
+        for idx in self._ring():
+            if limit is not None and len(result) >= limit:
+                break
+            result.append(self._read_job(self._slot(idx)))
+        return result
+
+    def has_user_job(self, username: str, statuses) -> bool:
+        self._check()
+        name = _pad(username or '', USERNAME_SIZE)
+        status_set = {_pad(st, STATUS_SIZE) for st in statuses}
+        for idx in self._ring():
+            s = self._slot(idx)
+            if s[9] == name and s[10] in status_set:
+                return True
+        return False
+
+    def close(self):
+        self._tree.release()
+        self._view.release()
+        self._mm.close()
+        if self._journal_fd is not None:
+            os.close(self._journal_fd)
+            self._journal_fd = None
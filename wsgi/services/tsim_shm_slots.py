@@ -0,0 +1,244 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Shared-Memory Slot Allocator
+Lock-free job tag allocation table in /dev/shm for the DSCP registry
+
+The table is an mmap'd file with one fixed-size slot per tag. A slot is
+owned by whoever swaps its 64-bit owner word from 0 to a token made of
+the owner PID and the claim time in seconds; the swap is a hardware
+compare-and-swap (libatomic via ctypes), so allocation and release never
+take a file lock. Stale slots (dead owner PID or older than max_age) are
+reclaimed with a second compare-and-swap against the observed token.
+
+Slot layout (128 bytes):
+    0   u64  owner token (pid << 32 | claim seconds), 0 = free
+    8   f64  allocated_at
+    16  64s  job_id (NUL padded)
+    80  48s  username (NUL padded)
+"""
+
+import ctypes
+import ctypes.util
+import os
+import struct
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Tuple
+
+from tsim.core.tsim_shm_manager import map_shared_segment
+
+
+MAGIC = b'TSIMSLOT'
+VERSION = 1
+HEADER_SIZE = 64
+SLOT_SIZE = 128
+JOB_ID_OFFSET = 16
+JOB_ID_SIZE = 64
+USERNAME_OFFSET = 80
+USERNAME_SIZE = 48
+_HEADER = struct.Struct('<8sIII')
+_SEQ_CST = 5
+
+
+def _load_libatomic():
+    """Sized __atomic_* entry points of libatomic, or None when unavailable."""
+    name = ctypes.util.find_library('atomic') or 'libatomic.so.1'
+    try:
+        lib = ctypes.CDLL(name)
+        cas = lib.__atomic_compare_exchange_8
+        load = lib.__atomic_load_8
+    except (OSError, AttributeError):
+        return None
+    cas.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint64), ctypes.c_uint64, ctypes.c_int, ctypes.c_int]
+    cas.restype = ctypes.c_bool
+    load.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    load.restype = ctypes.c_uint64
+    return cas, load
+
+
+_ATOMICS = _load_libatomic()
+
+
+def atomics_available() -> bool:
+    """True when compare-and-swap on shared memory is usable."""
+    return _ATOMICS is not None
+
+
+def _pid_alive(pid: int) -> bool:
+    if pid <= 0:
+        return False
+    try:
+        os.kill(pid, 0)
+        return True
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        return True
+
+
+class TsimShmSlotAllocator:
+    """Compare-and-swap slot table mapping tags tag_min..tag_min+count-1 to jobs"""
+
+    def __init__(self, path: Path, tag_min: int, count: int, max_age: float = 3600):
+        """Map (creating if needed) the slot table
+
+        Args:
+            path: Table file, normally under /dev/shm/tsim
+            tag_min: Tag of slot 0
+            count: Number of slots (tags)
+            max_age: Seconds after which a live owner's slot counts as stale
+
+        Raises:
+            RuntimeError: If libatomic is not available
+            OSError: If the table cannot be created or mapped
+        """
+        if _ATOMICS is None:
+            raise RuntimeError("libatomic not available for shared-memory CAS")
+        self._cas, self._load = _ATOMICS
+        self.path = Path(path)
+        self.tag_min = tag_min
+        self.count = count
+        self.max_age = max_age
+        self.size = HEADER_SIZE + count * SLOT_SIZE
+
+        self._mm = map_shared_segment(self.path, self.size, _HEADER.pack(MAGIC, VERSION, count, tag_min),
+                                      mode=0o664)
+
+        self._buffer = (ctypes.c_char * self.size).from_buffer(self._mm)
+        self._base = ctypes.addressof(self._buffer)
+        self._words = memoryview(self._mm).cast('Q')
+        self._index: Dict[str, int] = {}
+
+    # --------------- atomic primitives ---------------
+    def _owner_addr(self, slot: int) -> int:
+        return self._base + HEADER_SIZE + slot * SLOT_SIZE
+
+    def _compare_and_swap(self, slot: int, expected: int, desired: int) -> bool:
+        observed = ctypes.c_uint64(expected)
+        return bool(self._cas(self._owner_addr(slot), ctypes.byref(observed), desired, _SEQ_CST, _SEQ_CST))
+
+    def _owner(self, slot: int) -> int:
+        return self._load(self._owner_addr(slot), _SEQ_CST)
+
+    def _owners(self) -> List[int]:
+        """Snapshot of all owner words (plain reads; CAS re-checks before acting)."""
+        return self._words[HEADER_SIZE // 8::SLOT_SIZE // 8].tolist()
+
+    # --------------- slot fields ---------------
+    def _write_slot(self, slot: int, allocated_at: float, job_id: str, username: str):
+        offset = HEADER_SIZE + slot * SLOT_SIZE
+        self._mm[offset + 8:offset + 16] = struct.pack('<d', allocated_at)
+        self._mm[offset + JOB_ID_OFFSET:offset + JOB_ID_OFFSET + JOB_ID_SIZE] = \
+            job_id.encode()[:JOB_ID_SIZE - 1].ljust(JOB_ID_SIZE, b'\0')
+        self._mm[offset + USERNAME_OFFSET:offset + USERNAME_OFFSET + USERNAME_SIZE] = \
+            username.encode()[:USERNAME_SIZE - 1].ljust(USERNAME_SIZE, b'\0')
+
+    def _read_slot(self, slot: int) -> Tuple[float, str, str]:
+        offset = HEADER_SIZE + slot * SLOT_SIZE
+        allocated_at = struct.unpack_from('<d', self._mm, offset + 8)[0]
+        job_id = self._mm[offset + JOB_ID_OFFSET:offset + JOB_ID_OFFSET + JOB_ID_SIZE].split(b'\0', 1)[0]
+        username = self._mm[offset + USERNAME_OFFSET:offset + USERNAME_OFFSET + USERNAME_SIZE].split(b'\0', 1)[0]
+        return allocated_at, job_id.decode(errors='replace'), username.decode(errors='replace')
+
+    def _find(self, job_id: str) -> Optional[int]:
+        """Slot currently owned by job_id, or None."""
+        slot = self._index.get(job_id)
+        if slot is not None and self._owner(slot) and self._read_slot(slot)[1] == job_id:
+            return slot
+        self._index.pop(job_id, None)
+
+        needle = job_id.encode()[:JOB_ID_SIZE - 1] + b'\0'
+        pos = self._mm.find(needle, HEADER_SIZE)
+        while pos >= 0:
+            rel = pos - HEADER_SIZE - JOB_ID_OFFSET
+            if rel >= 0 and rel % SLOT_SIZE == 0:
+                slot = rel // SLOT_SIZE
+                if self._owner(slot):
+                    self._index[job_id] = slot
+                    return slot
+            pos = self._mm.find(needle, pos + 1)
+        return None
+
+    # --------------- public API ---------------
+    def allocate(self, job_id: str, username: str = 'unknown') -> Optional[int]:
+        """Claim the lowest free tag for job_id (existing claim is returned as is)
+
+        Returns:
+            Tag value or None if every slot is owned by a live, fresh job
+        """
+        existing = self._find(job_id)
+        if existing is not None:
+            return self.tag_min + existing
+
+        now = time.time()
+        token = (os.getpid() << 32) | (int(now) & 0xffffffff)
+        for attempt in range(2):
+            for slot, owner in enumerate(self._owners()):
+                if owner == 0 and self._compare_and_swap(slot, 0, token):
+                    self._write_slot(slot, now, job_id, username or 'unknown')
+                    self._index[job_id] = slot
+                    return self.tag_min + slot
+            if attempt == 0 and not self.reclaim_stale():
+                break
+        return None
+
+    def release(self, job_id: str) -> bool:
+        """Free the tag owned by job_id; False if it owns none."""
+        slot = self._find(job_id)
+        self._index.pop(job_id, None)
+        if slot is None:
+            return False
+        owner = self._owner(slot)
+        if owner == 0:
+            return False
+        # Take the slot over with our own token first: the fields are only
+        # cleared while nobody else (a reclaimer, a new owner) can hold it
+        token = (os.getpid() << 32) | (int(time.time()) & 0xffffffff)
+        if not self._compare_and_swap(slot, owner, token):
+            return False  # Released or reclaimed meanwhile
+        if self._read_slot(slot)[1] != job_id:
+            self._compare_and_swap(slot, token, owner)  # Re-claimed under the same token
+            return False
+        self._write_slot(slot, 0.0, '', '')
+        return self._compare_and_swap(slot, token, 0)
+
+    def tag_of(self, job_id: str) -> Optional[int]:
+        slot = self._find(job_id)
+        return self.tag_min + slot if slot is not None else None
+
+    def reclaim_stale(self) -> int:
+        """Free slots whose owner PID is dead or whose claim is older than max_age."""
+        now = int(time.time()) & 0xffffffff
+        reclaimed = 0
+        for slot, owner in enumerate(self._owners()):
+            if owner == 0:
+                continue
+            # The claim time lives in the owner word, so half-written slots age correctly
+            too_old = (now - (owner & 0xffffffff)) & 0xffffffff > self.max_age
+            if (not _pid_alive(owner >> 32) or too_old) and self._compare_and_swap(slot, owner, 0):
+                reclaimed += 1
+        return reclaimed
+
+    def allocations(self) -> Dict[str, Dict[str, Any]]:
+        """job_id -> allocation record in the JSON registry's format."""
+        result = {}
+        for slot, owner in enumerate(self._owners()):
+            if owner == 0:
+                continue
+            allocated_at, job_id, username = self._read_slot(slot)
+            if not job_id:
+                continue
+            result[job_id] = {
+                'dscp': self.tag_min + slot,
+                'job_id': job_id,
+                'username': username or 'unknown',
+                'allocated_at': allocated_at,
+                'pid': owner >> 32,
+                'status': 'active'
+            }
+        return result
+
+    def close(self):
+        self._words.release()
+        del self._buffer
+        self._mm.close()
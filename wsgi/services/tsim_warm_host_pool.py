@@ -0,0 +1,435 @@
+#!/usr/bin/env -S python3 -B -u
+"""
+TSIM Warm Host Pool
+Pre-created source host namespaces for quick jobs
+
+Keeps a few idle hosts attached to every (router, subnet) seen in recent
+quick jobs. Idle hosts sit on a parking address at the top of the subnet.
+Leasing one moves it to the job's source IP (address + default route, a
+single `ip -batch` in the namespace) instead of building a namespace, veth
+and bridge port from scratch; releasing it moves it back to its parking
+address. Creation and removal happen on a background thread.
+
+For virtual sources one idle host per (router, subnet) becomes a shared
+injector instead: it keeps its parking address and jobs send from it with
+their source IP as a non-local address, so nothing is re-addressed at all.
+"""
+
+import os
+import time
+import secrets
+import logging
+import ipaddress
+import threading
+from typing import Callable, Dict, List, Any, Optional, Tuple
+
+try:
+    from tsim.simulators.host_namespace_setup import HostNamespaceManager
+    WARM_POOL_AVAILABLE = True
+except ImportError as e:
+    WARM_POOL_AVAILABLE = False
+    _import_error = str(e)
+
+
+POOL_HOST_PREFIX = 'pool-'
+POOL_CREATOR_TAG = 'wsgi:host-pool'
+POOL_PREFIXLEN = 24
+CREATE_RETRY_DELAY = 60.0
+
+
+class TsimWarmHostPool:
+    """Idle host namespaces re-addressed at lease time"""
+
+    def __init__(self, config_service, registry_manager, exec_fn: Callable,
+                 host_manager=None, logger: Optional[logging.Logger] = None):
+        """Initialize warm host pool
+
+        Args:
+            config_service: TsimConfigService instance
+            registry_manager: TsimRegistryManager instance
+            exec_fn: tsimsh_exec-compatible callable used to add/remove hosts
+            host_manager: HostNamespaceManager (created if None)
+            logger: Optional logger
+        """
+        self.registry_mgr = registry_manager
+        self.exec_fn = exec_fn
+        self.logger = logger or logging.getLogger('tsim.warm_host_pool')
+
+        self.pool_size = int(config_service.get('quick_job_warm_pool_size', 2))
+        self.max_hosts = int(config_service.get('quick_job_warm_pool_max_hosts', 32))
+        self.recent_window = float(config_service.get('quick_job_warm_pool_recent_window', 3600))
+        self.interval = float(config_service.get('quick_job_warm_pool_interval', 5.0))
+
+        if host_manager is None:
+            if not WARM_POOL_AVAILABLE:
+                raise RuntimeError(f"HostNamespaceManager not available: {_import_error}")
+            host_manager = HostNamespaceManager(verbose=0, no_delay=True)
+        self.host_manager = host_manager
+
+        # (router, subnet) -> last time a job needed a host there
+        self.demand: Dict[Tuple[str, str], float] = {}
+        # (router, subnet) -> [host_name, ...] ready to lease
+        self.idle: Dict[Tuple[str, str], List[str]] = {}
+        # host_name -> {'key', 'park_ip'} for every host the pool owns
+        self.hosts: Dict[str, Dict[str, Any]] = {}
+        # host_name -> {'ip', 'jobs'} for leased hosts
+        self.leased: Dict[str, Dict[str, Any]] = {}
+        # (router, ip) -> host_name, so jobs sharing a source share the host
+        self.by_target: Dict[Tuple[str, str], str] = {}
+        # (router, subnet) -> injector host shared by virtual-source jobs
+        self.injectors: Dict[Tuple[str, str], str] = {}
+        # injector host -> set(job_id)
+        self.injector_jobs: Dict[str, set] = {}
+        # Released hosts waiting to be parked by the worker
+        self.recycle: List[str] = []
+        # (router, subnet) -> time host creation last failed there
+        self.failed: Dict[Tuple[str, str], float] = {}
+
+        self.stats = {'leases': 0, 'injections': 0, 'misses': 0, 'created': 0, 'removed': 0,
+                      'lease_ms_total': 0.0, 'lease_ms_max': 0.0}
+
+        self.lock = threading.Lock()
+        self._wakeup = threading.Event()
+        self._stop = threading.Event()
+        self._thread = None
+
+    @staticmethod
+    def subnet_key(router: str, ip: str) -> Tuple[str, str]:
+        network = ipaddress.IPv4Network(f"{ip.split('/')[0]}/{POOL_PREFIXLEN}", strict=False)
+        return router, str(network)
+
+    def start(self):
+        if self._thread and self._thread.is_alive():
+            return
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, name='tsim-warm-host-pool', daemon=True)
+        self._thread.start()
+        self.logger.info(f"Warm host pool started ({self.pool_size} idle hosts per subnet, "
+                         f"max {self.max_hosts})")
+
+    def stop(self):
+        self._stop.set()
+        self._wakeup.set()
+        if self._thread:
+            self._thread.join(timeout=5)
+
+    def owns(self, host_name: str) -> bool:
+        with self.lock:
+            return host_name in self.hosts
+
+    def note_demand(self, router: str, ip: str):
+        """Record that a job needs a source host on router in ip's subnet"""
+        key = self.subnet_key(router, ip)
+        with self.lock:
+            new = key not in self.demand
+            self.demand[key] = time.time()
+        if new:
+            self._wakeup.set()
+
+    def lease(self, router: str, ip: str, job_ids: List[str]) -> Optional[str]:
+        """Hand a warm host on router to jobs, addressed as ip
+
+        Returns:
+            Host name, or None if no idle host could be used (caller falls
+            back to creating a host on demand)
+        """
+        start = time.monotonic()
+        key = self.subnet_key(router, ip)
+        ip_only = ip.split('/')[0]
+
+        with self.lock:
+            host_name = self.by_target.get((router, ip_only))
+            if host_name:
+                self.leased[host_name]['jobs'].update(job_ids)
+                return host_name
+            idle = self.idle.get(key)
+            host_name = idle.pop() if idle else None
+            if not host_name:
+                self.stats['misses'] += 1
+                self._wakeup.set()
+                return None
+
+        try:
+            ok = self.host_manager.readdress_host(host_name, f"{ip_only}/{POOL_PREFIXLEN}")
+        except Exception as e:
+            self.logger.warning(f"Readdressing {host_name} to {ip_only} failed: {e}")
+            ok = False
+
+        elapsed_ms = (time.monotonic() - start) * 1000
+        with self.lock:
+            if not ok:
+                # Most likely the job IP is taken on this router; keep the host idle
+                self.idle.setdefault(key, []).append(host_name)
+                self.stats['misses'] += 1
+                return None
+            self.leased[host_name] = {'ip': ip_only, 'jobs': set(job_ids), 'since': time.time()}
+            self.by_target[(router, ip_only)] = host_name
+            self.stats['leases'] += 1
+            self.stats['lease_ms_total'] += elapsed_ms
+            self.stats['lease_ms_max'] = max(self.stats['lease_ms_max'], elapsed_ms)
+        self._wakeup.set()
+
+        self.logger.info(f"Leased warm host {host_name} as {ip_only} on {router} "
+                         f"({elapsed_ms:.1f} ms) for {len(job_ids)} job(s)")
+        return host_name
+
+    def injector(self, router: str, ip: str, job_ids: List[str]) -> Optional[str]:
+        """Shared injector host on router for virtual sources in ip's subnet
+
+        Returns:
+            Host name, or None if the subnet has no warm host yet
+        """
+        key = self.subnet_key(router, ip)
+        with self.lock:
+            host_name = self.injectors.get(key)
+            if not host_name:
+                idle = self.idle.get(key)
+                if not idle:
+                    self.stats['misses'] += 1
+                    self._wakeup.set()
+                    return None
+                host_name = idle.pop()
+                self.injectors[key] = host_name
+                self._wakeup.set()
+                self.logger.info(f"Warm host {host_name} is now the injector for {key[1]} on {router}")
+            self.injector_jobs.setdefault(host_name, set()).update(job_ids)
+            self.stats['injections'] += len(job_ids)
+        return host_name
+
+    def release(self, host_name: str, job_id: str) -> bool:
+        """Drop job_id from a leased host; park the host once unused
+
+        Returns:
+            True if host_name belongs to the pool
+        """
+        with self.lock:
+            if host_name not in self.hosts:
+                return False
+            if host_name in self.injector_jobs:
+                # Injectors stay attached; nothing to undo
+                self.injector_jobs[host_name].discard(job_id)
+                return True
+            lease = self.leased.get(host_name)
+            if not lease:
+                return True
+            lease['jobs'].discard(job_id)
+            if lease['jobs']:
+                return True
+            del self.leased[host_name]
+            router = self.hosts[host_name]['key'][0]
+            self.by_target.pop((router, lease['ip']), None)
+            self.recycle.append(host_name)
+        self._wakeup.set()
+        return True
+
+    def remove_idle(self, host_name: str) -> Dict[str, Any]:
+        """Remove an idle pool host (admin operation)"""
+        with self.lock:
+            info = self.hosts.get(host_name)
+            if not info:
+                return {'success': False, 'message': f'Host {host_name} is not a pool host'}
+            if host_name in self.leased:
+                jobs = sorted(self.leased[host_name]['jobs'])
+                return {'success': False,
+                        'message': f'Host {host_name} is currently in use by {len(jobs)} job(s): {", ".join(jobs)}'}
+            if self.injector_jobs.get(host_name):
+                jobs = sorted(self.injector_jobs[host_name])
+                return {'success': False,
+                        'message': f'Host {host_name} is currently in use by {len(jobs)} job(s): {", ".join(jobs)}'}
+            idle = self.idle.get(info['key'], [])
+            if self.injectors.get(info['key']) == host_name:
+                del self.injectors[info['key']]
+                self.injector_jobs.pop(host_name, None)
+            elif host_name in idle:
+                idle.remove(host_name)
+            else:
+                return {'success': False, 'message': f'Host {host_name} is being recycled'}
+        if self._remove(host_name):
+            return {'success': True, 'message': f'Host {host_name} removed successfully'}
+        return {'success': False, 'message': f'Failed to remove pool host {host_name}'}
+
+    def get_status(self) -> Dict[str, Any]:
+        with self.lock:
+            subnets = []
+            for key in sorted(set(self.demand) | set(self.idle)):
+                subnets.append({
+                    'router': key[0],
+                    'subnet': key[1],
+                    'idle': list(self.idle.get(key, [])),
+                    'injector': self.injectors.get(key),
+                    'last_demand': self.demand.get(key)
+                })
+            leases = self.stats['leases']
+            return {
+                'pool_size': self.pool_size,
+                'max_hosts': self.max_hosts,
+                'host_count': len(self.hosts),
+                'subnets': subnets,
+                'leased': {h: {'ip': l['ip'], 'jobs': sorted(l['jobs'])}
+                           for h, l in self.leased.items()},
+                'injector_jobs': {h: sorted(jobs) for h, jobs in self.injector_jobs.items() if jobs},
+                'recycling': list(self.recycle),
+                'leases': leases,
+                'injections': self.stats['injections'],
+                'misses': self.stats['misses'],
+                'created': self.stats['created'],
+                'removed': self.stats['removed'],
+                'lease_avg_ms': round(self.stats['lease_ms_total'] / leases, 2) if leases else None,
+                'lease_max_ms': round(self.stats['lease_ms_max'], 2) if leases else None
+            }
+
+    # ---- background worker ----
+
+    def _run(self):
+        try:
+            self._adopt()
+        except Exception as e:
+            self.logger.warning(f"Could not adopt existing pool hosts: {e}")
+        while not self._stop.is_set():
+            try:
+                self.maintain()
+            except Exception as e:
+                self.logger.error(f"Warm host pool maintenance failed: {e}", exc_info=True)
+            self._wakeup.wait(self.interval)
+            self._wakeup.clear()
+
+    def maintain(self):
+        """One maintenance pass: park released hosts, expire, refill"""
+        while True:
+            with self.lock:
+                if not self.recycle:
+                    break
+                host_name = self.recycle.pop(0)
+            self._park(host_name)
+
+        now = time.time()
+        with self.lock:
+            stale = [k for k, seen in self.demand.items() if now - seen > self.recent_window]
+            for key in stale:
+                del self.demand[key]
+                self.failed.pop(key, None)
+            surplus = []
+            for key, idle in self.idle.items():
+                keep = self.pool_size if key in self.demand else 0
+                while len(idle) > keep:
+                    surplus.append(idle.pop(0))
+            for key in [k for k in self.injectors if k not in self.demand]:
+                if not self.injector_jobs.get(self.injectors[key]):
+                    host_name = self.injectors.pop(key)
+                    self.injector_jobs.pop(host_name, None)
+                    surplus.append(host_name)
+        for host_name in surplus:
+            self._remove(host_name)
+
+        while not self._stop.is_set():
+            with self.lock:
+                if len(self.hosts) >= self.max_hosts:
+                    break
+                wanted = [k for k, seen in sorted(self.demand.items(), key=lambda kv: -kv[1])
+                          if len(self.idle.get(k, [])) < self.pool_size
+                          and now - self.failed.get(k, 0) > CREATE_RETRY_DELAY]
+            if not wanted:
+                break
+            if not self._create(wanted[0]):
+                with self.lock:
+                    self.failed[wanted[0]] = time.time()
+
+    def _adopt(self):
+        """Take over pool hosts left in the registry by a previous process"""
+        for host_name, info in self.registry_mgr.list_all_hosts().items():
+            if not host_name.startswith(POOL_HOST_PREFIX) or info.get('created_by') != POOL_CREATOR_TAG:
+                continue
+            router = info.get('connected_to', '')
+            ip = info.get('primary_ip', '')
+            if not router or not ip:
+                continue
+            key = self.subnet_key(router, ip)
+            # The host may have been leased when the previous process died
+            park_ip = ip.split('/')[0]
+            for candidate in self._parking_candidates(key, 1):
+                if self.host_manager.readdress_host(host_name, f"{candidate}/{POOL_PREFIXLEN}"):
+                    park_ip = candidate
+            with self.lock:
+                self.hosts[host_name] = {'key': key, 'park_ip': park_ip}
+                self.demand.setdefault(key, time.time())
+                self.idle.setdefault(key, []).append(host_name)
+            self.logger.info(f"Adopted pool host {host_name} ({ip} on {router})")
+
+    def _park(self, host_name: str):
+        with self.lock:
+            info = self.hosts.get(host_name)
+        if not info:
+            return
+        try:
+            ok = self.host_manager.readdress_host(host_name, f"{info['park_ip']}/{POOL_PREFIXLEN}")
+        except Exception as e:
+            self.logger.warning(f"Parking {host_name} failed: {e}")
+            ok = False
+        if not ok:
+            self._remove(host_name)
+            return
+        with self.lock:
+            self.idle.setdefault(info['key'], []).append(host_name)
+
+    def _parking_candidates(self, key: Tuple[str, str], count: int = 3) -> List[str]:
+        router, subnet = key
+        network = ipaddress.IPv4Network(subnet)
+        used = self._router_addresses(router)
+        for info in self.registry_mgr.list_all_hosts().values():
+            if info.get('connected_to') == router:
+                used.add(info.get('primary_ip', '').split('/')[0])
+                # Addresses tsim added to the router for a host's gateway
+                if info.get('gateway_ip'):
+                    used.add(info['gateway_ip'])
+        candidates = []
+        address = network.broadcast_address - 1
+        while address > network.network_address and len(candidates) < count:
+            if str(address) not in used:
+                candidates.append(str(address))
+            address -= 1
+        return candidates
+
+    def _router_addresses(self, router: str) -> set:
+        """Interface addresses of router according to its facts"""
+        facts = getattr(self.host_manager, 'routers', {}).get(router, {})
+        return {route['prefsrc']
+                for route in facts.get('routing', {}).get('tables', [])
+                if route.get('protocol') == 'kernel' and route.get('scope') == 'link'
+                and route.get('prefsrc')}
+
+    def _create(self, key: Tuple[str, str]) -> bool:
+        router = key[0]
+        env = os.environ.copy()
+        env['TSIM_CREATOR_TAG'] = POOL_CREATOR_TAG
+        for park_ip in self._parking_candidates(key):
+            host_name = f"{POOL_HOST_PREFIX}{secrets.token_hex(3)}"
+            result = self.exec_fn(
+                f"host add --name {host_name} --primary-ip {park_ip}/{POOL_PREFIXLEN} --connect-to {router} --no-delay",
+                capture_output=True, verbose=1, env=env
+            )
+            if result is None or '[REUSED]' in result:
+                self.logger.debug(f"Could not create pool host on {router} at {park_ip}")
+                continue
+            with self.lock:
+                self.hosts[host_name] = {'key': key, 'park_ip': park_ip}
+                self.idle.setdefault(key, []).append(host_name)
+                self.stats['created'] += 1
+            self.logger.info(f"Created warm host {host_name} on {router} (parked at {park_ip})")
+            return True
+        self.logger.warning(f"No usable parking address for warm host on {router} {key[1]}")
+        return False
+
+    def _remove(self, host_name: str) -> bool:
+        result = self.exec_fn(f"host remove --name {host_name} --force", capture_output=True, verbose=1)
+        with self.lock:
+            self.hosts.pop(host_name, None)
+            self.stats['removed'] += 1
+        if result is None:
+            self.logger.warning(f"Failed to remove pool host {host_name}")
+            return False
+        try:
+            self.registry_mgr.unregister_host(host_name)
+        except Exception as e:
+            self.logger.warning(f"Failed to unregister {host_name} from registry: {e}")
+        self.logger.info(f"Removed warm host {host_name}")
+        return True